@@ -95,7 +95,10 @@ SOURCES += fiff.cpp \
     fiff_info_base.cpp \
     fiff_evoked.cpp \
     fiff_evoked_set.cpp \
-    fiff_io.cpp
+    fiff_io.cpp \
+    fiff_file_map.cpp \
+    fiff_tag_pool.cpp \
+    fiff_raw_buffer_codec.cpp
 
 HEADERS += fiff.h \
     fiff_global.h \
@@ -122,7 +125,10 @@ HEADERS += fiff.h \
     fiff_stream.h \
     fiff_info_base.h \
     fiff_evoked.h \
-    fiff_evoked_set.h
+    fiff_evoked_set.h \
+    fiff_file_map.h \
+    fiff_tag_pool.h \
+    fiff_raw_buffer_codec.h
 
 INCLUDEPATH += $${EIGEN_INCLUDE_DIR}
 INCLUDEPATH += $${MNE_INCLUDE_DIR}
@@ -598,12 +598,31 @@ namespace FIFFLIB
 //
 #define FIFF_MNE_RT_COMMAND         3700              /**< Fiff Real-Time Command */
 #define FIFF_MNE_RT_CLIENT_ID       3701              /**< Fiff Real-Time mne_t_server client id */
+#define FIFF_MNE_RT_CODED_BUFFER    3702              /**< Fiff Real-Time raw buffer, delta and Rice coded integer samples */
+#define FIFF_MNE_RT_SHMEM_BUFFER    3703              /**< Fiff Real-Time announcement of a raw buffer published in the shared memory ring of mne_rt_server */
 
 //
 // 3710... Real-Time Blocks
 //
 #define FIFFB_MNE_RT_MEAS_INFO      3710              /**< Fiff Real-Time Measurement Info */
 
+//
+// 3720... Clustered Forward Solution Cache
+//
+#define FIFF_MNE_CLUSTER_KEY        3720              /**< Hash of the inputs the clustered forward solution was computed from */
+#define FIFF_MNE_CLUSTER_SOL        3721              /**< Clustered gain matrix, column major doubles */
+#define FIFF_MNE_CLUSTER_VERTNO     3722              /**< Vertnos of the cluster representatives of one hemisphere */
+#define FIFF_MNE_CLUSTER_SIZES      3723              /**< Number of vertices in each cluster */
+#define FIFF_MNE_CLUSTER_VERTICES   3724              /**< Concatenated vertnos of all clusters */
+#define FIFF_MNE_CLUSTER_DISTANCES  3725              /**< Concatenated distances to the cluster centroids */
+#define FIFF_MNE_CLUSTER_LABEL_IDS  3726              /**< Label id of each cluster */
+
+//
+// 3730... Clustered Forward Solution Cache Blocks
+//
+#define FIFFB_MNE_CLUSTERED_FWD     3730              /**< Clustered forward solution cache */
+#define FIFFB_MNE_CLUSTER_HEMI      3731              /**< Clustering result of one hemisphere */
+
 
 //
 // Fiff values associated with MNE computations
@@ -64,6 +64,8 @@ FiffDirTree::FiffDirTree()
 , nent(-1)
 , nent_tree(-1)
 , nchild(-1)
+, m_iBlock(-1)
+, m_bExpanded(false)
 {
 }
 
@@ -79,6 +81,9 @@ FiffDirTree::FiffDirTree(const FiffDirTree &p_FiffDirTree)
 , nent_tree(p_FiffDirTree.nent_tree)
 , children(p_FiffDirTree.children)
 , nchild(p_FiffDirTree.nchild)
+, m_pIndex(p_FiffDirTree.m_pIndex)
+, m_iBlock(p_FiffDirTree.m_iBlock)
+, m_bExpanded(p_FiffDirTree.m_bExpanded)
 {
 
 }
@@ -107,6 +112,9 @@ void FiffDirTree::clear()
     nent_tree = -1;
     children.clear();
     nchild = -1;
+    m_pIndex.clear();
+    m_iBlock = -1;
+    m_bExpanded = false;
 }
 
 
@@ -121,6 +129,8 @@ bool FiffDirTree::copy_tree(FiffStream::SPtr p_pStreamIn, FiffId& in_id, QList<F
 
     for(k = 0; k < p_Nodes.size(); ++k)
     {
+        p_Nodes[k].expand();
+
         p_pStreamOut->start_block(p_Nodes[k].block);//8
         if (p_Nodes[k].id.version != -1)
         {
@@ -288,11 +298,168 @@ qint32 FiffDirTree::make_dir_tree(FiffStream* p_pStream, QList<FiffDirEntry>& p_
 }
 
 
+//*************************************************************************************************************
+
+void FiffDirTree::make_dir_index(const FiffStream::SPtr& p_pStream, const QVector<FiffDirEntry>& p_Dir, FiffDirTree& p_Tree)
+{
+    FiffDirIndex::SPtr t_pIndex(new FiffDirIndex);
+    t_pIndex->stream = p_pStream;
+    t_pIndex->dir = p_Dir;
+
+    FiffDirIndex::Block t_Root = {0, -1, p_Dir.size(), 0};
+    t_pIndex->blocks.append(t_Root);
+
+    //
+    //  One pass over the directory, only the block kinds are read
+    //
+    FiffTag::SPtr t_pTag;
+    QVector<qint32> t_vecOpen;
+    t_vecOpen.append(0);
+    for(qint32 k = 0; k < p_Dir.size(); ++k)
+    {
+        if(p_Dir[k].kind == FIFF_BLOCK_START)
+        {
+            FiffTag::read_tag(p_pStream.data(), t_pTag, p_Dir[k].pos);
+            FiffDirIndex::Block t_Block = {*t_pTag->toInt(), k, p_Dir.size(), 0};
+            t_vecOpen.append(t_pIndex->blocks.size());
+            t_pIndex->blocks.append(t_Block);
+        }
+        else if(p_Dir[k].kind == FIFF_BLOCK_END && t_vecOpen.size() > 1)
+        {
+            FiffDirIndex::Block& t_Block = t_pIndex->blocks[t_vecOpen.last()];
+            t_Block.end = k;
+            t_Block.last = t_pIndex->blocks.size() - 1;
+            t_vecOpen.removeLast();
+        }
+    }
+
+    //
+    //  Blocks which are not closed (and the root) extend to the end of the directory
+    //
+    while(!t_vecOpen.isEmpty())
+    {
+        t_pIndex->blocks[t_vecOpen.last()].last = t_pIndex->blocks.size() - 1;
+        t_vecOpen.removeLast();
+    }
+
+    p_Tree = FiffDirTree::make_node(t_pIndex, 0, true);
+}
+
+
+//*************************************************************************************************************
+
+FiffDirTree FiffDirTree::make_node(const FiffDirIndex::ConstSPtr& p_pIndex, qint32 p_iBlock, bool p_bExpand)
+{
+    const FiffDirIndex::Block& t_Block = p_pIndex->blocks[p_iBlock];
+
+    FiffDirTree t_Node;
+    t_Node.m_pIndex = p_pIndex;
+    t_Node.m_iBlock = p_iBlock;
+    t_Node.block = t_Block.kind;
+    t_Node.nent = 0;
+    t_Node.nchild = 0;
+    t_Node.nent_tree = t_Block.start < 0 ? p_pIndex->dir.size() : qMin(t_Block.end, p_pIndex->dir.size() - 1) - t_Block.start + 1;
+
+    FiffTag::SPtr t_pTag;
+    qint32 t_iChild = p_iBlock + 1;
+    for(qint32 k = t_Block.start + 1; k < t_Block.end; ++k)
+    {
+        //
+        //  Skip the entries of the child blocks
+        //
+        if(t_iChild <= t_Block.last && k == p_pIndex->blocks[t_iChild].start)
+        {
+            k = p_pIndex->blocks[t_iChild].end;
+            t_iChild = p_pIndex->blocks[t_iChild].last + 1;
+            continue;
+        }
+
+        const FiffDirEntry& t_Entry = p_pIndex->dir[k];
+        if(t_Entry.kind == FIFF_BLOCK_START || t_Entry.kind == FIFF_BLOCK_END)
+            continue;
+
+        ++t_Node.nent;
+        t_Node.dir.append(t_Entry);
+
+        //
+        //  Add the id information if available
+        //
+        if (t_Node.block == 0)
+        {
+            if (t_Entry.kind == FIFF_FILE_ID)
+            {
+                FiffTag::read_tag(p_pIndex->stream.data(), t_pTag, t_Entry.pos);
+                t_Node.id = t_pTag->toFiffID();
+            }
+        }
+        else
+        {
+            if (t_Entry.kind == FIFF_BLOCK_ID)
+            {
+                FiffTag::read_tag(p_pIndex->stream.data(), t_pTag, t_Entry.pos);
+                t_Node.id = t_pTag->toFiffID();
+            }
+            else if (t_Entry.kind == FIFF_PARENT_BLOCK_ID)
+            {
+                FiffTag::read_tag(p_pIndex->stream.data(), t_pTag, t_Entry.pos);
+                t_Node.parent_id = t_pTag->toFiffID();
+            }
+        }
+    }
+
+    if(p_bExpand)
+        t_Node.expand();
+
+    return t_Node;
+}
+
+
+//*************************************************************************************************************
+
+void FiffDirTree::expand()
+{
+    if(m_pIndex.isNull() || m_bExpanded)
+        return;
+
+    children.clear();
+    nchild = 0;
+
+    const qint32 t_iLast = m_pIndex->blocks[m_iBlock].last;
+    for(qint32 c = m_iBlock + 1; c <= t_iLast; c = m_pIndex->blocks[c].last + 1)
+    {
+        children.append(FiffDirTree::make_node(m_pIndex, c, false));
+        ++nchild;
+    }
+
+    m_bExpanded = true;
+}
+
+
 //*************************************************************************************************************
 
 QList<FiffDirTree> FiffDirTree::dir_tree_find(fiff_int_t p_kind) const
 {
     QList<FiffDirTree> nodes;
+
+    if(!m_pIndex.isNull())
+    {
+        //
+        //  Lazily opened tree: search the block index, build only the matching nodes
+        //
+        const qint32 t_iLast = m_pIndex->blocks[m_iBlock].last;
+        for(qint32 b = m_iBlock; b <= t_iLast; ++b)
+        {
+            if(m_pIndex->blocks[b].kind == p_kind)
+            {
+                if(b == m_iBlock && m_bExpanded)
+                    nodes.append(*this);
+                else
+                    nodes.append(FiffDirTree::make_node(m_pIndex, b, true));
+            }
+        }
+        return nodes;
+    }
+
     if(this->block == p_kind)
         nodes.append(*this);
 
@@ -337,6 +504,15 @@ bool FiffDirTree::has_tag(fiff_int_t findkind)
 
 bool FiffDirTree::has_kind(fiff_int_t p_kind) const
 {
+    if(!m_pIndex.isNull())
+    {
+        const qint32 t_iLast = m_pIndex->blocks[m_iBlock].last;
+        for(qint32 b = m_iBlock; b <= t_iLast; ++b)
+            if(m_pIndex->blocks[b].kind == p_kind)
+                return true;
+        return false;
+    }
+
     if(this->block == p_kind)
         return true;
 
@@ -58,6 +58,7 @@
 #include <QList>
 #include <QSharedPointer>
 #include <QStringList>
+#include <QVector>
 
 
 //*************************************************************************************************************
@@ -71,6 +72,31 @@ namespace FIFFLIB
 class FiffStream;
 class FiffTag;
 
+//=============================================================================================================
+/**
+* Flat block index of a fiff file. It is shared by all nodes of a lazily opened directory tree, which are built
+* from it on demand.
+*
+* @brief Compact block index of a tag directory
+*/
+struct FiffDirIndex
+{
+    typedef QSharedPointer<FiffDirIndex> SPtr;              /**< Shared pointer type for FiffDirIndex. */
+    typedef QSharedPointer<const FiffDirIndex> ConstSPtr;   /**< Const shared pointer type for FiffDirIndex. */
+
+    struct Block
+    {
+        fiff_int_t  kind;   /**< Block type */
+        qint32      start;  /**< Directory index of the FIFF_BLOCK_START entry, -1 for the file root */
+        qint32      end;    /**< Directory index of the matching FIFF_BLOCK_END entry, directory size if there is none */
+        qint32      last;   /**< Index of the last block within this subtree */
+    };
+
+    QSharedPointer<FiffStream>  stream; /**< The stream the block ids are read from, kept alive by the index */
+    QVector<FiffDirEntry>       dir;    /**< The sequential tag directory */
+    QVector<Block>              blocks; /**< All blocks in pre-order, the file root first */
+};
+
 //=============================================================================================================
 /**
 * Replaces _fiffDirNode struct
@@ -150,6 +176,25 @@ public:
     */
     static qint32 make_dir_tree(FiffStream* p_pStream, QList<FiffDirEntry>& p_Dir, FiffDirTree& p_Tree, qint32 start = 0);
 
+    //=========================================================================================================
+    /**
+    * Lazy counterpart of make_dir_tree. Creates the flat block index of the directory and returns the root node.
+    * Nodes returned by dir_tree_find hold their entries and their direct children; the child lists of those
+    * children are built by expand() or by searching them with dir_tree_find.
+    *
+    * @param[in] p_pStream the opened fiff file; the index holds a reference to it, its device has to stay open
+    *                      while nodes are built
+    * @param[in] p_Dir the dir entries of which the index should be constructed
+    * @param[out] p_Tree the root node of the lazily built tree
+    */
+    static void make_dir_index(const QSharedPointer<FiffStream>& p_pStream, const QVector<FiffDirEntry>& p_Dir, FiffDirTree& p_Tree);
+
+    //=========================================================================================================
+    /**
+    * Builds the child list of a node which was created by make_dir_index. Does nothing for fully built nodes.
+    */
+    void expand();
+
     //=========================================================================================================
     /**
     * ### MNE toolbox root function ###: implementation of the fiff_dir_tree_find function
@@ -208,6 +253,23 @@ public:
     QList<FiffDirTree>  children;   /**< Child nodes */
     fiff_int_t          nchild;     /**< Number of child nodes */
 
+private:
+    //=========================================================================================================
+    /**
+    * Builds the node of a block of the flat index.
+    *
+    * @param[in] p_pIndex   the block index
+    * @param[in] p_iBlock   the block to build
+    * @param[in] p_bExpand  whether the child list should be built as well
+    *
+    * @return the node
+    */
+    static FiffDirTree make_node(const FiffDirIndex::ConstSPtr& p_pIndex, qint32 p_iBlock, bool p_bExpand);
+
+    FiffDirIndex::ConstSPtr m_pIndex;   /**< Block index of a lazily opened tree, null for fully built trees */
+    qint32                  m_iBlock;   /**< Block of this node within m_pIndex */
+    bool                    m_bExpanded;/**< Whether the child list of a lazy node was built */
+
 // typedef struct _fiffDirNode {
 //  int                 type;    /**< Block type for this directory *
 //  fiffId              id;      /**< Id of this block if any *
@@ -0,0 +1,114 @@
+//=============================================================================================================
+/**
+* @file     fiff_file_map.cpp
+* @author   Christoph Dinh <chdinh@nmr.mgh.harvard.edu>;
+*           Matti Hamalainen <msh@nmr.mgh.harvard.edu>
+* @version  1.0
+* @date     March, 2014
+*
+* @section  LICENSE
+*
+* Copyright (C) 2014, Christoph Dinh and Matti Hamalainen. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+* the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+*       following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+*       the following disclaimer in the documentation and/or other materials provided with the distribution.
+*     * Neither the name of the Massachusetts General Hospital nor the names of its contributors may be used
+*       to endorse or promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MASSACHUSETTS GENERAL HOSPITAL BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*
+*
+* @brief    Implementation of the FiffFileMap Class.
+*
+*/
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include "fiff_file_map.h"
+#include "fiff_constants.h"
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace FIFFLIB;
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE MEMBER METHODS
+//=============================================================================================================
+
+FiffFileMap::FiffFileMap(QIODevice* p_pIODevice)
+: m_pData(NULL)
+, m_iSize(0)
+{
+    QFile* t_pFile = qobject_cast<QFile*>(p_pIODevice);
+    if(!t_pFile || t_pFile->fileName().isEmpty())
+        return;
+
+    m_qFile.setFileName(t_pFile->fileName());
+    if(!m_qFile.open(QIODevice::ReadOnly))
+        return;
+
+    m_iSize = m_qFile.size();
+    if(m_iSize > 0)
+        m_pData = m_qFile.map(0, m_iSize);
+
+    if(!m_pData)
+    {
+        m_iSize = 0;
+        m_qFile.close();
+    }
+}
+
+
+//*************************************************************************************************************
+
+FiffFileMap::~FiffFileMap()
+{
+    if(m_pData)
+        m_qFile.unmap(m_pData);
+    m_qFile.close();
+}
+
+
+//*************************************************************************************************************
+
+bool FiffFileMap::read_raw_buffer(const FiffDirEntry& p_Entry, qint32 p_iNChan, qint32 p_iNSamp, const RowVectorXi& p_vecSel, const RowVectorXd& p_vecCal, qint32 p_iFirst, qint32 p_iNPick, MatrixXd& p_matData, qint32 p_iDest) const
+{
+    if(!this->contains(p_Entry))
+        return false;
+
+    switch(p_Entry.type)
+    {
+        case FIFFT_DAU_PACK16:
+        case FIFFT_SHORT:
+            read_raw_buffer<qint16>(p_Entry, p_iNChan, p_iNSamp, p_vecSel, p_vecCal, p_iFirst, p_iNPick, p_matData, p_iDest);
+            return true;
+        case FIFFT_INT:
+            read_raw_buffer<qint32>(p_Entry, p_iNChan, p_iNSamp, p_vecSel, p_vecCal, p_iFirst, p_iNPick, p_matData, p_iDest);
+            return true;
+        case FIFFT_FLOAT:
+            read_raw_buffer<float>(p_Entry, p_iNChan, p_iNSamp, p_vecSel, p_vecCal, p_iFirst, p_iNPick, p_matData, p_iDest);
+            return true;
+        default:
+            return false;
+    }
+}
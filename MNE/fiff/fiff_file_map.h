@@ -0,0 +1,300 @@
+//=============================================================================================================
+/**
+* @file     fiff_file_map.h
+* @author   Christoph Dinh <chdinh@nmr.mgh.harvard.edu>;
+*           Matti Hamalainen <msh@nmr.mgh.harvard.edu>
+* @version  1.0
+* @date     March, 2014
+*
+* @section  LICENSE
+*
+* Copyright (C) 2014, Christoph Dinh and Matti Hamalainen. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+* the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+*       following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+*       the following disclaimer in the documentation and/or other materials provided with the distribution.
+*     * Neither the name of the Massachusetts General Hospital nor the names of its contributors may be used
+*       to endorse or promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MASSACHUSETTS GENERAL HOSPITAL BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*
+*
+* @brief    FiffFileMap class declaration.
+*
+*/
+
+#ifndef FIFF_FILE_MAP_H
+#define FIFF_FILE_MAP_H
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include "fiff_global.h"
+#include "fiff_types.h"
+#include "fiff_dir_entry.h"
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Eigen INCLUDES
+//=============================================================================================================
+
+#include <Eigen/Core>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Qt INCLUDES
+//=============================================================================================================
+
+#include <QFile>
+#include <QIODevice>
+#include <QSharedPointer>
+#include <QtEndian>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE NAMESPACE FIFFLIB
+//=============================================================================================================
+
+namespace FIFFLIB
+{
+
+//*************************************************************************************************************
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace Eigen;
+
+
+//=============================================================================================================
+/**
+* Read-only memory map of a fiff file. Tag payloads are accessed in place, without reading them into a FiffTag
+* first. The map opens its own file handle, i.e. it does not move the position of the stream it was created from,
+* and the mapped data can be read from several threads at once.
+*
+* @brief Memory mapped fiff file
+*/
+class FIFFSHARED_EXPORT FiffFileMap
+{
+public:
+    typedef QSharedPointer<FiffFileMap> SPtr;            /**< Shared pointer type for FiffFileMap. */
+    typedef QSharedPointer<const FiffFileMap> ConstSPtr; /**< Const shared pointer type for FiffFileMap. */
+
+    //=========================================================================================================
+    /**
+    * Maps the file behind the given IO device. If the device is not a file or the file can't be mapped
+    * (e.g. on a 32-bit system with a file exceeding the address space) the map stays empty.
+    *
+    * @param[in] p_pIODevice    IO device of the fiff file to map
+    */
+    explicit FiffFileMap(QIODevice* p_pIODevice);
+
+    //=========================================================================================================
+    /**
+    * Unmaps and closes the file.
+    */
+    ~FiffFileMap();
+
+    //=========================================================================================================
+    /**
+    * True if the file is mapped.
+    *
+    * @return true if the file is mapped, false otherwise
+    */
+    inline bool isMapped() const;
+
+    //=========================================================================================================
+    /**
+    * Size of the mapped file in bytes.
+    *
+    * @return the size of the mapped file
+    */
+    inline qint64 size() const;
+
+    //=========================================================================================================
+    /**
+    * True if the data of the given directory entry lies completely within the map.
+    *
+    * @param[in] p_Entry    directory entry of the tag
+    *
+    * @return true if the tag data can be accessed through the map
+    */
+    inline bool contains(const FiffDirEntry& p_Entry) const;
+
+    //=========================================================================================================
+    /**
+    * Pointer to the data of a tag, the data is located right after the tag header.
+    *
+    * @param[in] p_Entry    directory entry of the tag
+    *
+    * @return pointer to the tag data (file byte order)
+    */
+    inline const uchar* tagData(const FiffDirEntry& p_Entry) const;
+
+    //=========================================================================================================
+    /**
+    * Zero-copy view of a tag's data as a (rows x cols) column major matrix. Note: The coefficients are in file
+    * byte order (big endian) - use toNative to convert single coefficients.
+    *
+    * @param[in] p_Entry    directory entry of the tag
+    * @param[in] p_iRows    number of rows
+    * @param[in] p_iCols    number of columns
+    *
+    * @return view of the tag data
+    */
+    template<typename T>
+    inline Map< const Matrix<T, Dynamic, Dynamic> > tagMatrix(const FiffDirEntry& p_Entry, qint32 p_iRows, qint32 p_iCols) const;
+
+    //=========================================================================================================
+    /**
+    * Converts a value stored in file byte order (big endian) to the native byte order.
+    *
+    * @param[in] p_Value    value in file byte order
+    *
+    * @return the value in native byte order
+    */
+    template<typename T>
+    inline static T toNative(T p_Value);
+
+    //=========================================================================================================
+    /**
+    * Reads samples of a raw data buffer (FIFFT_DAU_PACK16, FIFFT_SHORT, FIFFT_INT or FIFFT_FLOAT) straight from
+    * the map. Only the selected channels and the picked samples are converted; they are scaled by the given
+    * calibrations and written to p_matData(:, p_iDest:p_iDest+p_iNPick-1).
+    *
+    * @param[in] p_Entry        directory entry of the data buffer
+    * @param[in] p_iNChan       number of channels stored in the buffer
+    * @param[in] p_iNSamp       number of samples stored in the buffer
+    * @param[in] p_vecSel       channel selection; all channels if empty
+    * @param[in] p_vecCal       calibration per output row; no scaling if empty
+    * @param[in] p_iFirst       first sample to pick (relative to the buffer start)
+    * @param[in] p_iNPick       number of samples to pick
+    * @param[out] p_matData     matrix to write the data to; has to be of sufficient size
+    * @param[in] p_iDest        first destination column
+    *
+    * @return true if succeeded, false if the buffer type is not supported or the buffer lies outside the map
+    */
+    bool read_raw_buffer(const FiffDirEntry& p_Entry, qint32 p_iNChan, qint32 p_iNSamp, const RowVectorXi& p_vecSel, const RowVectorXd& p_vecCal, qint32 p_iFirst, qint32 p_iNPick, MatrixXd& p_matData, qint32 p_iDest = 0) const;
+
+private:
+    //=========================================================================================================
+    /**
+    * Typed implementation of read_raw_buffer.
+    */
+    template<typename T>
+    inline void read_raw_buffer(const FiffDirEntry& p_Entry, qint32 p_iNChan, qint32 p_iNSamp, const RowVectorXi& p_vecSel, const RowVectorXd& p_vecCal, qint32 p_iFirst, qint32 p_iNPick, MatrixXd& p_matData, qint32 p_iDest) const;
+
+    QFile   m_qFile;    /**< Own handle of the mapped file. */
+    uchar*  m_pData;    /**< Start of the mapped file; NULL if not mapped. */
+    qint64  m_iSize;    /**< Size of the mapped region in bytes. */
+
+    static const qint64 s_iTagHeaderSize = 16;  /**< kind, type, size, next -> 4*4 bytes */
+};
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INLINE DEFINITIONS
+//=============================================================================================================
+
+inline bool FiffFileMap::isMapped() const
+{
+    return m_pData != NULL;
+}
+
+
+//*************************************************************************************************************
+
+inline qint64 FiffFileMap::size() const
+{
+    return m_iSize;
+}
+
+
+//*************************************************************************************************************
+
+inline bool FiffFileMap::contains(const FiffDirEntry& p_Entry) const
+{
+    return m_pData != NULL && p_Entry.pos >= 0 && p_Entry.size >= 0
+            && (qint64)p_Entry.pos + s_iTagHeaderSize + (qint64)p_Entry.size <= m_iSize;
+}
+
+
+//*************************************************************************************************************
+
+inline const uchar* FiffFileMap::tagData(const FiffDirEntry& p_Entry) const
+{
+    return m_pData + (qint64)p_Entry.pos + s_iTagHeaderSize;
+}
+
+
+//*************************************************************************************************************
+
+template<typename T>
+inline Map< const Matrix<T, Dynamic, Dynamic> > FiffFileMap::tagMatrix(const FiffDirEntry& p_Entry, qint32 p_iRows, qint32 p_iCols) const
+{
+    return Map< const Matrix<T, Dynamic, Dynamic> >(reinterpret_cast<const T*>(tagData(p_Entry)), p_iRows, p_iCols);
+}
+
+
+//*************************************************************************************************************
+
+template<typename T>
+inline T FiffFileMap::toNative(T p_Value)
+{
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    T t_Value;
+    const char* t_pSrc = reinterpret_cast<const char*>(&p_Value);
+    char* t_pDst = reinterpret_cast<char*>(&t_Value);
+    for(size_t i = 0; i < sizeof(T); ++i)
+        t_pDst[i] = t_pSrc[sizeof(T) - 1 - i];
+    return t_Value;
+#else
+    return p_Value;
+#endif
+}
+
+
+//*************************************************************************************************************
+
+template<typename T>
+inline void FiffFileMap::read_raw_buffer(const FiffDirEntry& p_Entry, qint32 p_iNChan, qint32 p_iNSamp, const RowVectorXi& p_vecSel, const RowVectorXd& p_vecCal, qint32 p_iFirst, qint32 p_iNPick, MatrixXd& p_matData, qint32 p_iDest) const
+{
+    Map< const Matrix<T, Dynamic, Dynamic> > t_matBuf = tagMatrix<T>(p_Entry, p_iNChan, p_iNSamp);
+
+    qint32 r, c;
+    qint32 t_iNRows = p_vecSel.size() == 0 ? p_iNChan : p_vecSel.size();
+    for(c = 0; c < p_iNPick; ++c)
+    {
+        double* t_pDest = p_matData.data() + (qint64)(p_iDest + c)*p_matData.rows();
+        if(p_vecSel.size() == 0)
+            for(r = 0; r < t_iNRows; ++r)
+                t_pDest[r] = (double)toNative<T>(t_matBuf(r, p_iFirst + c));
+        else
+            for(r = 0; r < t_iNRows; ++r)
+                t_pDest[r] = (double)toNative<T>(t_matBuf(p_vecSel[r], p_iFirst + c));
+
+        if(p_vecCal.size() > 0)
+            for(r = 0; r < t_iNRows; ++r)
+                t_pDest[r] *= p_vecCal[r];
+    }
+}
+
+} // NAMESPACE
+
+#endif // FIFF_FILE_MAP_H
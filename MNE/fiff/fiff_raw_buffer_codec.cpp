@@ -0,0 +1,446 @@
+//=============================================================================================================
+/**
+* @file     fiff_raw_buffer_codec.cpp
+* @author   Christoph Dinh <chdinh@nmr.mgh.harvard.edu>;
+*           Matti Hamalainen <msh@nmr.mgh.harvard.edu>
+* @version  1.0
+* @date     March, 2014
+*
+* @section  LICENSE
+*
+* Copyright (C) 2014, Christoph Dinh and Matti Hamalainen. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+* the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+*       following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+*       the following disclaimer in the documentation and/or other materials provided with the distribution.
+*     * Neither the name of the Massachusetts General Hospital nor the names of its contributors may be used
+*       to endorse or promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MASSACHUSETTS GENERAL HOSPITAL BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*
+*
+* @brief    Implementation of the FiffRawBufferCodec Class.
+*
+*/
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include "fiff_raw_buffer_codec.h"
+#include "fiff_stream.h"
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// STL INCLUDES
+//=============================================================================================================
+
+#include <math.h>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Qt INCLUDES
+//=============================================================================================================
+
+#include <QtEndian>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace FIFFLIB;
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// STATIC DEFINITIONS
+//=============================================================================================================
+
+namespace
+{
+
+const double s_dMaxQuant = 1073741824.0;    /**< Integer samples have to stay below 2^30, their differences fit into 32 bits */
+const quint32 s_iRiceEscape = 24;           /**< Rice quotients from here on are escaped, the value follows in 32 bits */
+
+//=============================================================================================================
+/**
+* Appends bits, most significant first, to a byte array.
+*/
+class BitWriter
+{
+public:
+    explicit BitWriter(QByteArray& p_bytes)
+    : m_bytes(p_bytes)
+    , m_iCache(0)
+    , m_iBits(0)
+    {
+    }
+
+    inline void write(quint32 p_iValue, qint32 p_nBits)
+    {
+        m_iCache = (m_iCache << p_nBits) | (p_iValue & ((((quint64)1) << p_nBits) - 1));
+        m_iBits += p_nBits;
+        while(m_iBits >= 8)
+        {
+            m_iBits -= 8;
+            m_bytes.append((char)(m_iCache >> m_iBits));
+        }
+    }
+
+    inline void writeOnes(quint32 p_nOnes)
+    {
+        while(p_nOnes > 0)
+        {
+            qint32 n = p_nOnes < 32 ? p_nOnes : 32;
+            write(0xFFFFFFFF, n);
+            p_nOnes -= n;
+        }
+    }
+
+    inline void flush()
+    {
+        if(m_iBits > 0)
+            m_bytes.append((char)(m_iCache << (8 - m_iBits)));
+        m_iBits = 0;
+    }
+
+private:
+    QByteArray& m_bytes;
+    quint64     m_iCache;
+    qint32      m_iBits;
+};
+
+//=============================================================================================================
+/**
+* Reads bits, most significant first, from a byte array.
+*/
+class BitReader
+{
+public:
+    BitReader(const uchar* p_pData, qint32 p_iSize)
+    : m_pData(p_pData)
+    , m_pEnd(p_pData + p_iSize)
+    , m_iCache(0)
+    , m_iBits(0)
+    {
+    }
+
+    inline bool read(qint32 p_nBits, quint32& p_iValue)
+    {
+        while(m_iBits < p_nBits)
+        {
+            if(m_pData == m_pEnd)
+                return false;
+            m_iCache = (m_iCache << 8) | *m_pData++;
+            m_iBits += 8;
+        }
+        m_iBits -= p_nBits;
+        p_iValue = (quint32)((m_iCache >> m_iBits) & ((((quint64)1) << p_nBits) - 1));
+        return true;
+    }
+
+    inline bool readUnary(quint32 p_iMax, quint32& p_nOnes)
+    {
+        p_nOnes = 0;
+        quint32 t_iBit;
+        while(p_nOnes < p_iMax)
+        {
+            if(!read(1, t_iBit))
+                return false;
+            if(!t_iBit)
+                break;
+            ++p_nOnes;
+        }
+        return true;
+    }
+
+private:
+    const uchar*    m_pData;
+    const uchar*    m_pEnd;
+    quint64         m_iCache;
+    qint32          m_iBits;
+};
+
+inline quint32 zigzag(qint32 v)
+{
+    return ((quint32)v << 1) ^ (quint32)(v >> 31);
+}
+
+inline qint32 unzigzag(quint32 u)
+{
+    return (qint32)(u >> 1) ^ -(qint32)(u & 1);
+}
+
+} // NAMESPACE
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE MEMBER METHODS
+//=============================================================================================================
+
+FiffRawBufferCodec::FiffRawBufferCodec()
+{
+}
+
+
+//*************************************************************************************************************
+
+FiffRawBufferCodec::FiffRawBufferCodec(const FiffInfo& p_info)
+{
+    setInfo(p_info);
+}
+
+
+//*************************************************************************************************************
+
+void FiffRawBufferCodec::setInfo(const FiffInfo& p_info)
+{
+    m_vecCals.resize(p_info.nchan);
+    for(qint32 k = 0; k < p_info.nchan; ++k)
+        m_vecCals[k] = p_info.chs[k].range*p_info.chs[k].cal;
+}
+
+
+//*************************************************************************************************************
+
+bool FiffRawBufferCodec::encode(const MatrixXf& p_matData, Encoding p_encoding, QByteArray& p_block) const
+{
+    if(p_encoding == Float)
+    {
+        QByteArray t_block;
+        FiffStream t_FiffStreamOut(&t_block, QIODevice::WriteOnly);
+        t_FiffStreamOut.write_float(FIFF_DATA_BUFFER, p_matData.data(), p_matData.rows()*p_matData.cols());
+        p_block = t_block;
+        return true;
+    }
+
+    MatrixXi t_matQuant;
+    if(!quantize(p_matData, t_matQuant))
+        return false;
+
+    qint32 nchan = t_matQuant.rows();
+    qint32 nsamp = t_matQuant.cols();
+
+    QByteArray t_block;
+    FiffStream t_FiffStreamOut(&t_block, QIODevice::WriteOnly);
+
+    if(p_encoding == Integer)
+    {
+        //
+        // 16 bit if all samples fit, as most acquisition systems deliver them
+        //
+        bool t_bPack16 = t_matQuant.size() == 0 || (t_matQuant.minCoeff() >= -32768 && t_matQuant.maxCoeff() <= 32767);
+
+        t_FiffStreamOut << (qint32)FIFF_DATA_BUFFER;
+        t_FiffStreamOut << (qint32)(t_bPack16 ? FIFFT_DAU_PACK16 : FIFFT_INT);
+        t_FiffStreamOut << (qint32)(t_matQuant.size()*(t_bPack16 ? 2 : 4));
+        t_FiffStreamOut << (qint32)FIFFV_NEXT_SEQ;
+
+        const qint32* t_pQuant = t_matQuant.data();
+        if(t_bPack16)
+            for(qint32 i = 0; i < t_matQuant.size(); ++i)
+                t_FiffStreamOut << (qint16)t_pQuant[i];
+        else
+            for(qint32 i = 0; i < t_matQuant.size(); ++i)
+                t_FiffStreamOut << t_pQuant[i];
+    }
+    else
+    {
+        //
+        // Header: number of channels and samples, then the Rice parameter of each channel
+        //
+        QByteArray t_payload(8 + nchan, 0);
+        qToBigEndian<qint32>(nchan, (uchar*)t_payload.data());
+        qToBigEndian<qint32>(nsamp, (uchar*)t_payload.data() + 4);
+        t_payload.reserve(8 + nchan + t_matQuant.size()*2);
+
+        BitWriter t_writer(t_payload);
+        VectorXi t_vecResiduals(nsamp);
+
+        for(qint32 c = 0; c < nchan; ++c)
+        {
+            //
+            // First sample as is, the others as differences to their predecessor
+            //
+            quint64 t_iSum = 0;
+            qint32 t_iPrev = 0;
+            for(qint32 t = 0; t < nsamp; ++t)
+            {
+                quint32 u = zigzag(t_matQuant(c,t) - t_iPrev);
+                t_iPrev = t_matQuant(c,t);
+                t_vecResiduals[t] = (qint32)u;
+                if(t > 0 || nsamp == 1)
+                    t_iSum += u;
+            }
+
+            //
+            // Rice parameter close to log2 of the mean residual
+            //
+            quint64 t_nRes = nsamp > 1 ? nsamp - 1 : 1;
+            qint32 k = 0;
+            while(k < 30 && (t_nRes << (k+1)) <= t_iSum)
+                ++k;
+            t_payload[8 + c] = (char)k;
+
+            for(qint32 t = 0; t < nsamp; ++t)
+            {
+                quint32 u = (quint32)t_vecResiduals[t];
+                quint32 q = u >> k;
+                if(q < s_iRiceEscape)
+                {
+                    t_writer.writeOnes(q);
+                    t_writer.write(0, 1);
+                    t_writer.write(u, k);
+                }
+                else
+                {
+                    t_writer.writeOnes(s_iRiceEscape);
+                    t_writer.write(u, 32);
+                }
+            }
+        }
+        t_writer.flush();
+
+        t_FiffStreamOut << (qint32)FIFF_MNE_RT_CODED_BUFFER;
+        t_FiffStreamOut << (qint32)FIFFT_BYTE;
+        t_FiffStreamOut << (qint32)t_payload.size();
+        t_FiffStreamOut << (qint32)FIFFV_NEXT_SEQ;
+        t_FiffStreamOut.writeRawData(t_payload.constData(), t_payload.size());
+    }
+
+    p_block = t_block;
+    return true;
+}
+
+
+//*************************************************************************************************************
+
+bool FiffRawBufferCodec::decode(const FiffTag::SPtr& p_pTag, qint32 p_nChannels, MatrixXf& p_matData) const
+{
+    if(p_nChannels <= 0)
+        return false;
+
+    if(p_pTag->kind == FIFF_DATA_BUFFER && p_pTag->getType() == FIFFT_FLOAT)
+    {
+        qint32 nSamples = (p_pTag->size()/4)/p_nChannels;
+        p_matData = Map<MatrixXf>(p_pTag->toFloat(), p_nChannels, nSamples);
+        return true;
+    }
+
+    //
+    // Integer encodings need the calibrations of the measurement info
+    //
+    if(m_vecCals.size() != p_nChannels)
+    {
+        printf("FiffRawBufferCodec: no calibrations available to decode the raw buffer.\n");
+        return false;
+    }
+
+    if(p_pTag->kind == FIFF_DATA_BUFFER && p_pTag->getType() == FIFFT_DAU_PACK16)
+    {
+        qint32 nSamples = (p_pTag->size()/2)/p_nChannels;
+        const qint16* t_pData = p_pTag->toDauPack16();
+        p_matData.resize(p_nChannels, nSamples);
+        for(qint32 t = 0; t < nSamples; ++t)
+            for(qint32 c = 0; c < p_nChannels; ++c)
+                p_matData(c,t) = (float)(*t_pData++ * m_vecCals[c]);
+        return true;
+    }
+
+    if(p_pTag->kind == FIFF_DATA_BUFFER && p_pTag->getType() == FIFFT_INT)
+    {
+        qint32 nSamples = (p_pTag->size()/4)/p_nChannels;
+        const qint32* t_pData = p_pTag->toInt();
+        p_matData.resize(p_nChannels, nSamples);
+        for(qint32 t = 0; t < nSamples; ++t)
+            for(qint32 c = 0; c < p_nChannels; ++c)
+                p_matData(c,t) = (float)(*t_pData++ * m_vecCals[c]);
+        return true;
+    }
+
+    if(p_pTag->kind == FIFF_MNE_RT_CODED_BUFFER && p_pTag->size() >= 8)
+    {
+        const uchar* t_pData = (const uchar*)p_pTag->data();
+        qint32 nchan = qFromBigEndian<qint32>(t_pData);
+        qint32 nsamp = qFromBigEndian<qint32>(t_pData + 4);
+        if(nchan != p_nChannels || nsamp < 0 || p_pTag->size() < 8 + nchan)
+            return false;
+
+        const uchar* t_pK = t_pData + 8;
+        BitReader t_reader(t_pData + 8 + nchan, p_pTag->size() - 8 - nchan);
+
+        p_matData.resize(nchan, nsamp);
+        for(qint32 c = 0; c < nchan; ++c)
+        {
+            qint32 k = t_pK[c];
+            double t_dCal = m_vecCals[c];
+            qint32 t_iPrev = 0;
+            for(qint32 t = 0; t < nsamp; ++t)
+            {
+                quint32 q, r, u;
+                if(!t_reader.readUnary(s_iRiceEscape, q))
+                    return false;
+                if(q < s_iRiceEscape)
+                {
+                    if(!t_reader.read(k, r))
+                        return false;
+                    u = (q << k) | r;
+                }
+                else if(!t_reader.read(32, u))
+                    return false;
+
+                t_iPrev += unzigzag(u);
+                p_matData(c,t) = (float)(t_iPrev * t_dCal);
+            }
+        }
+        return true;
+    }
+
+    return false;
+}
+
+
+//*************************************************************************************************************
+
+bool FiffRawBufferCodec::quantize(const MatrixXf& p_matData, MatrixXi& p_matQuant) const
+{
+    if(m_vecCals.size() != p_matData.rows())
+        return false;
+
+    p_matQuant.resize(p_matData.rows(), p_matData.cols());
+
+    for(qint32 t = 0; t < p_matData.cols(); ++t)
+    {
+        for(qint32 c = 0; c < p_matData.rows(); ++c)
+        {
+            double v = p_matData(c,t) / m_vecCals[c];
+            if(!(fabs(v) < s_dMaxQuant))
+                return false;
+
+            qint32 q = (qint32)floor(v + 0.5);
+            if((float)(q * m_vecCals[c]) != p_matData(c,t))
+                return false;
+
+            p_matQuant(c,t) = q;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,177 @@
+//=============================================================================================================
+/**
+* @file     fiff_raw_buffer_codec.h
+* @author   Christoph Dinh <chdinh@nmr.mgh.harvard.edu>;
+*           Matti Hamalainen <msh@nmr.mgh.harvard.edu>
+* @version  1.0
+* @date     March, 2014
+*
+* @section  LICENSE
+*
+* Copyright (C) 2014, Christoph Dinh and Matti Hamalainen. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+* the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+*       following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+*       the following disclaimer in the documentation and/or other materials provided with the distribution.
+*     * Neither the name of the Massachusetts General Hospital nor the names of its contributors may be used
+*       to endorse or promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MASSACHUSETTS GENERAL HOSPITAL BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*
+*
+* @brief    FiffRawBufferCodec class declaration.
+*
+*/
+
+#ifndef FIFF_RAW_BUFFER_CODEC_H
+#define FIFF_RAW_BUFFER_CODEC_H
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include "fiff_global.h"
+#include "fiff_info.h"
+#include "fiff_tag.h"
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Eigen INCLUDES
+//=============================================================================================================
+
+#include <Eigen/Core>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Qt INCLUDES
+//=============================================================================================================
+
+#include <QByteArray>
+#include <QSharedPointer>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE NAMESPACE FIFFLIB
+//=============================================================================================================
+
+namespace FIFFLIB
+{
+
+//*************************************************************************************************************
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace Eigen;
+
+
+//=============================================================================================================
+/**
+* Encodes and decodes the raw buffers of the real-time protocol. Besides the default 32-bit float buffers, a
+* buffer can be sent as the integer samples it was calibrated from. The calibrations (range*cal of each channel)
+* are part of the measurement info, so they are sent once. Integer buffers are FIFF_DATA_BUFFER tags of type
+* FIFFT_DAU_PACK16 or FIFFT_INT. Delta buffers are FIFF_MNE_RT_CODED_BUFFER tags holding the Rice coded
+* differences of consecutive samples of each channel. All encodings are lossless: there is no tolerance or scale,
+* a buffer is only sent as integers if every sample is an integer multiple of its calibration which the receiver
+* turns back into exactly the same float. Buffers which were filtered, projected or otherwise processed after the
+* calibration usually don't, and fall back to floats as a whole.
+*
+* @brief Encoding of real-time raw buffers
+*/
+class FIFFSHARED_EXPORT FiffRawBufferCodec
+{
+public:
+    typedef QSharedPointer<FiffRawBufferCodec> SPtr;            /**< Shared pointer type for FiffRawBufferCodec. */
+    typedef QSharedPointer<const FiffRawBufferCodec> ConstSPtr; /**< Const shared pointer type for FiffRawBufferCodec. */
+
+    //=========================================================================================================
+    /**
+    * Raw buffer encodings, the values are used by the MNE_RT_SET_BUFFER_ENCODING command.
+    */
+    enum Encoding
+    {
+        Float = 0,      /**< 32-bit floats (FIFFT_FLOAT), the default. */
+        Integer = 1,    /**< Uncalibrated samples (FIFFT_DAU_PACK16 or FIFFT_INT), falls back to Float unless exact. */
+        Delta = 2,      /**< Rice coded sample differences (FIFF_MNE_RT_CODED_BUFFER), falls back to Float unless exact. */
+        NumEncodings = 3
+    };
+
+    //=========================================================================================================
+    /**
+    * Constructs a codec without calibrations, which encodes and decodes float buffers only.
+    */
+    FiffRawBufferCodec();
+
+    //=========================================================================================================
+    /**
+    * Constructs a codec for the channels of a measurement.
+    *
+    * @param[in] p_info     The measurement info providing the calibrations.
+    */
+    explicit FiffRawBufferCodec(const FiffInfo& p_info);
+
+    //=========================================================================================================
+    /**
+    * Sets the calibrations of the channels to range*cal, the way FiffRawData calibrates the samples.
+    *
+    * @param[in] p_info     The measurement info providing the calibrations.
+    */
+    void setInfo(const FiffInfo& p_info);
+
+    //=========================================================================================================
+    /**
+    * Encodes a raw buffer as a complete tag.
+    *
+    * @param[in] p_matData      The calibrated raw buffer (channels x samples).
+    * @param[in] p_encoding     The encoding to use.
+    * @param[out] p_block       The encoded tag.
+    *
+    * @return false if the buffer can't be encoded losslessly with p_encoding; p_block is left untouched then.
+    */
+    bool encode(const MatrixXf& p_matData, Encoding p_encoding, QByteArray& p_block) const;
+
+    //=========================================================================================================
+    /**
+    * Decodes a raw buffer tag of any encoding into p_matData. The memory of p_matData is reused when the size
+    * of the buffer didn't change.
+    *
+    * @param[in] p_pTag         The FIFF_DATA_BUFFER or FIFF_MNE_RT_CODED_BUFFER tag.
+    * @param[in] p_nChannels    Number of channels.
+    * @param[out] p_matData     The calibrated raw buffer (channels x samples).
+    *
+    * @return true if succeeded, false otherwise.
+    */
+    bool decode(const FiffTag::SPtr& p_pTag, qint32 p_nChannels, MatrixXf& p_matData) const;
+
+private:
+    //=========================================================================================================
+    /**
+    * Recovers the integer samples of a calibrated buffer.
+    *
+    * @param[in] p_matData      The calibrated raw buffer.
+    * @param[out] p_matQuant    The integer samples.
+    *
+    * @return true if calibrating p_matQuant reproduces p_matData exactly.
+    */
+    bool quantize(const MatrixXf& p_matData, MatrixXi& p_matQuant) const;
+
+    VectorXd m_vecCals;     /**< Calibration of each channel (range*cal). */
+};
+
+} // NAMESPACE
+
+#endif // FIFF_RAW_BUFFER_CODEC_H
@@ -43,6 +43,14 @@
 #include "fiff_stream.h"
 #include "cstdlib"
 
+
+//*************************************************************************************************************
+//=============================================================================================================
+// STL INCLUDES
+//=============================================================================================================
+
+#include <algorithm>
+
 //*************************************************************************************************************
 //=============================================================================================================
 // USED NAMESPACES
@@ -59,6 +67,8 @@ using namespace FIFFLIB;
 FiffRawData::FiffRawData()
 : first_samp(-1)
 , last_samp(-1)
+, m_bKernelValid(false)
+, m_iKernelCompKind(-1)
 {
 
 }
@@ -69,6 +79,8 @@ FiffRawData::FiffRawData()
 FiffRawData::FiffRawData(QIODevice &p_IODevice)
 : first_samp(-1)
 , last_samp(-1)
+, m_bKernelValid(false)
+, m_iKernelCompKind(-1)
 {
     //setup FiffRawData object
     if(!FiffStream::setup_read_raw(p_IODevice, *this))
@@ -89,8 +101,12 @@ FiffRawData::FiffRawData(const FiffRawData &p_FiffRawData)
 , last_samp(p_FiffRawData.last_samp)
 , cals(p_FiffRawData.cals)
 , rawdir(p_FiffRawData.rawdir)
+, rawdir_last(p_FiffRawData.rawdir_last)
 , proj(p_FiffRawData.proj)
 , comp(p_FiffRawData.comp)
+, filemap(p_FiffRawData.filemap)
+, m_bKernelValid(false)
+, m_iKernelCompKind(-1)
 {
 
 }
@@ -113,8 +129,11 @@ void FiffRawData::clear()
     last_samp = -1;
     cals = RowVectorXd();
     rawdir.clear();
+    rawdir_last.clear();
     proj = MatrixXd();
     comp.clear();
+    filemap.clear();
+    m_bKernelValid = false;
 }
 
 
@@ -122,11 +141,6 @@ void FiffRawData::clear()
 
 bool FiffRawData::read_raw_segment(MatrixXd& data, MatrixXd& times, fiff_int_t from, fiff_int_t to, const RowVectorXi& sel)
 {
-    bool projAvailable = true;
-
-    if (this->proj.size() == 0)
-        projAvailable = false;
-
     if(from == -1)
         from = this->first_samp;
     if(to == -1)
@@ -146,293 +160,349 @@ bool FiffRawData::read_raw_segment(MatrixXd& data, MatrixXd& times, fiff_int_t f
     }
     printf("Reading %d ... %d  =  %9.3f ... %9.3f secs...", from, to, ((float)from)/this->info.sfreq, ((float)to)/this->info.sfreq);
     //
-    //  Initialize the data and calibration vector
+    //  Set up the read kernel (calibration, compensation, projection and selection) - reused across calls
     //
-    qint32 nchan = this->info.nchan;
-    qint32 dest  = 0;//1;
-    qint32 i, k, r;
+    this->prepare_read(sel);
 
-    typedef Eigen::Triplet<double> T;
-    std::vector<T> tripletList;
-    tripletList.reserve(nchan);
-    for(i = 0; i < nchan; ++i)
-        tripletList.push_back(T(i, i, this->cals[i]));
+    data.resize(sel.size() == 0 ? this->info.nchan : sel.size(), to-from+1);
 
-    SparseMatrix<double> cal(nchan, nchan);
-    cal.setFromTriplets(tripletList.begin(), tripletList.end());
-//    cal.makeCompressed();
-
-    MatrixXd mult_full;
+    bool do_debug = false;
+    qint32 dest = 0;//1;
+    qint32 i, k;
+    fiff_int_t first_pick, last_pick, picksamp;
+    //
+    //  Look up the buffers containing from ... to in the raw directory index
     //
-    if (sel.size() == 0)
+    qint32 first_buf, last_buf;
+    if (!this->rawdir_range(from, to, first_buf, last_buf))
     {
-        data = MatrixXd(nchan, to-from+1);
-//            data->setZero();
-        if (projAvailable || this->comp.kind != -1)
-        {
-            if (!projAvailable)
-                mult_full = this->comp.data->data*cal;
-            else if (this->comp.kind == -1)
-                mult_full = this->proj*cal;
-            else
-                mult_full = this->proj*this->comp.data->data*cal;
-        }
+        printf("No data buffers in this range\n");
+        return false;
     }
-    else
-    {
-        data = MatrixXd(sel.size(),to-from+1);
-//            data->setZero();
-
-        MatrixXd selVect(sel.size(), nchan);
-
-        selVect.setZero();
 
-        if (!projAvailable && this->comp.kind == -1)
+    for(k = first_buf; k <= last_buf; ++k)
+    {
+        const FiffRawDir& thisRawDir = this->rawdir[k];
+        //
+        //  The picking logic is a bit complicated
+        //
+        if (to >= thisRawDir.last && from <= thisRawDir.first)
         {
-            tripletList.clear();
-            tripletList.reserve(sel.size());
-            for(i = 0; i < sel.size(); ++i)
-                tripletList.push_back(T(i, i, this->cals[sel[i]]));
-            cal = SparseMatrix<double>(sel.size(), sel.size());
-            cal.setFromTriplets(tripletList.begin(), tripletList.end());
+            //
+            //  We need the whole buffer
+            //
+            first_pick = 0;//1;
+            last_pick  = thisRawDir.nsamp - 1;
+            if (do_debug)
+                printf("W");
         }
-        else
+        else if (from > thisRawDir.first)
         {
-            if (!projAvailable)
-            {
-                qDebug() << "This has to be debugged! #1";
-                for( i = 0; i  < sel.size(); ++i)
-                    selVect.row(i) = this->comp.data->data.block(sel[i],0,1,nchan);
-                mult_full = selVect*cal;
-            }
-            else if (this->comp.kind == -1)
+            first_pick = from - thisRawDir.first;// + 1;
+            if(to < thisRawDir.last)
             {
-                for( i = 0; i  < sel.size(); ++i)
-                    selVect.row(i) = this->proj.block(sel[i],0,1,nchan);
-
-                mult_full = selVect*cal;
+                //
+                //  Something from the middle
+                //
+                last_pick = thisRawDir.nsamp + to - thisRawDir.last - 1;//is this alright?
+                if (do_debug)
+                    printf("M");
             }
             else
             {
-                qDebug() << "This has to be debugged! #3";
-                for( i = 0; i  < sel.size(); ++i)
-                    selVect.row(i) = this->proj.block(sel[i],0,1,nchan);
+                //
+                //  From the middle to the end
+                //
+                last_pick = thisRawDir.nsamp - 1;
+                if (do_debug)
+                    printf("E");
+            }
+        }
+        else
+        {
+            //
+            //  From the beginning to the middle
+            //
+            first_pick = 0;//1;
+            last_pick  = to - thisRawDir.first;// + 1;
+            if (do_debug)
+                printf("B");
+        }
+        //
+        //  Now we are ready to pick
+        //
+        picksamp = last_pick - first_pick + 1;
 
-                mult_full = selVect*this->comp.data->data*cal;
+        if(do_debug)
+        {
+            qDebug() << "first_pick: " << first_pick;
+            qDebug() << "last_pick: " << last_pick;
+            qDebug() << "picksamp: " << picksamp;
+        }
+
+        if (picksamp > 0)
+        {
+            if (!this->read_raw_buffer(thisRawDir, first_pick, picksamp, data, dest, m_matKernelWork))
+            {
+                printf(" [failed]\n");
+                return false;
             }
+            dest += picksamp;
         }
     }
+    printf(" [done]\n");
 
-    bool do_debug = false;
-    //
-    // Make mult sparse
-    //
-    tripletList.clear();
-    tripletList.reserve(mult_full.rows()*mult_full.cols());
-    for(i = 0; i < mult_full.rows(); ++i)
-        for(k = 0; k < mult_full.cols(); ++k)
-            if(mult_full(i,k) != 0)
-                tripletList.push_back(T(i, k, mult_full(i,k)));
-
-    SparseMatrix<double> mult(mult_full.rows(),mult_full.cols());
-    if(tripletList.size() > 0)
-        mult.setFromTriplets(tripletList.begin(), tripletList.end());
-//    mult.makeCompressed();
+    times = MatrixXd(1, to-from+1);
 
-    //
+    for (i = 0; i < times.cols(); ++i)
+        times(0, i) = ((float)(from+i)) / this->info.sfreq;
+
+    return true;
+}
+
+
+//*************************************************************************************************************
+
+void FiffRawData::prepare_read(const RowVectorXi& sel)
+{
+    this->update_read_kernel(sel);
 
-    FiffStream::SPtr fid;
     if (!this->file->device()->isOpen())
     {
         if (!this->file->device()->open(QIODevice::ReadOnly))
         {
             printf("Cannot open file %s",this->info.filename.toUtf8().constData());
         }
-        fid = this->file;
+    }
+
+    //
+    //  Map the file on first use - buffers which can't be accessed through the map are read tag by tag
+    //
+    if (!this->filemap)
+        this->filemap = FiffFileMap::SPtr(new FiffFileMap(this->file->device()));
+
+    if (this->rawdir_last.size() != this->rawdir.size())
+        this->update_rawdir_index();
+}
+
+
+//*************************************************************************************************************
+
+bool FiffRawData::read_raw_buffer(qint32 buf, fiff_int_t first_pick, fiff_int_t picksamp, MatrixXd& data, qint32 dest, MatrixXd& work) const
+{
+    if (!m_bKernelValid || buf < 0 || buf >= this->rawdir.size())
+        return false;
+
+    const FiffRawDir& t_RawDir = this->rawdir[buf];
+    if (first_pick < 0 || picksamp <= 0 || first_pick + picksamp > t_RawDir.nsamp || dest + picksamp > data.cols())
+        return false;
+
+    return this->read_raw_buffer(t_RawDir, first_pick, picksamp, data, dest, work);
+}
+
+
+//*************************************************************************************************************
+
+bool FiffRawData::rawdir_range(fiff_int_t from, fiff_int_t to, qint32& first, qint32& last) const
+{
+    first = last = -1;
+
+    if (from > to || this->rawdir.size() == 0)
+        return false;
+
+    if (this->rawdir_last.size() == this->rawdir.size())
+    {
+        //
+        //  Binary search in the index: first buffers ending at or after from resp. to
+        //
+        const fiff_int_t* t_pBegin = this->rawdir_last.constData();
+        const fiff_int_t* t_pEnd = t_pBegin + this->rawdir_last.size();
+
+        first = std::lower_bound(t_pBegin, t_pEnd, from) - t_pBegin;
+        last = std::lower_bound(t_pBegin + first, t_pEnd, to) - t_pBegin;
     }
     else
     {
-        fid = this->file;
+        //
+        //  Index is out of date - scan the directory
+        //
+        for(first = 0; first < this->rawdir.size() && this->rawdir[first].last < from; ++first);
+        for(last = first; last < this->rawdir.size() && this->rawdir[last].last < to; ++last);
     }
 
-    MatrixXd one;
-    fiff_int_t first_pick, last_pick, picksamp;
-    for(k = 0; k < this->rawdir.size(); ++k)
+    if (first >= this->rawdir.size() || this->rawdir[first].first > to)
+    {
+        first = last = -1;
+        return false;
+    }
+    if (last >= this->rawdir.size())
+        last = this->rawdir.size() - 1;
+
+    return true;
+}
+
+
+//*************************************************************************************************************
+
+void FiffRawData::update_rawdir_index()
+{
+    this->rawdir_last.resize(this->rawdir.size());
+    for(qint32 k = 0; k < this->rawdir.size(); ++k)
+        this->rawdir_last[k] = this->rawdir[k].last;
+}
+
+
+//*************************************************************************************************************
+
+void FiffRawData::update_read_kernel(const RowVectorXi& sel)
+{
+    bool projAvailable = this->proj.size() > 0;
+    bool compAvailable = this->comp.kind != -1;
+    //
+    //  Still valid?
+    //
+    if (m_bKernelValid
+            && m_vecKernelSel.size() == sel.size() && (sel.size() == 0 || m_vecKernelSel == sel)
+            && m_matKernelProj.rows() == this->proj.rows() && m_matKernelProj.cols() == this->proj.cols() && (!projAvailable || m_matKernelProj == this->proj)
+            && m_iKernelCompKind == this->comp.kind && (!compAvailable || m_matKernelComp == this->comp.data->data))
+        return;
+
+    qint32 nchan = this->info.nchan;
+    qint32 i;
+
+    m_vecKernelSel = sel;
+    m_matKernelProj = this->proj;
+    m_iKernelCompKind = this->comp.kind;
+    m_matKernelComp = compAvailable ? this->comp.data->data : MatrixXd();
+
+    if (!projAvailable && !compAvailable)
+    {
+        //
+        //  Calibration only - applied while decoding the selected channels
+        //
+        m_vecKernelCal.resize(sel.size() == 0 ? nchan : sel.size());
+        for(i = 0; i < m_vecKernelCal.size(); ++i)
+            m_vecKernelCal[i] = this->cals[sel.size() == 0 ? i : sel[i]];
+        m_matKernelMult = MatrixXd();
+    }
+    else
     {
-        FiffRawDir thisRawDir = this->rawdir[k];
         //
-        //  Do we need this buffer
+        //  mult = proj*comp*cal, restricted to the selected rows
         //
-        if (thisRawDir.last > from)
+        MatrixXd mult_full;
+        if (!projAvailable)
+            mult_full = this->comp.data->data;
+        else if (!compAvailable)
+            mult_full = this->proj;
+        else
+            mult_full = this->proj*this->comp.data->data;
+
+        for(i = 0; i < nchan; ++i)
+            mult_full.col(i) *= this->cals[i];
+
+        if (sel.size() == 0)
+            m_matKernelMult = mult_full;
+        else
         {
-            if (thisRawDir.ent.kind == -1)
-            {
-                //
-                //  Take the easy route: skip is translated to zeros
-                //
-                if(do_debug)
-                    printf("S");
-                if (sel.cols() <= 0)
-                    one.resize(nchan,thisRawDir.nsamp);
-                else
-                    one.resize(sel.cols(),thisRawDir.nsamp);
-
-                one.setZero();
-            }
-            else
-            {
-                FiffTag::SPtr t_pTag;
-                FiffTag::read_tag(fid.data(), t_pTag, thisRawDir.ent.pos);
-                //
-                //   Depending on the state of the projection and selection
-                //   we proceed a little bit differently
-                //
-                if (mult.cols() == 0)
-                {
-                    if (sel.cols() == 0)
-                    {
-                        if (t_pTag->type == FIFFT_DAU_PACK16)
-                            one = cal*(Map< MatrixDau16 >( t_pTag->toDauPack16(),nchan, thisRawDir.nsamp)).cast<double>();
-                        else if(t_pTag->type == FIFFT_INT)
-                            one = cal*(Map< MatrixXi >( t_pTag->toInt(),nchan, thisRawDir.nsamp)).cast<double>();
-                        else if(t_pTag->type == FIFFT_FLOAT)
-                            one = cal*(Map< MatrixXf >( t_pTag->toFloat(),nchan, thisRawDir.nsamp)).cast<double>();
-                        else
-                            printf("Data Storage Format not known jet [1]!! Type: %d\n", t_pTag->type);
-                    }
-                    else
-                    {
-
-                        //ToDo find a faster solution for this!! --> make cal and mul sparse like in MATLAB
-                        MatrixXd newData(sel.cols(), thisRawDir.nsamp); //ToDo this can be done much faster, without newData
-
-                        if (t_pTag->type == FIFFT_DAU_PACK16)
-                        {
-                            MatrixXd tmp_data = (Map< MatrixDau16 > ( t_pTag->toDauPack16(),nchan, thisRawDir.nsamp)).cast<double>();
-
-                            for(r = 0; r < sel.size(); ++r)
-                                newData.block(r,0,1,thisRawDir.nsamp) = tmp_data.block(sel[r],0,1,thisRawDir.nsamp);
-                        }
-                        else if(t_pTag->type == FIFFT_INT)
-                        {
-                            MatrixXd tmp_data = (Map< MatrixXi >( t_pTag->toInt(),nchan, thisRawDir.nsamp)).cast<double>();
-
-                            for(r = 0; r < sel.size(); ++r)
-                                newData.block(r,0,1,thisRawDir.nsamp) = tmp_data.block(sel[r],0,1,thisRawDir.nsamp);
-                        }
-                        else if(t_pTag->type == FIFFT_FLOAT)
-                        {
-                            MatrixXd tmp_data = (Map< MatrixXf > ( t_pTag->toFloat(),nchan, thisRawDir.nsamp)).cast<double>();
-
-                            for(r = 0; r < sel.size(); ++r)
-                                newData.block(r,0,1,thisRawDir.nsamp) = tmp_data.block(sel[r],0,1,thisRawDir.nsamp);
-                        }
-                        else
-                        {
-                            printf("Data Storage Format not known jet [2]!! Type: %d\n", t_pTag->type);
-                        }
-
-                        one = cal*newData;
-                    }
-                }
-                else
-                {
-                    if (t_pTag->type == FIFFT_DAU_PACK16)
-                        one = mult*(Map< MatrixDau16 >( t_pTag->toDauPack16(),nchan, thisRawDir.nsamp)).cast<double>();
-                    else if(t_pTag->type == FIFFT_INT)
-                        one = mult*(Map< MatrixXi >( t_pTag->toInt(),nchan, thisRawDir.nsamp)).cast<double>();
-                    else if(t_pTag->type == FIFFT_FLOAT)
-                        one = mult*(Map< MatrixXf >( t_pTag->toFloat(),nchan, thisRawDir.nsamp)).cast<double>();
-                    else
-                        printf("Data Storage Format not known jet [3]!! Type: %d\n", t_pTag->type);
-                }
-            }
-            //
-            //  The picking logic is a bit complicated
-            //
-            if (to >= thisRawDir.last && from <= thisRawDir.first)
-            {
-                //
-                //  We need the whole buffer
-                //
-                first_pick = 0;//1;
-                last_pick  = thisRawDir.nsamp - 1;
-                if (do_debug)
-                    printf("W");
-            }
-            else if (from > thisRawDir.first)
-            {
-                first_pick = from - thisRawDir.first;// + 1;
-                if(to < thisRawDir.last)
-                {
-                    //
-                    //  Something from the middle
-                    //
-//                    qDebug() << "This needs to be debugged!";
-                    last_pick = thisRawDir.nsamp + to - thisRawDir.last - 1;//is this alright?
-                    if (do_debug)
-                        printf("M");
-                }
-                else
-                {
-                    //
-                    //  From the middle to the end
-                    //
-                    last_pick = thisRawDir.nsamp - 1;
-                    if (do_debug)
-                        printf("E");
-                }
-            }
-            else
-            {
-                //
-                //  From the beginning to the middle
-                //
-                first_pick = 0;//1;
-                last_pick  = to - thisRawDir.first;// + 1;
-                if (do_debug)
-                    printf("B");
-            }
-            //
-            //  Now we are ready to pick
-            //
-            picksamp = last_pick - first_pick + 1;
+            m_matKernelMult.resize(sel.size(), nchan);
+            for(i = 0; i < sel.size(); ++i)
+                m_matKernelMult.row(i) = mult_full.row(sel[i]);
+        }
+        m_vecKernelCal = RowVectorXd();
+    }
 
-            if(do_debug)
-            {
-                qDebug() << "first_pick: " << first_pick;
-                qDebug() << "last_pick: " << last_pick;
-                qDebug() << "picksamp: " << picksamp;
-            }
+    m_bKernelValid = true;
+}
 
-            if (picksamp > 0)
-            {
-//                    for(r = 0; r < data->rows(); ++r)
-//                        for(c = 0; c < picksamp; ++c)
-//                            (*data)(r,dest + c) = one(r,first_pick + c);
-                data.block(0,dest,data.rows(),picksamp) = one.block(0, first_pick, data.rows(), picksamp);
 
-                dest += picksamp;
-            }
-        }
+//*************************************************************************************************************
+
+template<typename T>
+void FiffRawData::apply_read_kernel(const MatrixBase<T>& buf, fiff_int_t first_pick, fiff_int_t picksamp, MatrixXd& data, qint32 dest, MatrixXd& work) const
+{
+    if (m_matKernelMult.size() == 0)
+    {
+        for(qint32 r = 0; r < data.rows(); ++r)
+            data.block(r,dest,1,picksamp) = m_vecKernelCal[r] * buf.block(m_vecKernelSel.size() == 0 ? r : m_vecKernelSel[r],first_pick,1,picksamp).template cast<double>();
+    }
+    else
+    {
+        work = buf.block(0,first_pick,buf.rows(),picksamp).template cast<double>();
+        data.block(0,dest,data.rows(),picksamp).noalias() = m_matKernelMult*work;
+    }
+}
+
+
+//*************************************************************************************************************
+
+bool FiffRawData::read_raw_buffer(const FiffRawDir& p_RawDir, fiff_int_t first_pick, fiff_int_t picksamp, MatrixXd& data, qint32 dest, MatrixXd& work) const
+{
+    qint32 nchan = this->info.nchan;
+
+    if (p_RawDir.ent.kind == -1)
+    {
+        //
+        //  Take the easy route: skip is translated to zeros
+        //
+        data.block(0,dest,data.rows(),picksamp).setZero();
+        return true;
+    }
+    else if (this->filemap && this->filemap->contains(p_RawDir.ent))
+    {
         //
-        //  Done?
+        //  Decode straight from the map into the output
         //
-        if (thisRawDir.last >= to)
+        if (m_matKernelMult.size() == 0)
         {
-            printf(" [done]\n");
-            break;
+            if(this->filemap->read_raw_buffer(p_RawDir.ent, nchan, p_RawDir.nsamp, m_vecKernelSel, m_vecKernelCal, first_pick, picksamp, data, dest))
+                return true;
+            printf("Data Storage Format not known jet [1]!! Type: %d\n", p_RawDir.ent.type);
+        }
+        else
+        {
+            work.resize(nchan, picksamp);
+            if(this->filemap->read_raw_buffer(p_RawDir.ent, nchan, p_RawDir.nsamp, defaultRowVectorXi, defaultRowVectorXd, first_pick, picksamp, work, 0))
+            {
+                data.block(0,dest,data.rows(),picksamp).noalias() = m_matKernelMult*work;
+                return true;
+            }
+            printf("Data Storage Format not known jet [3]!! Type: %d\n", p_RawDir.ent.type);
         }
     }
+    else
+    {
+        FiffTag::SPtr t_pTag;
+        FiffTag::read_tag(this->file.data(), t_pTag, p_RawDir.ent.pos, &m_tagPool);
 
-//        fclose(fid);
-
-    times = MatrixXd(1, to-from+1);
-
-    for (i = 0; i < times.cols(); ++i)
-        times(0, i) = ((float)(from+i)) / this->info.sfreq;
+        if (t_pTag->type == FIFFT_DAU_PACK16)
+        {
+            this->apply_read_kernel(Map< MatrixDau16 >( t_pTag->toDauPack16(),nchan, p_RawDir.nsamp), first_pick, picksamp, data, dest, work);
+            return true;
+        }
+        else if(t_pTag->type == FIFFT_SHORT)
+        {
+            this->apply_read_kernel(Map< MatrixDau16 >( t_pTag->toShort(),nchan, p_RawDir.nsamp), first_pick, picksamp, data, dest, work);
+            return true;
+        }
+        else if(t_pTag->type == FIFFT_INT)
+        {
+            this->apply_read_kernel(Map< MatrixXi >( t_pTag->toInt(),nchan, p_RawDir.nsamp), first_pick, picksamp, data, dest, work);
+            return true;
+        }
+        else if(t_pTag->type == FIFFT_FLOAT)
+        {
+            this->apply_read_kernel(Map< MatrixXf >( t_pTag->toFloat(),nchan, p_RawDir.nsamp), first_pick, picksamp, data, dest, work);
+            return true;
+        }
+        printf("Data Storage Format not known jet [2]!! Type: %d\n", t_pTag->type);
+    }
 
-    return true;
+    //
+    //  Don't hand out whatever was in the output before
+    //
+    data.block(0,dest,data.rows(),picksamp).setZero();
+    return false;
 }
 
 
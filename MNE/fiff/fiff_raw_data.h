@@ -45,6 +45,8 @@
 #include "fiff_info.h"
 #include "fiff_raw_dir.h"
 #include "fiff_stream.h"
+#include "fiff_file_map.h"
+#include "fiff_tag_pool.h"
 
 
 //*************************************************************************************************************
@@ -64,6 +66,7 @@
 #include <QFile>
 #include <QList>
 #include <QSharedPointer>
+#include <QVector>
 
 
 //*************************************************************************************************************
@@ -146,7 +149,10 @@ public:
     /**
     * ### MNE toolbox root function ###: Implementation of the fiff_read_raw_segment function
     *
-    * Read a specific raw data segment
+    * Read a specific raw data segment. If the raw file can be memory mapped, the data buffers are decoded in place
+    * (only the requested samples and - without projection - only the selected channels are converted).
+    * Calibration, compensation, projection and channel selection are fused into one read kernel, which is cached
+    * and only rebuilt if sel, proj or comp change between calls.
     *
     * @param[out] data      returns the data matrix (channels x samples)
     * @param[out] times     returns the time values corresponding to the samples
@@ -174,6 +180,55 @@ public:
     */
     bool read_raw_segment_times(MatrixXd& data, MatrixXd& times, float from, float to, const RowVectorXi& sel = defaultRowVectorXi);
 
+    //=========================================================================================================
+    /**
+    * Prepares reading for the channel selection sel: builds the read kernel for the current proj and comp, maps
+    * the file and updates the raw directory index. read_raw_segment does this on its own; call it before using
+    * read_raw_buffer directly.
+    *
+    * @param[in] sel        channel selection vector (optional)
+    */
+    void prepare_read(const RowVectorXi& sel = defaultRowVectorXi);
+
+    //=========================================================================================================
+    /**
+    * Reads samples of a single raw directory entry through the read kernel set up by prepare_read, i.e. the
+    * calibrated, compensated, projected and selected data are written to data(:, dest:dest+picksamp-1).
+    * This is safe to call from several threads at once only for entries which are skips or lie within the memory
+    * map (filemap->contains()); all other tags are read through the shared stream and tag pool.
+    *
+    * @param[in] buf            index of the rawdir entry
+    * @param[in] first_pick     first sample to pick (relative to the buffer start)
+    * @param[in] picksamp       number of samples to pick
+    * @param[out] data          the output data matrix (selected channels x samples), has to be allocated
+    * @param[in] dest           first destination column
+    * @param[in, out] work      work space, resized when required
+    *
+    * @return true if succeeded, false otherwise (on an unknown data type the destination block is zeroed)
+    */
+    bool read_raw_buffer(qint32 buf, fiff_int_t first_pick, fiff_int_t picksamp, MatrixXd& data, qint32 dest, MatrixXd& work) const;
+
+    //=========================================================================================================
+    /**
+    * Looks up the raw directory entries (data buffers or skips) which hold the samples from ... to. Uses a binary
+    * search in the raw directory index (falls back to a linear scan if the index is out of date).
+    *
+    * @param[in] from       first sample of the interval
+    * @param[in] to         last sample of the interval
+    * @param[out] first     index of the first rawdir entry within the interval
+    * @param[out] last      index of the last rawdir entry within the interval
+    *
+    * @return true if the interval overlaps with the raw data, false otherwise
+    */
+    bool rawdir_range(fiff_int_t from, fiff_int_t to, qint32& first, qint32& last) const;
+
+    //=========================================================================================================
+    /**
+    * (Re-)builds the raw directory index rawdir_last. This is done by FiffStream::setup_read_raw and has to be
+    * called again only if rawdir is changed afterwards.
+    */
+    void update_rawdir_index();
+
 public:
     FiffStream::SPtr file;      /**< replaces fid */
     FiffInfo info;              /**< Fiff measurement information */
@@ -181,8 +236,60 @@ public:
     fiff_int_t last_samp;       /**< Do we have a skip ToDo... */
     RowVectorXd cals;              /**< Calibration matrix: ToDo Check if RowVectorXd is enough */
     QList<FiffRawDir> rawdir;   /**< Special fiff diretory entry for raw data. */
+    QVector<fiff_int_t> rawdir_last;  /**< Raw directory index: last sample of each rawdir entry (ascending). */
     MatrixXd proj;              /**< SSP operator to apply to the data. */
     FiffCtfComp comp;           /**< Comepnsator. */
+    FiffFileMap::SPtr filemap;  /**< Memory map of the raw file; set up on the first read_raw_segment call. */
+
+private:
+    //=========================================================================================================
+    /**
+    * Builds the read kernel for the given channel selection and the current proj and comp. Nothing is done if
+    * the cached kernel was built for the same settings.
+    *
+    * @param[in] sel        channel selection vector
+    */
+    void update_read_kernel(const RowVectorXi& sel);
+
+    //=========================================================================================================
+    /**
+    * Reads samples of one raw buffer through the current read kernel, i.e. the calibrated, compensated, projected
+    * and selected data are written to data(:, dest:dest+picksamp-1).
+    *
+    * @param[in] p_RawDir       raw directory entry of the buffer
+    * @param[in] first_pick     first sample to pick (relative to the buffer start)
+    * @param[in] picksamp       number of samples to pick
+    * @param[out] data          the output data matrix
+    * @param[in] dest           first destination column
+    * @param[in, out] work      work space, resized when required
+    *
+    * @return true if succeeded, false if the data type is not known; the destination block is zeroed then
+    */
+    bool read_raw_buffer(const FiffRawDir& p_RawDir, fiff_int_t first_pick, fiff_int_t picksamp, MatrixXd& data, qint32 dest, MatrixXd& work) const;
+
+    //=========================================================================================================
+    /**
+    * Applies the read kernel to an already decoded (channels x samples) buffer.
+    *
+    * @param[in] buf            the buffer data
+    * @param[in] first_pick     first sample to pick
+    * @param[in] picksamp       number of samples to pick
+    * @param[out] data          the output data matrix
+    * @param[in] dest           first destination column
+    * @param[in, out] work      work space, resized when required
+    */
+    template<typename T>
+    void apply_read_kernel(const MatrixBase<T>& buf, fiff_int_t first_pick, fiff_int_t picksamp, MatrixXd& data, qint32 dest, MatrixXd& work) const;
+
+    bool m_bKernelValid;            /**< Whether the read kernel was set up. */
+    RowVectorXi m_vecKernelSel;     /**< Channel selection the read kernel was built for. */
+    MatrixXd m_matKernelProj;       /**< Projector the read kernel was built for. */
+    fiff_int_t m_iKernelCompKind;   /**< Compensation kind the read kernel was built for. */
+    MatrixXd m_matKernelComp;       /**< Compensator the read kernel was built for. */
+    RowVectorXd m_vecKernelCal;     /**< Calibrations of the selected channels; used when there is no projection. */
+    MatrixXd m_matKernelMult;       /**< proj*comp*cal restricted to the selected rows; empty if there is no projection. */
+    MatrixXd m_matKernelWork;       /**< Work space of read_raw_segment. */
+    mutable FiffTagPool m_tagPool;  /**< Buffer tags reused while reading through the stream. */
 };
 
 } // NAMESPACE
@@ -200,6 +200,53 @@ bool FiffStream::get_evoked_entries(const QList<FiffDirTree> &evoked_node, QStri
 //*************************************************************************************************************
 
 bool FiffStream::open(FiffDirTree& p_Tree, QList<FiffDirEntry>& p_Dir)
+{
+    QVector<FiffDirEntry> t_Dir;
+    if(!this->open_dir(t_Dir))
+        return false;
+
+    //
+    //   Create the directory tree structure
+    //
+    p_Dir = t_Dir.toList();
+    FiffDirTree::make_dir_tree(this, p_Dir, p_Tree);
+
+    printf("[done]\n");
+
+    //
+    //   Back to the beginning
+    //
+    this->device()->seek(0); //fseek(fid,0,'bof');
+    return true;
+}
+
+
+//*************************************************************************************************************
+
+bool FiffStream::open(const FiffStream::SPtr& p_pStream, FiffDirTree& p_Tree)
+{
+    QVector<FiffDirEntry> t_Dir;
+    if(!p_pStream->open_dir(t_Dir))
+        return false;
+
+    //
+    //   Create the block index, nodes are built when they are visited
+    //
+    FiffDirTree::make_dir_index(p_pStream, t_Dir, p_Tree);
+
+    printf("[done]\n");
+
+    //
+    //   Back to the beginning
+    //
+    p_pStream->device()->seek(0); //fseek(fid,0,'bof');
+    return true;
+}
+
+
+//*************************************************************************************************************
+
+bool FiffStream::open_dir(QVector<FiffDirEntry>& p_Dir)
 {
     QString t_sFileName = this->streamName();
 
@@ -238,7 +285,7 @@ bool FiffStream::open(FiffDirTree& p_Tree, QList<FiffDirEntry>& p_Dir)
     }
 
     //
-    //   Read or create the directory tree
+    //   Read or create the directory
     //
     printf("\nCreating tag directory for %s...", t_sFileName.toUtf8().constData());
 
@@ -247,36 +294,37 @@ bool FiffStream::open(FiffDirTree& p_Tree, QList<FiffDirEntry>& p_Dir)
     if (dirpos > 0)
     {
         FiffTag::read_tag(this, t_pTag, dirpos);
-        p_Dir = t_pTag->toDirEntry();
+        if(!t_pTag->isMatrix() && t_pTag->getType() == FIFFT_DIR_ENTRY_STRUCT && t_pTag->data() != NULL)
+        {
+            //
+            //   Decode the on-disk directory straight into the flat array
+            //
+            const qint32* t_pInt32 = (const qint32*)t_pTag->data();
+            p_Dir.resize(t_pTag->size()/16);
+            for (qint32 k = 0; k < p_Dir.size(); ++k)
+            {
+                p_Dir[k].kind = t_pInt32[k*4];
+                p_Dir[k].type = t_pInt32[k*4+1];
+                p_Dir[k].size = t_pInt32[k*4+2];
+                p_Dir[k].pos  = t_pInt32[k*4+3];
+            }
+        }
     }
     else
     {
-        qint32 k = 0;
         this->device()->seek(0);//fseek(fid,0,'bof');
         FiffDirEntry t_fiffDirEntry;
         while (t_pTag->next >= 0)
         {
             t_fiffDirEntry.pos = this->device()->pos();//pos = ftell(fid);
             FiffTag::read_tag_info(this, t_pTag);
-            ++k;
             t_fiffDirEntry.kind = t_pTag->kind;
             t_fiffDirEntry.type = t_pTag->type;
             t_fiffDirEntry.size = t_pTag->size();
             p_Dir.append(t_fiffDirEntry);
         }
     }
-    //
-    //   Create the directory tree structure
-    //
-
-    FiffDirTree::make_dir_tree(this, p_Dir, p_Tree);
-
-    printf("[done]\n");
 
-    //
-    //   Back to the beginning
-    //
-    this->device()->seek(0); //fseek(fid,0,'bof');
     return true;
 }
 
@@ -1310,9 +1358,8 @@ bool FiffStream::setup_read_raw(QIODevice &p_IODevice, FiffRawData& data, bool a
     printf("Opening raw data %s...\n",t_sFileName.toUtf8().constData());
 
     FiffDirTree t_Tree;
-    QList<FiffDirEntry> t_Dir;
 
-    if(!p_pStream->open(t_Tree, t_Dir))
+    if(!FiffStream::open(p_pStream, t_Tree))
         return false;
 
     //
@@ -1481,6 +1528,7 @@ bool FiffStream::setup_read_raw(QIODevice &p_IODevice, FiffRawData& data, bool a
     //
     data.cals       = cals;
     data.rawdir     = rawdir;
+    data.update_rawdir_index();
     //data->proj       = [];
     //data.comp       = [];
     //
@@ -1977,10 +2025,13 @@ void FiffStream::write_double(fiff_int_t kind, const double* data, fiff_int_t ne
     *this << (qint32)datasize;
     *this << (qint32)FIFFV_NEXT_SEQ;
 
-//    this->setFloatingPointPrecision(QDataStream::SinglePrecision);
+    // The stream runs in single precision for all float tags; doubles have to be written with 8 bytes
+    this->setFloatingPointPrecision(QDataStream::DoublePrecision);
 
     for(qint32 i = 0; i < nel; ++i)
         *this << data[i];
+
+    this->setFloatingPointPrecision(QDataStream::SinglePrecision);
 }
 
 
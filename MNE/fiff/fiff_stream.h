@@ -84,6 +84,7 @@
 #include <QSharedPointer>
 #include <QString>
 #include <QStringList>
+#include <QVector>
 
 
 //*************************************************************************************************************
@@ -219,6 +220,24 @@ public:
     */
     bool open(FiffDirTree& p_Tree, QList<FiffDirEntry>& p_Dir);
 
+    //=========================================================================================================
+    /**
+    * fiff_open - lazy mode
+    *
+    * Opens a fif file like open(FiffDirTree&, QList<FiffDirEntry>&) does, but uses the on-disk directory
+    * (FIFF_DIR_POINTER) when present and keeps the tag directory in a flat array shared by all nodes. Only the
+    * nodes visited by FiffDirTree::dir_tree_find are built (see FiffDirTree::make_dir_index). The tree holds a
+    * reference to the stream; its device has to stay open as long as nodes are requested from the tree.
+    * Files without an on-disk directory still have all their tag headers scanned once to create the directory,
+    * only building the nodes is deferred then.
+    *
+    * @param[in] p_pStream  the stream of the fif file
+    * @param[out] p_Tree    tag directory organized into a lazily built tree
+    *
+    * @return true if succeeded, false otherwise
+    */
+    static bool open(const FiffStream::SPtr& p_pStream, FiffDirTree& p_Tree);
+
     //=========================================================================================================
     /**
     * fiff_read_bad_channels
@@ -663,6 +682,18 @@ public:
     * @param[in] data       The string data to write
     */
     void write_rt_command(fiff_int_t command, const QString& data);
+
+private:
+    //=========================================================================================================
+    /**
+    * Opens the device, checks the file id and reads the sequential tag directory, either from the on-disk
+    * directory or by scanning all tags when there is none.
+    *
+    * @param[out] p_Dir     the sequential tag directory
+    *
+    * @return true if succeeded, false otherwise
+    */
+    bool open_dir(QVector<FiffDirEntry>& p_Dir);
 };
 
 } // NAMESPACE
@@ -40,6 +40,7 @@
 //=============================================================================================================
 
 #include "fiff_tag.h"
+#include "fiff_tag_pool.h"
 #include <utils/ioutils.h>
 
 
@@ -134,9 +135,9 @@ bool FiffTag::read_tag_data(FiffStream* p_pStream, FiffTag::SPtr& p_pTag, qint64
 
 //*************************************************************************************************************
 
-bool FiffTag::read_tag_info(FiffStream* p_pStream, FiffTag::SPtr &p_pTag, bool p_bDoSkip)
+bool FiffTag::read_tag_info(FiffStream* p_pStream, FiffTag::SPtr &p_pTag, bool p_bDoSkip, FiffTagPool* p_pPool)
 {
-    p_pTag = FiffTag::SPtr(new FiffTag());
+    p_pTag = p_pPool ? p_pPool->acquire() : FiffTag::SPtr(new FiffTag());
 
     //Option 1
 //    t_DataStream.readRawData((char *)p_pTag, FIFFC_TAG_INFO_SIZE);
@@ -181,12 +182,12 @@ bool FiffTag::read_tag_info(FiffStream* p_pStream, FiffTag::SPtr &p_pTag, bool p
 
 //*************************************************************************************************************
 
-bool FiffTag::read_rt_tag(FiffStream* p_pStream, FiffTag::SPtr& p_pTag)
+bool FiffTag::read_rt_tag(FiffStream* p_pStream, FiffTag::SPtr& p_pTag, FiffTagPool* p_pPool)
 {
     while(p_pStream->device()->bytesAvailable() < 16)
         p_pStream->device()->waitForReadyRead(10);
 
-    if(!FiffTag::read_tag_info(p_pStream, p_pTag, false))
+    if(!FiffTag::read_tag_info(p_pStream, p_pTag, false, p_pPool))
         return false;
 
     while(p_pStream->device()->bytesAvailable() < p_pTag->size())
@@ -201,14 +202,14 @@ bool FiffTag::read_rt_tag(FiffStream* p_pStream, FiffTag::SPtr& p_pTag)
 
 //*************************************************************************************************************
 
-bool FiffTag::read_tag(FiffStream* p_pStream, FiffTag::SPtr& p_pTag, qint64 pos)
+bool FiffTag::read_tag(FiffStream* p_pStream, FiffTag::SPtr& p_pTag, qint64 pos, FiffTagPool* p_pPool)
 {
     if (pos >= 0)
     {
         p_pStream->device()->seek(pos);
     }
 
-    p_pTag = FiffTag::SPtr(new FiffTag());
+    p_pTag = p_pPool ? p_pPool->acquire() : FiffTag::SPtr(new FiffTag());
 
     //
     // Read fiff tag header from stream
@@ -131,6 +131,7 @@ namespace FIFFLIB
 {
 
 class FiffStream;
+class FiffTagPool;
 
 //*************************************************************************************************************
 //=============================================================================================================
@@ -209,10 +210,11 @@ public:
     * @param[in] p_pStream opened fif file
     * @param[out] p_pTag the read tag info
     * @param[in] p_bDoSkip if true it skips the data of the tag (optional, default = true)
+    * @param[in] p_pPool pool the tag is taken from, a new tag is allocated if NULL (optional, default = NULL)
     *
     * @return true if succeeded, false otherwise
     */
-    static bool read_tag_info(FiffStream* p_pStream, FiffTag::SPtr& p_pTag, bool p_bDoSkip = true);
+    static bool read_tag_info(FiffStream* p_pStream, FiffTag::SPtr& p_pTag, bool p_bDoSkip = true, FiffTagPool* p_pPool = NULL);
 
     //=========================================================================================================
     /**
@@ -221,10 +223,11 @@ public:
     *
     * @param[in] p_pStream opened fif file
     * @param[out] p_pTag the read tag
+    * @param[in] p_pPool pool the tag is taken from, a new tag is allocated if NULL (optional, default = NULL)
     *
     * @return true if succeeded, false otherwise
     */
-    static bool read_rt_tag(FiffStream* p_pStream, FiffTag::SPtr& p_pTag);
+    static bool read_rt_tag(FiffStream* p_pStream, FiffTag::SPtr& p_pTag, FiffTagPool* p_pPool = NULL);
 
     //=========================================================================================================
     /**
@@ -236,10 +239,11 @@ public:
     * @param[in] p_pStream opened fif file
     * @param[out] p_pTag the read tag
     * @param[in] pos position of the tag inside the fif file
+    * @param[in] p_pPool pool the tag is taken from, a new tag is allocated if NULL (optional, default = NULL)
     *
     * @return true if succeeded, false otherwise
     */
-    static bool read_tag(FiffStream* p_pStream, FiffTag::SPtr& p_pTag, qint64 pos = -1);
+    static bool read_tag(FiffStream* p_pStream, FiffTag::SPtr& p_pTag, qint64 pos = -1, FiffTagPool* p_pPool = NULL);
 
     //=========================================================================================================
     /**
@@ -587,6 +591,8 @@ public:
 //    QByteArray* data;       /**< Pointer to the data.
 //                             *   This point to the data read or to be written. */
 private:
+    friend class FiffTagPool;
+
     std::complex<float>* m_pComplexFloatData;
 
     std::complex<double>* m_pComplexDoubleData;
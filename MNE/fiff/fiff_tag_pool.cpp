@@ -0,0 +1,151 @@
+//=============================================================================================================
+/**
+* @file     fiff_tag_pool.cpp
+* @author   Christoph Dinh <chdinh@nmr.mgh.harvard.edu>;
+*           Matti Hamalainen <msh@nmr.mgh.harvard.edu>
+* @version  1.0
+* @date     March, 2014
+*
+* @section  LICENSE
+*
+* Copyright (C) 2014, Christoph Dinh and Matti Hamalainen. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+* the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+*       following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+*       the following disclaimer in the documentation and/or other materials provided with the distribution.
+*     * Neither the name of the Massachusetts General Hospital nor the names of its contributors may be used
+*       to endorse or promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MASSACHUSETTS GENERAL HOSPITAL BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*
+*
+* @brief    Implementation of the FiffTagPool Class.
+*
+*/
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include "fiff_tag_pool.h"
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace FIFFLIB;
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE PRIVATE DATA
+//=============================================================================================================
+
+class FiffTagPool::Data
+{
+public:
+    explicit Data(qint32 p_iMaxFree)
+    : m_iMaxFree(p_iMaxFree)
+    {
+    }
+
+    ~Data()
+    {
+        qDeleteAll(m_qListFree);
+    }
+
+    void release(FiffTag* p_pTag)
+    {
+        //
+        // Drop the cached complex values, they refer to the old content
+        //
+        if(p_pTag->m_pComplexFloatData)
+        {
+            delete p_pTag->m_pComplexFloatData;
+            p_pTag->m_pComplexFloatData = NULL;
+        }
+        if(p_pTag->m_pComplexDoubleData)
+        {
+            delete p_pTag->m_pComplexDoubleData;
+            p_pTag->m_pComplexDoubleData = NULL;
+        }
+
+        //
+        // Pin the capacity, QByteArray would otherwise free or shrink the buffer when it is resized to a smaller tag
+        //
+        if(p_pTag->capacity() > 0)
+            p_pTag->reserve(p_pTag->capacity());
+
+        QMutexLocker locker(&m_qMutex);
+        if(m_qListFree.size() < m_iMaxFree)
+            m_qListFree.append(p_pTag);
+        else
+            delete p_pTag;
+    }
+
+    QMutex              m_qMutex;       /**< Guards the free list */
+    QList<FiffTag*>     m_qListFree;    /**< Tags ready for reuse */
+    qint32              m_iMaxFree;     /**< Maximal number of free tags kept */
+};
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE MEMBER METHODS
+//=============================================================================================================
+
+FiffTagPool::FiffTagPool(qint32 p_iMaxFree)
+: m_pData(new Data(p_iMaxFree))
+{
+}
+
+
+//*************************************************************************************************************
+
+FiffTag::SPtr FiffTagPool::acquire()
+{
+    FiffTag* t_pTag = NULL;
+    {
+        QMutexLocker locker(&m_pData->m_qMutex);
+        if(!m_pData->m_qListFree.isEmpty())
+            t_pTag = m_pData->m_qListFree.takeLast();
+    }
+
+    if(!t_pTag)
+        t_pTag = new FiffTag();
+
+    Recycler t_recycler;
+    t_recycler.m_pData = m_pData;
+    return FiffTag::SPtr(t_pTag, t_recycler);
+}
+
+
+//*************************************************************************************************************
+
+qint32 FiffTagPool::numFree() const
+{
+    QMutexLocker locker(&m_pData->m_qMutex);
+    return m_pData->m_qListFree.size();
+}
+
+
+//*************************************************************************************************************
+
+void FiffTagPool::Recycler::operator()(FiffTag* p_pTag) const
+{
+    m_pData->release(p_pTag);
+}
@@ -0,0 +1,125 @@
+//=============================================================================================================
+/**
+* @file     fiff_tag_pool.h
+* @author   Christoph Dinh <chdinh@nmr.mgh.harvard.edu>;
+*           Matti Hamalainen <msh@nmr.mgh.harvard.edu>
+* @version  1.0
+* @date     March, 2014
+*
+* @section  LICENSE
+*
+* Copyright (C) 2014, Christoph Dinh and Matti Hamalainen. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+* the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+*       following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+*       the following disclaimer in the documentation and/or other materials provided with the distribution.
+*     * Neither the name of the Massachusetts General Hospital nor the names of its contributors may be used
+*       to endorse or promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MASSACHUSETTS GENERAL HOSPITAL BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*
+*
+* @brief    FiffTagPool class declaration.
+*
+*/
+
+#ifndef FIFF_TAG_POOL_H
+#define FIFF_TAG_POOL_H
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include "fiff_global.h"
+#include "fiff_tag.h"
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Qt INCLUDES
+//=============================================================================================================
+
+#include <QList>
+#include <QMutex>
+#include <QSharedPointer>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE NAMESPACE FIFFLIB
+//=============================================================================================================
+
+namespace FIFFLIB
+{
+
+//=============================================================================================================
+/**
+* Pool of reusable tags. A tag acquired from the pool goes back to it when its last shared pointer is released,
+* keeping its data buffer. Reading a stream of equally sized tags (e.g. raw data buffers) through a pool
+* therefore doesn't allocate once the pool is warmed up. Copies of a pool share the same tags, tags can be
+* acquired and released from different threads.
+*
+* @brief Pool of reusable FIFF data tags
+*/
+class FIFFSHARED_EXPORT FiffTagPool
+{
+public:
+    typedef QSharedPointer<FiffTagPool> SPtr;            /**< Shared pointer type for FiffTagPool. */
+    typedef QSharedPointer<const FiffTagPool> ConstSPtr; /**< Const shared pointer type for FiffTagPool. */
+
+    //=========================================================================================================
+    /**
+    * Constructs an empty pool.
+    *
+    * @param[in] p_iMaxFree     maximal number of released tags kept for reuse (optional, default 8)
+    */
+    explicit FiffTagPool(qint32 p_iMaxFree = 8);
+
+    //=========================================================================================================
+    /**
+    * Hands out a tag from the pool, or a new one if there is no free tag left. The content of a reused tag is
+    * undefined, the read functions of FiffTag overwrite header and data.
+    *
+    * @return the tag, it is returned to the pool when the last shared pointer to it is released
+    */
+    FiffTag::SPtr acquire();
+
+    //=========================================================================================================
+    /**
+    * Number of released tags which are ready for reuse.
+    *
+    * @return the number of free tags
+    */
+    qint32 numFree() const;
+
+private:
+    class Data;
+
+    //=========================================================================================================
+    /**
+    * Deleter of the handed out tags, returns them to the pool data.
+    */
+    struct Recycler
+    {
+        QSharedPointer<Data> m_pData;       /**< The pool data, kept alive as long as tags are handed out */
+
+        void operator()(FiffTag* p_pTag) const;
+    };
+
+    QSharedPointer<Data> m_pData;           /**< Free tags, shared by copies of the pool */
+};
+
+} // NAMESPACE
+
+#endif // FIFF_TAG_POOL_H
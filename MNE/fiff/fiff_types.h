@@ -77,6 +77,7 @@ const static Eigen::MatrixXd defaultConstMatrixXd(0,0);
 const static Eigen::MatrixXi defaultMatrixXi(0,0);
 const static Eigen::VectorXi defaultVectorXi;
 const static Eigen::RowVectorXi defaultRowVectorXi;
+const static Eigen::RowVectorXd defaultRowVectorXd;
 const static QPair<QVariant,QVariant> defaultVariantPair;
 
 typedef Eigen::Matrix<qint16, Eigen::Dynamic, Eigen::Dynamic> MatrixDau16;
@@ -46,6 +46,8 @@
 #include "buffer.h"
 
 #include <typeinfo>
+#include <climits>
+#include <cstring>
 
 
 //*************************************************************************************************************
@@ -61,9 +63,13 @@
 // QT INCLUDES
 //=============================================================================================================
 
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QMutexLocker>
 #include <QPair>
-#include <QSemaphore>
 #include <QSharedPointer>
+#include <QWaitCondition>
 
 
 //*************************************************************************************************************
@@ -85,7 +91,11 @@ using namespace Eigen;
 
 //=============================================================================================================
 /**
-* Circular Matrix buffer provides a template for thread safe circular matrix buffers.
+* Circular Matrix buffer provides a template for thread safe circular matrix buffers. It is a lock-free single
+* producer / single consumer ring: one thread pushes, one thread pops. Each matrix occupies one contiguous slot,
+* push and pop copy it with a single memcpy. The threads only synchronize through a mutex when one of them has to
+* wait for the other, i.e. when the buffer is empty or full. Other threads never move the counters: releaseFromPop,
+* releaseFromPush and clear only raise flags which the producer and the consumer act on.
 *
 * @brief The circular matrix buffer
 */
@@ -115,7 +125,7 @@ public:
 
     //=========================================================================================================
     /**
-    * Adds a whole matrix at the end buffer.
+    * Adds a whole matrix at the end buffer. Blocks while the buffer is full.
     *
     * @param [in] pMatrix pointer to a Matrix which should be apend to the end.
     */
@@ -123,15 +133,39 @@ public:
 
     //=========================================================================================================
     /**
-    * Returns the first matrix (first in first out).
+    * Adds a whole matrix at the end buffer. Waits at most msecTimeout milliseconds while the buffer is full.
     *
-    * @return the first matrix
+    * @param [in] pMatrix       pointer to a Matrix which should be apend to the end.
+    * @param [in] msecTimeout   maximal time to wait for a free slot, -1 waits forever.
+    *
+    * @return true if the matrix was added (or skipped because the buffer is paused), false on timeout, wrong dimensions
+    *         or when released by releaseFromPush.
+    */
+    inline bool push(const Matrix<_Tp, Dynamic, Dynamic>* pMatrix, int msecTimeout);
+
+    //=========================================================================================================
+    /**
+    * Returns the first matrix (first in first out). Blocks while the buffer is empty.
+    *
+    * @return the first matrix; a zero matrix if the wait was released by releaseFromPop
     */
     inline Matrix<_Tp, Dynamic, Dynamic> pop();
 
     //=========================================================================================================
     /**
-    * Clears the buffer.
+    * Copies the first matrix (first in first out) into a caller supplied matrix, which is only resized when its
+    * dimensions differ. Waits at most msecTimeout milliseconds while the buffer is empty.
+    *
+    * @param [out] matrix       the first matrix; zero while the buffer is paused.
+    * @param [in] msecTimeout   maximal time to wait for a matrix, -1 waits forever.
+    *
+    * @return true if a matrix was popped, false on timeout or when released by releaseFromPop.
+    */
+    inline bool pop(Matrix<_Tp, Dynamic, Dynamic>& matrix, int msecTimeout = -1);
+
+    //=========================================================================================================
+    /**
+    * Clears the buffer. The matrices pushed so far are dropped by the consumer with its next pop.
     */
     void clear();
 
@@ -141,6 +175,12 @@ public:
     */
     inline quint32 size() const;
 
+    //=========================================================================================================
+    /**
+    * Number of matrices which are ready to be popped.
+    */
+    inline quint32 count() const;
+
     //=========================================================================================================
     /**
     * Rows of the stored matrices of the buffer.
@@ -161,37 +201,70 @@ public:
 
     //=========================================================================================================
     /**
-    * Releases the circular buffer from the acquire statement in the pop() function.
-    * @param [out] bool returns true if resources were freed so that the aquire statement in the pop function can release, otherwise false.
+    * Releases the circular buffer from the wait in the pop() function. A pop which waits for a matrix returns
+    * immediately instead; if matrices are available the next pop returns one of them and the release is dropped.
+    * @param [out] bool returns true if the buffer is empty, i.e. a waiting pop returns right away, otherwise false.
     */
     inline bool releaseFromPop();
 
     //=========================================================================================================
     /**
-    * Releases the circular buffer from the acquire statement in the push() function.
-    * @param [out] bool returns true if resources were freed so that the aquire statement in the push function can release, otherwise false.
+    * Releases the circular buffer from the wait in the push() function. A push which waits for a free slot returns
+    * immediately instead, without adding its matrix; if a slot is free the next push adds its matrix and the
+    * release is dropped.
+    * @param [out] bool returns true if the buffer is full, i.e. a waiting push returns right away, otherwise false.
     */
     inline bool releaseFromPush();
 
 private:
     //=========================================================================================================
     /**
-    * Returns the current circular index to the corresponding given index.
+    * Returns the first element of the slot of the given matrix count.
+    *
+    * @param [in] uiCount   the running matrix count (read or write position).
+    * @return pointer to the slot.
+    */
+    inline _Tp* slot(quint32 uiCount) const;
+
+    //=========================================================================================================
+    /**
+    * Waits until the buffer is no longer empty (bForFree = false) or no longer full (bForFree = true).
+    *
+    * @param [in] bForFree      whether to wait for a free slot instead of a used one.
+    * @param [in] msecTimeout   maximal time to wait, -1 waits forever.
+    * @return true if the condition is met, false on timeout or release.
+    */
+    inline bool wait(bool bForFree, int msecTimeout);
+
+    //=========================================================================================================
+    /**
+    * Drops the matrices pushed before the last clear(); called by the consumer.
+    */
+    inline void applyClear();
+
+    //=========================================================================================================
+    /**
+    * Wakes the other side if it is waiting.
     *
-    * @param [in] index which should be mapped.
-    * @return the mapped index.
+    * @param [in] bWaiter   the waiting flag of the other side.
     */
-    inline unsigned int mapIndex(int& index);
+    inline void wake(QAtomicInt& bWaiter);
 
     unsigned int    m_uiMaxNumMatrices;         /**< Holds the maximal number of matrices.*/
     unsigned int    m_uiRows;                   /**< Holds the number rows.*/
     unsigned int    m_uiCols;                   /**< Holds the number cols.*/
     unsigned int    m_uiMaxNumElements;         /**< Holds the maximal number of buffer elements.*/
     _Tp*            m_pBuffer;                  /**< Holds the circular buffer.*/
-    int             m_iCurrentReadIndex;        /**< Holds the current read index.*/
-    int             m_iCurrentWriteIndex;       /**< Holds the current write index.*/
-    QSemaphore*     m_pFreeElements;            /**< Holds a semaphore which acquires free elements for thread safe writing. A semaphore is a generalization of a mutex.*/
-    QSemaphore*     m_pUsedElements;            /**< Holds a semaphore which acquires written semaphore for thread safe reading.*/
+    QAtomicInt      m_iReadCount;               /**< Number of matrices popped so far (wraps around); written by the consumer only.*/
+    QAtomicInt      m_iWriteCount;              /**< Number of matrices pushed so far (wraps around); written by the producer only.*/
+    QAtomicInt      m_iConsumerWaiting;         /**< Set while the consumer waits for a matrix.*/
+    QAtomicInt      m_iProducerWaiting;         /**< Set while the producer waits for a free slot.*/
+    QAtomicInt      m_iReleasePop;              /**< Set by releaseFromPop, taken or dropped by the next pop.*/
+    QAtomicInt      m_iReleasePush;             /**< Set by releaseFromPush, taken or dropped by the next push.*/
+    QAtomicInt      m_iClearRequest;            /**< Set by clear, taken by the consumer.*/
+    QAtomicInt      m_iClearCount;              /**< Write count at the last clear; the consumer drops the matrices before it.*/
+    QMutex          m_qMutex;                   /**< Only taken to wait and to wake up.*/
+    QWaitCondition  m_qCondition;               /**< Signalled when a waiting side can continue.*/
     bool            m_bPause;
 };
 
@@ -209,10 +282,14 @@ CircularMatrixBuffer<_Tp>::CircularMatrixBuffer(unsigned int uiMaxNumMatrices, u
 , m_uiCols(uiCols)
 , m_uiMaxNumElements(m_uiMaxNumMatrices*m_uiRows*m_uiCols)
 , m_pBuffer(new _Tp[m_uiMaxNumElements])
-, m_iCurrentReadIndex(-1)
-, m_iCurrentWriteIndex(-1)
-, m_pFreeElements(new QSemaphore(m_uiMaxNumElements))
-, m_pUsedElements(new QSemaphore(0))
+, m_iReadCount(0)
+, m_iWriteCount(0)
+, m_iConsumerWaiting(0)
+, m_iProducerWaiting(0)
+, m_iReleasePop(0)
+, m_iReleasePush(0)
+, m_iClearRequest(0)
+, m_iClearCount(0)
 , m_bPause(false)
 {
 
@@ -224,8 +301,6 @@ CircularMatrixBuffer<_Tp>::CircularMatrixBuffer(unsigned int uiMaxNumMatrices, u
 template<typename _Tp>
 CircularMatrixBuffer<_Tp>::~CircularMatrixBuffer()
 {
-    delete m_pFreeElements;
-    delete m_pUsedElements;
     delete [] m_pBuffer;
 }
 
@@ -235,19 +310,33 @@ CircularMatrixBuffer<_Tp>::~CircularMatrixBuffer()
 template<typename _Tp>
 inline void CircularMatrixBuffer<_Tp>::push(const Matrix<_Tp, Dynamic, Dynamic>* pMatrix)
 {
-    if(!m_bPause)
+    push(pMatrix, -1);
+}
+
+
+//*************************************************************************************************************
+
+template<typename _Tp>
+inline bool CircularMatrixBuffer<_Tp>::push(const Matrix<_Tp, Dynamic, Dynamic>* pMatrix, int msecTimeout)
+{
+    if(m_bPause)
+        return true;
+
+    if((unsigned int)pMatrix->size() != m_uiRows*m_uiCols)
     {
-        unsigned int t_size = pMatrix->size();
-        if(t_size == m_uiRows*m_uiCols)
-        {
-            m_pFreeElements->acquire(t_size);
-            for(unsigned int i = 0; i < t_size; ++i)
-                m_pBuffer[mapIndex(m_iCurrentWriteIndex)] = pMatrix->data()[i];
-            m_pUsedElements->release(t_size);
-        }
-    //    else
-    //        printf("Error: Matrix not appended to CircularMatrixBuffer - wrong dimensions\n");
+    //    printf("Error: Matrix not appended to CircularMatrixBuffer - wrong dimensions\n");
+        return false;
     }
+
+    if(!wait(true, msecTimeout))
+        return false;
+
+    quint32 t_uiWrite = (quint32)m_iWriteCount.loadAcquire();
+    memcpy(slot(t_uiWrite), pMatrix->data(), m_uiRows*m_uiCols*sizeof(_Tp));
+    m_iWriteCount.fetchAndStoreOrdered((int)(t_uiWrite + 1));
+
+    wake(m_iConsumerWaiting);
+    return true;
 }
 
 
@@ -257,45 +346,127 @@ template<typename _Tp>
 inline Matrix<_Tp, Dynamic, Dynamic> CircularMatrixBuffer<_Tp>::pop()
 {
     Matrix<_Tp, Dynamic, Dynamic> matrix(m_uiRows, m_uiCols);
+    if(!pop(matrix, -1))
+        matrix.setZero();
+    return matrix;
+}
+
+
+//*************************************************************************************************************
+
+template<typename _Tp>
+inline bool CircularMatrixBuffer<_Tp>::pop(Matrix<_Tp, Dynamic, Dynamic>& matrix, int msecTimeout)
+{
+    if(matrix.rows() != (int)m_uiRows || matrix.cols() != (int)m_uiCols)
+        matrix.resize(m_uiRows, m_uiCols);
 
-    if(!m_bPause)
+    if(m_bPause)
     {
-        m_pUsedElements->acquire(m_uiRows*m_uiCols);
-        for(quint32 i = 0; i < m_uiRows*m_uiCols; ++i)
-            matrix.data()[i] = m_pBuffer[mapIndex(m_iCurrentReadIndex)];
-        m_pFreeElements->release(m_uiRows*m_uiCols);
-    }
-    else
         matrix.setZero();
+        return true;
+    }
 
-    return matrix;
+    applyClear();
+
+    if(!wait(false, msecTimeout))
+        return false;
+
+    quint32 t_uiRead = (quint32)m_iReadCount.loadAcquire();
+    memcpy(matrix.data(), slot(t_uiRead), m_uiRows*m_uiCols*sizeof(_Tp));
+    m_iReadCount.fetchAndStoreOrdered((int)(t_uiRead + 1));
+
+    wake(m_iProducerWaiting);
+    return true;
+}
+
+
+//*************************************************************************************************************
+
+template<typename _Tp>
+inline _Tp* CircularMatrixBuffer<_Tp>::slot(quint32 uiCount) const
+{
+    return m_pBuffer + (uiCount % m_uiMaxNumMatrices)*m_uiRows*m_uiCols;
 }
 
 
 //*************************************************************************************************************
 
 template<typename _Tp>
-inline unsigned int CircularMatrixBuffer<_Tp>::mapIndex(int& index)
+inline bool CircularMatrixBuffer<_Tp>::wait(bool bForFree, int msecTimeout)
 {
-    int AuxIndex;
-    AuxIndex = ++index;
-    return index = AuxIndex % m_uiMaxNumElements;
+    QAtomicInt& t_iWaiting = bForFree ? m_iProducerWaiting : m_iConsumerWaiting;
+    QAtomicInt& t_iRelease = bForFree ? m_iReleasePush : m_iReleasePop;
+
+    QElapsedTimer t_timer;
+    t_timer.start();
+
+    while(bForFree ? count() >= m_uiMaxNumMatrices : count() == 0)
+    {
+        qint64 t_iRemaining = msecTimeout < 0 ? -1 : msecTimeout - t_timer.elapsed();
+        if(t_iRelease.testAndSetOrdered(1, 0) || (msecTimeout >= 0 && t_iRemaining <= 0))
+            return false;
+
+        //
+        // Announce the wait first and check again, the other side and the releasing thread read the flag after
+        // publishing their counter or release
+        //
+        QMutexLocker t_locker(&m_qMutex);
+        t_iWaiting.fetchAndStoreOrdered(1);
+        if((bForFree ? count() >= m_uiMaxNumMatrices : count() == 0) && !t_iRelease.loadAcquire())
+            m_qCondition.wait(&m_qMutex, t_iRemaining < 0 ? ULONG_MAX : (unsigned long)t_iRemaining);
+        t_iWaiting.fetchAndStoreOrdered(0);
+    }
+
+    //
+    // A release only applies to the wait it was issued for - drop it once the side goes on without waiting
+    //
+    if(t_iRelease.loadAcquire())
+        t_iRelease.testAndSetOrdered(1, 0);
 
+    return true;
 }
 
 
 //*************************************************************************************************************
 
 template<typename _Tp>
-void CircularMatrixBuffer<_Tp>::clear()
+inline void CircularMatrixBuffer<_Tp>::wake(QAtomicInt& bWaiter)
+{
+    if(bWaiter.loadAcquire())
+    {
+        QMutexLocker t_locker(&m_qMutex);
+        m_qCondition.wakeAll();
+    }
+}
+
+
+//*************************************************************************************************************
+
+template<typename _Tp>
+inline void CircularMatrixBuffer<_Tp>::applyClear()
 {
-    delete m_pFreeElements;
-    m_pFreeElements = new QSemaphore(m_uiMaxNumElements);
-    delete m_pUsedElements;
-    m_pUsedElements = new QSemaphore(0);
+    if(m_iClearRequest.testAndSetOrdered(1, 0))
+    {
+        quint32 t_uiClear = (quint32)m_iClearCount.loadAcquire();
+        quint32 t_uiRead = (quint32)m_iReadCount.loadAcquire();
 
-    m_iCurrentReadIndex = -1;
-    m_iCurrentWriteIndex = -1;
+        //The counters wrap around - only move forward
+        if((qint32)(t_uiClear - t_uiRead) > 0)
+        {
+            m_iReadCount.fetchAndStoreOrdered((int)t_uiClear);
+            wake(m_iProducerWaiting);
+        }
+    }
+}
+
+
+//*************************************************************************************************************
+
+template<typename _Tp>
+void CircularMatrixBuffer<_Tp>::clear()
+{
+    m_iClearCount.fetchAndStoreOrdered(m_iWriteCount.loadAcquire());
+    m_iClearRequest.fetchAndStoreOrdered(1);
 }
 
 
@@ -308,6 +479,15 @@ inline quint32 CircularMatrixBuffer<_Tp>::size() const
 }
 
 
+//*************************************************************************************************************
+
+template<typename _Tp>
+inline quint32 CircularMatrixBuffer<_Tp>::count() const
+{
+    return (quint32)m_iWriteCount.loadAcquire() - (quint32)m_iReadCount.loadAcquire();
+}
+
+
 //*************************************************************************************************************
 
 template<typename _Tp>
@@ -340,20 +520,10 @@ inline void CircularMatrixBuffer<_Tp>::pause(bool bPause)
 template<typename _Tp>
 inline bool CircularMatrixBuffer<_Tp>::releaseFromPop()
 {
-   if((uint)m_pUsedElements->available() < m_uiRows*m_uiCols)
-    {
-        //The last matrix which is to be popped from the buffer is supposed to be a zero matrix
-        unsigned int t_size = m_uiRows*m_uiCols;
-        for(unsigned int i = 0; i < t_size; ++i)
-            m_pBuffer[mapIndex(m_iCurrentWriteIndex)] = 0;
+    m_iReleasePop.fetchAndStoreOrdered(1);
+    wake(m_iConsumerWaiting);
 
-        //Release (create) values from m_pUsedElements so that the pop function can leave the acquire statement in the pop function
-        m_pUsedElements->release(m_uiRows*m_uiCols);
-
-        return true;
-    }
-
-    return false;
+    return count() == 0;
 }
 
 
@@ -362,20 +532,10 @@ inline bool CircularMatrixBuffer<_Tp>::releaseFromPop()
 template<typename _Tp>
 inline bool CircularMatrixBuffer<_Tp>::releaseFromPush()
 {
-    if((uint)m_pFreeElements->available() < m_uiRows*m_uiCols)
-    {
-        //The last matrix which is to be pushed to the buffer is supposed to be a zero matrix
-        unsigned int t_size = m_uiRows*m_uiCols;
-        for(unsigned int i = 0; i < t_size; ++i)
-            m_pBuffer[mapIndex(m_iCurrentWriteIndex)] = 0;
-
-        //Release (create) values from m_pFreeElements so that the push function can leave the acquire statement in the push function
-        m_pFreeElements->release(m_uiRows*m_uiCols);
-
-        return true;
-    }
+    m_iReleasePush.fetchAndStoreOrdered(1);
+    wake(m_iProducerWaiting);
 
-    return false;
+    return count() >= m_uiMaxNumMatrices;
 }
 
 
@@ -64,11 +64,15 @@ win32 {
 SOURCES += \ 
     circularbuffer.cpp \
     circularmatrixbuffer.cpp \
+    monotonicclock.cpp \
+    sharedmatrixring.cpp \
     observerpattern.cpp \
     buffer.cpp
 
 HEADERS += generics_global.h \
     circularmatrixbuffer.h \
+    monotonicclock.h \
+    sharedmatrixring.h \
     circularbuffer.h \
     observerpattern.h \
     commandpattern.h \
@@ -0,0 +1,93 @@
+//=============================================================================================================
+/**
+* @file     monotonicclock.cpp
+* @author   Christoph Dinh <chdinh@nmr.mgh.harvard.edu>;
+*           Matti Hamalainen <msh@nmr.mgh.harvard.edu>
+* @version  1.0
+* @date     March, 2014
+*
+* @section  LICENSE
+*
+* Copyright (C) 2014, Christoph Dinh and Matti Hamalainen. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+* the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+*       following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+*       the following disclaimer in the documentation and/or other materials provided with the distribution.
+*     * Neither the name of the Massachusetts General Hospital nor the names of its contributors may be used
+*       to endorse or promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MASSACHUSETTS GENERAL HOSPITAL BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*
+*
+* @brief    Implementation of the MonotonicClock Class.
+*
+*/
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include "monotonicclock.h"
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// SYSTEM INCLUDES
+//=============================================================================================================
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#elif defined(Q_OS_MAC)
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace IOBuffer;
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE MEMBER METHODS
+//=============================================================================================================
+
+qint64 MonotonicClock::microseconds()
+{
+#if defined(Q_OS_WIN)
+    LARGE_INTEGER t_frequency, t_counter;
+    QueryPerformanceFrequency(&t_frequency);
+    QueryPerformanceCounter(&t_counter);
+    return (t_counter.QuadPart / t_frequency.QuadPart) * 1000000
+            + (t_counter.QuadPart % t_frequency.QuadPart) * 1000000 / t_frequency.QuadPart;
+#elif defined(Q_OS_MAC)
+    static mach_timebase_info_data_t s_timebase = { 0, 0 };
+    if(s_timebase.denom == 0)
+        mach_timebase_info(&s_timebase);
+    // ticks*numer/denom are nanoseconds; split the multiply so it can't overflow
+    quint64 t_ticks = mach_absolute_time();
+    quint64 t_nsecs = (t_ticks / s_timebase.denom) * s_timebase.numer
+            + (t_ticks % s_timebase.denom) * s_timebase.numer / s_timebase.denom;
+    return (qint64)(t_nsecs / 1000);
+#else
+    struct timespec t_time;
+    clock_gettime(CLOCK_MONOTONIC, &t_time);
+    return (qint64)t_time.tv_sec * 1000000 + t_time.tv_nsec / 1000;
+#endif
+}
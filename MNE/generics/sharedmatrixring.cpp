@@ -0,0 +1,321 @@
+//=============================================================================================================
+/**
+* @file     sharedmatrixring.cpp
+* @author   Christoph Dinh <chdinh@nmr.mgh.harvard.edu>;
+*           Matti Hamalainen <msh@nmr.mgh.harvard.edu>
+* @version  1.0
+* @date     March, 2014
+*
+* @section  LICENSE
+*
+* Copyright (C) 2014, Christoph Dinh and Matti Hamalainen. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+* the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+*       following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+*       the following disclaimer in the documentation and/or other materials provided with the distribution.
+*     * Neither the name of the Massachusetts General Hospital nor the names of its contributors may be used
+*       to endorse or promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MASSACHUSETTS GENERAL HOSPITAL BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*
+*
+* @brief    Implementation of the SharedMatrixRing Class.
+*
+*/
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include "sharedmatrixring.h"
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// QT INCLUDES
+//=============================================================================================================
+
+#include <QAtomicInt>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// STL INCLUDES
+//=============================================================================================================
+
+#include <climits>
+#include <cstdio>
+#include <cstring>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace IOBuffer;
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// STATIC DEFINITIONS
+//=============================================================================================================
+
+namespace
+{
+const qint32 s_iMagic       = 0x4d525352;   /**< "MRSR" */
+const qint32 s_iVersion     = 1;
+const qint32 s_iAlignment   = 64;           /**< Slots start on cache line boundaries. */
+
+inline qint64 alignUp(qint64 p_iSize)
+{
+    return (p_iSize + s_iAlignment - 1) / s_iAlignment * s_iAlignment;
+}
+}
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// SHARED MEMORY LAYOUT
+//=============================================================================================================
+
+/**
+* Header at the beginning of the segment; it is followed by the slots at offset alignUp(sizeof(Header)).
+*/
+struct SharedMatrixRing::Header
+{
+    qint32      magic;
+    qint32      version;
+    qint32      numSlots;
+    qint32      capacity;
+    qint32      slotSize;
+    QAtomicInt  latestSeq;
+};
+
+
+/**
+* Header of a slot, it is followed by capacity floats holding the matrix column major.
+*/
+struct SharedMatrixRing::Slot
+{
+    QAtomicInt  seq;        /**< Sequence number of the held matrix, 0 while the slot is written. */
+    qint32      rows;
+    qint32      cols;
+    qint32      reserved;
+
+    inline float* data()
+    {
+        return reinterpret_cast<float*>(this + 1);
+    }
+};
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE MEMBER METHODS
+//=============================================================================================================
+
+SharedMatrixRing::SharedMatrixRing()
+: m_pHeader(NULL)
+, m_iSlots(0)
+, m_iCapacity(0)
+, m_iSlotSize(0)
+, m_iNextSeq(0)
+{
+}
+
+
+//*************************************************************************************************************
+
+SharedMatrixRing::~SharedMatrixRing()
+{
+    detach();
+}
+
+
+//*************************************************************************************************************
+
+bool SharedMatrixRing::create(const QString& p_sKey, qint32 p_iSlots, qint32 p_iCapacity)
+{
+    detach();
+
+    if(p_iSlots < 2 || p_iCapacity < 1)
+        return false;
+
+    qint64 t_iSlotSize = alignUp(sizeof(Slot) + (qint64)p_iCapacity*sizeof(float));
+    qint64 t_iSize = alignUp(sizeof(Header)) + p_iSlots*t_iSlotSize;
+    if(t_iSlotSize > INT_MAX || t_iSize > INT_MAX)
+    {
+        printf("SharedMatrixRing: %d slots of %d elements do not fit into a shared memory segment.\n", p_iSlots, p_iCapacity);
+        return false;
+    }
+
+    m_sharedMemory.setKey(p_sKey);
+    if(!m_sharedMemory.create((int)t_iSize))
+    {
+        // A segment left over by a crashed writer is removed once the last process detaches from it
+        if(m_sharedMemory.error() == QSharedMemory::AlreadyExists && m_sharedMemory.attach())
+            m_sharedMemory.detach();
+        if(!m_sharedMemory.create((int)t_iSize))
+        {
+            printf("SharedMatrixRing: Could not create %s (%s).\n", p_sKey.toUtf8().constData(), m_sharedMemory.errorString().toUtf8().constData());
+            return false;
+        }
+    }
+
+    memset(m_sharedMemory.data(), 0, (size_t)t_iSize);
+
+    m_pHeader = static_cast<Header*>(m_sharedMemory.data());
+    m_pHeader->magic = s_iMagic;
+    m_pHeader->version = s_iVersion;
+    m_pHeader->numSlots = p_iSlots;
+    m_pHeader->capacity = p_iCapacity;
+    m_pHeader->slotSize = (qint32)t_iSlotSize;
+    m_pHeader->latestSeq.storeRelease(0);
+
+    m_iSlots = p_iSlots;
+    m_iCapacity = p_iCapacity;
+    m_iSlotSize = (qint32)t_iSlotSize;
+    m_iNextSeq = 1;
+
+    return true;
+}
+
+
+//*************************************************************************************************************
+
+bool SharedMatrixRing::attach(const QString& p_sKey)
+{
+    detach();
+
+    m_sharedMemory.setKey(p_sKey);
+    // Read write, since isValid uses an atomic read-modify-write as full barrier
+    if(!m_sharedMemory.attach(QSharedMemory::ReadWrite))
+    {
+        printf("SharedMatrixRing: Could not attach to %s (%s).\n", p_sKey.toUtf8().constData(), m_sharedMemory.errorString().toUtf8().constData());
+        return false;
+    }
+
+    const Header* t_pHeader = static_cast<const Header*>(m_sharedMemory.constData());
+    if(m_sharedMemory.size() < (int)sizeof(Header) || t_pHeader->magic != s_iMagic || t_pHeader->version != s_iVersion
+            || t_pHeader->numSlots < 2 || t_pHeader->capacity < 1
+            || t_pHeader->slotSize < alignUp(sizeof(Slot) + (qint64)t_pHeader->capacity*sizeof(float))
+            || m_sharedMemory.size() < alignUp(sizeof(Header)) + (qint64)t_pHeader->numSlots*t_pHeader->slotSize)
+    {
+        printf("SharedMatrixRing: %s is not a matrix ring.\n", p_sKey.toUtf8().constData());
+        m_sharedMemory.detach();
+        return false;
+    }
+
+    m_pHeader = static_cast<Header*>(m_sharedMemory.data());
+    m_iSlots = t_pHeader->numSlots;
+    m_iCapacity = t_pHeader->capacity;
+    m_iSlotSize = t_pHeader->slotSize;
+    m_iNextSeq = 0;
+
+    return true;
+}
+
+
+//*************************************************************************************************************
+
+void SharedMatrixRing::detach()
+{
+    if(m_sharedMemory.isAttached())
+        m_sharedMemory.detach();
+
+    m_pHeader = NULL;
+    m_iSlots = 0;
+    m_iCapacity = 0;
+    m_iSlotSize = 0;
+    m_iNextSeq = 0;
+}
+
+
+//*************************************************************************************************************
+
+quint32 SharedMatrixRing::publish(const MatrixXf& p_matData)
+{
+    if(!m_pHeader || m_iNextSeq == 0 || p_matData.size() > m_iCapacity)
+        return 0;
+
+    quint32 t_iSeq = m_iNextSeq;
+    Slot* t_pSlot = slot(t_iSeq);
+
+    // Invalidate the slot before touching its content; the ordered exchange keeps the copy behind it
+    t_pSlot->seq.fetchAndStoreOrdered(0);
+    t_pSlot->rows = (qint32)p_matData.rows();
+    t_pSlot->cols = (qint32)p_matData.cols();
+    if(p_matData.size() > 0)
+        memcpy(t_pSlot->data(), p_matData.data(), p_matData.size()*sizeof(float));
+    t_pSlot->seq.storeRelease((int)t_iSeq);
+
+    m_pHeader->latestSeq.storeRelease((int)t_iSeq);
+
+    // 0 marks a slot in progress, skip it on wrap around
+    if(++m_iNextSeq == 0)
+        m_iNextSeq = 1;
+
+    return t_iSeq;
+}
+
+
+//*************************************************************************************************************
+
+Map<const MatrixXf> SharedMatrixRing::view(quint32 p_iSeq) const
+{
+    if(m_pHeader && p_iSeq != 0)
+    {
+        Slot* t_pSlot = slot(p_iSeq);
+        if((quint32)t_pSlot->seq.loadAcquire() == p_iSeq)
+        {
+            qint32 t_iRows = t_pSlot->rows;
+            qint32 t_iCols = t_pSlot->cols;
+            // The size may be torn by a concurrent overwrite, which isValid reports; just never map beyond the slot
+            if(t_iRows >= 0 && t_iCols >= 0 && (qint64)t_iRows*t_iCols <= m_iCapacity)
+                return Map<const MatrixXf>(t_pSlot->data(), t_iRows, t_iCols);
+        }
+    }
+
+    return Map<const MatrixXf>(NULL, 0, 0);
+}
+
+
+//*************************************************************************************************************
+
+bool SharedMatrixRing::isValid(quint32 p_iSeq) const
+{
+    if(!m_pHeader || p_iSeq == 0)
+        return false;
+
+    // Ordered compare and swap of the value with itself: a full barrier, the reads of the view stay in front of it
+    return slot(p_iSeq)->seq.testAndSetOrdered((int)p_iSeq, (int)p_iSeq);
+}
+
+
+//*************************************************************************************************************
+
+quint32 SharedMatrixRing::latestSeq() const
+{
+    return m_pHeader ? (quint32)m_pHeader->latestSeq.loadAcquire() : 0;
+}
+
+
+//*************************************************************************************************************
+
+SharedMatrixRing::Slot* SharedMatrixRing::slot(quint32 p_iSeq) const
+{
+    char* t_pSlots = reinterpret_cast<char*>(m_pHeader) + alignUp(sizeof(Header));
+    return reinterpret_cast<Slot*>(t_pSlots + (qint64)(p_iSeq % (quint32)m_iSlots)*m_iSlotSize);
+}
@@ -0,0 +1,245 @@
+//=============================================================================================================
+/**
+* @file     sharedmatrixring.h
+* @author   Christoph Dinh <chdinh@nmr.mgh.harvard.edu>;
+*           Matti Hamalainen <msh@nmr.mgh.harvard.edu>
+* @version  1.0
+* @date     March, 2014
+*
+* @section  LICENSE
+*
+* Copyright (C) 2014, Christoph Dinh and Matti Hamalainen. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+* the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+*       following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+*       the following disclaimer in the documentation and/or other materials provided with the distribution.
+*     * Neither the name of the Massachusetts General Hospital nor the names of its contributors may be used
+*       to endorse or promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MASSACHUSETTS GENERAL HOSPITAL BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*
+*
+* @brief    SharedMatrixRing class declaration.
+*
+*/
+
+#ifndef SHAREDMATRIXRING_H
+#define SHAREDMATRIXRING_H
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include "generics_global.h"
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Eigen INCLUDES
+//=============================================================================================================
+
+#include <Eigen/Core>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// QT INCLUDES
+//=============================================================================================================
+
+#include <QSharedMemory>
+#include <QString>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE NAMESPACE IOBuffer
+//=============================================================================================================
+
+namespace IOBuffer
+{
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace Eigen;
+
+
+//=============================================================================================================
+/**
+* Shared matrix ring is a single writer / multi reader ring of float matrices placed in a named shared memory
+* segment, so processes on the same host can exchange buffers without copying them through a socket. Every
+* published matrix gets a sequence number (never 0) and is written into slot seq % slots. A slot carries the
+* sequence number of the matrix it holds, and 0 while it is being overwritten. Readers never block the writer: they
+* map a slot in place and check afterwards with isValid whether it was recycled in the meantime, so a reader which
+* falls more than slots - 1 buffers behind loses buffers instead of slowing down the writer.
+*
+* The ring does not notify readers, the sequence numbers are expected to be announced through another channel.
+*
+* @brief Shared memory ring of float matrices
+*/
+class GENERICSSHARED_EXPORT SharedMatrixRing
+{
+public:
+    //=========================================================================================================
+    /**
+    * Constructs a SharedMatrixRing which is neither created nor attached.
+    */
+    SharedMatrixRing();
+
+    //=========================================================================================================
+    /**
+    * Destroys the SharedMatrixRing and detaches from the shared memory segment.
+    */
+    ~SharedMatrixRing();
+
+    //=========================================================================================================
+    /**
+    * Creates the shared memory segment as writer. A previously created or attached segment is detached first.
+    *
+    * @param[in] p_sKey         Platform independent key of the segment.
+    * @param[in] p_iSlots       Number of slots, i.e. how many buffers a reader may lag behind.
+    * @param[in] p_iCapacity    Maximal number of elements (rows*cols) of a published matrix.
+    *
+    * @return true if the segment was created, false otherwise.
+    */
+    bool create(const QString& p_sKey, qint32 p_iSlots, qint32 p_iCapacity);
+
+    //=========================================================================================================
+    /**
+    * Attaches to an existing segment as reader. A previously created or attached segment is detached first.
+    *
+    * @param[in] p_sKey     Platform independent key of the segment.
+    *
+    * @return true if the segment was attached and its layout is valid, false otherwise.
+    */
+    bool attach(const QString& p_sKey);
+
+    //=========================================================================================================
+    /**
+    * Detaches from the shared memory segment.
+    */
+    void detach();
+
+    //=========================================================================================================
+    /**
+    * Copies a matrix into the next slot. Only the process which created the ring may publish.
+    *
+    * @param[in] p_matData  Matrix to publish, its size has to fit the capacity of the ring.
+    *
+    * @return the sequence number of the published matrix, 0 if it could not be published.
+    */
+    quint32 publish(const MatrixXf& p_matData);
+
+    //=========================================================================================================
+    /**
+    * Maps the matrix with the given sequence number in place. The view stays readable, but its content may be
+    * overwritten once the writer recycles the slot; check isValid after using it.
+    *
+    * @param[in] p_iSeq     Sequence number of the matrix.
+    *
+    * @return a view of the matrix, an empty view if the matrix is not in the ring anymore.
+    */
+    Map<const MatrixXf> view(quint32 p_iSeq) const;
+
+    //=========================================================================================================
+    /**
+    * Returns whether the slot of the given sequence number still holds it, i.e. whether what was read from a view
+    * of it is consistent.
+    *
+    * @param[in] p_iSeq     Sequence number of the matrix.
+    *
+    * @return true if the matrix was not overwritten.
+    */
+    bool isValid(quint32 p_iSeq) const;
+
+    //=========================================================================================================
+    /**
+    * Returns the sequence number of the latest published matrix, 0 if nothing was published yet.
+    *
+    * @return the latest sequence number.
+    */
+    quint32 latestSeq() const;
+
+    //=========================================================================================================
+    /**
+    * Returns whether the ring is created or attached.
+    *
+    * @return true if a segment is mapped.
+    */
+    inline bool isAttached() const;
+
+    //=========================================================================================================
+    /**
+    * Returns the key of the mapped segment.
+    *
+    * @return the key, empty if no segment is mapped.
+    */
+    inline QString key() const;
+
+    //=========================================================================================================
+    /**
+    * Returns the maximal number of elements of a matrix published into the ring.
+    *
+    * @return the slot capacity, 0 if no segment is mapped.
+    */
+    inline qint32 capacity() const;
+
+private:
+    struct Header;
+    struct Slot;
+
+    Slot* slot(quint32 p_iSeq) const;
+
+    QSharedMemory   m_sharedMemory;     /**< The mapped segment. */
+    Header*         m_pHeader;          /**< Header at the beginning of the segment, NULL if nothing is mapped. */
+    qint32          m_iSlots;           /**< Number of slots of the mapped segment. */
+    qint32          m_iCapacity;        /**< Maximal number of elements per slot of the mapped segment. */
+    qint32          m_iSlotSize;        /**< Size of a slot in bytes, including its header. */
+    quint32         m_iNextSeq;         /**< Sequence number of the next published matrix (writer only). */
+};
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INLINE DEFINITIONS
+//=============================================================================================================
+
+inline bool SharedMatrixRing::isAttached() const
+{
+    return m_pHeader != NULL;
+}
+
+
+//*************************************************************************************************************
+
+inline QString SharedMatrixRing::key() const
+{
+    return m_pHeader ? m_sharedMemory.key() : QString();
+}
+
+
+//*************************************************************************************************************
+
+inline qint32 SharedMatrixRing::capacity() const
+{
+    return m_pHeader ? m_iCapacity : 0;
+}
+
+} // NAMESPACE
+
+#endif // SHAREDMATRIXRING_H
@@ -92,6 +92,7 @@ SOURCES += \
     minimumNorm/minimumnorm.cpp \
     rapMusic/rapmusic.cpp \
     rapMusic/pwlrapmusic.cpp \
+    rapMusic/subspacetracker.cpp \
     rapMusic/dipole.cpp
 
 HEADERS +=\
@@ -100,6 +101,7 @@ HEADERS +=\
     minimumNorm/minimumnorm.h \
     rapMusic/rapmusic.h \
     rapMusic/pwlrapmusic.h \
+    rapMusic/subspacetracker.h \
     rapMusic/dipole.h
 
 INCLUDEPATH += $${EIGEN_INCLUDE_DIR}
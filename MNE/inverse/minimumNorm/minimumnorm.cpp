@@ -70,6 +70,9 @@ using namespace INVERSELIB;
 MinimumNorm::MinimumNorm(const MNEInverseOperator &p_inverseOperator, float lambda, const QString method)
 : m_inverseOperator(p_inverseOperator)
 , inverseSetup(false)
+, m_bCombineXyz(false)
+, m_bSinglePrecision(false)
+, m_iFactoredSamples(0)
 {
     this->setRegularization(lambda);
     this->setMethod(method);
@@ -80,6 +83,9 @@ MinimumNorm::MinimumNorm(const MNEInverseOperator &p_inverseOperator, float lamb
 MinimumNorm::MinimumNorm(const MNEInverseOperator &p_inverseOperator, float lambda, bool dSPM, bool sLORETA)
 : m_inverseOperator(p_inverseOperator)
 , inverseSetup(false)
+, m_bCombineXyz(false)
+, m_bSinglePrecision(false)
+, m_iFactoredSamples(0)
 {
     this->setRegularization(lambda);
     this->setMethod(dSPM, sLORETA);
@@ -102,6 +108,8 @@ MNESourceEstimate MinimumNorm::calculateInverse(const FiffEvoked &p_fiffEvoked,
     }
 
     doInverseSetup(nave,pick_normal);
+    if(!inverseSetup)
+        return MNESourceEstimate();
 
     //
     //   Pick the correct channels from the data
@@ -186,51 +194,218 @@ MNESourceEstimate MinimumNorm::calculateInverse(const FiffEvoked &p_fiffEvoked,
 //*************************************************************************************************************
 
 MNESourceEstimate MinimumNorm::calculateInverse(const MatrixXd &data, float tmin, float tstep) const
+{
+    MNESourceEstimate sourceEstimate;
+
+    if(!applyInverse(data, tmin, tstep, sourceEstimate))
+        return MNESourceEstimate();
+
+    return sourceEstimate;
+}
+
+
+//*************************************************************************************************************
+
+bool MinimumNorm::applyInverse(const MatrixXd &data, float tmin, float tstep, MNESourceEstimate &p_sourceEstimate) const
 {
     if(!inverseSetup)
     {
         qWarning("Inverse not setup -> call doInverseSetup first!");
-        return MNESourceEstimate();
+        return false;
+    }
+
+    if(data.rows() != m_matKernelB.cols())
+    {
+        qWarning("Data has %d rows, the imaging kernel expects %d channels!", (int)data.rows(), (int)m_matKernelB.cols());
+        return false;
     }
 
-    MatrixXd sol = K * data; //apply imaging kernel
+    prepareSourceEstimate(data.cols(), tmin, tstep, p_sourceEstimate);
 
-    if (inv.source_ori == FIFFV_MNE_FREE_ORI)
+    if(m_bSinglePrecision)
     {
-        printf("combining the current components...");
-        MatrixXd sol1(sol.rows()/3,sol.cols());
-        for(qint32 i = 0; i < sol.cols(); ++i)
-        {
-            VectorXd* tmp = MNEMath::combine_xyz(sol.block(0,i,sol.rows(),1));
-            sol1.block(0,i,sol.rows()/3,1) = tmp->cwiseSqrt();
-            delete tmp;
-        }
-        sol.resize(sol1.rows(),sol1.cols());
-        sol = sol1;
+        m_matDataF = data.cast<float>();
+        computeSolution(m_matDataF, p_sourceEstimate.data);
     }
+    else
+        computeSolution(data, p_sourceEstimate.data);
+
+    return true;
+}
+
+
+//*************************************************************************************************************
 
-    if (m_bdSPM)
+bool MinimumNorm::applyInverse(const MatrixXf &data, float tmin, float tstep, MNESourceEstimate &p_sourceEstimate) const
+{
+    if(!inverseSetup)
     {
-        printf("(dSPM)...");
-        sol = inv.noisenorm*sol;
+        qWarning("Inverse not setup -> call doInverseSetup first!");
+        return false;
     }
-    else if (m_bsLORETA)
+
+    if(data.rows() != m_matKernelB.cols())
     {
-        printf("(sLORETA)...");
-        sol = inv.noisenorm*sol;
+        qWarning("Data has %d rows, the imaging kernel expects %d channels!", (int)data.rows(), (int)m_matKernelB.cols());
+        return false;
     }
-    printf("[done]\n");
 
-    //Results
-    VectorXi p_vecVertices(inv.src[0].vertno.size() + inv.src[1].vertno.size());
-    p_vecVertices << inv.src[0].vertno, inv.src[1].vertno;
+    prepareSourceEstimate(data.cols(), tmin, tstep, p_sourceEstimate);
 
-//    VectorXi p_vecVertices();
-//    for(qint32 h = 0; h < inv.src.size(); ++h)
-//        t_qListVertices.push_back(inv.src[h].vertno);
+    if(m_bSinglePrecision)
+        computeSolution(data, p_sourceEstimate.data);
+    else
+    {
+        m_matDataD = data.cast<double>();
+        computeSolution(m_matDataD, p_sourceEstimate.data);
+    }
+
+    return true;
+}
+
+
+//*************************************************************************************************************
+
+void MinimumNorm::computeSolution(const MatrixXd &p_matData, MatrixXd &p_matSol) const
+{
+    if(usesFactoredKernel(p_matData.cols()))
+    {
+        m_matProjD.noalias() = m_matKernelB * p_matData;
+        applyKernel(m_matKernelA, m_matProjD, m_matBlockD, p_matSol);
+        m_iFactoredSamples += p_matData.cols();
+    }
+    else
+    {
+        if(K.size() == 0)
+            K = m_matKernelA * m_matKernelB;
+        applyKernel(K, p_matData, m_matBlockD, p_matSol);
+    }
+}
+
+
+//*************************************************************************************************************
+
+void MinimumNorm::computeSolution(const MatrixXf &p_matData, MatrixXd &p_matSol) const
+{
+    if(usesFactoredKernel(p_matData.cols()))
+    {
+        m_matProjF.noalias() = m_matKernelBF * p_matData;
+        applyKernel(m_matKernelAF, m_matProjF, m_matBlockF, p_matSol);
+        m_iFactoredSamples += p_matData.cols();
+    }
+    else
+    {
+        if(m_matKernelF.size() == 0)
+            m_matKernelF = (m_matKernelA * m_matKernelB).cast<float>();
+        applyKernel(m_matKernelF, p_matData, m_matBlockF, p_matSol);
+    }
+}
+
+
+//*************************************************************************************************************
+
+void MinimumNorm::prepareSourceEstimate(qint32 p_iNumSamples, float tmin, float tstep, MNESourceEstimate &p_sourceEstimate) const
+{
+    qint32 nSources = m_bCombineXyz ? m_matKernelA.rows()/3 : m_matKernelA.rows();
+    if(p_sourceEstimate.data.rows() != nSources || p_sourceEstimate.data.cols() != p_iNumSamples)
+        p_sourceEstimate.data.resize(nSources, p_iNumSamples);
+
+    if(p_sourceEstimate.vertices.size() != m_vecVertices.size())
+        p_sourceEstimate.vertices = m_vecVertices;
+
+    if(p_sourceEstimate.times.size() != p_iNumSamples || p_sourceEstimate.tmin != tmin || p_sourceEstimate.tstep != tstep)
+    {
+        p_sourceEstimate.tmin = tmin;
+        p_sourceEstimate.tstep = tstep;
+        p_sourceEstimate.update_times();
+    }
+}
+
+
+//*************************************************************************************************************
+
+bool MinimumNorm::usesFactoredKernel(qint32 p_iNumSamples) const
+{
+    double nRows = m_matKernelA.rows();
+    double nRank = m_matKernelB.rows();
+    double nChannels = m_matKernelB.cols();
+
+    double costFactored = nRank * (nChannels + nRows);
+    double costDense = nRows * nChannels;
+
+    if(costFactored <= costDense)
+        return true;
+
+    bool bDenseAssembled = m_bSinglePrecision ? m_matKernelF.size() > 0 : K.size() > 0;
+    if(bDenseAssembled)
+        return false;
+
+    //
+    // Assembling the dense kernel is paid once: keep the factors until the extra cost they caused over all
+    // buffers, including this one, would pay for the assembly
+    //
+    double costAssembly = nRows * nRank * nChannels;
+    return (double)(m_iFactoredSamples + p_iNumSamples) * (costFactored - costDense) < costAssembly;
+}
+
+
+//*************************************************************************************************************
+
+template<typename T>
+void MinimumNorm::applyKernel(const Matrix<T,Dynamic,Dynamic> &p_matKernel, const Matrix<T,Dynamic,Dynamic> &p_matData, Matrix<T,Dynamic,Dynamic> &p_matBlock, MatrixXd &p_matSol) const
+{
+    const qint32 nComp = m_bCombineXyz ? 3 : 1;
+    const qint32 nSources = p_matSol.rows();
+    const qint32 nSamples = p_matData.cols();
+    const bool bNoiseNorm = m_vecNoiseNorm.size() == nSources;
+
+    if(nSources == 0 || nSamples == 0)
+        return;
+
+    //
+    // Number of sources per block, such that the block product stays in cache
+    //
+    qint32 nBlockSources = MN_APPLY_BLOCK_BYTES / (nComp * nSamples * (qint32)sizeof(T));
+    if(nBlockSources < 1)
+        nBlockSources = 1;
+    if(nBlockSources > nSources)
+        nBlockSources = nSources;
+
+    if(p_matBlock.rows() != nBlockSources*nComp || p_matBlock.cols() != nSamples)
+        p_matBlock.resize(nBlockSources*nComp, nSamples);
 
-    return MNESourceEstimate(sol, p_vecVertices, tmin, tstep);
+    for(qint32 s0 = 0; s0 < nSources; s0 += nBlockSources)
+    {
+        qint32 nb = (s0 + nBlockSources <= nSources) ? nBlockSources : nSources - s0;
+
+        p_matBlock.topRows(nb*nComp).noalias() = p_matKernel.middleRows(s0*nComp, nb*nComp) * p_matData;
 
+        for(qint32 c = 0; c < nSamples; ++c)
+        {
+            const T* pBlock = p_matBlock.data() + c*p_matBlock.rows();
+            double* pSol = p_matSol.data() + c*nSources + s0;
+
+            if(m_bCombineXyz)
+            {
+                for(qint32 i = 0; i < nb; ++i)
+                {
+                    double x = pBlock[3*i];
+                    double y = pBlock[3*i+1];
+                    double z = pBlock[3*i+2];
+                    pSol[i] = sqrt(x*x + y*y + z*z);
+                }
+            }
+            else
+            {
+                for(qint32 i = 0; i < nb; ++i)
+                    pSol[i] = pBlock[i];
+            }
+
+            if(bNoiseNorm)
+                for(qint32 i = 0; i < nb; ++i)
+                    pSol[i] *= m_vecNoiseNorm[s0+i];
+        }
+    }
 }
 
 
@@ -238,13 +413,55 @@ MNESourceEstimate MinimumNorm::calculateInverse(const MatrixXd &data, float tmin
 
 void MinimumNorm::doInverseSetup(qint32 nave, bool pick_normal)
 {
+    inverseSetup = false;
+
     //
     //   Set up the inverse according to the parameters
     //
     inv = m_inverseOperator.prepare_inverse_operator(nave, m_fLambda, m_bdSPM, m_bsLORETA);
 
     printf("Computing inverse...");
-    inv.assemble_kernel(label, m_sMethod, pick_normal, K, noise_norm, vertno);
+    K = MatrixXd();
+    m_iFactoredSamples = 0;
+    if(!inv.assemble_kernel_factors(label, m_sMethod, pick_normal, m_matKernelA, m_matKernelB, noise_norm, vertno))
+    {
+        printf("[failed]\n");
+        qWarning("Imaging kernel could not be assembled!");
+        return;
+    }
+
+    //
+    //   Precompute what the kernel application needs: the free orientation components are combined unless
+    //   only the normal component was picked, the noise normalization is diagonal
+    //
+    m_bCombineXyz = inv.source_ori == FIFFV_MNE_FREE_ORI && !pick_normal;
+
+    qint32 nSources = m_bCombineXyz ? m_matKernelA.rows()/3 : m_matKernelA.rows();
+    m_vecNoiseNorm = VectorXd();
+    if(m_bdSPM || m_bsLORETA)
+    {
+        if(noise_norm.rows() != nSources)
+        {
+            printf("[failed]\n");
+            qWarning("Noise normalization has %d rows, the imaging kernel has %d sources - %s not applicable!", (int)noise_norm.rows(), nSources, m_bdSPM ? "dSPM" : "sLORETA");
+            return;
+        }
+
+        m_vecNoiseNorm = VectorXd::Ones(nSources);
+        for (qint32 k = 0; k < noise_norm.outerSize(); ++k)
+            for (SparseMatrix<double>::InnerIterator it(noise_norm,k); it; ++it)
+                if(it.row() == it.col())
+                    m_vecNoiseNorm[it.row()] = it.value();
+    }
+
+    m_vecVertices = VectorXi(inv.src[0].vertno.size() + inv.src[1].vertno.size());
+    m_vecVertices << inv.src[0].vertno, inv.src[1].vertno;
+
+    m_matKernelF = MatrixXf();
+    m_matKernelAF = m_bSinglePrecision ? MatrixXf(m_matKernelA.cast<float>()) : MatrixXf();
+    m_matKernelBF = m_bSinglePrecision ? MatrixXf(m_matKernelB.cast<float>()) : MatrixXf();
+
+    printf("[done]\n");
 
     inverseSetup = true;
 }
@@ -317,3 +534,19 @@ void MinimumNorm::setRegularization(float lambda)
 {
     m_fLambda = lambda;
 }
+
+
+//*************************************************************************************************************
+
+void MinimumNorm::setSinglePrecision(bool p_bSinglePrecision)
+{
+    m_bSinglePrecision = p_bSinglePrecision;
+
+    if(inverseSetup)
+    {
+        m_iFactoredSamples = 0;
+        m_matKernelF = MatrixXf();
+        m_matKernelAF = m_bSinglePrecision ? MatrixXf(m_matKernelA.cast<float>()) : MatrixXf();
+        m_matKernelBF = m_bSinglePrecision ? MatrixXf(m_matKernelB.cast<float>()) : MatrixXf();
+    }
+}
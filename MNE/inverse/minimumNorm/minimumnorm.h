@@ -50,6 +50,14 @@
 #include <QSharedPointer>
 
 
+//*************************************************************************************************************
+//=============================================================================================================
+// Eigen INCLUDES
+//=============================================================================================================
+
+#include <Eigen/Core>
+
+
 //*************************************************************************************************************
 //=============================================================================================================
 // DEFINE NAMESPACE INVERSELIB
@@ -71,6 +79,15 @@ namespace INVERSELIB
 
 using namespace MNELIB;
 using namespace FSLIB;
+using namespace Eigen;
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINES
+//=============================================================================================================
+
+#define MN_APPLY_BLOCK_BYTES    262144  /**< Defines the size of the kernel row blocks which are applied and combined together */
 
 
 //=============================================================================================================
@@ -127,6 +144,48 @@ public:
 
     virtual MNESourceEstimate calculateInverse(const MatrixXd &data, float tmin, float tstep) const;
 
+    //=========================================================================================================
+    /**
+    * Applies the imaging kernel prepared by doInverseSetup to the data. The kernel multiplication, the
+    * combination of the free orientation components and the noise normalization are done in a single pass
+    * over blocks of sources. The source estimate is reused and only reallocated when its dimensions change,
+    * which makes this the method of choice for continuous real-time estimation. Depending on the number of
+    * samples and the rank of the inverse operator, either the dense kernel or its factors are applied (see
+    * usesFactoredKernel). Uses internal scratch buffers, calls on the same object must not be made
+    * concurrently.
+    *
+    * @param[in] data               Data matrix (channels x samples), picked to the inverse operator channels.
+    * @param[in] tmin               Time of the first sample.
+    * @param[in] tstep              Time between two samples.
+    * @param[out] p_sourceEstimate  The source estimate which is filled with the solution.
+    *
+    * @return true if successful, false otherwise
+    */
+    bool applyInverse(const MatrixXd &data, float tmin, float tstep, MNESourceEstimate &p_sourceEstimate) const;
+
+    //=========================================================================================================
+    /**
+    * Single precision data variant of applyInverse.
+    *
+    * @param[in] data               Data matrix (channels x samples), picked to the inverse operator channels.
+    * @param[in] tmin               Time of the first sample.
+    * @param[in] tstep              Time between two samples.
+    * @param[out] p_sourceEstimate  The source estimate which is filled with the solution.
+    *
+    * @return true if successful, false otherwise
+    */
+    bool applyInverse(const MatrixXf &data, float tmin, float tstep, MNESourceEstimate &p_sourceEstimate) const;
+
+    //=========================================================================================================
+    /**
+    * Prepares the inverse operator and its imaging kernel for the given number of averages. If the kernel
+    * can't be assembled, or the noise normalization required by dSPM or sLORETA doesn't match its sources, a
+    * warning is issued and the inverse stays not set up, i.e. applyInverse fails.
+    *
+    * @param[in] nave           Number of averages.
+    * @param[in] pick_normal    If True, rather than pooling the orientations by taking the norm, only the radial
+    *                           component is kept. This is only applied when working with loose orientations.
+    */
     virtual void doInverseSetup(qint32 nave, bool pick_normal = false);
 
 
@@ -159,7 +218,72 @@ public:
     */
     void setRegularization(float lambda);
 
+    //=========================================================================================================
+    /**
+    * Apply the imaging kernel in single precision. The combination and the noise normalization are still
+    * accumulated in double precision.
+    *
+    * @param[in] p_bSinglePrecision   Whether a single precision kernel should be used.
+    */
+    void setSinglePrecision(bool p_bSinglePrecision);
+
+    //=========================================================================================================
+    /**
+    * Returns whether applyInverse applies the kernel in its factored form K = A*B to the next data of the given
+    * number of samples. The factored form costs rank x (channels + sources) per sample, the dense form channels x
+    * sources per sample plus the one-time assembly of K. If the dense form is cheaper per sample, the factors are
+    * applied only until the extra cost they caused over all data applied since the setup would pay for the
+    * assembly; from then on K is assembled and used. This way small real-time buffers end up with K as well.
+    *
+    * @param[in] p_iNumSamples  Number of samples of the data to apply the kernel to.
+    *
+    * @return true if the factored kernel is applied, false if the dense kernel is applied
+    */
+    bool usesFactoredKernel(qint32 p_iNumSamples) const;
+
 private:
+    //=========================================================================================================
+    /**
+    * Multiplies the kernel blockwise with the data and combines and normalizes each block while it is
+    * still in cache.
+    *
+    * @param[in] p_matKernel    The imaging kernel.
+    * @param[in] p_matData      The data matrix.
+    * @param[in] p_matBlock     Scratch buffer for the block products.
+    * @param[out] p_matSol      The solution, has to be sized to (number of sources x number of samples).
+    */
+    template<typename T>
+    void applyKernel(const Matrix<T,Dynamic,Dynamic> &p_matKernel, const Matrix<T,Dynamic,Dynamic> &p_matData, Matrix<T,Dynamic,Dynamic> &p_matBlock, MatrixXd &p_matSol) const;
+
+    //=========================================================================================================
+    /**
+    * Computes the solution for double precision data with the dense or the factored kernel.
+    *
+    * @param[in] p_matData      The data matrix.
+    * @param[out] p_matSol      The solution, has to be sized to (number of sources x number of samples).
+    */
+    void computeSolution(const MatrixXd &p_matData, MatrixXd &p_matSol) const;
+
+    //=========================================================================================================
+    /**
+    * Computes the solution for single precision data with the dense or the factored single precision kernel.
+    *
+    * @param[in] p_matData      The data matrix.
+    * @param[out] p_matSol      The solution, has to be sized to (number of sources x number of samples).
+    */
+    void computeSolution(const MatrixXf &p_matData, MatrixXd &p_matSol) const;
+
+    //=========================================================================================================
+    /**
+    * Sizes the source estimate to the solution dimensions and updates its vertices and times.
+    *
+    * @param[in] p_iNumSamples      Number of samples.
+    * @param[in] tmin               Time of the first sample.
+    * @param[in] tstep              Time between two samples.
+    * @param[out] p_sourceEstimate  The source estimate to prepare.
+    */
+    void prepareSourceEstimate(qint32 p_iNumSamples, float tmin, float tstep, MNESourceEstimate &p_sourceEstimate) const;
+
     MNEInverseOperator m_inverseOperator;   /**< The inverse operator */
     float m_fLambda;                        /**< Regularization parameter */
     QString m_sMethod;                      /**< Selected method */
@@ -171,7 +295,25 @@ private:
     SparseMatrix<double> noise_norm;        /**< The noise normalization */
     QList<VectorXi> vertno;                 /**< The vertices numbers */
     Label label;                            /**< The corresponding labels */
-    MatrixXd K;                             /**< Imaging kernel */
+    mutable MatrixXd K;                     /**< Imaging kernel, assembled from its factors on first dense use */
+
+    MatrixXd m_matKernelA;                  /**< Left kernel factor (sources x rank) */
+    MatrixXd m_matKernelB;                  /**< Right kernel factor (rank x channels) */
+    MatrixXf m_matKernelAF;                 /**< Single precision copy of the left kernel factor */
+    MatrixXf m_matKernelBF;                 /**< Single precision copy of the right kernel factor */
+    mutable MatrixXf m_matKernelF;          /**< Single precision copy of the imaging kernel, assembled on first dense use */
+    VectorXd m_vecNoiseNorm;                /**< Diagonal of the noise normalization, empty for MNE */
+    VectorXi m_vecVertices;                 /**< Vertices of both hemispheres */
+    bool m_bCombineXyz;                     /**< Combine the three orientation components of each source */
+    bool m_bSinglePrecision;                /**< Apply the kernel in single precision */
+    mutable qint64 m_iFactoredSamples;      /**< Samples the factored kernel was applied to since the setup */
+
+    mutable MatrixXd m_matBlockD;           /**< Scratch buffer for the double precision block products */
+    mutable MatrixXf m_matBlockF;           /**< Scratch buffer for the single precision block products */
+    mutable MatrixXf m_matDataF;            /**< Scratch buffer for the single precision data */
+    mutable MatrixXd m_matDataD;            /**< Scratch buffer for the double precision data */
+    mutable MatrixXd m_matProjD;            /**< Scratch buffer for the double precision right factor products */
+    mutable MatrixXf m_matProjF;            /**< Scratch buffer for the single precision right factor products */
 
 };
 
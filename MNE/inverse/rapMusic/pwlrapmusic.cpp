@@ -109,40 +109,34 @@ MNESourceEstimate PwlRapMusic::calculateInverse(const MatrixXd &data, float tmin
 
 MNESourceEstimate PwlRapMusic::calculateInverse(const MatrixXd& p_matMeasurement, QList< DipolePair<double> > &p_RapDipoles) const
 {
-    MNESourceEstimate p_SourceEstimate;
+    return RapMusic::calculateInverse(p_matMeasurement, p_RapDipoles);
+}
+
+
+//*************************************************************************************************************
 
+bool PwlRapMusic::scanSubspace(const MatrixXd& p_matPhi_s, QList< DipolePair<double> > &p_RapDipoles) const
+{
     //if not initialized -> break
     if(!m_bIsInit)
     {
         std::cout << "RAP MUSIC wasn't initialized!"; //ToDo: catch this earlier
-        return p_SourceEstimate; //false
+        return false;
     }
 
-    //Test if data are correct
-    if(p_matMeasurement.rows() != m_iNumChannels)
+    //Test if the signal subspace is correct
+    if(p_matPhi_s.rows() != m_iNumChannels)
     {
-        std::cout << "Lead Field channels do not fit to number of measurement channels!"; //ToDo: catch this earlier
-        return p_SourceEstimate;
+        std::cout << "Lead Field channels do not fit to number of signal subspace channels!"; //ToDo: catch this earlier
+        return false;
     }
 
     //Inits
-    //Stop the time for benchmark purpose
-    clock_t start, end;
-    start = clock();
-
-//    //Map HPCMatrix to Eigen Matrix
-//    Eigen::Map<MatrixXT>
-//        t_MappedMatMeasurement(	p_pMatMeasurement->data(),
-//        p_pMatMeasurement->rows(),
-//        p_pMatMeasurement->cols() );
-
-    //Calculate the signal subspace (t_pMatPhi_s)
-    MatrixXT* t_pMatPhi_s = NULL;//(m_iNumChannels, m_iN < t_r ? m_iN : t_r);
-    int t_r = calcPhi_s(/*(MatrixXT)*/p_matMeasurement, t_pMatPhi_s);
+    int t_r = p_matPhi_s.cols();
 
     int t_iMaxSearch = m_iN < t_r ? m_iN : t_r; //The smallest of Rank and Iterations
 
-    if (t_r < m_iN)
+    if (t_r < m_iN && m_bVerbose)
     {
         std::cout << "Warning: Rank " << t_r << " of the measurement data is smaller than the " << m_iN;
         std::cout << " sources to find." << std::endl;
@@ -175,15 +169,13 @@ MNESourceEstimate PwlRapMusic::calculateInverse(const MatrixXd& p_matMeasurement
 //    }
     p_RapDipoles.clear();
 
-    std::cout << "##### Calculation of RAP MUSIC started ######\n\n";
-
-    MatrixXT t_matProj_Phi_s(t_matOrthProj.rows(), t_pMatPhi_s->cols());
+    MatrixXT t_matProj_Phi_s(t_matOrthProj.rows(), p_matPhi_s.cols());
     //new Version: Calculate projection before
     MatrixXT t_matProj_LeadField(m_ForwardSolution.sol->data.rows(), m_ForwardSolution.sol->data.cols());
 
     for(int r = 0; r < t_iMaxSearch ; ++r)
     {
-        t_matProj_Phi_s = t_matOrthProj*(*t_pMatPhi_s);
+        t_matProj_Phi_s = t_matOrthProj*(p_matPhi_s);
 
         //new Version: Calculating Projection before
         t_matProj_LeadField = t_matOrthProj * m_ForwardSolution.sol->data;//Subtract the found sources from the current found source
@@ -194,114 +186,58 @@ MNESourceEstimate PwlRapMusic::calculateInverse(const MatrixXd& p_matMeasurement
         MatrixXT t_matU_B;
         useFullRank(t_svdProj_Phi_S.matrixU(), t_svdProj_Phi_S.singularValues().asDiagonal(), t_matU_B);
 
-        //Inits
-        VectorXT t_vecRoh(m_iNumLeadFieldCombinations,1);
-        t_vecRoh.setZero();
-
         //subcorr benchmark
         //Stop the time
         clock_t start_subcorr, end_subcorr;
         start_subcorr = clock();
 
-        double t_val_roh_k;
+        //Factors are shared by all Powell rows
+        SubcorrBasis t_basis;
+        if(m_bBatchedSubcorr)
+            calcSubcorrBasis(t_matProj_LeadField, t_matU_B, t_basis);
 
         //Powell
         int t_iCurrentRow = 2;
 
-        int t_iIdx1 = -1;
-        int t_iIdx2 = -1;
-
-        int t_iMaxIdx_old = -1;
-
-        int t_iMaxFound = 0;
-
-        Eigen::VectorXi t_pVecIdxElements(m_iNumGridPoints);
-
-        PowellIdxVec(t_iCurrentRow, m_iNumGridPoints, t_pVecIdxElements);
+        PairCorrelation t_maxPair = {-1.0, -1, -1};
 
-        int t_iNumVecElements = m_iNumGridPoints;
-
-        while(t_iMaxFound == 0)
+        while(true)
         {
+            //Multithreading correlation calculation of the current row and search of its maximum
+            PairCorrelation t_rowMaxPair = scanPointPairs(t_iCurrentRow, t_matProj_LeadField, t_matU_B, t_basis);
 
-            //Multithreading correlation calculation
-            #ifdef _OPENMP
-            #pragma omp parallel num_threads(m_iMaxNumThreads)
-            #endif
-            {
-            #ifdef _OPENMP
-            #pragma omp for
-            #endif
-                for(int i = 0; i < t_iNumVecElements; i++)
-                {
-                    int k = t_pVecIdxElements(i);
-                    //new Version: calculate matrix multiplication before
-                    //Create Lead Field combinations -> It would be better to use a pointer construction, to increase performance
-                    MatrixX6T t_matProj_G(t_matProj_LeadField.rows(),6);
-
-                    int idx1 = m_ppPairIdxCombinations[k]->x1;
-                    int idx2 = m_ppPairIdxCombinations[k]->x2;
-
-                    RapMusic::getGainMatrixPair(t_matProj_LeadField, t_matProj_G, idx1, idx2);
-
-                    t_vecRoh(k) = RapMusic::subcorr(t_matProj_G, t_matU_B);//t_vecRoh holds the correlations roh_k
-                }
-            }
-
-    //         if(r==0)
-    //         {
-    //             std::fstream filestr;
-    //             std::stringstream filename;
-    //             filename << "Roh_gold.txt";
-    //
-    //             filestr.open ( filename.str().c_str(), std::fstream::out);
-    //             for(int i = 0; i < m_iNumLeadFieldCombinations; ++i)
-    //             {
-    //               filestr << t_vecRoh(i) << "\n";
-    //             }
-    //             filestr.close();
-    //
-    //             //exit(0);
-    //         }
-
-            //Find the maximum of correlation - can't put this in the for loop because it's running in different threads.
-
-            VectorXT::Index t_iMaxIdx;
-
-            t_val_roh_k = t_vecRoh.maxCoeff(&t_iMaxIdx);//p_vecCor = ^roh_k
-
-            if((int)t_iMaxIdx == t_iMaxIdx_old)
-            {
-                t_iMaxFound = 1;
+            //Maximum didn't change -> found
+            if(!RapMusic::isBetterPair(t_rowMaxPair, t_maxPair))
                 break;
-            }
-            else
-            {
-                t_iMaxIdx_old = t_iMaxIdx;
-                //get positions in sparsed leadfield from index combinations;
-                t_iIdx1 = m_ppPairIdxCombinations[t_iMaxIdx]->x1;
-                t_iIdx2 = m_ppPairIdxCombinations[t_iMaxIdx]->x2;
-            }
 
+            t_maxPair = t_rowMaxPair;
 
             //set new index
-            if(t_iIdx1 == t_iCurrentRow)
-                t_iCurrentRow = t_iIdx2;
+            if(t_maxPair.x1 == t_iCurrentRow)
+                t_iCurrentRow = t_maxPair.x2;
             else
-                t_iCurrentRow = t_iIdx1;
-
-            PowellIdxVec(t_iCurrentRow, m_iNumGridPoints, t_pVecIdxElements);
+                t_iCurrentRow = t_maxPair.x1;
         }
 
+        double t_val_roh_k = t_maxPair.cor;
+
+        //positions in sparsed leadfield
+        int t_iIdx1 = t_maxPair.x1;
+        int t_iIdx2 = t_maxPair.x2;
+
         //subcorr benchmark
         end_subcorr = clock();
 
-        float t_fSubcorrElapsedTime = ( (float)(end_subcorr-start_subcorr) / (float)CLOCKS_PER_SEC ) * 1000.0f;
-        std::cout << "Time Elapsed: " << t_fSubcorrElapsedTime << " ms" << std::endl;
+        if(m_bVerbose)
+        {
+            float t_fSubcorrElapsedTime = ( (float)(end_subcorr-start_subcorr) / (float)CLOCKS_PER_SEC ) * 1000.0f;
+            std::cout << "Time Elapsed: " << t_fSubcorrElapsedTime << " ms" << std::endl;
+        }
 
 
         // (Idx+1) because of MATLAB positions -> starting with 1 not with 0
-        std::cout << "Iteration: " << r+1 << " of " << t_iMaxSearch
+        if(m_bVerbose)
+            std::cout << "Iteration: " << r+1 << " of " << t_iMaxSearch
             << "; Correlation: " << t_val_roh_k<< "; Position (Idx+1): " << t_iIdx1+1 << " - " << t_iIdx2+1 <<"\n\n";
 
         //Calculations with the max correlated dipole pair G_k_1
@@ -324,8 +260,11 @@ MNESourceEstimate PwlRapMusic::calculateInverse(const MatrixXd& p_matMeasurement
         //Stop Searching when Correlation is smaller then the Threshold
         if (t_val_roh_k < m_dThreshold)
         {
-            std::cout << "Searching stopped, last correlation " << t_val_roh_k;
-            std::cout << " is smaller then the given threshold " << m_dThreshold << std::endl << std::endl;
+            if(m_bVerbose)
+            {
+                std::cout << "Searching stopped, last correlation " << t_val_roh_k;
+                std::cout << " is smaller then the given threshold " << m_dThreshold << std::endl << std::endl;
+            }
             break;
         }
 
@@ -339,17 +278,56 @@ MNESourceEstimate PwlRapMusic::calculateInverse(const MatrixXd& p_matMeasurement
         //ToDo
     }
 
-    std::cout << "##### Calculation of RAP MUSIC completed ######"<< std::endl << std::endl << std::endl;
+    return true;
+}
+
 
-    end = clock();
+//*************************************************************************************************************
 
-    float t_fElapsedTime = ( (float)(end-start) / (float)CLOCKS_PER_SEC ) * 1000.0f;
-    std::cout << "Total Time Elapsed: " << t_fElapsedTime << " ms" << std::endl << std::endl;
+PairCorrelation PwlRapMusic::scanPointPairs(int p_iPoint, const MatrixXT& p_matProj_LeadField, const MatrixXT& p_matU_B, const SubcorrBasis& p_basis) const
+{
+    PairCorrelation t_maxPair = {-1.0, -1, -1};
 
-    //garbage collecting
-    delete t_pMatPhi_s;
+    #ifdef _OPENMP
+    #pragma omp parallel num_threads(m_iMaxNumThreads)
+    #endif
+    {
+        //Per thread maximum and pair buffer
+        PairCorrelation t_threadMaxPair = {-1.0, -1, -1};
+        MatrixX6T t_matProj_G(p_matProj_LeadField.rows(),6);
+
+    #ifdef _OPENMP
+    #pragma omp for
+    #endif
+        for(int i = 0; i < m_iNumGridPoints; ++i)
+        {
+            //col combination index (i, p_iPoint) - row combination index (p_iPoint, i)
+            int idx1 = i < p_iPoint ? i : p_iPoint;
+            int idx2 = i < p_iPoint ? p_iPoint : i;
+
+            PairCorrelation t_pair = {0.0, idx1, idx2};
+
+            if(!m_bBatchedSubcorr || !RapMusic::subcorr(p_basis, idx1, idx2, t_pair.cor))
+            {
+                RapMusic::getGainMatrixPair(p_matProj_LeadField, t_matProj_G, idx1, idx2);
+                t_pair.cor = RapMusic::subcorr(t_matProj_G, p_matU_B);
+            }
+
+            if(RapMusic::isBetterPair(t_pair, t_threadMaxPair))
+                t_threadMaxPair = t_pair;
+        }
+
+        //Reduce the thread maxima
+    #ifdef _OPENMP
+    #pragma omp critical
+    #endif
+        {
+            if(RapMusic::isBetterPair(t_threadMaxPair, t_maxPair))
+                t_maxPair = t_threadMaxPair;
+        }
+    }
 
-    return p_SourceEstimate;
+    return t_maxPair;
 }
 
 
@@ -146,6 +146,22 @@ public:
 
     virtual MNESourceEstimate calculateInverse(const MatrixXd& p_matMeasurement, QList< DipolePair<double> > &p_RapDipoles) const;
 
+    virtual bool scanSubspace(const MatrixXd& p_matPhi_s, QList< DipolePair<double> > &p_RapDipoles) const;
+
+    //=========================================================================================================
+    /**
+    * Scans all gain matrix index combinations which contain the grid point p_iPoint (one Powell row/column of
+    * the combination triangle) and returns the best correlated one. Every thread keeps its own maximum which
+    * are reduced at the end.
+    *
+    * @param[in] p_iPoint   The grid point which is combined with all grid points.
+    * @param[in] p_matProj_LeadField    The projected Lead Field matrix.
+    * @param[in] p_matU_B   The matrix U is the subspace projection of the orthogonal projected Phi_s
+    * @param[in] p_basis    The factors of the batched subspace correlation (only used when enabled).
+    * @return   The best correlated pair. Ties are resolved to the lowest combination index.
+    */
+    PairCorrelation scanPointPairs(int p_iPoint, const MatrixXT& p_matProj_LeadField, const MatrixXT& p_matU_B, const SubcorrBasis& p_basis) const;
+
     static int PowellOffset(int p_iRow, int p_iNumPoints);
 
     static void PowellIdxVec(int p_iRow, int p_iNumPoints, Eigen::VectorXi& p_pVecElements);
@@ -45,6 +45,8 @@
 #include <omp.h>
 #endif
 
+#include <limits>
+
 
 //*************************************************************************************************************
 //=============================================================================================================
@@ -65,8 +67,9 @@ RapMusic::RapMusic()
 , m_iNumGridPoints(0)
 , m_iNumChannels(0)
 , m_iNumLeadFieldCombinations(0)
-, m_ppPairIdxCombinations(NULL)
 , m_iMaxNumThreads(1)
+, m_bBatchedSubcorr(false)
+, m_bVerbose(true)
 , m_bIsInit(false)
 , m_iSamplesStcWindow(-1)
 , m_fStcOverlap(-1)
@@ -82,8 +85,9 @@ RapMusic::RapMusic(MNEForwardSolution& p_pFwd, bool p_bSparsed, int p_iN, double
 , m_iNumGridPoints(0)
 , m_iNumChannels(0)
 , m_iNumLeadFieldCombinations(0)
-, m_ppPairIdxCombinations(NULL)
 , m_iMaxNumThreads(1)
+, m_bBatchedSubcorr(false)
+, m_bVerbose(true)
 , m_bIsInit(false)
 , m_iSamplesStcWindow(-1)
 , m_fStcOverlap(-1)
@@ -97,8 +101,6 @@ RapMusic::RapMusic(MNEForwardSolution& p_pFwd, bool p_bSparsed, int p_iN, double
 
 RapMusic::~RapMusic()
 {
-    if(m_ppPairIdxCombinations != NULL)
-        free(m_ppPairIdxCombinations);
 }
 
 
@@ -153,20 +155,9 @@ bool RapMusic::init(MNEForwardSolution& p_pFwd, bool p_bSparsed, int p_iN, doubl
 
     m_ForwardSolution = p_pFwd;
 
-    //##### Calc lead field combination #####
-
-    std::cout << "Calculate gain matrix combinations. \n";
-
+    //Lead field combinations are indexed arithmetically during the scan (see getPointPair)
     m_iNumLeadFieldCombinations = MNEMath::nchoose2(m_iNumGridPoints+1);
 
-    m_ppPairIdxCombinations = (Pair **)malloc(m_iNumLeadFieldCombinations * sizeof(Pair *));
-
-    calcPairCombinations(m_iNumGridPoints, m_iNumLeadFieldCombinations, m_ppPairIdxCombinations);
-
-    std::cout << "Gain matrix combinations calculated. \n\n";
-
-    //##### Calc lead field combination end #####
-
     std::cout << "Number of grid points: " << m_iNumGridPoints << "\n\n";
 
     std::cout << "Number of combinated points: " << m_iNumLeadFieldCombinations << "\n\n";
@@ -405,19 +396,53 @@ MNESourceEstimate RapMusic::calculateInverse(const MatrixXd& p_matMeasurement, Q
     clock_t start, end;
     start = clock();
 
-//    //Map HPCMatrix to Eigen Matrix
-//    Eigen::Map<MatrixXT>
-//        t_MappedMatMeasurement(	p_pMatMeasurement->data(),
-//        p_pMatMeasurement->rows(),
-//        p_pMatMeasurement->cols() );
+    std::cout << "##### Calculation of RAP MUSIC started ######\n\n";
 
     //Calculate the signal subspace (t_pMatPhi_s)
     MatrixXT* t_pMatPhi_s = NULL;//(m_iNumChannels, m_iN < t_r ? m_iN : t_r);
-    int t_r = calcPhi_s(/*(MatrixXT)*/p_matMeasurement, t_pMatPhi_s);
+    calcPhi_s(/*(MatrixXT)*/p_matMeasurement, t_pMatPhi_s);
+
+    //Scan for the correlated dipole pairs
+    scanSubspace(*t_pMatPhi_s, p_RapDipoles);
+
+    //garbage collecting
+    delete t_pMatPhi_s;
+
+    std::cout << "##### Calculation of RAP MUSIC completed ######"<< std::endl << std::endl << std::endl;
+
+    end = clock();
+
+    float t_fElapsedTime = ( (float)(end-start) / (float)CLOCKS_PER_SEC ) * 1000.0f;
+    std::cout << "Total Time Elapsed: " << t_fElapsedTime << " ms" << std::endl << std::endl;
+
+    return p_SourceEstimate;
+}
+
+
+//*************************************************************************************************************
+
+bool RapMusic::scanSubspace(const MatrixXd& p_matPhi_s, QList< DipolePair<double> > &p_RapDipoles) const
+{
+    //if not initialized -> break
+    if(!m_bIsInit)
+    {
+        std::cout << "RAP MUSIC wasn't initialized!"; //ToDo: catch this earlier
+        return false;
+    }
+
+    //Test if the signal subspace is correct
+    if(p_matPhi_s.rows() != m_iNumChannels)
+    {
+        std::cout << "Lead Field channels do not fit to number of signal subspace channels!"; //ToDo: catch this earlier
+        return false;
+    }
+
+    //Inits
+    int t_r = p_matPhi_s.cols();
 
     int t_iMaxSearch = m_iN < t_r ? m_iN : t_r; //The smallest of Rank and Iterations
 
-    if (t_r < m_iN)
+    if (t_r < m_iN && m_bVerbose)
     {
         std::cout << "Warning: Rank " << t_r << " of the measurement data is smaller than the " << m_iN;
         std::cout << " sources to find." << std::endl;
@@ -450,15 +475,13 @@ MNESourceEstimate RapMusic::calculateInverse(const MatrixXd& p_matMeasurement, Q
 //    }
     p_RapDipoles.clear();
 
-    std::cout << "##### Calculation of RAP MUSIC started ######\n\n";
-
-    MatrixXT t_matProj_Phi_s(t_matOrthProj.rows(), t_pMatPhi_s->cols());
+    MatrixXT t_matProj_Phi_s(t_matOrthProj.rows(), p_matPhi_s.cols());
     //new Version: Calculate projection before
     MatrixXT t_matProj_LeadField(m_ForwardSolution.sol->data.rows(), m_ForwardSolution.sol->data.cols());
 
     for(int r = 0; r < t_iMaxSearch ; ++r)
     {
-        t_matProj_Phi_s = t_matOrthProj*(*t_pMatPhi_s);
+        t_matProj_Phi_s = t_matOrthProj*(p_matPhi_s);
 
         //new Version: Calculating Projection before
         t_matProj_LeadField = t_matOrthProj * m_ForwardSolution.sol->data;//Subtract the found sources from the current found source
@@ -469,74 +492,32 @@ MNESourceEstimate RapMusic::calculateInverse(const MatrixXd& p_matMeasurement, Q
         MatrixXT t_matU_B;
         useFullRank(t_svdProj_Phi_S.matrixU(), t_svdProj_Phi_S.singularValues().asDiagonal(), t_matU_B);
 
-        //Inits
-        VectorXT t_vecRoh(m_iNumLeadFieldCombinations,1);
-        t_vecRoh.setZero();
-
         //subcorr benchmark
         //Stop the time
         clock_t start_subcorr, end_subcorr;
         start_subcorr = clock();
 
-        //Multithreading correlation calculation
-        #ifdef _OPENMP
-        #pragma omp parallel num_threads(m_iMaxNumThreads)
-        #endif
-        {
-        #ifdef _OPENMP
-        #pragma omp for
-        #endif
-            for(int i = 0; i < m_iNumLeadFieldCombinations; i++)
-            {
-                //new Version: calculate matrix multiplication before
-                //Create Lead Field combinations -> It would be better to use a pointer construction, to increase performance
-                MatrixX6T t_matProj_G(t_matProj_LeadField.rows(),6);
-
-                int idx1 = m_ppPairIdxCombinations[i]->x1;
-                int idx2 = m_ppPairIdxCombinations[i]->x2;
-
-                RapMusic::getGainMatrixPair(t_matProj_LeadField, t_matProj_G, idx1, idx2);
-
-                t_vecRoh(i) = RapMusic::subcorr(t_matProj_G, t_matU_B);//t_vecRoh holds the correlations roh_k
-            }
-        }
-
-
-//         if(r==0)
-//         {
-//             std::fstream filestr;
-//             std::stringstream filename;
-//             filename << "Roh_gold.txt";
-//
-//             filestr.open ( filename.str().c_str(), std::fstream::out);
-//             for(int i = 0; i < m_iNumLeadFieldCombinations; ++i)
-//             {
-//               filestr << t_vecRoh(i) << "\n";
-//             }
-//             filestr.close();
-//
-//             //exit(0);
-//         }
+        //Multithreading correlation calculation and search of the maximum
+        PairCorrelation t_maxPair = scanPairs(t_matProj_LeadField, t_matU_B);
 
         //subcorr benchmark
         end_subcorr = clock();
 
-        float t_fSubcorrElapsedTime = ( (float)(end_subcorr-start_subcorr) / (float)CLOCKS_PER_SEC ) * 1000.0f;
-        std::cout << "Time Elapsed: " << t_fSubcorrElapsedTime << " ms" << std::endl;
-
-        //Find the maximum of correlation - can't put this in the for loop because it's running in different threads.
-        double t_val_roh_k;
-
-        VectorXT::Index t_iMaxIdx;
+        if(m_bVerbose)
+        {
+            float t_fSubcorrElapsedTime = ( (float)(end_subcorr-start_subcorr) / (float)CLOCKS_PER_SEC ) * 1000.0f;
+            std::cout << "Time Elapsed: " << t_fSubcorrElapsedTime << " ms" << std::endl;
+        }
 
-        t_val_roh_k = t_vecRoh.maxCoeff(&t_iMaxIdx);//p_vecCor = ^roh_k
+        double t_val_roh_k = t_maxPair.cor;//p_vecCor = ^roh_k
 
-        //get positions in sparsed leadfield from index combinations;
-        int t_iIdx1 = m_ppPairIdxCombinations[t_iMaxIdx]->x1;
-        int t_iIdx2 = m_ppPairIdxCombinations[t_iMaxIdx]->x2;
+        //positions in sparsed leadfield
+        int t_iIdx1 = t_maxPair.x1;
+        int t_iIdx2 = t_maxPair.x2;
 
         // (Idx+1) because of MATLAB positions -> starting with 1 not with 0
-        std::cout << "Iteration: " << r+1 << " of " << t_iMaxSearch
+        if(m_bVerbose)
+            std::cout << "Iteration: " << r+1 << " of " << t_iMaxSearch
             << "; Correlation: " << t_val_roh_k<< "; Position (Idx+1): " << t_iIdx1+1 << " - " << t_iIdx2+1 <<"\n\n";
 
         //Calculations with the max correlated dipole pair G_k_1 -> ToDo Obsolet when taking direkt Projected Lead Field
@@ -559,8 +540,11 @@ MNESourceEstimate RapMusic::calculateInverse(const MatrixXd& p_matMeasurement, Q
         //Stop Searching when Correlation is smaller then the Threshold
         if (t_val_roh_k < m_dThreshold)
         {
-            std::cout << "Searching stopped, last correlation " << t_val_roh_k;
-            std::cout << " is smaller then the given threshold " << m_dThreshold << std::endl << std::endl;
+            if(m_bVerbose)
+            {
+                std::cout << "Searching stopped, last correlation " << t_val_roh_k;
+                std::cout << " is smaller then the given threshold " << m_dThreshold << std::endl << std::endl;
+            }
             break;
         }
 
@@ -574,17 +558,7 @@ MNESourceEstimate RapMusic::calculateInverse(const MatrixXd& p_matMeasurement, Q
         //ToDo
     }
 
-    std::cout << "##### Calculation of RAP MUSIC completed ######"<< std::endl << std::endl << std::endl;
-
-    end = clock();
-
-    float t_fElapsedTime = ( (float)(end-start) / (float)CLOCKS_PER_SEC ) * 1000.0f;
-    std::cout << "Total Time Elapsed: " << t_fElapsedTime << " ms" << std::endl << std::endl;
-
-    //garbage collecting
-    delete t_pMatPhi_s;
-
-    return p_SourceEstimate;
+    return true;
 }
 
 
@@ -751,6 +725,102 @@ double RapMusic::subcorr(MatrixX6T& p_matProj_G, const MatrixXT& p_matU_B, Vecto
 }
 
 
+//*************************************************************************************************************
+
+bool RapMusic::subcorr(const SubcorrBasis& p_basis, int p_iIdx1, int p_iIdx2, double& p_dCor)
+{
+    typedef Eigen::Block<const MatrixXT, Eigen::Dynamic, 3, true> QBlock;
+    typedef Eigen::Block<const MatrixXT, 3, Eigen::Dynamic, false> PBlock;
+
+    QBlock t_matQ_1 = p_basis.Q.middleCols<3>(3*p_iIdx1);
+    QBlock t_matQ_2 = p_basis.Q.middleCols<3>(3*p_iIdx2);
+    PBlock t_matP_1 = p_basis.Q_T_U_B.middleRows<3>(3*p_iIdx1);
+    PBlock t_matP_2 = p_basis.Q_T_U_B.middleRows<3>(3*p_iIdx2);
+
+    //R = blkdiag(R_1, R_2) with [G_1 G_2] = [Q_1 Q_2] * R
+    Matrix6T t_matR = Matrix6T::Zero();
+    t_matR.topLeftCorner<3,3>() = p_basis.R.middleCols<3>(3*p_iIdx1);
+    t_matR.bottomRightCorner<3,3>() = p_basis.R.middleCols<3>(3*p_iIdx2);
+
+    //Gram matrix of [Q_1 Q_2]
+    Matrix6T t_matS = Matrix6T::Identity();
+    t_matS.topRightCorner<3,3>() = t_matQ_1.transpose().lazyProduct(t_matQ_2);
+    t_matS.bottomLeftCorner<3,3>() = t_matS.topRightCorner<3,3>().transpose();
+
+    //P * P^T with P = [Q_1 Q_2]^T * U_B
+    Matrix6T t_matPP_T;
+    t_matPP_T.topLeftCorner<3,3>() = t_matP_1.lazyProduct(t_matP_1.transpose());
+    t_matPP_T.topRightCorner<3,3>() = t_matP_1.lazyProduct(t_matP_2.transpose());
+    t_matPP_T.bottomLeftCorner<3,3>() = t_matPP_T.topRightCorner<3,3>().transpose();
+    t_matPP_T.bottomRightCorner<3,3>() = t_matP_2.lazyProduct(t_matP_2.transpose());
+
+    //G^T * G = V * Sigma^2 * V^T and G^T * U_B * U_B^T * G
+    Matrix6T t_matG_T_G = t_matR.transpose() * t_matS * t_matR;
+    Matrix6T t_matG_T_U_B_U_B_T_G = t_matR.transpose() * t_matPP_T * t_matR;
+
+    //U_A = G * W with W = V * Sigma^-1 - lt. Mosher 1998: Only Retain those Components that correspond to nonzero
+    //singular values; same criterion as getRank: sigma > 10^-5, at least the largest one
+    Eigen::SelfAdjointEigenSolver<Matrix6T> t_eigGram(t_matG_T_G);
+    const double t_dThreshold = 0.00001*0.00001;
+    const double t_dTol = 1000*std::numeric_limits<double>::epsilon()*qMax(t_eigGram.eigenvalues()[5], t_dThreshold);
+    Matrix6T t_matW = t_eigGram.eigenvectors();
+    for(int k = 0; k < 6; ++k)
+    {
+        double t_dSigma_2 = t_eigGram.eigenvalues()[k];
+
+        //The squared singular values are only accurate to about eps * sigma_max^2 - leave the decision to the SVD
+        if(fabs(t_dSigma_2 - t_dThreshold) <= t_dTol || (k == 5 && t_dSigma_2 <= t_dTol))
+            return false;
+
+        if(t_dSigma_2 > t_dThreshold || k == 5)
+            t_matW.col(k) /= sqrt(t_dSigma_2);
+        else
+            t_matW.col(k).setZero();
+    }
+
+    //The squared singular values of C = U_A^T * U_B are the eigenvalues of C * C^T = W^T * G^T * U_B * U_B^T * G * W
+    Matrix6T t_matC_C_T = t_matW.transpose() * t_matG_T_U_B_U_B_T_G * t_matW;
+    Eigen::SelfAdjointEigenSolver<Matrix6T> t_eigCor(t_matC_C_T, Eigen::EigenvaluesOnly);
+
+    //Step 3 - eigenvalues are sorted in increasing order
+    double t_dSigma_C_2 = t_eigCor.eigenvalues()[5];
+
+    p_dCor = t_dSigma_C_2 > 0 ? sqrt(t_dSigma_C_2) : 0;
+
+    return true;
+}
+
+
+//*************************************************************************************************************
+
+void RapMusic::calcSubcorrBasis(const MatrixXT& p_matProj_LeadField, const MatrixXT& p_matU_B, SubcorrBasis& p_basis) const
+{
+    int t_iNumPoints = p_matProj_LeadField.cols()/3;
+    int t_iNumChannels = p_matProj_LeadField.rows();
+
+    p_basis.Q.resize(t_iNumChannels, 3*t_iNumPoints);
+    p_basis.R.resize(3, 3*t_iNumPoints);
+
+    #ifdef _OPENMP
+    #pragma omp parallel num_threads(m_iMaxNumThreads)
+    #endif
+    {
+    #ifdef _OPENMP
+    #pragma omp for
+    #endif
+        for(int i = 0; i < t_iNumPoints; ++i)
+        {
+            Eigen::HouseholderQR<MatrixXT> t_qrG(p_matProj_LeadField.middleCols(3*i, 3));
+
+            p_basis.Q.middleCols(3*i, 3) = t_qrG.householderQ() * MatrixXT::Identity(t_iNumChannels, 3);
+            p_basis.R.middleCols(3*i, 3) = t_qrG.matrixQR().topRows(3).triangularView<Eigen::Upper>();
+        }
+    }
+
+    p_basis.Q_T_U_B = p_basis.Q.transpose() * p_matU_B;
+}
+
+
 //*************************************************************************************************************
 
 void RapMusic::calcA_k_1(   const MatrixX6T& p_matG_k_1,
@@ -812,32 +882,72 @@ void RapMusic::calcOrthProj(const MatrixXT& p_matA_k_1, MatrixXT& p_matOrthProj)
 
 //*************************************************************************************************************
 
-void RapMusic::calcPairCombinations(    const int p_iNumPoints,
-                                        const int p_iNumCombinations,
-                                        Pair** p_ppPairIdxCombinations) const
+PairCorrelation RapMusic::scanPairs(const MatrixXT& p_matProj_LeadField, const MatrixXT& p_matU_B) const
 {
-    int idx1 = 0;
-    int idx2 = 0;
+    //Grid point blocks whose projected gain columns fit together into the cache
+    int t_iBlockSize = RAP_SCAN_BLOCK_BYTES / (3 * (int)p_matProj_LeadField.rows() * (int)sizeof(double));
+    if(t_iBlockSize < 1)
+        t_iBlockSize = 1;
+
+    int t_iNumBlocks = (m_iNumGridPoints + t_iBlockSize - 1) / t_iBlockSize;
+    int t_iNumTiles = MNEMath::nchoose2(t_iNumBlocks+1);
+
+    SubcorrBasis t_basis;
+    if(m_bBatchedSubcorr)
+        calcSubcorrBasis(p_matProj_LeadField, p_matU_B, t_basis);
+
+    PairCorrelation t_maxPair = {-1.0, -1, -1};
 
-    //Process Code in {m_max_num_threads} threads -> When compile with Intel Compiler -> probably obsolete
     #ifdef _OPENMP
-    #pragma omp parallel num_threads(m_iMaxNumThreads) private(idx1, idx2)
+    #pragma omp parallel num_threads(m_iMaxNumThreads)
     #endif
     {
+        //Per thread maximum and pair buffer
+        PairCorrelation t_threadMaxPair = {-1.0, -1, -1};
+        MatrixX6T t_matProj_G(p_matProj_LeadField.rows(),6);
+
     #ifdef _OPENMP
-    #pragma omp for
+    #pragma omp for schedule(dynamic)
     #endif
-        for (int i = 0; i < p_iNumCombinations; ++i)
+        for(int t = 0; t < t_iNumTiles; ++t)
         {
-            RapMusic::getPointPair(p_iNumPoints, i, idx1, idx2);
+            //Tiles are combinations of blocks - same indexing as the point pairs
+            int t_iBlock1, t_iBlock2;
+            RapMusic::getPointPair(t_iNumBlocks, t, t_iBlock1, t_iBlock2);
 
-            Pair* t_pairCombination = new Pair();
-            t_pairCombination->x1 = idx1;
-            t_pairCombination->x2 = idx2;
+            int t_iEnd1 = qMin((t_iBlock1+1)*t_iBlockSize, m_iNumGridPoints);
+            int t_iStart2 = t_iBlock2*t_iBlockSize;
+            int t_iEnd2 = qMin((t_iBlock2+1)*t_iBlockSize, m_iNumGridPoints);
 
-            p_ppPairIdxCombinations[i] = t_pairCombination;
+            for(int idx1 = t_iBlock1*t_iBlockSize; idx1 < t_iEnd1; ++idx1)
+            {
+                for(int idx2 = qMax(idx1, t_iStart2); idx2 < t_iEnd2; ++idx2)
+                {
+                    PairCorrelation t_pair = {0.0, idx1, idx2};
+
+                    if(!m_bBatchedSubcorr || !RapMusic::subcorr(t_basis, idx1, idx2, t_pair.cor))
+                    {
+                        RapMusic::getGainMatrixPair(p_matProj_LeadField, t_matProj_G, idx1, idx2);
+                        t_pair.cor = RapMusic::subcorr(t_matProj_G, p_matU_B);
+                    }
+
+                    if(isBetterPair(t_pair, t_threadMaxPair))
+                        t_threadMaxPair = t_pair;
+                }
+            }
+        }
+
+        //Reduce the thread maxima
+    #ifdef _OPENMP
+    #pragma omp critical
+    #endif
+        {
+            if(isBetterPair(t_threadMaxPair, t_maxPair))
+                t_maxPair = t_threadMaxPair;
         }
     }
+
+    return t_maxPair;
 }
 
 
@@ -907,3 +1017,19 @@ void RapMusic::setStcAttr(int p_iSampStcWin, float p_fStcOverlap)
     m_iSamplesStcWindow = p_iSampStcWin;
     m_fStcOverlap = p_fStcOverlap;
 }
+
+
+//*************************************************************************************************************
+
+void RapMusic::setVerbose(bool p_bVerbose)
+{
+    m_bVerbose = p_bVerbose;
+}
+
+
+//*************************************************************************************************************
+
+void RapMusic::setBatchedSubcorr(bool p_bBatched)
+{
+    m_bBatchedSubcorr = p_bBatched;
+}
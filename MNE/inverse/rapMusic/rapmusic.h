@@ -61,6 +61,8 @@
 #include <Eigen/Core>
 #include <Eigen/SVD>
 #include <Eigen/LU>
+#include <Eigen/QR>
+#include <Eigen/Eigenvalues>
 
 
 //*************************************************************************************************************
@@ -86,17 +88,31 @@ using namespace MNELIB;
 
 #define NOT_TRANSPOSED   0  /**< Defines NOT_TRANSPOSED */
 #define IS_TRANSPOSED   1   /**< Defines IS_TRANSPOSED */
+#define RAP_SCAN_BLOCK_BYTES    131072  /**< Defines the size of the gain matrix column blocks which are scanned together */
 
 
 //=============================================================================================================
 /**
-* Declares a pair structure for index combinations used in RAP MUSIC algorithm.
+* Declares a pair structure for the best correlated index combination found by the RAP MUSIC pair scan.
 */
-typedef struct Pair
+typedef struct PairCorrelation
 {
-    int x1; /**< Index one of the pair. */
-    int x2; /**< Index two of the pair. */
-} Pair;
+    double cor; /**< Subspace correlation of the pair. */
+    int x1;     /**< Index one of the pair. */
+    int x2;     /**< Index two of the pair. */
+} PairCorrelation;
+
+
+//=============================================================================================================
+/**
+* Declares the per grid point factors used by the batched subspace correlation of the RAP MUSIC pair scan.
+*/
+typedef struct SubcorrBasis
+{
+    Eigen::MatrixXd Q;          /**< Orthonormal bases of the projected gain matrix 3-column blocks (channels x 3*points). */
+    Eigen::MatrixXd R;          /**< Upper triangular factors of the blocks, G_i = Q_i * R_i (3 x 3*points). */
+    Eigen::MatrixXd Q_T_U_B;    /**< Q^T * U_B, the signal subspace expressed in the bases (3*points x rank). */
+} SubcorrBasis;
 
 
 
@@ -166,6 +182,17 @@ public:
 
     virtual MNESourceEstimate calculateInverse(const MatrixXd& p_matMeasurement, QList< DipolePair<double> > &p_RapDipoles) const;
 
+    //=========================================================================================================
+    /**
+    * Searches the correlated dipole pairs of a given signal subspace. This is the RAP MUSIC scan without the
+    * decomposition of the measurement, e.g. for a signal subspace which is tracked online (SubspaceTracker).
+    *
+    * @param[in] p_matPhi_s     The signal subspace (channels x rank) with orthonormal columns.
+    * @param[out] p_RapDipoles  The found dipole pairs.
+    * @return   true if successful, false otherwise.
+    */
+    virtual bool scanSubspace(const MatrixXd& p_matPhi_s, QList< DipolePair<double> > &p_RapDipoles) const;
+
     virtual const char* getName() const;
 
     virtual const MNESourceSpace& getSourceSpace() const;
@@ -179,6 +206,23 @@ public:
     */
     void setStcAttr(int p_iSampStcWin, float p_fStcOverlap);
 
+    //=========================================================================================================
+    /**
+    * Selects the subspace correlation path of the pair scan.
+    *
+    * @param[in] p_bBatched     True to factorize every grid point once per iteration and to reuse the factors for
+    *                           all its pairs, false (default) to compute one SVD per pair.
+    */
+    void setBatchedSubcorr(bool p_bBatched);
+
+    //=========================================================================================================
+    /**
+    * Sets whether scanSubspace reports every iteration. Switch it off when scanning continuously.
+    *
+    * @param[in] p_bVerbose     True (default) to print the correlation and timing of every iteration.
+    */
+    void setVerbose(bool p_bVerbose);
+
 protected:
     //=========================================================================================================
     /**
@@ -224,6 +268,36 @@ protected:
     */
     static double subcorr(MatrixX6T& p_matProj_G, const MatrixXT& p_matU_B, Vector6T& p_vec_phi_k_1);
 
+    //=========================================================================================================
+    /**
+    * Batched subspace correlation of the gain matrix pair (p_iIdx1, p_iIdx2), based on the per grid point
+    * factors of calcSubcorrBasis. Uses only fixed size 6 x 6 kernels and does not allocate heap memory.
+    * The components of the pair are retained by the same absolute criterion as the per pair SVD (getRank):
+    * singular values above 10^-5, at least one. The singular values are taken from the eigenvalues of the 6 x 6
+    * Gram matrix of the pair, which are only accurate to about eps * sigma_max^2. If a singular value is too
+    * close to the threshold to decide, the pair is left to the per pair SVD.
+    *
+    * @param[in] p_basis    The factors of the projected Lead Field and the projected signal subspace.
+    * @param[in] p_iIdx1    first Lead Field index point
+    * @param[in] p_iIdx2    second Lead Field index point
+    * @param[out] p_dCor    The maximal correlation c_1 of the subspace correlation of the Lead Field combination
+    *                       and the projected measurement.
+    * @return   true if the correlation was computed, false if the pair has to be computed by the per pair SVD.
+    */
+    static bool subcorr(const SubcorrBasis& p_basis, int p_iIdx1, int p_iIdx2, double& p_dCor);
+
+    //=========================================================================================================
+    /**
+    * Calculates the factors for the batched subspace correlation: a QR decomposition of each 3-column grid point
+    * block of the projected Lead Field and the signal subspace expressed in these bases. No components are dropped
+    * here, the rank is decided per pair by subcorr.
+    *
+    * @param[in] p_matProj_LeadField    The projected Lead Field matrix.
+    * @param[in] p_matU_B   The matrix U is the subspace projection of the orthogonal projected Phi_s
+    * @param[out] p_basis   The factors.
+    */
+    void calcSubcorrBasis(const MatrixXT& p_matProj_LeadField, const MatrixXT& p_matU_B, SubcorrBasis& p_basis) const;
+
     //=========================================================================================================
     /**
     * Calculates the accumulated manifold vectors A_{k1}
@@ -250,18 +324,27 @@ protected:
 
     //=========================================================================================================
     /**
-    * Pre-Calculates the gain matrix index combinations to search for a two dipole independent topography
-    * (IT = source).
+    * Scans all gain matrix index combinations to search for the best correlated two dipole independent
+    * topography (IT = source). The pair indices are computed on the fly; the combinations are processed in
+    * tiles of grid point blocks, whose projected gain columns fit into the cache, and every thread keeps its
+    * own maximum which are reduced at the end.
+    *
+    * @param[in] p_matProj_LeadField    The projected Lead Field matrix.
+    * @param[in] p_matU_B   The matrix U is the subspace projection of the orthogonal projected Phi_s
+    * @return   The best correlated pair. Ties are resolved to the lowest combination index.
+    */
+    PairCorrelation scanPairs(const MatrixXT& p_matProj_LeadField, const MatrixXT& p_matU_B) const;
+
+    //=========================================================================================================
+    /**
+    * Whether pair correlation p_candidate is better than p_best. Equal correlations are resolved to the lower
+    * combination index, which keeps the threaded scan deterministic.
     *
-    * @param[in] p_iNumPoints   The number of Lead Field points -> for dimension check
-    * @param[in] p_iNumCombinations The number of pair index combinations.
-    * @param[out] p_ppPairIdxCombinations   The destination which contains pointer to pointer of index
-    *                                       combinations of Lead Field indices -> Number of pointers =
-    *                                       Combination (number of grid points over 2 = Num + 1 C 2)
+    * @param[in] p_candidate    The candidate pair.
+    * @param[in] p_best         The current best pair.
+    * @return   true if p_candidate is better than p_best, false otherwise.
     */
-    void calcPairCombinations(  const int p_iNumPoints,
-                                const int p_iNumCombinations,
-                                Pair** p_ppPairIdxCombinations) const;
+    static inline bool isBetterPair(const PairCorrelation& p_candidate, const PairCorrelation& p_best);
 
     //=========================================================================================================
     /**
@@ -320,10 +403,11 @@ protected:
     int m_iNumChannels;                 /**< Number of channels */
     int m_iNumLeadFieldCombinations;    /**< Number of Lead Filed combinations (grid points + 1 over 2)*/
 
-    Pair** m_ppPairIdxCombinations; /**< Index combination vector with grid pair indices. */
-
     int m_iMaxNumThreads;   /**< Number of available CPU threads. */
 
+    bool m_bBatchedSubcorr; /**< Whether the pair scan uses the batched subspace correlation. */
+    bool m_bVerbose;        /**< Whether scanSubspace reports every iteration. */
+
     bool m_bIsInit; /**< Wether the algorithm is initialized. */
 
     //Stc stuff
@@ -370,6 +454,18 @@ protected:
 // INLINE DEFINITIONS
 //=============================================================================================================
 
+inline bool RapMusic::isBetterPair(const PairCorrelation& p_candidate, const PairCorrelation& p_best)
+{
+    if(p_candidate.cor != p_best.cor)
+        return p_candidate.cor > p_best.cor;
+
+    //Combinations are ordered row wise -> lower index first
+    return p_candidate.x1 < p_best.x1 || (p_candidate.x1 == p_best.x1 && p_candidate.x2 < p_best.x2);
+}
+
+
+//*************************************************************************************************************
+
 inline int RapMusic::getRank(const MatrixXT& p_matSigma)
 {
     int t_iRank;
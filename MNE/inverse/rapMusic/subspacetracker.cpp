@@ -0,0 +1,170 @@
+//=============================================================================================================
+/**
+* @file     subspacetracker.cpp
+* @author   Christoph Dinh <christoph.dinh@tu-ilmenau.de>
+* @version  1.0
+* @date     March, 2014
+*
+* @section  LICENSE
+*
+* Copyright (C) 2014, Christoph Dinh. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+* the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+*       following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+*       the following disclaimer in the documentation and/or other materials provided with the distribution.
+*     * Neither the name of the Massachusetts General Hospital nor the names of its contributors may be used
+*       to endorse or promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MASSACHUSETTS GENERAL HOSPITAL BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*
+*
+* @brief    Implementation of the SubspaceTracker Class.
+*
+*/
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include "subspacetracker.h"
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Eigen INCLUDES
+//=============================================================================================================
+
+#include <Eigen/QR>
+#include <Eigen/Eigenvalues>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// STL INCLUDES
+//=============================================================================================================
+
+#include <iostream>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace INVERSELIB;
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE MEMBER METHODS
+//=============================================================================================================
+
+SubspaceTracker::SubspaceTracker(int p_iNumChannels, int p_iWindowSize, int p_iRank, int p_iNumIterations)
+: m_iNumChannels(p_iNumChannels)
+, m_iWindowSize(p_iWindowSize)
+, m_iRank(p_iRank < p_iNumChannels ? p_iRank : p_iNumChannels)
+, m_iNumIterations(p_iNumIterations > 0 ? p_iNumIterations : 1)
+, m_matWindow(p_iNumChannels, p_iWindowSize)
+{
+    clear();
+}
+
+
+//*************************************************************************************************************
+
+void SubspaceTracker::append(const MatrixXd& p_matSamples)
+{
+    if(p_matSamples.rows() != m_iNumChannels)
+    {
+        std::cout << "SubspaceTracker: Number of channels (" << p_matSamples.rows() << ") doesn't match (" << m_iNumChannels << ")." << std::endl;
+        return;
+    }
+
+    //Only the latest window size samples are of interest
+    int t_iStart = 0;
+    if(p_matSamples.cols() >= m_iWindowSize)
+    {
+        t_iStart = p_matSamples.cols() - m_iWindowSize;
+        clear();
+    }
+
+    //Block update of the covariance - ring buffer chunks
+    while(t_iStart < p_matSamples.cols())
+    {
+        int t_iChunk = p_matSamples.cols() - t_iStart;
+        if(t_iChunk > m_iWindowSize - m_iWindowPos)
+            t_iChunk = m_iWindowSize - m_iWindowPos;
+
+        if(m_iNumSamples == m_iWindowSize)
+            m_matCov.selfadjointView<Lower>().rankUpdate(m_matWindow.middleCols(m_iWindowPos, t_iChunk), -1.0);
+
+        m_matWindow.middleCols(m_iWindowPos, t_iChunk) = p_matSamples.middleCols(t_iStart, t_iChunk);
+        m_matCov.selfadjointView<Lower>().rankUpdate(m_matWindow.middleCols(m_iWindowPos, t_iChunk), 1.0);
+
+        m_iWindowPos = (m_iWindowPos + t_iChunk) % m_iWindowSize;
+        m_iNumSamples = m_iNumSamples + t_iChunk < m_iWindowSize ? m_iNumSamples + t_iChunk : m_iWindowSize;
+        m_iSamplesSinceRefresh += t_iChunk;
+        t_iStart += t_iChunk;
+    }
+
+    if(m_iNumSamples < m_iWindowSize)
+        return;
+
+    //Recompute the covariance once per window to get rid of the accumulated round-off of the downdates
+    if(m_iSamplesSinceRefresh >= m_iWindowSize)
+    {
+        m_matCov.setZero();
+        m_matCov.selfadjointView<Lower>().rankUpdate(m_matWindow, 1.0);
+        m_iSamplesSinceRefresh = 0;
+    }
+
+    updateSubspace();
+}
+
+
+//*************************************************************************************************************
+
+void SubspaceTracker::clear()
+{
+    m_iWindowPos = 0;
+    m_iNumSamples = 0;
+    m_iSamplesSinceRefresh = 0;
+
+    m_matCov = MatrixXd::Zero(m_iNumChannels, m_iNumChannels);
+    m_matPhi_s.resize(m_iNumChannels, m_iRank);
+    m_bSubspaceValid = false;
+}
+
+
+//*************************************************************************************************************
+
+void SubspaceTracker::updateSubspace()
+{
+    if(!m_bSubspaceValid)
+    {
+        //Cold start - full decomposition, eigenvalues are sorted in increasing order
+        SelfAdjointEigenSolver<MatrixXd> t_eigCov(m_matCov);
+        m_matPhi_s = t_eigCov.eigenvectors().rightCols(m_iRank).rowwise().reverse();
+        m_bSubspaceValid = true;
+        return;
+    }
+
+    //Warm start - orthogonal iteration Phi_s = orth(F*F^T * Phi_s)
+    for(int i = 0; i < m_iNumIterations; ++i)
+    {
+        MatrixXd t_matZ = m_matCov.selfadjointView<Lower>() * m_matPhi_s;
+        HouseholderQR<MatrixXd> t_qrZ(t_matZ);
+        m_matPhi_s = t_qrZ.householderQ() * MatrixXd::Identity(m_iNumChannels, m_iRank);
+    }
+}
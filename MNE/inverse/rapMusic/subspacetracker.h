@@ -0,0 +1,193 @@
+//=============================================================================================================
+/**
+* @file     subspacetracker.h
+* @author   Christoph Dinh <christoph.dinh@tu-ilmenau.de>
+* @version  1.0
+* @date     March, 2014
+*
+* @section  LICENSE
+*
+* Copyright (C) 2014, Christoph Dinh. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+* the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+*       following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+*       the following disclaimer in the documentation and/or other materials provided with the distribution.
+*     * Neither the name of the Massachusetts General Hospital nor the names of its contributors may be used
+*       to endorse or promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MASSACHUSETTS GENERAL HOSPITAL BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*
+*
+* @brief    SubspaceTracker class declaration.
+*
+*/
+
+#ifndef SUBSPACETRACKER_H
+#define SUBSPACETRACKER_H
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include "../inverse_global.h"
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// QT INCLUDES
+//=============================================================================================================
+
+#include <QSharedPointer>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Eigen INCLUDES
+//=============================================================================================================
+
+#include <Eigen/Core>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE NAMESPACE INVERSELIB
+//=============================================================================================================
+
+namespace INVERSELIB
+{
+
+//*************************************************************************************************************
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace Eigen;
+
+
+//=============================================================================================================
+/**
+* Keeps the signal subspace of a sliding measurement window up to date while samples arrive and leave the
+* window. The window covariance F*F^T is updated by block rank updates of the entering and leaving samples;
+* the rank n signal subspace is tracked by orthogonal iteration, warm started with the previous subspace. A
+* full decomposition is only done once, when the window is filled for the first time.
+*
+* @brief Online signal subspace of a sliding window for RAP MUSIC.
+*/
+class INVERSESHARED_EXPORT SubspaceTracker
+{
+public:
+    typedef QSharedPointer<SubspaceTracker> SPtr;             /**< Shared pointer type for SubspaceTracker. */
+    typedef QSharedPointer<const SubspaceTracker> ConstSPtr;  /**< Const shared pointer type for SubspaceTracker. */
+
+    //=========================================================================================================
+    /**
+    * Constructs the subspace tracker.
+    *
+    * @param[in] p_iNumChannels     Number of channels.
+    * @param[in] p_iWindowSize      Number of samples of the sliding window.
+    * @param[in] p_iRank            Dimension n of the tracked signal subspace.
+    * @param[in] p_iNumIterations   Orthogonal iterations per update (default 1).
+    */
+    SubspaceTracker(int p_iNumChannels, int p_iWindowSize, int p_iRank, int p_iNumIterations = 1);
+
+    //=========================================================================================================
+    /**
+    * Appends new samples to the sliding window. The oldest samples leave the window and the signal subspace is
+    * updated as soon as the window is filled.
+    *
+    * @param[in] p_matSamples   The new samples (channels x samples).
+    */
+    void append(const MatrixXd& p_matSamples);
+
+    //=========================================================================================================
+    /**
+    * Removes all samples and the tracked subspace.
+    */
+    void clear();
+
+    //=========================================================================================================
+    /**
+    * Returns whether the window is filled and the signal subspace is valid.
+    *
+    * @return true if the signal subspace is valid, false otherwise.
+    */
+    inline bool isFull() const;
+
+    //=========================================================================================================
+    /**
+    * Returns the tracked signal subspace.
+    *
+    * @return the signal subspace (channels x rank) with orthonormal columns.
+    */
+    inline const MatrixXd& signalSubspace() const;
+
+    //=========================================================================================================
+    /**
+    * Returns the dimension of the tracked signal subspace.
+    *
+    * @return the rank n.
+    */
+    inline int rank() const;
+
+private:
+    //=========================================================================================================
+    /**
+    * Updates the signal subspace from the current window covariance.
+    */
+    void updateSubspace();
+
+    int m_iNumChannels;         /**< Number of channels. */
+    int m_iWindowSize;          /**< Number of samples of the sliding window. */
+    int m_iRank;                /**< Dimension of the signal subspace. */
+    int m_iNumIterations;       /**< Orthogonal iterations per update. */
+
+    MatrixXd m_matWindow;       /**< Ring buffer of the window samples. */
+    int m_iWindowPos;           /**< Position of the oldest sample in the ring buffer. */
+    int m_iNumSamples;          /**< Number of samples in the window. */
+    int m_iSamplesSinceRefresh; /**< Samples since the covariance was recomputed from the window. */
+
+    MatrixXd m_matCov;          /**< Window covariance F*F^T - only the lower triangular part is kept up to date. */
+    MatrixXd m_matPhi_s;        /**< Tracked signal subspace. */
+    bool m_bSubspaceValid;      /**< Whether m_matPhi_s was initialized. */
+};
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INLINE DEFINITIONS
+//=============================================================================================================
+
+inline bool SubspaceTracker::isFull() const
+{
+    return m_bSubspaceValid;
+}
+
+
+//*************************************************************************************************************
+
+inline const MatrixXd& SubspaceTracker::signalSubspace() const
+{
+    return m_matPhi_s;
+}
+
+
+//*************************************************************************************************************
+
+inline int SubspaceTracker::rank() const
+{
+    return m_iRank;
+}
+
+} //NAMESPACE
+
+#endif // SUBSPACETRACKER_H
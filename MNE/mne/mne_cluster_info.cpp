@@ -67,3 +67,88 @@ void MNEClusterInfo::clear()
     clusterDistances.clear();
     clusterLabelIds.clear();
 }
+
+
+//*************************************************************************************************************
+
+void MNEClusterInfo::writeToStream(FiffStream* p_pStream) const
+{
+    qint32 nClust = this->numClust();
+    qint32 nTotal = 0;
+    for(qint32 i = 0; i < nClust; ++i)
+        nTotal += this->clusterVertnos[i].size();
+
+    VectorXi sizes(nClust);
+    VectorXi labelIds(nClust);
+    VectorXi vertices(nTotal);
+    VectorXd distances(nTotal);
+
+    qint32 offset = 0;
+    for(qint32 i = 0; i < nClust; ++i)
+    {
+        qint32 n = this->clusterVertnos[i].size();
+        sizes[i] = n;
+        labelIds[i] = this->clusterLabelIds[i];
+        vertices.segment(offset, n) = this->clusterVertnos[i];
+        distances.segment(offset, n) = this->clusterDistances[i];
+        offset += n;
+    }
+
+    p_pStream->write_int(FIFF_MNE_CLUSTER_SIZES, sizes.data(), nClust);
+    p_pStream->write_int(FIFF_MNE_CLUSTER_LABEL_IDS, labelIds.data(), nClust);
+    p_pStream->write_int(FIFF_MNE_CLUSTER_VERTICES, vertices.data(), nTotal);
+    p_pStream->write_double(FIFF_MNE_CLUSTER_DISTANCES, distances.data(), nTotal);
+}
+
+
+//*************************************************************************************************************
+
+bool MNEClusterInfo::readFromStream(FiffStream* p_pStream, const FiffDirTree& p_Node, MNEClusterInfo& p_ClusterInfo)
+{
+    p_ClusterInfo.clear();
+
+    FiffTag::SPtr t_pTag;
+
+    if(!p_Node.find_tag(p_pStream, FIFF_MNE_CLUSTER_SIZES, t_pTag) || !t_pTag->toInt())
+    {
+        printf("Cluster sizes not found.\n");
+        return false;
+    }
+    qint32 nClust = t_pTag->size()/4;
+    VectorXi sizes = Map<VectorXi>(t_pTag->toInt(), nClust);
+
+    if(!p_Node.find_tag(p_pStream, FIFF_MNE_CLUSTER_LABEL_IDS, t_pTag) || !t_pTag->toInt() || t_pTag->size()/4 != nClust)
+    {
+        printf("Cluster label ids not found.\n");
+        return false;
+    }
+    VectorXi labelIds = Map<VectorXi>(t_pTag->toInt(), nClust);
+
+    qint32 nTotal = sizes.sum();
+
+    if(!p_Node.find_tag(p_pStream, FIFF_MNE_CLUSTER_VERTICES, t_pTag) || !t_pTag->toInt() || t_pTag->size()/4 != nTotal)
+    {
+        printf("Cluster vertices not found.\n");
+        return false;
+    }
+    VectorXi vertices = Map<VectorXi>(t_pTag->toInt(), nTotal);
+
+    if(!p_Node.find_tag(p_pStream, FIFF_MNE_CLUSTER_DISTANCES, t_pTag) || !t_pTag->toDouble() || t_pTag->size()/8 != nTotal)
+    {
+        printf("Cluster distances not found.\n");
+        return false;
+    }
+    VectorXd distances = Map<VectorXd>(t_pTag->toDouble(), nTotal);
+
+    qint32 offset = 0;
+    for(qint32 i = 0; i < nClust; ++i)
+    {
+        qint32 n = sizes[i];
+        p_ClusterInfo.clusterVertnos.append(vertices.segment(offset, n));
+        p_ClusterInfo.clusterDistances.append(distances.segment(offset, n));
+        p_ClusterInfo.clusterLabelIds.append(labelIds[i]);
+        offset += n;
+    }
+
+    return true;
+}
@@ -44,6 +44,14 @@
 #include "mne_global.h"
 
 
+//*************************************************************************************************************
+//=============================================================================================================
+// FIFF INCLUDES
+//=============================================================================================================
+
+#include <fiff/fiff.h>
+
+
 //*************************************************************************************************************
 //=============================================================================================================
 // Eigen INCLUDES
@@ -75,6 +83,7 @@ namespace MNELIB
 //=============================================================================================================
 
 using namespace Eigen;
+using namespace FIFFLIB;
 
 
 //=============================================================================================================
@@ -117,6 +126,27 @@ public:
     */
     inline qint32 numClust() const;
 
+    //=========================================================================================================
+    /**
+    * Writes the cluster information to a FIF stream. The per cluster vertnos and distances are stored
+    * concatenated together with the cluster sizes.
+    *
+    * @param[in] p_pStream  The stream to write to.
+    */
+    void writeToStream(FiffStream* p_pStream) const;
+
+    //=========================================================================================================
+    /**
+    * Reads the cluster information which was written by writeToStream from a FIF node.
+    *
+    * @param[in] p_pStream      The opened fif stream to read from.
+    * @param[in] p_Node         The node containing the cluster information.
+    * @param[out] p_ClusterInfo The read cluster information.
+    *
+    * @return true if succeeded, false otherwise.
+    */
+    static bool readFromStream(FiffStream* p_pStream, const FiffDirTree& p_Node, MNEClusterInfo& p_ClusterInfo);
+
 public:
     QList<VectorXi> clusterVertnos;    /**< Vertnos which belong to corresponding cluster. */
     QList<VectorXd> clusterDistances;  /**< Distances to clusters centroid. */
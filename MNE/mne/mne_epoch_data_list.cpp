@@ -41,6 +41,15 @@
 #include "mne_epoch_data_list.h"
 
 
+//*************************************************************************************************************
+//=============================================================================================================
+// Qt INCLUDES
+//=============================================================================================================
+
+#include <QMap>
+#include <QtConcurrent>
+
+
 //*************************************************************************************************************
 //=============================================================================================================
 // USED NAMESPACES
@@ -125,3 +134,150 @@ FiffEvoked MNEEpochDataList::average(FiffInfo& info, fiff_int_t first, fiff_int_
 
     return p_evoked;
 }
+
+
+//*************************************************************************************************************
+
+MNEEpochDataList MNEEpochDataList::readEpochs(FiffRawData& raw, const MatrixXi& events, float tmin, float tmax, qint32 event, const RowVectorXi& picks)
+{
+    MNEEpochDataList data;
+
+    //
+    //    Select the desired events
+    //
+    qint32 p, k;
+    QList<qint32> selected;
+    for (p = 0; p < events.rows(); ++p)
+        if (events(p,1) == 0 && events(p,2) == event)
+            selected.append(p);
+
+    if (selected.size() > 0)
+        printf("%d matching events found\n",selected.size());
+    else
+    {
+        printf("No desired events found.\n");
+        return data;
+    }
+
+    raw.prepare_read(picks);
+    qint32 nchan = picks.size() > 0 ? picks.size() : raw.info.nchan;
+
+    //
+    //  Set up the epochs and collect per raw buffer the epochs which need samples of it
+    //
+    QMap<qint32, EpochReadJob> t_qMapJobs;
+    fiff_int_t event_samp, from, to;
+    qint32 first_buf, last_buf;
+    for (p = 0; p < selected.size(); ++p)
+    {
+        event_samp = events(selected[p],0);
+        from = event_samp + tmin*raw.info.sfreq;
+        to   = event_samp + floor(tmax*raw.info.sfreq + 0.5);
+
+        if (from < raw.first_samp || to > raw.last_samp || !raw.rawdir_range(from, to, first_buf, last_buf))
+        {
+            printf("Epoch of event at sample %d is outside of the data range - omitted.\n", event_samp);
+            continue;
+        }
+
+        MNEEpochData::SPtr epoch(new MNEEpochData());
+        epoch->epoch.resize(nchan, to-from+1);
+        epoch->event = event;
+        epoch->tmin = ((float)(from)-(float)(raw.first_samp))/raw.info.sfreq;
+        epoch->tmax = ((float)(to)-(float)(raw.first_samp))/raw.info.sfreq;
+        data.append(epoch);
+
+        for (k = first_buf; k <= last_buf; ++k)
+        {
+            EpochReadJob& t_job = t_qMapJobs[k];
+            t_job.pRaw = &raw;
+            t_job.iBuffer = k;
+            t_job.failed = false;
+            t_job.epochs.append(epoch);
+            t_job.froms.append(from);
+        }
+    }
+
+    //
+    //  Decode - jobs are ordered by buffer, i.e. by file position. Buffers outside of the memory map are read
+    //  through the shared stream and tag pool of the raw data, so go parallel only if all of them are mapped.
+    //
+    printf("Reading %d epochs from %d buffers... ", data.size(), t_qMapJobs.size());
+    QList<EpochReadJob> t_qListJobs = t_qMapJobs.values();
+    bool t_bParallel = raw.filemap && raw.filemap->isMapped();
+    for (k = 0; t_bParallel && k < t_qListJobs.size(); ++k)
+    {
+        const FiffDirEntry& t_ent = raw.rawdir[t_qListJobs[k].iBuffer].ent;
+        t_bParallel = t_ent.kind == -1 || raw.filemap->contains(t_ent);
+    }
+
+    if (t_bParallel)
+        QtConcurrent::blockingMap(t_qListJobs, &EpochReadJob::read);
+    else
+        for (k = 0; k < t_qListJobs.size(); ++k)
+            t_qListJobs[k].read();
+
+    //
+    //  Omit the epochs with buffers which could not be decoded
+    //
+    for (k = 0; k < t_qListJobs.size(); ++k)
+    {
+        if (!t_qListJobs[k].failed)
+            continue;
+        for (p = 0; p < t_qListJobs[k].epochs.size(); ++p)
+        {
+            if (data.removeOne(t_qListJobs[k].epochs[p]))
+                printf("Epoch starting at sample %d could not be read - omitted.\n", t_qListJobs[k].froms[p]);
+        }
+    }
+    printf("[done]\n");
+
+    return data;
+}
+
+
+//*************************************************************************************************************
+
+void EpochReadJob::read()
+{
+    const FiffRawDir& t_RawDir = pRaw->rawdir[iBuffer];
+    qint32 i;
+    fiff_int_t from, to;
+    MatrixXd work;
+
+    if (epochs.size() == 1)
+    {
+        //
+        //  Single epoch - decode straight into it
+        //
+        from = qMax(froms[0], t_RawDir.first);
+        to   = qMin(froms[0] + (fiff_int_t)epochs[0]->epoch.cols() - 1, t_RawDir.last);
+        failed = !pRaw->read_raw_buffer(iBuffer, from - t_RawDir.first, to - from + 1, epochs[0]->epoch, from - froms[0], work);
+        return;
+    }
+
+    //
+    //  Union of the samples needed by the epochs
+    //
+    fiff_int_t first = t_RawDir.last;
+    fiff_int_t last  = t_RawDir.first;
+    for (i = 0; i < epochs.size(); ++i)
+    {
+        first = qMin(first, qMax(froms[i], t_RawDir.first));
+        last  = qMax(last, qMin(froms[i] + (fiff_int_t)epochs[i]->epoch.cols() - 1, t_RawDir.last));
+    }
+
+    MatrixXd t_matBuf(epochs[0]->epoch.rows(), last - first + 1);
+    if (!pRaw->read_raw_buffer(iBuffer, first - t_RawDir.first, last - first + 1, t_matBuf, 0, work))
+    {
+        failed = true;
+        return;
+    }
+
+    for (i = 0; i < epochs.size(); ++i)
+    {
+        from = qMax(froms[i], t_RawDir.first);
+        to   = qMin(froms[i] + (fiff_int_t)epochs[i]->epoch.cols() - 1, t_RawDir.last);
+        epochs[i]->epoch.block(0, from - froms[i], t_matBuf.rows(), to - from + 1) = t_matBuf.block(0, from - first, t_matBuf.rows(), to - from + 1);
+    }
+}
@@ -43,6 +43,7 @@
 
 #include <fiff/fiff_types.h>
 #include <fiff/fiff_evoked.h>
+#include <fiff/fiff_raw_data.h>
 
 
 //*************************************************************************************************************
@@ -77,6 +78,31 @@ namespace MNELIB
 //=============================================================================================================
 
 
+//*************************************************************************************************************
+//=============================================================================================================
+// TYPEDEFS
+//=============================================================================================================
+
+//=============================================================================================================
+/**
+* Read job of MNEEpochDataList::readEpochs: one raw buffer and all epochs which need samples of it
+*/
+struct EpochReadJob
+{
+    const FiffRawData*          pRaw;       /**< The raw data to read from */
+    qint32                      iBuffer;    /**< Index of the rawdir entry */
+    QList<MNEEpochData::SPtr>   epochs;     /**< Epochs overlapping with the buffer */
+    QList<fiff_int_t>           froms;      /**< First sample of each epoch */
+    bool                        failed;     /**< Set by read() if the buffer could not be decoded */
+
+    //=========================================================================================================
+    /**
+    * Decodes the needed part of the buffer once and distributes it to the epochs.
+    */
+    void read();
+};
+
+
 //=============================================================================================================
 /**
 * Epoch data list, which corresponds to a set of events
@@ -112,6 +138,25 @@ public:
     * @param[in] proj       Apply SSP projection vectors (optional, default = false)
     */
     FiffEvoked average(FiffInfo& p_info, fiff_int_t first, fiff_int_t last, VectorXi sel = defaultVectorXi, bool proj = false);
+
+    //=========================================================================================================
+    /**
+    * Reads the epochs around all events of the given kind. The raw buffers which are needed are sorted and each
+    * one is decoded only once, even if several epochs overlap with it. If all needed buffers lie within the
+    * memory map of the raw file they are decoded in parallel. Epochs which exceed the data range or need a buffer
+    * which can't be decoded are omitted.
+    * The projection and compensation set up in raw (raw.proj, raw.comp) are applied.
+    *
+    * @param[in] raw        the raw data to read from
+    * @param[in] events     events (sample, before, after) as read by MNE::read_events
+    * @param[in] tmin       start time of the epochs relative to the event in seconds
+    * @param[in] tmax       end time of the epochs relative to the event in seconds
+    * @param[in] event      the event code of interest
+    * @param[in] picks      channel selection (optional)
+    *
+    * @return the epochs
+    */
+    static MNEEpochDataList readEpochs(FiffRawData& raw, const MatrixXi& events, float tmin, float tmax, qint32 event, const RowVectorXi& picks = defaultRowVectorXi);
 };
 
 } // NAMESPACE
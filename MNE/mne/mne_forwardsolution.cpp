@@ -58,8 +58,13 @@
 //=============================================================================================================
 
 #include <iostream>
+#include <algorithm>
+#include <vector>
+#include <cstdio>
 #include <QtConcurrent>
 #include <QFuture>
+#include <QCryptographicHash>
+#include <QDir>
 
 
 //*************************************************************************************************************
@@ -224,29 +229,26 @@ MNEForwardSolution MNEForwardSolution::cluster_forward_solution(AnnotationSet &p
 //    //DEBUG END
 
 
-    KMeans t_kMeans(QString("cityblock"), QString("sample"), 5);//QString("sqeuclidean")//QString("sample")//cityblock
-    MatrixXd t_LF_new;
+    qint32 nSens = this->sol->data.rows();
 
-    qint32 count;
-    qint32 offset;
+    //
+    // Collect the regions of both hemispheres
+    //
+    QList<RegionDataIn> t_qListRegionDataIn;
+    QList<qint32> t_qListRegionHemi;
+    QList<VectorXi> t_qListLabelIds;
 
     for(qint32 h = 0; h < this->src.size(); ++h )//obj.sizeForwardSolution)
     {
-        count = 0;
-        offset = 0;
+        qint32 offset = 0;
 
         // Offset for continuous indexing;
-        if(h > 0)
-            for(qint32 j = 0; j < h; ++j)
-                offset += this->src[j].nuse;
-
-        if(h == 0)
-            printf("Cluster Left Hemisphere\n");
-        else
-            printf("Cluster Right Hemisphere\n");
+        for(qint32 j = 0; j < h; ++j)
+            offset += this->src[j].nuse;
 
         Colortable t_CurrentColorTable = p_AnnotationSet[h].getColortable();
         VectorXi label_ids = t_CurrentColorTable.getLabelIds();
+        t_qListLabelIds.append(label_ids);
 
         // Get label ids for every vertex
         VectorXi vertno_labeled = VectorXi::Zero(this->src[h].vertno.rows());
@@ -255,17 +257,10 @@ MNEForwardSolution MNEForwardSolution::cluster_forward_solution(AnnotationSet &p
         for(qint32 i = 0; i < vertno_labeled.rows(); ++i)
             vertno_labeled[i] = p_AnnotationSet[h].getLabelIds()[this->src[h].vertno[i]];
 
-        //iterate over labels
-        MatrixXd t_LF_partial;
-        //ToDo OpenMP
         for (qint32 i = 0; i < label_ids.rows(); ++i)
         {
-
             if (label_ids[i] != 0)
             {
-                QString curr_name = t_CurrentColorTable.struct_names[i];//obj.label2AtlasName(label(i));
-                printf("\tCluster %d / %li %s...", i+1, label_ids.rows(), curr_name.toUtf8().constData());
-
                 //
                 // Get source space indeces
                 //
@@ -283,147 +278,147 @@ MNEForwardSolution MNEForwardSolution::cluster_forward_solution(AnnotationSet &p
                 }
                 idcs.conservativeResize(c);
 
-                //get selected LF
-                MatrixXd t_LF(this->sol->data.rows(), idcs.rows()*3);
+                if (c > 0)
+                {
+                    RegionDataIn t_sensG;
 
-                for(qint32 j = 0; j < idcs.rows(); ++j)
-                    t_LF.block(0, j*3, t_LF.rows(), 3) = this->sol->data.block(0, (idcs[j]+offset)*3, t_LF.rows(), 3);
+                    t_sensG.idcs = idcs;
+                    t_sensG.iLabelIdxIn = i;
+                    t_sensG.iSeed = (quint32)(h << 16) + (quint32)i;
+                    t_sensG.nClusters = ceil((double)c/(double)p_iClusterSize);
 
-                qint32 nSens = t_LF.rows();
-                qint32 nSources = t_LF.cols()/3;
-                qint32 nClusters = 0;
+                    // Reshape Input data -> sources rows; sensors columns
+                    t_sensG.matRoiG = MatrixXd(c, 3*nSens);
+                    for(qint32 k = 0; k < c; ++k)
+                        for(qint32 j = 0; j < nSens; ++j)
+                            t_sensG.matRoiG.block(k,j*3,1,3) = this->sol->data.block(j, (idcs[k]+offset)*3, 1, 3);
 
-                if (nSources > 0)
+                    t_qListRegionDataIn.append(t_sensG);
+                    t_qListRegionHemi.append(h);
+                }
+                else
                 {
-                    nClusters = ceil((double)nSources/(double)p_iClusterSize);
+                    printf("\tCluster %d / %li %s failed! Label contains no sources.\n", i+1, label_ids.rows(), t_CurrentColorTable.struct_names[i].toUtf8().constData());
+                }
+            }
+        }
+    }
 
-                    printf("%d Cluster(s)... ", nClusters);
+    //
+    // Cluster the regions concurrently, largest first: the thread pool hands out the regions one by one, so
+    // the big regions do not end up at the tail of the schedule. Every region carries its own seed.
+    //
+    std::vector< std::pair<qint32, qint32> > t_vecSizeIdx;
+    for(qint32 r = 0; r < t_qListRegionDataIn.size(); ++r)
+        t_vecSizeIdx.push_back(std::pair<qint32, qint32>(-(qint32)t_qListRegionDataIn[r].matRoiG.rows(), r));
+    std::sort(t_vecSizeIdx.begin(), t_vecSizeIdx.end());  // descending size, ties by region order
+
+    // The gain matrices are swapped into the schedule, the assembly only needs the indices
+    QList<RegionDataIn> t_qListScheduled;
+    for(quint32 r = 0; r < t_vecSizeIdx.size(); ++r)
+    {
+        RegionDataIn& t_in = t_qListRegionDataIn[t_vecSizeIdx[r].second];
+        MatrixXd t_matRoiG;
+        t_matRoiG.swap(t_in.matRoiG);
+        t_qListScheduled.append(t_in);
+        t_qListScheduled.last().matRoiG.swap(t_matRoiG);
+    }
 
-                    t_LF_partial = MatrixXd::Zero(nSens,nClusters*3);
+    printf("Clustering %d regions... ", t_qListScheduled.size());
+    QFuture< RegionDataOut > res = QtConcurrent::mapped(t_qListScheduled, &RegionDataIn::cluster);
+    res.waitForFinished();
+    printf("[done]\n");
+    t_qListScheduled.clear();
 
-                    // Reshape Input data -> sources rows; sensors columns
-                    MatrixXd t_sensLF(t_LF.cols()/3, 3*nSens);
-                    for(qint32 j = 0; j < nSens; ++j)
-                    {
-                        for(qint32 k = 0; k < t_sensLF.rows(); ++k)
-                            t_sensLF.block(k,j*3,1,3) = t_LF.block(j,k*3,1,3);
-                    }
+    QVector<RegionDataOut> t_qVecRegionDataOut(t_qListRegionDataIn.size());
+    for(quint32 r = 0; r < t_vecSizeIdx.size(); ++r)
+        t_qVecRegionDataOut[t_vecSizeIdx[r].second] = res.resultAt(r);
 
-                    // Kmeans Reduction
-                    VectorXi roiIdx;
-                    MatrixXd ctrs;
-                    VectorXd sumd;
-                    MatrixXd D;
+    //
+    // Assemble in hemisphere and label order
+    //
+    qint32 nClustersTotal = 0;
+    for(qint32 r = 0; r < t_qVecRegionDataOut.size(); ++r)
+        nClustersTotal += t_qVecRegionDataOut[r].ctrs.rows();
 
-                    t_kMeans.calculate(t_sensLF, nClusters, roiIdx, ctrs, sumd, D);
+    MatrixXd t_LF_new(nSens, nClustersTotal*3);
+    qint32 colOffset = 0;
 
-                    //
-                    // Assign the centroid for each cluster to the partial LF
-                    //
-                    for(qint32 j = 0; j < nSens; ++j)
-                        for(qint32 k = 0; k < nClusters; ++k)
-                            t_LF_partial.block(j, k*3, 1, 3) = ctrs.block(k,j*3,1,3);
+    qint32 r = 0;
+    for(qint32 h = 0; h < this->src.size(); ++h )
+    {
+        qint32 count = 0;
+        qint32 offset = 0;
+        for(qint32 j = 0; j < h; ++j)
+            offset += this->src[j].nuse;
 
-                    //
-                    // Get cluster indizes and its distances to the centroid
-                    //
-                    for(qint32 j = 0; j < nClusters; ++j)
-                    {
-                        VectorXi clusterIdcs = VectorXi::Zero(roiIdx.rows());
-                        VectorXd clusterDistance = VectorXd::Zero(roiIdx.rows());
-                        qint32 nClusterIdcs = 0;
-                        for(qint32 k = 0; k < roiIdx.rows(); ++k)
-                        {
-                            if(roiIdx[k] == j)
-                            {
-                                clusterIdcs[nClusterIdcs] = idcs[k];
-                                clusterDistance[nClusterIdcs] = D(k,j);
-                                ++nClusterIdcs;
-                            }
-                        }
-                        clusterIdcs.conservativeResize(nClusterIdcs);
-                        p_fwdOut.src[h].cluster_info.clusterVertnos.append(clusterIdcs);
-                        p_fwdOut.src[h].cluster_info.clusterDistances.append(clusterDistance);
-                        p_fwdOut.src[h].cluster_info.clusterLabelIds.append(label_ids[i]);
-                    }
+        for(; r < t_qListRegionDataIn.size() && t_qListRegionHemi[r] == h; ++r)
+        {
+            const RegionDataIn& t_in = t_qListRegionDataIn[r];
+            const RegionDataOut& t_out = t_qVecRegionDataOut[r];
+            qint32 nClusters = t_out.ctrs.rows();
 
-                    //
-                    // Assign partial LF to new LeadField
-                    //
-                    if(t_LF_partial.rows() > 0 && t_LF_partial.cols() > 0)
-                    {
-                        t_LF_new.conservativeResize(t_LF_partial.rows(), t_LF_new.cols() + t_LF_partial.cols());
-                        t_LF_new.block(0, t_LF_new.cols() - t_LF_partial.cols(), t_LF_new.rows(), t_LF_partial.cols()) = t_LF_partial;
+            //
+            // Assign the centroid for each cluster to the new LeadField
+            //
+            for(qint32 j = 0; j < nSens; ++j)
+                for(qint32 k = 0; k < nClusters; ++k)
+                    t_LF_new.block(j, colOffset + k*3, 1, 3) = t_out.ctrs.block(k,j*3,1,3);
 
-                        // Map the centroids to the closest rr
-                        for(qint32 k = 0; k < nClusters; ++k)
-                        {
-                            qint32 j = 0;
-
-                            double sqec = sqrt((t_LF.block(0, j*3, t_LF.rows(), 3) - t_LF_partial.block(0, k*3, t_LF_partial.rows(), 3)).array().pow(2).sum());
-                            double sqec_min = sqec;
-                            qint32 j_min = j;
-                            for(qint32 j = 1; j < idcs.rows(); ++j)
-                            {
-                                sqec = sqrt((t_LF.block(0, j*3, t_LF.rows(), 3) - t_LF_partial.block(0, k*3, t_LF_partial.rows(), 3)).array().pow(2).sum());
-                                if(sqec < sqec_min)
-                                {
-                                    sqec_min = sqec;
-                                    j_min = j;
-                                }
-                            }
-
-                            // Take the closest coordinates
-                            qint32 sel_idx = idcs[j_min];
-                            //ToDo store this in cluster info
-//                            p_fwdOut.src[h].rr.row(count) = this->src[h].rr.row(sel_idx);
-//                            p_fwdOut.src[h].nn.row(count) = MatrixXd::Zero(1,3);
-
-                            p_fwdOut.src[h].vertno[count] = this->src[h].vertno[sel_idx];
-
-                            ++count;
-                        }
+            //
+            // Get cluster indizes and its distances to the centroid
+            //
+            for(qint32 j = 0; j < nClusters; ++j)
+            {
+                VectorXi clusterIdcs = VectorXi::Zero(t_out.roiIdx.rows());
+                VectorXd clusterDistance = VectorXd::Zero(t_out.roiIdx.rows());
+                qint32 nClusterIdcs = 0;
+                for(qint32 k = 0; k < t_out.roiIdx.rows(); ++k)
+                {
+                    if(t_out.roiIdx[k] == j)
+                    {
+                        clusterIdcs[nClusterIdcs] = t_in.idcs[k];
+                        clusterDistance[nClusterIdcs] = t_out.D(k,j);
+                        ++nClusterIdcs;
                     }
-                    printf("[done]\n");
                 }
-                else
+                clusterIdcs.conservativeResize(nClusterIdcs);
+                p_fwdOut.src[h].cluster_info.clusterVertnos.append(clusterIdcs);
+                p_fwdOut.src[h].cluster_info.clusterDistances.append(clusterDistance);
+                p_fwdOut.src[h].cluster_info.clusterLabelIds.append(t_qListLabelIds[h][t_out.iLabelIdxOut]);
+            }
+
+            //
+            // Map the centroids to the closest rr
+            //
+            for(qint32 k = 0; k < nClusters; ++k)
+            {
+                double sqec_min = -1;
+                qint32 j_min = 0;
+                for(qint32 j = 0; j < t_in.idcs.rows(); ++j)
                 {
-                    printf("failed! Label contains no sources.\n");
+                    double sqec = sqrt((this->sol->data.block(0, (t_in.idcs[j]+offset)*3, nSens, 3) - t_LF_new.block(0, colOffset + k*3, nSens, 3)).array().pow(2).sum());
+                    if(sqec_min < 0 || sqec < sqec_min)
+                    {
+                        sqec_min = sqec;
+                        j_min = j;
+                    }
                 }
+
+                // Take the closest coordinates
+                qint32 sel_idx = t_in.idcs[j_min];
+                p_fwdOut.src[h].vertno[count] = this->src[h].vertno[sel_idx];
+
+                ++count;
             }
+
+            colOffset += nClusters*3;
         }
 
         //
         // Assemble new hemisphere information
         //
-//ToDo store this in cluster info
-//        p_fwdOut.src[h].rr.conservativeResize(count, 3);
-//        p_fwdOut.src[h].nn.conservativeResize(count, 3);
         p_fwdOut.src[h].vertno.conservativeResize(count);
-
-//        std::cout << "Vertno hemisphere:" << h << std::endl << p_fwdOut.src[h].vertno << std::endl;
-
-
-//        p_fwdOut.src[h].nuse_tri = 0;
-//        p_fwdOut.src[h].use_tris = MatrixX3i(0,3);
-
-
-//        if(p_fwdOut.src[h].rr.rows() > 0 && p_fwdOut.src[h].rr.cols() > 0)
-//        {
-//            if(h == 0)
-//            {
-//                p_fwdOut.source_rr = MatrixX3d(0,3);
-//                p_fwdOut.source_nn = MatrixX3d(0,3);
-//            }
-
-//            p_fwdOut.source_rr.conservativeResize(p_fwdOut.source_rr.rows() + p_fwdOut.src[h].rr.rows(),3);
-//            p_fwdOut.source_rr.block(p_fwdOut.source_rr.rows() -  p_fwdOut.src[h].rr.rows(), 0,  p_fwdOut.src[h].rr.rows(), 3) = p_fwdOut.src[h].rr;
-
-//            p_fwdOut.source_nn.conservativeResize(p_fwdOut.source_nn.rows() + p_fwdOut.src[h].nn.rows(),3);
-//            p_fwdOut.source_nn.block(p_fwdOut.source_nn.rows() -  p_fwdOut.src[h].nn.rows(), 0,  p_fwdOut.src[h].nn.rows(), 3) = p_fwdOut.src[h].nn;
-//        }
-
-        printf("[done]\n");
     }
 
     //
@@ -461,6 +456,7 @@ MNEForwardSolution MNEForwardSolution::cluster_forward_solution_ccr(AnnotationSe
 
 
     KMeans t_kMeans(QString("cityblock"), QString("sample"), 5);//QString("sqeuclidean")//QString("sample")//cityblock
+    t_kMeans.setAccelerated(true);
     MatrixXd t_LF_new;
 
     qint32 count;
@@ -534,6 +530,7 @@ MNEForwardSolution MNEForwardSolution::cluster_forward_solution_ccr(AnnotationSe
 
                     t_sensG.idcs = idcs;
                     t_sensG.iLabelIdxIn = i;
+                    t_sensG.iSeed = (quint32)(h << 16) + (quint32)i;
                     t_sensG.nClusters = ceil((double)nSources/(double)p_iClusterSize);
 
                     t_sensG.matRoiGOrig = t_LF;
@@ -706,6 +703,84 @@ MNEForwardSolution MNEForwardSolution::cluster_forward_solution_ccr(AnnotationSe
 }
 
 
+//*************************************************************************************************************
+
+MNEForwardSolution MNEForwardSolution::cluster_forward_solution_cached(AnnotationSet &p_AnnotationSet, qint32 p_iClusterSize, const QString &p_sCacheDir, bool p_bCcr)
+{
+    QString t_sKey = this->cluster_cache_key(p_AnnotationSet, p_iClusterSize, p_bCcr);
+    QFile t_fileCache(QDir(p_sCacheDir).filePath(QString("clustered-%1-fwd.fif").arg(t_sKey)));
+
+    if(t_fileCache.exists())
+    {
+        MNEForwardSolution p_fwdOut(*this);
+        if(p_fwdOut.read_clustered(t_fileCache, t_sKey))
+            return p_fwdOut;
+
+        printf("Cached clustering %s is not usable, clustering again.\n", t_fileCache.fileName().toUtf8().constData());
+    }
+
+    MNEForwardSolution p_fwdOut = p_bCcr ? this->cluster_forward_solution_ccr(p_AnnotationSet, p_iClusterSize)
+                                         : this->cluster_forward_solution(p_AnnotationSet, p_iClusterSize);
+
+    // Write to a temporary file first, so an interrupted run doesn't leave a truncated cache file behind
+    QFile t_fileTmp(t_fileCache.fileName() + ".tmp");
+    if(p_fwdOut.write_clustered(t_fileTmp, t_sKey))
+    {
+        //
+        // rename replaces an existing cache file atomically on POSIX systems. Where it refuses to replace
+        // (Windows), remove it first - a concurrent reader may then miss the cache and cluster on its own.
+        //
+        QByteArray t_sTmpName = QFile::encodeName(t_fileTmp.fileName());
+        QByteArray t_sCacheName = QFile::encodeName(t_fileCache.fileName());
+        if(std::rename(t_sTmpName.constData(), t_sCacheName.constData()) != 0)
+        {
+            QFile::remove(t_fileCache.fileName());
+            if(!QFile::rename(t_fileTmp.fileName(), t_fileCache.fileName()))
+                QFile::remove(t_fileTmp.fileName());
+        }
+    }
+    else
+        QFile::remove(t_fileTmp.fileName());
+
+    return p_fwdOut;
+}
+
+
+//*************************************************************************************************************
+
+QString MNEForwardSolution::cluster_cache_key(AnnotationSet &p_AnnotationSet, qint32 p_iClusterSize, bool p_bCcr) const
+{
+    QCryptographicHash t_hash(QCryptographicHash::Sha1);
+
+    // Increase the revision whenever the clustering changes its results, so older cache files are not hit
+    t_hash.addData(p_bCcr ? QByteArray("cluster_forward_solution_ccr/1") : QByteArray("cluster_forward_solution/1"));
+
+    qint32 t_header[5] = { p_iClusterSize, this->source_ori, this->coord_frame, (qint32)this->sol->data.rows(), (qint32)this->sol->data.cols() };
+    t_hash.addData((const char*)t_header, sizeof(t_header));
+    t_hash.addData((const char*)this->sol->data.data(), this->sol->data.size()*sizeof(double));
+
+    for(qint32 h = 0; h < this->src.size(); ++h)
+    {
+        const VectorXi& t_vertno = this->src[h].vertno;
+        VectorXi t_labelIds;
+        VectorXi t_ctLabelIds;
+        if(h < p_AnnotationSet.size())
+        {
+            t_labelIds = p_AnnotationSet[h].getLabelIds();
+            t_ctLabelIds = p_AnnotationSet[h].getColortable().getLabelIds();
+        }
+
+        qint32 t_sizes[3] = { (qint32)t_vertno.size(), (qint32)t_labelIds.size(), (qint32)t_ctLabelIds.size() };
+        t_hash.addData((const char*)t_sizes, sizeof(t_sizes));
+        t_hash.addData((const char*)t_vertno.data(), t_vertno.size()*sizeof(int));
+        t_hash.addData((const char*)t_labelIds.data(), t_labelIds.size()*sizeof(int));
+        t_hash.addData((const char*)t_ctLabelIds.data(), t_ctLabelIds.size()*sizeof(int));
+    }
+
+    return QString(t_hash.result().toHex());
+}
+
+
 //*************************************************************************************************************
 
 FiffCov MNEForwardSolution::compute_depth_prior(const MatrixXd &Gain, const FiffInfo &gain_info, bool is_fixed_ori, double exp, double limit, const MatrixXd &patch_areas, bool limit_depth_chs)
@@ -729,11 +804,13 @@ FiffCov MNEForwardSolution::compute_depth_prior(const MatrixXd &Gain, const Fiff
         qint32 n_pos = G.cols() / 3;
         d = VectorXd::Zero(n_pos);
         MatrixXd Gk;
+        VectorXd s;
         for (qint32 k = 0; k < n_pos; ++k)
         {
+            // largest eigenvalue of Gk^T*Gk, i.e. the squared largest singular value of Gk
             Gk = G.block(0,3*k, G.rows(), 3);
-            JacobiSVD<MatrixXd> svd(Gk.transpose()*Gk);
-            d[k] = svd.singularValues().maxCoeff();
+            MNEMath::svd(Gk, s);
+            d[k] = s[0]*s[0];
         }
     }
 
@@ -1664,6 +1741,122 @@ bool MNEForwardSolution::read_one(FiffStream* p_pStream, const FiffDirTree& p_No
 }
 
 
+//*************************************************************************************************************
+
+bool MNEForwardSolution::read_clustered(QIODevice &p_IODevice, const QString &p_sKey)
+{
+    FiffStream::SPtr t_pStream(new FiffStream(&p_IODevice));
+    FiffDirTree t_Tree;
+    QList<FiffDirEntry> t_Dir;
+
+    printf("Reading clustered forward solution from %s...", t_pStream->streamName().toUtf8().constData());
+    if(!t_pStream->open(t_Tree, t_Dir))
+        return false;
+
+    QList<FiffDirTree> t_qListClustered = t_Tree.dir_tree_find(FIFFB_MNE_CLUSTERED_FWD);
+    if(t_qListClustered.size() != 1)
+    {
+        t_pStream->device()->close();
+        printf("No clustered forward solution found.\n");
+        return false;
+    }
+    const FiffDirTree& t_Node = t_qListClustered[0];
+    FiffTag::SPtr t_pTag;
+
+    if(!t_Node.find_tag(t_pStream.data(), FIFF_MNE_CLUSTER_KEY, t_pTag) || t_pTag->toString() != p_sKey)
+    {
+        t_pStream->device()->close();
+        printf("Cache key doesn't match.\n");
+        return false;
+    }
+
+    fiff_int_t nsource, nrow, ncol;
+    if(!t_Node.find_tag(t_pStream.data(), FIFF_MNE_SOURCE_SPACE_NPOINTS, t_pTag) || !t_pTag->toInt())
+    {
+        t_pStream->device()->close();
+        printf("Number of sources not found.\n");
+        return false;
+    }
+    nsource = *t_pTag->toInt();
+
+    if(!t_Node.find_tag(t_pStream.data(), FIFF_MNE_NROW, t_pTag) || !t_pTag->toInt())
+    {
+        t_pStream->device()->close();
+        printf("Number of rows not found.\n");
+        return false;
+    }
+    nrow = *t_pTag->toInt();
+
+    if(!t_Node.find_tag(t_pStream.data(), FIFF_MNE_NCOL, t_pTag) || !t_pTag->toInt())
+    {
+        t_pStream->device()->close();
+        printf("Number of columns not found.\n");
+        return false;
+    }
+    ncol = *t_pTag->toInt();
+
+    if(nrow != this->sol->data.rows() || !t_Node.find_tag(t_pStream.data(), FIFF_MNE_CLUSTER_SOL, t_pTag)
+            || !t_pTag->toDouble() || t_pTag->size() != nrow*ncol*8)
+    {
+        t_pStream->device()->close();
+        printf("Clustered gain matrix doesn't fit to the forward solution.\n");
+        return false;
+    }
+    MatrixXd t_LF_new = Map<MatrixXd>(t_pTag->toDouble(), nrow, ncol);
+
+    QList<FiffDirTree> t_qListHemis = t_Node.dir_tree_find(FIFFB_MNE_CLUSTER_HEMI);
+    if(t_qListHemis.size() != this->src.size())
+    {
+        t_pStream->device()->close();
+        printf("Number of clustered hemispheres doesn't fit to the forward solution.\n");
+        return false;
+    }
+
+    QList<VectorXi> t_qListVertno;
+    QList<MNEClusterInfo> t_qListClusterInfo;
+    qint32 t_iNumVertno = 0;
+    for(qint32 h = 0; h < t_qListHemis.size(); ++h)
+    {
+        MNEClusterInfo t_clusterInfo;
+        if(!t_qListHemis[h].find_tag(t_pStream.data(), FIFF_MNE_CLUSTER_VERTNO, t_pTag) || !t_pTag->toInt()
+                || !MNEClusterInfo::readFromStream(t_pStream.data(), t_qListHemis[h], t_clusterInfo))
+        {
+            t_pStream->device()->close();
+            printf("Clustering of hemisphere %d not found.\n", h);
+            return false;
+        }
+        t_qListVertno.append(Map<VectorXi>(t_pTag->toInt(), t_pTag->size()/4));
+        t_qListClusterInfo.append(t_clusterInfo);
+        t_iNumVertno += t_qListVertno[h].size();
+    }
+
+    t_pStream->device()->close();
+
+    if(t_iNumVertno != nsource || ncol != 3*nsource)
+    {
+        printf("Clustered source space is inconsistent.\n");
+        return false;
+    }
+
+    //
+    // Apply the clustering the same way cluster_forward_solution does
+    //
+    for(qint32 h = 0; h < this->src.size(); ++h)
+    {
+        this->src[h].vertno = t_qListVertno[h];
+        this->src[h].cluster_info = t_qListClusterInfo[h];
+    }
+
+    this->sol->data = t_LF_new;
+    this->sol->ncol = ncol;
+    this->nsource = nsource;
+
+    printf("[done]\n");
+
+    return true;
+}
+
+
 //*************************************************************************************************************
 
 void MNEForwardSolution::restrict_gain_matrix(MatrixXd &G, const FiffInfo &info)
@@ -1710,6 +1903,56 @@ void MNEForwardSolution::restrict_gain_matrix(MatrixXd &G, const FiffInfo &info)
 }
 
 
+//*************************************************************************************************************
+
+bool MNEForwardSolution::write_clustered(QIODevice &p_IODevice, const QString &p_sKey) const
+{
+    FiffStream::SPtr t_pStream = FiffStream::start_file(p_IODevice);
+    if(!t_pStream)
+        return false;
+
+    printf("Writing clustered forward solution to %s...", t_pStream->streamName().toUtf8().constData());
+
+    t_pStream->start_block(FIFFB_MNE_CLUSTERED_FWD);
+
+    t_pStream->write_string(FIFF_MNE_CLUSTER_KEY, p_sKey);
+    t_pStream->write_int(FIFF_MNE_SOURCE_SPACE_NPOINTS, &this->nsource);
+
+    fiff_int_t nrow = this->sol->data.rows();
+    fiff_int_t ncol = this->sol->data.cols();
+    t_pStream->write_int(FIFF_MNE_NROW, &nrow);
+    t_pStream->write_int(FIFF_MNE_NCOL, &ncol);
+    t_pStream->write_double(FIFF_MNE_CLUSTER_SOL, this->sol->data.data(), nrow*ncol);
+
+    for(qint32 h = 0; h < this->src.size(); ++h)
+    {
+        t_pStream->start_block(FIFFB_MNE_CLUSTER_HEMI);
+        t_pStream->write_int(FIFF_MNE_HEMI, &this->src[h].id);
+        t_pStream->write_int(FIFF_MNE_CLUSTER_VERTNO, this->src[h].vertno.data(), this->src[h].vertno.size());
+        this->src[h].cluster_info.writeToStream(t_pStream.data());
+        t_pStream->end_block(FIFFB_MNE_CLUSTER_HEMI);
+    }
+
+    t_pStream->end_block(FIFFB_MNE_CLUSTERED_FWD);
+    t_pStream->end_file();
+
+    //
+    // The stream status misses errors of buffered files which only show when they are flushed
+    //
+    bool t_bOk = t_pStream->status() == QDataStream::Ok;
+    QFile* t_pFile = qobject_cast<QFile*>(t_pStream->device());
+    if(t_pFile && !t_pFile->flush())
+        t_bOk = false;
+    t_pStream->device()->close();
+    if(t_pFile && t_pFile->error() != QFile::NoError)
+        t_bOk = false;
+
+    printf(t_bOk ? "[done]\n" : "[failed]\n");
+
+    return t_bOk;
+}
+
+
 //*************************************************************************************************************
 
 void MNEForwardSolution::to_fixed_ori()
@@ -138,6 +138,7 @@ struct RegionDataIn
 
     VectorXi    idcs;           /**< Get source space indeces */
     qint32      iLabelIdxIn;
+    quint32     iSeed;          /**< Seed of the K-Means initialization, makes the result independent of the scheduling */
 
     RegionDataOut cluster() const
     {
@@ -145,6 +146,8 @@ struct RegionDataIn
         RegionDataOut p_RegionDataOut;
 
         KMeans t_kMeans(QString("cityblock"), QString("sample"), 5);
+        t_kMeans.setSeed(this->iSeed);
+        t_kMeans.setAccelerated(true);
         t_kMeans.calculate(this->matRoiG, this->nClusters, p_RegionDataOut.roiIdx, p_RegionDataOut.ctrs, p_RegionDataOut.sumd, p_RegionDataOut.D);
 
         p_RegionDataOut.iLabelIdxOut = this->iLabelIdxIn;
@@ -221,7 +224,9 @@ public:
     //=========================================================================================================
     /**
     * Cluster the forward solution and stores the result to p_fwdOut.
-    * The clustering is done by using the provided annotations
+    * The clustering is done by using the provided annotations. The regions of both hemispheres are clustered
+    * concurrently, largest first for load balance. Each region is seeded by its hemisphere and label, so
+    * the result does not depend on the number of threads.
     *
     * @param[in] p_AnnotationSet    Annotation set containing the annotation of left & right hemisphere
     * @param[in] p_iClusterSize     Maximal cluster size per roi
@@ -232,6 +237,35 @@ public:
 
     MNEForwardSolution cluster_forward_solution_ccr(AnnotationSet &p_AnnotationSet, qint32 p_iClusterSize);
 
+    //=========================================================================================================
+    /**
+    * Cluster the forward solution like cluster_forward_solution_ccr (or cluster_forward_solution) and keep
+    * the result in an on-disk cache. The cache file is stored as FIFF in p_sCacheDir and named by
+    * cluster_cache_key. On a hit only the clustered gain matrix and the cluster information are read back,
+    * otherwise the forward solution is clustered and the result is written for the next run.
+    *
+    * @param[in] p_AnnotationSet    Annotation set containing the annotation of left & right hemisphere
+    * @param[in] p_iClusterSize     Maximal cluster size per roi
+    * @param[in] p_sCacheDir        Directory of the cache files, e.g. the directory of the forward solution file
+    * @param[in] p_bCcr             Use cluster_forward_solution_ccr; cluster_forward_solution otherwise (optional)
+    *
+    * @return clustered MNE forward solution
+    */
+    MNEForwardSolution cluster_forward_solution_cached(AnnotationSet &p_AnnotationSet, qint32 p_iClusterSize, const QString &p_sCacheDir, bool p_bCcr = true);
+
+    //=========================================================================================================
+    /**
+    * Key of a clustering in the cache of cluster_forward_solution_cached. It is a SHA-1 hash over the gain
+    * matrix, the used vertices, the annotations, the cluster size and the clustering method.
+    *
+    * @param[in] p_AnnotationSet    Annotation set containing the annotation of left & right hemisphere
+    * @param[in] p_iClusterSize     Maximal cluster size per roi
+    * @param[in] p_bCcr             Key of cluster_forward_solution_ccr; cluster_forward_solution otherwise (optional)
+    *
+    * @return the hex encoded cache key
+    */
+    QString cluster_cache_key(AnnotationSet &p_AnnotationSet, qint32 p_iClusterSize, bool p_bCcr = true) const;
+
     //=========================================================================================================
     /**
     * Compute orientation prior
@@ -456,6 +490,29 @@ private:
     */
     static bool read_one(FiffStream* p_pStream, const FiffDirTree& p_Node, MNEForwardSolution& one);
 
+    //=========================================================================================================
+    /**
+    * Writes the clustering result (gain matrix, vertnos and cluster information) to a cache file.
+    *
+    * @param[in] p_IODevice     IO device to write to.
+    * @param[in] p_sKey         Cache key of the clustering.
+    *
+    * @return True if succeeded, false if the stream or the file reported a write error
+    */
+    bool write_clustered(QIODevice &p_IODevice, const QString &p_sKey) const;
+
+    //=========================================================================================================
+    /**
+    * Applies a clustering result written by write_clustered to this unclustered forward solution.
+    * Nothing is changed if the file does not match p_sKey or this forward solution.
+    *
+    * @param[in] p_IODevice     IO device to read from.
+    * @param[in] p_sKey         Expected cache key of the clustering.
+    *
+    * @return True if succeeded, false otherwise
+    */
+    bool read_clustered(QIODevice &p_IODevice, const QString &p_sKey);
+
 public:
     FiffInfoBase info;                  /**< light weighted measurement info */
     fiff_int_t source_ori;              /**< Source orientation: fixed or free */
@@ -134,6 +134,20 @@ MNEInverseOperator::~MNEInverseOperator()
 //*************************************************************************************************************
 
 bool MNEInverseOperator::assemble_kernel(const Label &label, QString method, bool pick_normal, MatrixXd &K, SparseMatrix<double> &noise_norm, QList<VectorXi> &vertno) const
+{
+    MatrixXd A, B;
+    if(!assemble_kernel_factors(label, method, pick_normal, A, B, noise_norm, vertno))
+        return false;
+
+    K = A*B;
+
+    return true;
+}
+
+
+//*************************************************************************************************************
+
+bool MNEInverseOperator::assemble_kernel_factors(const Label &label, QString method, bool pick_normal, MatrixXd &A, MatrixXd &B, SparseMatrix<double> &noise_norm, QList<VectorXi> &vertno) const
 {
     MatrixXd t_eigen_leads = this->eigen_leads->data;
     MatrixXd t_source_cov = this->source_cov->data;
@@ -237,7 +251,7 @@ bool MNEInverseOperator::assemble_kernel(const Label &label, QString method, boo
     SparseMatrix<double> t_reginv(reginv.rows(),reginv.rows());
     t_reginv.setFromTriplets(tripletList.begin(), tripletList.end());
 
-    MatrixXd trans = t_reginv*eigen_fields->data*whitener*proj;
+    B = t_reginv*eigen_fields->data*whitener*proj;
     //
     //   Transformation into current distributions by weighting the eigenleads
     //   with the weights computed above
@@ -248,7 +262,7 @@ bool MNEInverseOperator::assemble_kernel(const Label &label, QString method, boo
         //     R^0.5 has been already factored in
         //
         printf("(eigenleads already weighted)...");
-        K = t_eigen_leads*trans;
+        A = t_eigen_leads;
     }
     else
     {
@@ -264,7 +278,33 @@ bool MNEInverseOperator::assemble_kernel(const Label &label, QString method, boo
        SparseMatrix<double> t_sourceCov(t_source_cov.rows(),t_source_cov.rows());
        t_sourceCov.setFromTriplets(tripletList2.begin(), tripletList2.end());
 
-       K = t_sourceCov*t_eigen_leads*trans;
+       A = t_sourceCov*t_eigen_leads;
+    }
+
+    //
+    //   Components with a zero regularized inverse don't contribute to the kernel - drop them from the factors
+    //
+    qint32 nKeep = 0;
+    for(qint32 i = 0; i < reginv.rows(); ++i)
+        if(reginv(i,0) != 0)
+            ++nKeep;
+
+    if(nKeep < reginv.rows())
+    {
+        MatrixXd t_A(A.rows(), nKeep);
+        MatrixXd t_B(nKeep, B.cols());
+        qint32 count = 0;
+        for(qint32 i = 0; i < reginv.rows(); ++i)
+        {
+            if(reginv(i,0) != 0)
+            {
+                t_A.col(count) = A.col(i);
+                t_B.row(count) = B.row(i);
+                ++count;
+            }
+        }
+        A = t_A;
+        B = t_B;
     }
 
     if(method.compare("MNE") == 0)
@@ -473,22 +513,17 @@ MNEInverseOperator MNEInverseOperator::make_inverse_operator(const FiffInfo &inf
     // 12. Decompose the combined matrix
     //
     printf("Computing SVD of whitened and weighted lead field matrix.\n");
-    JacobiSVD<MatrixXd> svd(gain, ComputeThinU | ComputeThinV);
-    std::cout << "ToDo Sorting Necessary?" << std::endl;
-    VectorXd p_sing = svd.singularValues();
-    MatrixXd t_U = svd.matrixU();
-    MNEMath::sort<double>(p_sing, t_U);
-    FiffNamedMatrix::SDPtr p_eigen_fields = FiffNamedMatrix::SDPtr(new FiffNamedMatrix( svd.matrixU().cols(),
-                                                                                        svd.matrixU().rows(),
+    VectorXd p_sing;
+    MatrixXd t_U, t_V;
+    MNEMath::svd(gain, p_sing, &t_U, &t_V);
+    FiffNamedMatrix::SDPtr p_eigen_fields = FiffNamedMatrix::SDPtr(new FiffNamedMatrix( t_U.cols(),
+                                                                                        t_U.rows(),
                                                                                         defaultQStringList,
                                                                                         gain_info.ch_names,
                                                                                         t_U.transpose() ));
 
-    p_sing = svd.singularValues();
-    MatrixXd t_V = svd.matrixV();
-    MNEMath::sort<double>(p_sing, t_V);
-    FiffNamedMatrix::SDPtr p_eigen_leads = FiffNamedMatrix::SDPtr(new FiffNamedMatrix( svd.matrixV().rows(),
-                                                                                       svd.matrixV().cols(),
+    FiffNamedMatrix::SDPtr p_eigen_leads = FiffNamedMatrix::SDPtr(new FiffNamedMatrix( t_V.rows(),
+                                                                                       t_V.cols(),
                                                                                        defaultQStringList,
                                                                                        defaultQStringList,
                                                                                        t_V ));
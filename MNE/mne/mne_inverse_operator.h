@@ -178,6 +178,25 @@ public:
     */
     bool assemble_kernel(const Label &label, QString method, bool pick_normal, MatrixXd &K, SparseMatrix<double> &noise_norm, QList<VectorXi> &vertno) const;
 
+    //=========================================================================================================
+    /**
+    * Same as assemble_kernel, but returns the kernel in its factored form K = A*B. A holds the (weighted)
+    * eigenleads (n_sources x rank), B the regularized and whitened eigenfields (rank x n_channels). Since
+    * the rank is at most the number of channels, applying the factors can be cheaper than applying K. Components
+    * whose regularized inverse is zero are dropped, i.e. the rank is the number of the remaining components.
+    *
+    * @param[in] label          labels.
+    * @param[in] method         The applied normals. ("MNE" | "dSPM" | "sLORETA")
+    * @param[in] pick_normal    Pick normals.
+    * @param[out] A             Left kernel factor.
+    * @param[out] B             Right kernel factor.
+    * @param[out] noise_norm    Noise normals.
+    * @param[out] vertno        Vertices of the hemispheres.
+    *
+    * @return true if successful, false otherwise
+    */
+    bool assemble_kernel_factors(const Label &label, QString method, bool pick_normal, MatrixXd &A, MatrixXd &B, SparseMatrix<double> &noise_norm, QList<VectorXi> &vertno) const;
+
     //=========================================================================================================
     /**
     * Check that channels in inverse operator are measurements.
@@ -188,20 +188,18 @@ public:
     */
     MNESourceEstimate& operator= (const MNESourceEstimate &rhs);
 
+    //=========================================================================================================
+    /**
+    * Update the times attribute after changing tmin, tmax, or tstep
+    */
+    void update_times();
+
 public:
     MatrixXd data;          /**< Matrix of shape [n_dipoles x n_times] which contains the data in source space. */
     VectorXi vertices;      /**< The indices of the dipoles in the different source spaces. */ //ToDo define is_clustered_result; change vertno to ROI idcs
     RowVectorXf times;      /**< The time vector with n_times steps. */
     float tmin;             /**< Time starting point. */
     float tstep;            /**< Time steps within the times vector. */
-
-private:
-
-    //=========================================================================================================
-    /**
-    * Update the times attribute after changing tmin, tmax, or tstep
-    */
-    void update_times();
 };
 
 
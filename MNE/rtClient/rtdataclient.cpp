@@ -43,6 +43,15 @@
 #include "rtdataclient.h"
 
 
+//*************************************************************************************************************
+//=============================================================================================================
+// QT INCLUDES
+//=============================================================================================================
+
+#include <QHostAddress>
+#include <QtEndian>
+
+
 //*************************************************************************************************************
 //=============================================================================================================
 // USED NAMESPACES
@@ -51,6 +60,26 @@
 using namespace RTCLIENTLIB;
 
 
+//*************************************************************************************************************
+//=============================================================================================================
+// STATIC DEFINITIONS
+//=============================================================================================================
+
+namespace
+{
+//=============================================================================================================
+/**
+* Whether an address is a loopback address, including IPv4 addresses mapped to IPv6.
+*/
+bool isLoopbackAddress(const QHostAddress& p_address)
+{
+    return p_address.isInSubnet(QHostAddress("127.0.0.0"), 8)
+            || p_address.isInSubnet(QHostAddress("::ffff:127.0.0.0"), 104)
+            || p_address == QHostAddress(QHostAddress::LocalHostIPv6);
+}
+}
+
+
 //*************************************************************************************************************
 //=============================================================================================================
 // DEFINE MEMBER METHODS
@@ -59,7 +88,12 @@ using namespace RTCLIENTLIB;
 RtDataClient::RtDataClient(QObject *parent)
 : QTcpSocket(parent)
 , m_clientID(-1)
+, m_bSharedMemoryTransport(true)
+, m_iViewSeq(0)
 {
+    connect(this, &QTcpSocket::connected,
+            this, &RtDataClient::requestSharedMemoryTransport);
+
     getClientId();
 }
 
@@ -312,6 +346,8 @@ FiffInfo::SPtr RtDataClient::readInfo()
     for (qint32 c = 0; c < p_pFiffInfo->nchan; ++c)
         p_pFiffInfo->ch_names << p_pFiffInfo->chs[c].ch_name;
 
+    m_rawBufferCodec.setInfo(*p_pFiffInfo);
+
     return p_pFiffInfo;
 }
 
@@ -328,20 +364,168 @@ void RtDataClient::readRawBuffer(qint32 p_nChannels, MatrixXf& data, fiff_int_t&
     //
     FiffTag::SPtr t_pTag;
 
-    FiffTag::read_rt_tag(&t_fiffStream, t_pTag);
+    FiffTag::read_rt_tag(&t_fiffStream, t_pTag, &m_tagPool);
 
     kind = t_pTag->kind;
 
-    if(kind == FIFF_DATA_BUFFER)
+    if(kind == FIFF_DATA_BUFFER || kind == FIFF_MNE_RT_CODED_BUFFER)
     {
-        qint32 nSamples = (t_pTag->size()/4)/p_nChannels;
-        data = MatrixXf(Map< MatrixXf >(t_pTag->toFloat(), p_nChannels, nSamples));
+        if(m_rawBufferCodec.decode(t_pTag, p_nChannels, data))
+            kind = FIFF_DATA_BUFFER;
+        else
+            printf("RtDataClient: raw buffer couldn't be decoded\n");
+    }
+    else if(kind == FIFF_MNE_RT_SHMEM_BUFFER)
+    {
+        quint32 t_iSeq;
+        Map<const MatrixXf> t_view = mapSharedRawBuffer(t_pTag, t_iSeq);
+        if(t_view.size() > 0)
+        {
+            data = t_view;
+            if(m_rawBufferRing.isValid(t_iSeq))
+                kind = FIFF_DATA_BUFFER;
+            else
+                printf("RtDataClient: raw buffer %u was overwritten while it was read\n", t_iSeq);
+        }
     }
 //        else
 //            data = tag.data;
 }
 
 
+//*************************************************************************************************************
+
+Map<const MatrixXf> RtDataClient::readRawBufferView(qint32 p_nChannels, fiff_int_t& kind)
+{
+    FiffStream t_fiffStream(this);
+    FiffTag::SPtr t_pTag;
+
+    FiffTag::read_rt_tag(&t_fiffStream, t_pTag, &m_tagPool);
+
+    kind = t_pTag->kind;
+    m_iViewSeq = 0;
+
+    if(kind == FIFF_DATA_BUFFER || kind == FIFF_MNE_RT_CODED_BUFFER)
+    {
+        if(m_rawBufferCodec.decode(t_pTag, p_nChannels, m_matRawBuffer))
+        {
+            kind = FIFF_DATA_BUFFER;
+            return Map<const MatrixXf>(m_matRawBuffer.data(), m_matRawBuffer.rows(), m_matRawBuffer.cols());
+        }
+        printf("RtDataClient: raw buffer couldn't be decoded\n");
+    }
+    else if(kind == FIFF_MNE_RT_SHMEM_BUFFER)
+    {
+        quint32 t_iSeq;
+        Map<const MatrixXf> t_view = mapSharedRawBuffer(t_pTag, t_iSeq);
+        if(t_view.size() > 0)
+        {
+            kind = FIFF_DATA_BUFFER;
+            m_iViewSeq = t_iSeq;
+            return t_view;
+        }
+    }
+
+    return Map<const MatrixXf>(NULL, 0, 0);
+}
+
+
+//*************************************************************************************************************
+
+bool RtDataClient::isRawBufferViewValid() const
+{
+    return m_iViewSeq == 0 || m_rawBufferRing.isValid(m_iViewSeq);
+}
+
+
+//*************************************************************************************************************
+
+void RtDataClient::setSharedMemoryTransport(bool p_bEnabled)
+{
+    bool t_bChanged = m_bSharedMemoryTransport != p_bEnabled;
+    m_bSharedMemoryTransport = p_bEnabled;
+
+    if(t_bChanged && state() == QAbstractSocket::ConnectedState && isLoopbackAddress(peerAddress()))
+    {
+        FiffStream t_fiffStream(this);
+        t_fiffStream.write_rt_command(4, QString::number(p_bEnabled ? 1 : 0));//MNE_RT.MNE_RT_SET_SHMEM_TRANSPORT, enabled);
+        this->flush();
+    }
+}
+
+
+//*************************************************************************************************************
+
+void RtDataClient::requestSharedMemoryTransport()
+{
+    if(m_bSharedMemoryTransport && isLoopbackAddress(peerAddress()))
+    {
+        FiffStream t_fiffStream(this);
+        t_fiffStream.write_rt_command(4, QString::number(1));//MNE_RT.MNE_RT_SET_SHMEM_TRANSPORT, enabled);
+        this->flush();
+    }
+}
+
+
+//*************************************************************************************************************
+
+Map<const MatrixXf> RtDataClient::mapSharedRawBuffer(const FiffTag::SPtr& p_pTag, quint32& p_iSeq)
+{
+    p_iSeq = 0;
+    if(p_pTag->size() <= 4)
+        return Map<const MatrixXf>(NULL, 0, 0);
+
+    //
+    // Announcement: sequence number followed by the key of the ring
+    //
+    p_iSeq = qFromBigEndian<quint32>((const uchar*)p_pTag->data());
+    QString t_sKey = QString::fromUtf8(p_pTag->data() + 4, p_pTag->size() - 4);
+
+    if(t_sKey != m_rawBufferRing.key() && !m_rawBufferRing.attach(t_sKey))
+    {
+        printf("RtDataClient: shared memory ring not available, falling back to the socket\n");
+        m_bSharedMemoryTransport = false;
+        FiffStream t_fiffStream(this);
+        t_fiffStream.write_rt_command(4, QString::number(0));//MNE_RT.MNE_RT_SET_SHMEM_TRANSPORT, disabled);
+        this->flush();
+        return Map<const MatrixXf>(NULL, 0, 0);
+    }
+
+    Map<const MatrixXf> t_view = m_rawBufferRing.view(p_iSeq);
+    if(t_view.size() == 0)
+        printf("RtDataClient: raw buffer %u was overwritten before it was read\n", p_iSeq);
+
+    return t_view;
+}
+
+
+//*************************************************************************************************************
+
+void RtDataClient::setBufferEncoding(FiffRawBufferCodec::Encoding p_encoding)
+{
+    FiffStream t_fiffStream(this);
+    t_fiffStream.write_rt_command(3, QString::number(p_encoding));//MNE_RT.MNE_RT_SET_BUFFER_ENCODING, encoding);
+    this->flush();
+}
+
+
+//*************************************************************************************************************
+
+void RtDataClient::setChannelSelection(const QStringList& p_sListSelection)
+{
+    FiffStream t_fiffStream(this);
+    t_fiffStream.write_rt_command(5, p_sListSelection.join(":"));//MNE_RT.MNE_RT_SET_CHANNEL_SELECTION, selection);
+    this->flush();
+
+    //
+    // The server answers the commands of the data connection in order; the client id is only sent back after the
+    // selection is set
+    //
+    m_clientID = -1;
+    getClientId();
+}
+
+
 //*************************************************************************************************************
 
 void RtDataClient::setClientAlias(const QString &p_sAlias)
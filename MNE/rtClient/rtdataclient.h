@@ -54,6 +54,16 @@
 #include <fiff/fiff_stream.h>
 #include <fiff/fiff_info.h>
 #include <fiff/fiff_tag.h>
+#include <fiff/fiff_tag_pool.h>
+#include <fiff/fiff_raw_buffer_codec.h>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Generics INCLUDES
+//=============================================================================================================
+
+#include <generics/sharedmatrixring.h>
 
 
 //*************************************************************************************************************
@@ -63,6 +73,7 @@
 
 #include <QSharedPointer>
 #include <QString>
+#include <QStringList>
 #include <QTcpSocket>
 
 
@@ -81,11 +92,14 @@ namespace RTCLIENTLIB
 //=============================================================================================================
 
 using namespace FIFFLIB;
+using namespace IOBuffer;
 
 
 //=============================================================================================================
 /**
 * The real-time data client class provides an interface to communicate with the data port 4218 of a running mne_rt_server.
+* When connected through the loopback interface, the client asks the server to publish the raw buffers in a shared
+* memory ring; only a short announcement per buffer goes through the socket then.
 *
 * @brief Real-time data client
 */
@@ -130,7 +144,8 @@ public:
 
     //=========================================================================================================
     /**
-    * Reads fiff measurement information of a data the connection
+    * Reads a raw buffer of the data connection. Buffers of all encodings are decoded into data, reusing its
+    * memory when the buffer size didn't change; they are reported as FIFF_DATA_BUFFER.
     *
     * @param[in] p_nChannels    Number of channels to reshape the received data
     * @param[out] data          The read data - ToDo change this to raw buffer data object
@@ -138,6 +153,58 @@ public:
     */
     void readRawBuffer(qint32 p_nChannels, MatrixXf& data, fiff_int_t& kind);
 
+    //=========================================================================================================
+    /**
+    * Reads a raw buffer like readRawBuffer, but without copying buffers of the shared memory transport: the view
+    * maps the buffer in the ring of mne_rt_server. Buffers received through the socket are decoded into memory
+    * of the client. The view is valid until the next read; since the server never waits for its clients, check
+    * isRawBufferViewValid after processing a view to make sure the buffer wasn't overwritten meanwhile.
+    *
+    * @param[in] p_nChannels    Number of channels to reshape the received data
+    * @param[out] kind          Data kind, FIFF_DATA_BUFFER if a raw buffer was read
+    *
+    * @return the view of the raw buffer, empty if no raw buffer was read
+    */
+    Map<const MatrixXf> readRawBufferView(qint32 p_nChannels, fiff_int_t& kind);
+
+    //=========================================================================================================
+    /**
+    * Returns whether the view of the last readRawBufferView still holds the read raw buffer.
+    *
+    * @return true if the buffer wasn't overwritten
+    */
+    bool isRawBufferViewValid() const;
+
+    //=========================================================================================================
+    /**
+    * Enables or disables the shared memory transport, which is used by default when the client is connected to
+    * mne_rt_server on the same host.
+    *
+    * @param[in] p_bEnabled     Whether raw buffers should be read from the shared memory ring
+    */
+    void setSharedMemoryTransport(bool p_bEnabled);
+
+    //=========================================================================================================
+    /**
+    * Asks mne_rt_server to send the raw buffers in the given encoding. The integer encodings need the
+    * calibrations of the measurement info, so readInfo has to be called before the first buffer is read.
+    * Buffers which can't be encoded losslessly, i.e. whose samples aren't exact integer multiples of the
+    * calibrations, e.g. because they were processed after the calibration, are still sent as floats.
+    *
+    * @param[in] p_encoding     The raw buffer encoding
+    */
+    void setBufferEncoding(FiffRawBufferCodec::Encoding p_encoding);
+
+    //=========================================================================================================
+    /**
+    * Asks mne_rt_server to send only the selected channels. The selection applies to the measurement info
+    * requested afterwards, which then describes the selected channels only, and to the raw buffers following it.
+    * Blocks until the server confirmed the selection, so it has to be called before the measurement starts.
+    *
+    * @param[in] p_sListSelection   Channel types (meg, grad, mag, eeg, stim) and channel names; empty for all channels
+    */
+    void setChannelSelection(const QStringList& p_sListSelection);
+
     //=========================================================================================================
     /**
     * Sets the alias of the data client
@@ -147,7 +214,33 @@ public:
     void setClientAlias(const QString &p_sAlias);
 
 private:
-    qint32 m_clientID;  /**< Corresponding client id of the data client at mne_rt_server */
+    qint32 m_clientID;          /**< Corresponding client id of the data client at mne_rt_server */
+    FiffTagPool m_tagPool;      /**< Tags reused by readRawBuffer */
+    FiffRawBufferCodec m_rawBufferCodec;    /**< Decodes the raw buffers, calibrations of the last read measurement info */
+
+    bool m_bSharedMemoryTransport;          /**< Whether the shared memory transport is requested on same host connections */
+    SharedMatrixRing m_rawBufferRing;       /**< Shared memory ring of mne_rt_server, attached with the first announced buffer */
+    quint32 m_iViewSeq;                     /**< Sequence number of the last view into the ring, 0 if the view maps m_matRawBuffer */
+    MatrixXf m_matRawBuffer;                /**< Last raw buffer received through the socket, mapped by readRawBufferView */
+
+    //=========================================================================================================
+    /**
+    * Asks mne_rt_server for the shared memory transport if it is enabled and the connection is a same host one.
+    * Called when the socket is connected.
+    */
+    void requestSharedMemoryTransport();
+
+    //=========================================================================================================
+    /**
+    * Maps the raw buffer announced by a FIFF_MNE_RT_SHMEM_BUFFER tag, attaching to the ring it names if needed.
+    * Falls back to the socket transport if the ring can't be attached.
+    *
+    * @param[in] p_pTag     The announcement
+    * @param[out] p_iSeq    Sequence number of the buffer in the ring
+    *
+    * @return the view of the buffer, empty if it is not available
+    */
+    Map<const MatrixXf> mapSharedRawBuffer(const FiffTag::SPtr& p_pTag, quint32& p_iSeq);
 
 signals:
     
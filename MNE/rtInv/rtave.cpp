@@ -98,7 +98,11 @@ void RtAve::append(const MatrixXd &p_DataSegment)
 //    if(m_pRawMatrixBuffer) // ToDo handle change buffersize
 
     if(!m_pRawMatrixBuffer)
+    {
+        QMutexLocker locker(&mutex);
         m_pRawMatrixBuffer = CircularMatrixBuffer<double>::SPtr(new CircularMatrixBuffer<double>(128, p_DataSegment.rows(), p_DataSegment.cols()));
+        m_qBufferCreated.wakeAll();
+    }
 
     m_pRawMatrixBuffer->push(&p_DataSegment);
 }
@@ -276,7 +280,11 @@ void RtAve::assemblePreStimulus(const QList<QPair<QList<qint32>, MatrixXd> > &p_
 
 bool RtAve::stop()
 {
+    mutex.lock();
     m_bIsRunning = false;
+    m_qBufferCreated.wakeAll();
+    mutex.unlock();
+
     QThread::wait();
 
     return true;
@@ -368,16 +376,22 @@ void RtAve::run()
 
 
     qint32 count = 0;
+    MatrixXd rawSegment;
+
+    // Block until the first data segment created the buffer
+    mutex.lock();
+    while(m_bIsRunning && !m_pRawMatrixBuffer)
+        m_qBufferCreated.wait(&mutex);
+    mutex.unlock();
 
     //Enter the main loop
     while(m_bIsRunning)
     {
-        if(m_pRawMatrixBuffer)
+        //
+        // Acquire Data - timed, to notice stop() while no data arrives
+        //
+        if(m_pRawMatrixBuffer->pop(rawSegment, 100))
         {
-            //
-            // Acquire Data
-            //
-            MatrixXd rawSegment = m_pRawMatrixBuffer->pop();
             if(t_nSamplesPerBuf == 0)
                 t_nSamplesPerBuf = rawSegment.cols();
 
@@ -68,6 +68,7 @@
 
 #include <QThread>
 #include <QMutex>
+#include <QWaitCondition>
 #include <QSharedPointer>
 #include <QSet>
 #include <QList>
@@ -210,6 +211,7 @@ private:
     void assemblePreStimulus(const QList<QPair<QList<qint32>, MatrixXd> > &p_qListRawMatBuf, qint32 p_iStimIdx);
 
     QMutex      mutex;                  /**< Provides access serialization between threads*/
+    QWaitCondition m_qBufferCreated;    /**< Signalled when the raw matrix buffer is created or the thread is stopped. */
 
     qint32 m_iNumAverages;              /**< Number of averages */
 
@@ -93,7 +93,11 @@ void RtCov::append(const MatrixXd &p_DataSegment)
 //    if(m_pRawMatrixBuffer) // ToDo handle change buffersize
 
     if(!m_pRawMatrixBuffer)
+    {
+        QMutexLocker locker(&mutex);
         m_pRawMatrixBuffer = CircularMatrixBuffer<double>::SPtr(new CircularMatrixBuffer<double>(32, p_DataSegment.rows(), p_DataSegment.cols()));
+        m_qBufferCreated.wakeAll();
+    }
 
     m_pRawMatrixBuffer->push(&p_DataSegment);
 }
@@ -103,7 +107,11 @@ void RtCov::append(const MatrixXd &p_DataSegment)
 
 bool RtCov::stop()
 {
+    mutex.lock();
     m_bIsRunning = false;
+    m_qBufferCreated.wakeAll();
+    mutex.unlock();
+
     QThread::wait();
 
     return true;
@@ -121,13 +129,19 @@ void RtCov::run()
 
     FiffCov::SPtr cov(new FiffCov());
     VectorXd mu;
+    MatrixXd rawSegment;
+
+    // Block until the first data segment created the buffer
+    mutex.lock();
+    while(m_bIsRunning && !m_pRawMatrixBuffer)
+        m_qBufferCreated.wait(&mutex);
+    mutex.unlock();
 
     while(m_bIsRunning)
     {
-        if(m_pRawMatrixBuffer)
+        // Timed pop to notice stop() while no data arrives
+        if(m_pRawMatrixBuffer->pop(rawSegment, 100))
         {
-            MatrixXd rawSegment = m_pRawMatrixBuffer->pop();
-
             if(n_samples == 0)
             {
                 mu = rawSegment.rowwise().sum();
@@ -68,6 +68,7 @@
 
 #include <QThread>
 #include <QMutex>
+#include <QWaitCondition>
 #include <QSharedPointer>
 
 
@@ -171,6 +172,7 @@ protected:
 
 private:
     QMutex      mutex;                  /**< Provides access serialization between threads*/
+    QWaitCondition m_qBufferCreated;    /**< Signalled when the raw matrix buffer is created or the thread is stopped. */
 
     quint32      m_iMaxSamples;         /**< Maximal amount of samples received, before covariance is estimated.*/
 
@@ -49,6 +49,15 @@
 
 
 #include <QDebug>
+#include <QElapsedTimer>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Eigen INCLUDES
+//=============================================================================================================
+
+#include <Eigen/Eigenvalues>
 
 
 //*************************************************************************************************************
@@ -65,10 +74,18 @@ using namespace RTINVLIB;
 
 RtInvOp::RtInvOp(FiffInfo::SPtr &p_pFiffInfo, MNEForwardSolution::SPtr &p_pFwd, QObject *parent)
 : QThread(parent)
+, m_bIsRunning(false)
+, m_iWakeCount(0)
+, m_iWakeLatencySum(0)
+, m_iWakeLatencyMax(0)
+, m_iUpdateTimeLast(0)
+, m_iUpdateTimeMax(0)
 , m_pFiffInfo(p_pFiffInfo)
 , m_pFwd(p_pFwd)
+, m_bCacheValid(false)
 {
     qRegisterMetaType<MNEInverseOperator::SPtr>("MNEInverseOperator::SPtr");
+    m_timer.start();
 }
 
 
@@ -84,11 +101,11 @@ RtInvOp::~RtInvOp()
 
 void RtInvOp::appendNoiseCov(FiffCov::SPtr p_pNoiseCov)
 {
-    mutex.lock();
-    //Use here a circular buffer
+    QMutexLocker locker(&mutex);
     m_vecNoiseCov.push_back(p_pNoiseCov);
+    m_vecAppendTime.push_back(m_timer.nsecsElapsed());
 
-    mutex.unlock();
+    m_qNoiseCovAppended.wakeOne();
 }
 
 
@@ -96,33 +113,191 @@ void RtInvOp::appendNoiseCov(FiffCov::SPtr p_pNoiseCov)
 
 bool RtInvOp::stop()
 {
+    mutex.lock();
     m_bIsRunning = false;
+    m_qNoiseCovAppended.wakeAll();
+    mutex.unlock();
+
     QThread::wait();
 
     return true;
 }
 
 
+//*************************************************************************************************************
+
+qint64 RtInvOp::wakeCount() const
+{
+    QMutexLocker locker(&mutex);
+    return m_iWakeCount;
+}
+
+
+//*************************************************************************************************************
+
+double RtInvOp::meanWakeLatency() const
+{
+    QMutexLocker locker(&mutex);
+    return m_iWakeCount > 0 ? (double)m_iWakeLatencySum / (double)m_iWakeCount : 0.0;
+}
+
+
+//*************************************************************************************************************
+
+qint64 RtInvOp::maxWakeLatency() const
+{
+    QMutexLocker locker(&mutex);
+    return m_iWakeLatencyMax;
+}
+
+
+//*************************************************************************************************************
+
+qint64 RtInvOp::lastUpdateTime() const
+{
+    QMutexLocker locker(&mutex);
+    return m_iUpdateTimeLast;
+}
+
+
+//*************************************************************************************************************
+
+qint64 RtInvOp::maxUpdateTime() const
+{
+    QMutexLocker locker(&mutex);
+    return m_iUpdateTimeMax;
+}
+
+
+//*************************************************************************************************************
+
+MNEInverseOperator::SPtr RtInvOp::updateInverseOperator(const FiffCov &p_noiseCov)
+{
+    //
+    // Whitener and channel selection for the new noise covariance
+    //
+    FiffInfo gain_info;
+    MatrixXd gain;
+    MatrixXd whitener;
+    qint32 n_nzero;
+    FiffCov t_noiseCov;
+    m_forwardMeg.prepare_forward(*m_pFiffInfo.data(), p_noiseCov, false, gain_info, gain, t_noiseCov, whitener, n_nzero);
+
+    //
+    // Channel selection changed (or first call) -> compute everything and cache the forward-derived terms
+    //
+    if(!m_bCacheValid || gain_info.ch_names != m_qListChNames)
+    {
+        m_invOpCached = MNEInverseOperator::make_inverse_operator(*m_pFiffInfo.data(), m_forwardMeg, p_noiseCov, 0.2f, 0.8f);
+        m_qListChNames = gain_info.ch_names;
+
+        if(m_invOpCached.depth_prior.constData() && m_invOpCached.depth_prior->data.rows() == gain.cols())
+            m_vecSourceWeights = m_invOpCached.depth_prior->data.col(0);
+        else
+            m_vecSourceWeights = VectorXd::Ones(gain.cols());
+        if(m_invOpCached.orient_prior.constData() && m_invOpCached.orient_prior->data.rows() == gain.cols())
+            m_vecSourceWeights.array() *= m_invOpCached.orient_prior->data.col(0).array();
+
+        m_matGainWeighted = gain * m_vecSourceWeights.cwiseSqrt().asDiagonal();
+        m_matGainCov.noalias() = m_matGainWeighted * m_matGainWeighted.transpose();
+        m_bCacheValid = true;
+
+        return MNEInverseOperator::SPtr(new MNEInverseOperator(m_invOpCached));
+    }
+
+    //
+    // Whiten the cached weighted gain product and adjust the trace of W*G*R*G^T*W^T to n_nzero
+    //
+    MatrixXd t_matCov = whitener * m_matGainCov * whitener.transpose();
+    double scaling_source_cov = (double)n_nzero / t_matCov.trace();
+    t_matCov *= scaling_source_cov;
+
+    //
+    // Decompose: the eigenvectors of the whitened gain product are the left singular vectors of the
+    // whitened and weighted lead field, the right ones follow as V = G_w^T U S^-1
+    //
+    SelfAdjointEigenSolver<MatrixXd> t_eig(t_matCov);
+    qint32 n_chan = t_matCov.rows();
+
+    VectorXd p_sing(n_chan);
+    MatrixXd t_U(n_chan, n_chan);
+    for(qint32 i = 0; i < n_chan; ++i)
+    {
+        // eigenvalues are ascending, singular values are sorted descending
+        double t_dEig = t_eig.eigenvalues()[n_chan-1-i];
+        p_sing[i] = t_dEig > 0 ? sqrt(t_dEig) : 0;
+        t_U.col(i) = t_eig.eigenvectors().col(n_chan-1-i);
+    }
+
+    MatrixXd t_matWU = whitener.transpose() * t_U;
+    // eigenvalues carry an absolute error of about eps*max, smaller singular values are treated as zero
+    double t_dTol = p_sing.size() > 0 ? p_sing[0] * sqrt(n_chan * 1e-15) : 0;
+    for(qint32 i = 0; i < n_chan; ++i)
+        t_matWU.col(i) *= p_sing[i] > t_dTol ? sqrt(scaling_source_cov) / p_sing[i] : 0;
+
+    MatrixXd t_V = m_matGainWeighted.transpose() * t_matWU;
+
+    //
+    // Assemble from the cached operator
+    //
+    MNEInverseOperator::SPtr t_pInvOp(new MNEInverseOperator(m_invOpCached));
+
+    t_pInvOp->eigen_fields = FiffNamedMatrix::SDPtr(new FiffNamedMatrix(n_chan, n_chan, defaultQStringList, gain_info.ch_names, t_U.transpose()));
+    t_pInvOp->eigen_leads = FiffNamedMatrix::SDPtr(new FiffNamedMatrix(t_V.rows(), t_V.cols(), defaultQStringList, defaultQStringList, t_V));
+    t_pInvOp->sing = p_sing;
+    t_pInvOp->noise_cov = FiffCov::SDPtr(new FiffCov(t_noiseCov));
+    t_pInvOp->source_cov->data = m_vecSourceWeights * scaling_source_cov;
+
+    return t_pInvOp;
+}
+
+
 //*************************************************************************************************************
 
 void RtInvOp::run()
 {
+    mutex.lock();
     m_bIsRunning = true;
+    mutex.unlock();
 
-    while(m_bIsRunning)
+    // Restrict forward solution as necessary for MEG, the forward does not change while running
+    m_forwardMeg = m_pFwd->pick_types(true, false);
+
+    while(true)
     {
-        if(m_vecNoiseCov.size() > 0)
+        mutex.lock();
+        while(m_bIsRunning && m_vecNoiseCov.isEmpty())
+            m_qNoiseCovAppended.wait(&mutex);
+
+        if(!m_bIsRunning)
         {
-            // Restrict forward solution as necessary for MEG
-            MNEForwardSolution t_forwardMeg = m_pFwd->pick_types(true, false);
+            mutex.unlock();
+            break;
+        }
 
-            MNEInverseOperator::SPtr t_invOpMeg(new MNEInverseOperator(*m_pFiffInfo.data(), t_forwardMeg, *m_vecNoiseCov[0].data(), 0.2f, 0.8f));
+        FiffCov::SPtr t_pNoiseCov = m_vecNoiseCov.front();
+        m_vecNoiseCov.pop_front();
 
-            mutex.lock();
-            m_vecNoiseCov.pop_front();
-            mutex.unlock();
+        qint64 t_iLatency = (m_timer.nsecsElapsed() - m_vecAppendTime.front()) / 1000;
+        m_vecAppendTime.pop_front();
+        ++m_iWakeCount;
+        m_iWakeLatencySum += t_iLatency;
+        if(t_iLatency > m_iWakeLatencyMax)
+            m_iWakeLatencyMax = t_iLatency;
+        mutex.unlock();
 
-            emit invOperatorCalculated(t_invOpMeg);
-        }
+        QElapsedTimer t_timer;
+        t_timer.start();
+
+        MNEInverseOperator::SPtr t_invOpMeg = updateInverseOperator(*t_pNoiseCov.data());
+
+        qint64 t_iUpdateTime = t_timer.nsecsElapsed() / 1000;
+        mutex.lock();
+        m_iUpdateTimeLast = t_iUpdateTime;
+        if(t_iUpdateTime > m_iUpdateTimeMax)
+            m_iUpdateTimeMax = t_iUpdateTime;
+        mutex.unlock();
+
+        emit invOperatorCalculated(t_invOpMeg);
     }
 }
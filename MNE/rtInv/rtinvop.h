@@ -67,6 +67,8 @@
 
 #include <QThread>
 #include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
 #include <QSharedPointer>
 
 
@@ -128,7 +130,8 @@ public:
 
     //=========================================================================================================
     /**
-    * Slot to receive incoming noise covariance estimations.
+    * Slot to receive incoming noise covariance estimations. Wakes the worker thread, which blocks while no
+    * covariance is pending.
     *
     * @param[in] p_pNoiseCov     Noise covariance estimation
     */
@@ -150,6 +153,46 @@ public:
     */
     inline bool isRunning();
 
+    //=========================================================================================================
+    /**
+    * Returns the number of noise covariances the worker has picked up so far.
+    *
+    * @return the number of worker wake-ups
+    */
+    qint64 wakeCount() const;
+
+    //=========================================================================================================
+    /**
+    * Returns the mean time between appending a noise covariance and the worker picking it up.
+    *
+    * @return the mean wake-up latency in microseconds
+    */
+    double meanWakeLatency() const;
+
+    //=========================================================================================================
+    /**
+    * Returns the largest time between appending a noise covariance and the worker picking it up.
+    *
+    * @return the maximal wake-up latency in microseconds
+    */
+    qint64 maxWakeLatency() const;
+
+    //=========================================================================================================
+    /**
+    * Returns the time the worker took to compute the last inverse operator.
+    *
+    * @return the last update time in microseconds
+    */
+    qint64 lastUpdateTime() const;
+
+    //=========================================================================================================
+    /**
+    * Returns the longest time the worker took to compute an inverse operator.
+    *
+    * @return the maximal update time in microseconds
+    */
+    qint64 maxUpdateTime() const;
+
 signals:
     //=========================================================================================================
     /**
@@ -160,6 +203,20 @@ signals:
     void invOperatorCalculated(MNELIB::MNEInverseOperator::SPtr p_pInvOp);
 
 protected:
+    //=========================================================================================================
+    /**
+    * Computes the inverse operator for a new noise covariance. Only the whitener and the decomposition
+    * depend on the noise covariance, the picked gain, the depth and orientation priors and the weighted
+    * gain product G*R*G^T are cached and reused as long as the channel selection does not change. The
+    * decomposition is done on the channel sized matrix W*G*R*G^T*W^T instead of the full whitened lead
+    * field, the eigenleads are recovered from the eigenfields with a single product.
+    *
+    * @param[in] p_noiseCov     The noise covariance.
+    *
+    * @return the inverse operator
+    */
+    MNEInverseOperator::SPtr updateInverseOperator(const FiffCov &p_noiseCov);
+
     //=========================================================================================================
     /**
     * The starting point for the thread. After calling start(), the newly created thread calls this function.
@@ -169,13 +226,30 @@ protected:
     virtual void run();
 
 private:
-    QMutex      mutex;                  /**< Provides access serialization between threads. */
-    bool        m_bIsRunning;           /**< Whether RtInv is running. */
+    mutable QMutex  mutex;              /**< Provides access serialization between threads. */
+    QWaitCondition  m_qNoiseCovAppended;/**< Signalled when a noise covariance is appended or the worker is stopped. */
+    bool            m_bIsRunning;       /**< Whether RtInv is running. */
 
     QVector<FiffCov::SPtr> m_vecNoiseCov;/**< Noise covariance matrices. */
+    QVector<qint64> m_vecAppendTime;    /**< Time stamps (ns, m_timer) at which the pending noise covariances were appended. */
+
+    QElapsedTimer   m_timer;            /**< Reference clock of the wake-up latency counter. */
+    qint64          m_iWakeCount;       /**< Number of worker wake-ups. */
+    qint64          m_iWakeLatencySum;  /**< Accumulated wake-up latency in microseconds. */
+    qint64          m_iWakeLatencyMax;  /**< Maximal wake-up latency in microseconds. */
+    qint64          m_iUpdateTimeLast;  /**< Time of the last inverse operator update in microseconds. */
+    qint64          m_iUpdateTimeMax;   /**< Maximal time of an inverse operator update in microseconds. */
 
     FiffInfo::SPtr m_pFiffInfo;         /**< The fiff measurement information. */
     MNEForwardSolution::SPtr m_pFwd;    /**< The forward solution. */
+
+    MNEForwardSolution m_forwardMeg;    /**< MEG part of the forward solution, picked once. */
+    bool m_bCacheValid;                 /**< Whether the cached forward-derived terms can be used. */
+    MNEInverseOperator m_invOpCached;   /**< Last fully computed inverse operator, holds the forward-derived terms. */
+    QStringList m_qListChNames;         /**< Channels the cached terms were computed for. */
+    VectorXd m_vecSourceWeights;        /**< Unscaled source covariance R (depth times orientation prior). */
+    MatrixXd m_matGainWeighted;         /**< Picked gain weighted with the source standard deviations G*R^0.5. */
+    MatrixXd m_matGainCov;              /**< Weighted gain product G*R*G^T. */
 };
 
 //*************************************************************************************************************
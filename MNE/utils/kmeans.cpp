@@ -50,6 +50,7 @@
 #include <iostream>
 #include <algorithm>
 #include <vector>
+#include <limits>
 #include <time.h>
 
 
@@ -59,6 +60,7 @@
 //=============================================================================================================
 
 #include <QDebug>
+#include <QtConcurrent>
 
 
 //*************************************************************************************************************
@@ -69,6 +71,882 @@
 using namespace UTILSLIB;
 
 
+//*************************************************************************************************************
+//=============================================================================================================
+// STATIC DEFINITIONS
+//=============================================================================================================
+
+namespace
+{
+
+//=============================================================================================================
+/**
+* Squared euclidean distance with mean centroids. The distances are accumulated dimension by dimension in the
+* same order as KMeans::distfun does, hence both engines yield bitwise identical distances.
+*/
+struct SqEuclideanDistance
+{
+    // Distance of the contiguous point x to the centroid in row i of C
+    static inline double distance(const double* x, const MatrixXd& C, qint32 i)
+    {
+        const qint32 k = C.rows();
+        const double* c = C.data() + i;
+        double diff = x[0] - c[0];
+        double dist = diff*diff;
+        for(qint32 j = 1; j < C.cols(); ++j)
+        {
+            diff = x[j] - c[j*k];
+            dist += diff*diff;
+        }
+        return dist;
+    }
+
+    // Distances of the contiguous point x to all centroids, vectorized over the centroids
+    static inline void distances(const double* x, const MatrixXd& C, VectorXd& dist)
+    {
+        dist = (C.col(0).array() - x[0]).square();
+        for(qint32 j = 1; j < C.cols(); ++j)
+            dist.array() += (C.col(j).array() - x[j]).square();
+    }
+
+    // Distances of all points of X (rows) to the centroid in row i of C, vectorized over the points
+    static inline void distances(const MatrixXd& X, const MatrixXd& C, qint32 i, MatrixXd& D, qint32 col)
+    {
+        D.col(col) = (X.col(0).array() - C(i,0)).square();
+        for(qint32 j = 1; j < X.cols(); ++j)
+            D.col(col).array() += (X.col(j).array() - C(i,j)).square();
+    }
+
+    // The bounds require a metric: the euclidean distance
+    static inline double metric(double dist)
+    {
+        return sqrt(dist);
+    }
+
+    // Mean of the members, accumulated as in KMeans::gcentroids
+    static inline void centroid(const MatrixXd& X, const VectorXi& members, qint32 count, VectorXd& /*buf*/, MatrixXd& C, qint32 i)
+    {
+        for(qint32 j = 0; j < X.cols(); ++j)
+        {
+            const double* x = X.data() + j*X.rows();
+            double c = 0;
+            for(qint32 l = 0; l < count; ++l)
+                c += x[members[l]] / count;
+            C(i,j) = c;
+        }
+    }
+};
+
+
+//=============================================================================================================
+/**
+* Cityblock distance with median centroids.
+*/
+struct CityblockDistance
+{
+    static inline double distance(const double* x, const MatrixXd& C, qint32 i)
+    {
+        const qint32 k = C.rows();
+        const double* c = C.data() + i;
+        double dist = std::fabs(x[0] - c[0]);
+        for(qint32 j = 1; j < C.cols(); ++j)
+            dist += std::fabs(x[j] - c[j*k]);
+        return dist;
+    }
+
+    static inline void distances(const double* x, const MatrixXd& C, VectorXd& dist)
+    {
+        dist = (C.col(0).array() - x[0]).abs();
+        for(qint32 j = 1; j < C.cols(); ++j)
+            dist.array() += (C.col(j).array() - x[j]).abs();
+    }
+
+    static inline void distances(const MatrixXd& X, const MatrixXd& C, qint32 i, MatrixXd& D, qint32 col)
+    {
+        D.col(col) = (X.col(0).array() - C(i,0)).abs();
+        for(qint32 j = 1; j < X.cols(); ++j)
+            D.col(col).array() += (X.col(j).array() - C(i,j)).abs();
+    }
+
+    static inline double metric(double dist)
+    {
+        return dist;
+    }
+
+    // Per dimension order statistics of the members around the median: lo <= mid <= hi are the sorted values at
+    // floor(count/2)-1, floor(count/2) and floor(count/2)+1; all equal for singletons
+    static inline void medians(const double* x, const VectorXi& members, qint32 count, VectorXd& buf, double& lo, double& mid, double& hi)
+    {
+        for(qint32 l = 0; l < count; ++l)
+            buf[l] = x[members[l]];
+
+        qint32 nn = count/2;
+        std::nth_element(buf.data(), buf.data() + nn, buf.data() + count);
+        mid = buf[nn];
+        lo = nn > 0 ? *std::max_element(buf.data(), buf.data() + nn) : mid;
+        hi = nn + 1 < count ? *std::min_element(buf.data() + nn + 1, buf.data() + count) : mid;
+    }
+
+    static inline void centroid(const MatrixXd& X, const VectorXi& members, qint32 count, VectorXd& buf, MatrixXd& C, qint32 i)
+    {
+        double lo, mid, hi;
+        for(qint32 j = 0; j < X.cols(); ++j)
+        {
+            medians(X.data() + j*X.rows(), members, count, buf, lo, mid, hi);
+            C(i,j) = count % 2 == 0 ? .5 * (lo + mid) : mid;
+        }
+    }
+};
+
+
+//=============================================================================================================
+/**
+* One K-Means replicate: the shared input, the initial centroids and the result.
+*/
+struct KMeansReplicate
+{
+    const MatrixXd* X;      /**< Input data, n x p */
+    const MatrixXd* Xt;     /**< Transposed input data, one point per column */
+    qint32 k;               /**< Number of clusters */
+    qint32 maxit;           /**< Maximal number of iterations */
+    bool online;            /**< If online update should be performed */
+    bool emptyError;        /**< If an empty cluster stops the batch update */
+    qint32 rep;             /**< Replicate number */
+    MatrixXd C0;            /**< Initial centroids */
+    MatrixXd DelIn;         /**< Reassignment criterion k x n left by the previous replicate; NaN if empty */
+
+    VectorXi idx;           /**< Resulting cluster indeces */
+    MatrixXd C;             /**< Resulting centroids */
+    VectorXd sumD;          /**< Resulting within cluster sums of distances */
+    MatrixXd D;             /**< Resulting point to centroid distances */
+    double totsumD;         /**< Resulting total sum of distances */
+    VectorXi computed;      /**< Clusters whose reassignment criterion was computed in the online phase */
+    bool inherits;          /**< If the online phase started with empty clusters, i.e. used DelIn */
+};
+
+
+//=============================================================================================================
+/**
+* Accelerated K-Means engine. It follows the batch and online phase of KMeans step by step, including the
+* tie breaking, but skips the work bounds prove to be unnecessary:
+* - Batch phase: a lower bound of the distance of each point to its second closest centroid (Hamerly). A
+*   point needs the distances to all centroids only when its distance to its own centroid exceeds it.
+* - Online phase: the reassignment criterion is updated lazily per point and cluster. Only the first point
+*   which improves by moving is needed, and lower bounds of the criterion of the other clusters (Elkan) prove
+*   most points to stay without touching their stale entries.
+* All buffers are allocated once per replicate.
+*/
+template<typename Distance>
+class KMeansEngine
+{
+public:
+    explicit KMeansEngine(KMeansReplicate& p_rep)
+    : r(p_rep)
+    , X(*p_rep.X)
+    , Xt(*p_rep.Xt)
+    , n(X.rows())
+    , p(X.cols())
+    , k(p_rep.k)
+    , C(p_rep.C0)
+    , D0(n, k)
+    , idx(n)
+    , previdx(n)
+    , m(VectorXi::Zero(k))
+    , d(n)
+    , lower(n)
+    , dist(k)
+    , drift(VectorXd::Zero(k))
+    , cOld(p, 4)
+    , changed(k)
+    , nChanged(0)
+    , isChanged(k)
+    , members(n)
+    , buf(n)
+    , iter(0)
+    {
+    }
+
+    bool run()
+    {
+        assign();
+
+        bool converged = batchUpdate();
+        if (r.online)
+            converged = onlineUpdate();
+
+        if (!converged)
+            printf("Failed To Converge during replicate %d\n", r.rep);
+
+        finish();
+        return converged;
+    }
+
+    //=========================================================================================================
+    /**
+    * Reassignment criterion a replicate leaves behind: the one of its final clustering for the clusters it
+    * computed, the inherited one otherwise.
+    */
+    static void finalCriterion(KMeansReplicate& p_rep, MatrixXd& p_Del)
+    {
+        if(p_rep.DelIn.size() > 0)
+            p_Del = p_rep.DelIn;
+        else
+        {
+            p_Del.resize(p_rep.k, p_rep.X->rows());
+            p_Del.fill(std::numeric_limits<double>::quiet_NaN());
+        }
+
+        KMeansEngine engine(p_rep);
+        engine.C = p_rep.C;
+        engine.idx = p_rep.idx;
+        for(qint32 l = 0; l < engine.n; ++l)
+            ++engine.m[engine.idx[l]];
+        engine.prepareOnline();
+
+        double lb;
+        for(qint32 i = 0; i < engine.k; ++i)
+            if(p_rep.computed[i])
+                for(qint32 l = 0; l < engine.n; ++l)
+                    p_Del(i,l) = engine.criterion(i, l, lb);
+    }
+
+private:
+    // First index of the minimum, same semantics as Eigen's minCoeff
+    static inline qint32 argmin(const double* v, qint32 size, double& vmin)
+    {
+        qint32 imin = 0;
+        vmin = v[0];
+        for(qint32 j = 1; j < size; ++j)
+        {
+            if(v[j] < vmin)
+            {
+                vmin = v[j];
+                imin = j;
+            }
+        }
+        return imin;
+    }
+
+    qint32 gatherMembers(qint32 i)
+    {
+        qint32 count = 0;
+        for(qint32 l = 0; l < n; ++l)
+            if(idx[l] == i)
+                members[count++] = l;
+        return count;
+    }
+
+    // Initial assignment to the closest start centroid and initial lower bounds
+    void assign()
+    {
+        for(qint32 i = 0; i < k; ++i)
+            Distance::distances(X, C, i, D0, i);
+
+        for(qint32 l = 0; l < n; ++l)
+        {
+            for(qint32 i = 0; i < k; ++i)
+                dist[i] = D0(l,i);
+            idx[l] = argmin(dist.data(), k, d[l]);
+            ++m[idx[l]];
+            lower[l] = secondMetric(idx[l]);
+        }
+    }
+
+    // Metric distance to the closest centroid other than i, from the distances in dist
+    inline double secondMetric(qint32 i) const
+    {
+        double second = std::numeric_limits<double>::infinity();
+        for(qint32 j = 0; j < k; ++j)
+            if(j != i && dist[j] < second)
+                second = dist[j];
+        return Distance::metric(second);
+    }
+
+    // New centroids and counts of the changed clusters and their drift
+    void updateCentroids()
+    {
+        for(qint32 c = 0; c < nChanged; ++c)
+        {
+            qint32 i = changed[c];
+            for(qint32 j = 0; j < p; ++j)
+                cOld(j,0) = C(i,j);
+
+            m[i] = gatherMembers(i);
+            if(m[i] > 0)
+                Distance::centroid(X, members, m[i], buf, C, i);
+            else
+                C.row(i).fill(std::numeric_limits<double>::quiet_NaN());
+
+            drift[i] = Distance::metric(Distance::distance(cOld.data(), C, i));
+        }
+    }
+
+    bool batchUpdate()
+    {
+        for(qint32 i = 0; i < k; ++i)
+            changed[i] = i;
+        nChanged = k;
+
+        double totsumD;
+        double prevtotsumD = std::numeric_limits<double>::max();
+        previdx.setZero();
+
+        iter = 0;
+        bool converged = false;
+        while(true)
+        {
+            ++iter;
+
+            drift.setZero();
+            updateCentroids();
+
+            // Deal with clusters that have just lost all their members
+            for(qint32 c = 0; c < nChanged; ++c)
+                if(m[changed[c]] == 0 && r.emptyError)
+                    return converged;
+
+            // Distances to the moved centroids and total sum of distances
+            isChanged.setZero();
+            for(qint32 c = 0; c < nChanged; ++c)
+                isChanged[changed[c]] = 1;
+
+            totsumD = 0;
+            for(qint32 l = 0; l < n; ++l)
+            {
+                if(isChanged[idx[l]])
+                    d[l] = Distance::distance(Xt.data() + l*p, C, idx[l]);
+                totsumD += d[l];
+            }
+
+            // Test for a cycle: if objective is not decreased, back out the last step
+            if(prevtotsumD <= totsumD)
+            {
+                idx = previdx;
+                updateCentroids();
+                --iter;
+                break;
+            }
+
+            if (iter >= r.maxit)
+                break;
+
+            previdx = idx;
+            prevtotsumD = totsumD;
+
+            // Largest two drifts; NaN drifts of emptied clusters invalidate all bounds
+            double drift1 = 0, drift2 = 0;
+            qint32 iDrift1 = -1;
+            bool validBounds = true;
+            for(qint32 c = 0; c < nChanged; ++c)
+            {
+                qint32 i = changed[c];
+                if(drift[i] != drift[i])
+                    validBounds = false;
+                else if(drift[i] > drift1)
+                {
+                    drift2 = drift1;
+                    drift1 = drift[i];
+                    iDrift1 = i;
+                }
+                else if(drift[i] > drift2)
+                    drift2 = drift[i];
+            }
+
+            // Determine closest cluster for each point and reassign points to clusters
+            isChanged.setZero();
+            qint32 nMoved = 0;
+            for(qint32 l = 0; l < n; ++l)
+            {
+                qint32 own = idx[l];
+                lower[l] -= own == iDrift1 ? drift2 : drift1;
+
+                // Small margin for the rounding of the bounds; ties always take the exact path
+                if(validBounds && Distance::metric(d[l]) * (1.0 + 1e-10) < lower[l])
+                    continue;
+
+                Distance::distances(Xt.data() + l*p, C, dist);
+
+                double dmin;
+                qint32 nidx = argmin(dist.data(), k, dmin);
+
+                // Resolve ties in favor of not moving
+                if(nidx != own && dist[own] > dmin)
+                {
+                    idx[l] = nidx;
+                    isChanged[own] = 1;
+                    isChanged[nidx] = 1;
+                    ++nMoved;
+                }
+
+                d[l] = dist[idx[l]];
+                lower[l] = secondMetric(idx[l]);
+            }
+
+            if(nMoved == 0)
+            {
+                converged = true;
+                break;
+            }
+
+            nChanged = 0;
+            for(qint32 i = 0; i < k; ++i)
+                if(isChanged[i])
+                    changed[nChanged++] = i;
+        }
+        return converged;
+    }
+
+    //=========================================================================================================
+    // Online phase, specialized per distance
+
+    void prepareOnline();
+
+    // Reassignment criterion of point l for cluster i; lb is a lower bound of it while cluster i changes
+    // (measured in drift units), valid for nonmembers only
+    double criterion(qint32 i, qint32 l, double& lb) const;
+
+    // Lower bound of the criterion of point l for cluster i, which it does not belong to
+    double lowerCriterion(qint32 i, qint32 l) const;
+
+    // Stores the part of cluster i the criterion depends on, to measure its drift afterwards
+    void saveCentroid(qint32 i, qint32 slot);
+    double centroidDrift(qint32 i, qint32 slot) const;
+
+    void moveCentroids(qint32 oidx, qint32 nidx, qint32 moved);
+
+    // Criterion of point l for cluster i, brought up to date if cluster i changed since
+    inline double criterionEntry(qint32 i, qint32 l)
+    {
+        if(stamp(i,l) != version[i])
+        {
+            double lb;
+            Del(i,l) = criterion(i, l, lb);
+            lbRef(i,l) = idx[l] == i ? -std::numeric_limits<double>::infinity() : lb + cumDrift[i];
+            stamp(i,l) = version[i];
+        }
+        return Del(i,l);
+    }
+
+    // Whether point l provably stays: its criterion is lower than the one of all other clusters
+    inline bool stays(qint32 l, double ownDel) const
+    {
+        const qint32 own = idx[l];
+        for(qint32 j = 0; j < k; ++j)
+        {
+            if(j == own)
+                continue;
+            if(stamp(j,l) == version[j])
+            {
+                // Ties with a lower cluster index move the minimum; NaN only matters in front
+                double v = Del(j,l);
+                if(v != v)
+                {
+                    if(j == 0)
+                        return false;
+                }
+                else if(j < own ? !(ownDel < v) : !(ownDel <= v))
+                    return false;
+            }
+            else if(!(ownDel * (1.0 + 1e-10) < lowerCriterion(j,l)))
+                return false;
+        }
+        return true;
+    }
+
+    bool onlineUpdate()
+    {
+        const double inf = std::numeric_limits<double>::infinity();
+
+        // Clusters which are empty now keep the criterion of the previous replicate
+        if(r.DelIn.size() > 0)
+            Del = r.DelIn;
+        else
+        {
+            Del.resize(k, n);
+            Del.fill(std::numeric_limits<double>::quiet_NaN());
+        }
+        stamp = MatrixXi::Zero(k, n);
+        lbRef = MatrixXd::Constant(k, n, -inf);
+        version = VectorXi::Zero(k);
+        cumDrift = VectorXd::Zero(k);
+        r.computed = VectorXi::Zero(k);
+        r.inherits = false;
+
+        prepareOnline();
+
+        for(qint32 i = 0; i < k; ++i)
+        {
+            if(m[i] > 0)
+                version[i] = 1;
+            else
+                r.inherits = true;
+        }
+
+        qint32 lastmoved = 0;
+        qint32 nummoved = 0;
+        qint32 iter1 = iter;
+        bool converged = false;
+        while(iter < r.maxit)
+        {
+            for(qint32 i = 0; i < k; ++i)
+                if(version[i] > 0)
+                    r.computed[i] = 1;
+
+            // The point with the lowest index which improves by moving; like KMeans a lone tie of the first
+            // point counts as a move
+            qint32 moved = -1;
+            qint32 nidx = 0;
+            qint32 tieNidx = -1;
+            bool otherCandidates = false;
+            for(qint32 l = 0; l < n; ++l)
+            {
+                if(stays(l, criterionEntry(idx[l], l)))
+                    continue;
+
+                for(qint32 j = 0; j < k; ++j)
+                    criterionEntry(j, l);
+
+                double minDel;
+                const double* del = Del.data() + l*k;
+                qint32 jmin = argmin(del, k, minDel);
+                if(jmin == idx[l])
+                    continue;
+                if(del[idx[l]] > minDel)
+                {
+                    moved = l;
+                    nidx = jmin;
+                    break;
+                }
+                if(l == 0)
+                    tieNidx = jmin;
+                else
+                    otherCandidates = true;
+            }
+            if(moved < 0 && tieNidx >= 0 && !otherCandidates)
+            {
+                moved = 0;
+                nidx = tieNidx;
+            }
+
+            if(moved < 0)
+            {
+                if ((iter == iter1) || nummoved > 0)
+                    ++iter;
+                converged = true;
+                break;
+            }
+
+            if (moved <= lastmoved)
+            {
+                ++iter;
+                if(iter >= r.maxit)
+                    break;
+                nummoved = 0;
+            }
+            ++nummoved;
+            lastmoved = moved;
+
+            qint32 oidx = idx[moved];
+            saveCentroid(oidx, 0);
+            saveCentroid(nidx, 1);
+
+            idx[moved] = nidx;
+            ++m[nidx];
+            --m[oidx];
+
+            moveCentroids(oidx, nidx, moved);
+
+            cumDrift[oidx] += centroidDrift(oidx, 0);
+            cumDrift[nidx] += centroidDrift(nidx, 1);
+            ++version[oidx];
+            ++version[nidx];
+            lbRef(oidx, moved) = -inf;
+        }
+
+        return converged;
+    }
+
+    // Final distances, within cluster sums and total sum of distances
+    void finish()
+    {
+        r.D.resize(n, k);
+        for(qint32 i = 0; i < k; ++i)
+        {
+            if(m[i] > 0)
+                Distance::distances(X, C, i, r.D, i);
+            else
+                r.D.col(i) = D0.col(i);
+        }
+
+        r.sumD = VectorXd::Zero(k);
+        for(qint32 l = 0; l < n; ++l)
+            r.sumD[idx[l]] += r.D(l, idx[l]);
+
+        r.totsumD = r.sumD.array().sum();
+        r.idx = idx;
+        r.C = C;
+    }
+
+    KMeansReplicate& r;
+    const MatrixXd& X;
+    const MatrixXd& Xt;
+    const qint32 n;
+    const qint32 p;
+    const qint32 k;
+
+    MatrixXd C;             // centroids k x p
+    MatrixXd D0;            // distances to the start centroids
+    VectorXi idx;
+    VectorXi previdx;
+    VectorXi m;
+    VectorXd d;             // distance of each point to its own centroid
+    VectorXd lower;         // lower bound of the metric distance of each point to its second closest centroid
+    VectorXd dist;
+    VectorXd drift;
+    MatrixXd cOld;          // saved centroids, resp. median boxes, one per column
+    VectorXi changed;
+    qint32 nChanged;
+    VectorXi isChanged;
+    VectorXi members;
+    VectorXd buf;
+    qint32 iter;
+
+    MatrixXd Del;           // reassignment criterion k x n
+    MatrixXi stamp;         // version of the cluster each criterion entry was computed for
+    MatrixXd lbRef;         // lower bounds of the criterion entries plus the cluster drift at that time
+    VectorXi version;       // number of changes of each cluster
+    VectorXd cumDrift;      // accumulated drift of each cluster
+    MatrixXd Xmid1;         // lower median neighbours (cityblock)
+    MatrixXd Xmid2;         // upper median neighbours (cityblock)
+    std::vector<MatrixXd> sorted;   // per cluster the sorted member values, one column per dimension (cityblock)
+};
+
+
+//*************************************************************************************************************
+
+template<>
+void KMeansEngine<SqEuclideanDistance>::prepareOnline()
+{
+}
+
+
+//*************************************************************************************************************
+
+template<>
+double KMeansEngine<SqEuclideanDistance>::criterion(qint32 i, qint32 l, double& lb) const
+{
+    // -1 for members, 1 for nonmembers, 0 for singleton members
+    const double sgn = idx[l] == i ? (m[i] == 1 ? 0.0 : -1.0) : 1.0;
+    const double dist = SqEuclideanDistance::distance(Xt.data() + l*p, C, i);
+    lb = sqrt(dist);
+    return ((double)m[i] / ((double)m[i] + sgn)) * dist;
+}
+
+
+//*************************************************************************************************************
+
+template<>
+double KMeansEngine<SqEuclideanDistance>::lowerCriterion(qint32 i, qint32 l) const
+{
+    // Lower bound of the euclidean distance to the centroid
+    double lb = lbRef(i,l) - cumDrift[i];
+    lb -= 1e-10 * (std::fabs(lbRef(i,l)) + cumDrift[i]);
+    if(!(lb > 0))
+        return 0;
+    return ((double)m[i] / ((double)m[i] + 1.0)) * lb * lb;
+}
+
+
+//*************************************************************************************************************
+
+template<>
+void KMeansEngine<SqEuclideanDistance>::saveCentroid(qint32 i, qint32 slot)
+{
+    for(qint32 j = 0; j < p; ++j)
+        cOld(j,slot) = C(i,j);
+}
+
+
+//*************************************************************************************************************
+
+template<>
+double KMeansEngine<SqEuclideanDistance>::centroidDrift(qint32 i, qint32 slot) const
+{
+    return sqrt(SqEuclideanDistance::distance(cOld.data() + slot*p, C, i));
+}
+
+
+//*************************************************************************************************************
+
+template<>
+void KMeansEngine<SqEuclideanDistance>::moveCentroids(qint32 oidx, qint32 nidx, qint32 moved)
+{
+    for(qint32 j = 0; j < p; ++j)
+    {
+        C(nidx,j) = C(nidx,j) + (X(moved,j) - C(nidx,j)) / m[nidx];
+        C(oidx,j) = C(oidx,j) - (X(moved,j) - C(oidx,j)) / m[oidx];
+    }
+}
+
+
+//*************************************************************************************************************
+
+template<>
+void KMeansEngine<CityblockDistance>::prepareOnline()
+{
+    Xmid1 = MatrixXd::Zero(k,p);
+    Xmid2 = MatrixXd::Zero(k,p);
+    sorted.resize(k);
+    for(qint32 i = 0; i < k; ++i)
+    {
+        qint32 count = gatherMembers(i);
+        sorted[i].resize(std::max(2*count, 4), p);
+        for(qint32 j = 0; j < p; ++j)
+        {
+            double* col = sorted[i].data() + j*sorted[i].rows();
+            for(qint32 l = 0; l < count; ++l)
+                col[l] = X(members[l], j);
+            std::sort(col, col + count);
+
+            if(count > 0)
+            {
+                qint32 nn = count/2;
+                Xmid1(i,j) = nn > 0 ? col[nn-1] : col[nn];
+                Xmid2(i,j) = count % 2 == 0 || nn + 1 >= count ? col[nn] : col[nn+1];
+            }
+        }
+    }
+}
+
+
+//*************************************************************************************************************
+
+template<>
+double KMeansEngine<CityblockDistance>::criterion(qint32 i, qint32 l, double& lb) const
+{
+    const double* x = Xt.data() + l*p;
+    double sum;
+    if (m[i] % 2 == 0)
+    {
+        // Moving a point changes the median of an even cluster only within [Xmid1, Xmid2]
+        const double sgn = idx[l] == i ? -1.0 : 1.0; // -1 for members, 1 for nonmembers
+        sum = 0;
+        for(qint32 h = 0; h < p; ++h)
+        {
+            double ldist = sgn * (Xmid1(i,h) - x[h]);
+            double rdist = sgn * (x[h] - Xmid2(i,h));
+            sum += rdist > ldist ? rdist < 0 ? 0 : rdist : ldist < 0 ? 0 : ldist;
+        }
+    }
+    else
+        sum = CityblockDistance::distance(x, C, i);
+
+    // For nonmembers the criterion is the distance to the box [Xmid1, Xmid2], resp. to the median
+    lb = sum;
+    return sum;
+}
+
+
+//*************************************************************************************************************
+
+template<>
+double KMeansEngine<CityblockDistance>::lowerCriterion(qint32 i, qint32 l) const
+{
+    return lbRef(i,l) - cumDrift[i] - 1e-10 * (std::fabs(lbRef(i,l)) + cumDrift[i]);
+}
+
+
+//*************************************************************************************************************
+
+template<>
+void KMeansEngine<CityblockDistance>::saveCentroid(qint32 i, qint32 slot)
+{
+    const bool even = m[i] % 2 == 0;
+    for(qint32 j = 0; j < p; ++j)
+    {
+        cOld(j,2*slot) = even ? Xmid1(i,j) : C(i,j);
+        cOld(j,2*slot+1) = even ? Xmid2(i,j) : C(i,j);
+    }
+}
+
+
+//*************************************************************************************************************
+
+template<>
+double KMeansEngine<CityblockDistance>::centroidDrift(qint32 i, qint32 slot) const
+{
+    // Largest distance of a point of the new box to the old box
+    const bool even = m[i] % 2 == 0;
+    double drift = 0;
+    for(qint32 j = 0; j < p; ++j)
+    {
+        double lo = even ? Xmid1(i,j) : C(i,j);
+        double hi = even ? Xmid2(i,j) : C(i,j);
+        drift += std::max(0.0, std::max(cOld(j,2*slot) - lo, hi - cOld(j,2*slot+1)));
+    }
+    return drift;
+}
+
+
+//*************************************************************************************************************
+
+template<>
+void KMeansEngine<CityblockDistance>::moveCentroids(qint32 oidx, qint32 nidx, qint32 moved)
+{
+    // Keep the sorted member values up to date: one removal and one insertion per dimension
+    if(m[nidx] > sorted[nidx].rows())
+        sorted[nidx].conservativeResize(2*m[nidx], p);
+
+    const qint32 nOld = m[oidx] + 1;
+    const qint32 nNew = m[nidx] - 1;
+    for(qint32 j = 0; j < p; ++j)
+    {
+        const double v = X(moved,j);
+
+        double* col = sorted[oidx].data() + j*sorted[oidx].rows();
+        qint32 pos = std::lower_bound(col, col + nOld, v) - col;
+        std::copy(col + pos + 1, col + nOld, col + pos);
+
+        col = sorted[nidx].data() + j*sorted[nidx].rows();
+        pos = std::upper_bound(col, col + nNew, v) - col;
+        std::copy_backward(col + pos, col + nNew, col + nNew + 1);
+        col[pos] = v;
+    }
+
+    qint32 onidx[2] = {oidx, nidx};
+    for(qint32 h = 0; h < 2; ++h)
+    {
+        qint32 i = onidx[h];
+        qint32 count = m[i];
+        if(count == 0)
+            continue;
+        qint32 nn = count/2;
+        for(qint32 j = 0; j < p; ++j)
+        {
+            const double* col = sorted[i].data() + j*sorted[i].rows();
+            double lo = nn > 0 ? col[nn-1] : col[nn];
+            double mid = col[nn];
+            double hi = nn + 1 < count ? col[nn+1] : mid;
+            C(i,j) = count % 2 == 0 ? .5 * (lo + mid) : mid;
+            Xmid1(i,j) = lo;
+            Xmid2(i,j) = count % 2 == 0 ? mid : hi;
+        }
+    }
+}
+
+
+//*************************************************************************************************************
+
+template<typename Distance>
+void runReplicate(KMeansReplicate& p_rep)
+{
+    KMeansEngine<Distance> engine(p_rep);
+    engine.run();
+}
+
+} // NAMESPACE
+
+
 //*************************************************************************************************************
 //=============================================================================================================
 // DEFINE MEMBER METHODS
@@ -81,6 +959,10 @@ KMeans::KMeans(QString distance, QString start, qint32 replicates, QString empty
 , m_sEmptyact(emptyact)
 , m_iMaxit(maxit)
 , m_bOnline(online)
+, m_bAccelerated(false)
+, m_bSeeded(false)
+, m_iSeed(0)
+, m_iRandState(1)
 {
     // Assume one replicate
     if (m_iReps < 1)
@@ -90,19 +972,29 @@ KMeans::KMeans(QString distance, QString start, qint32 replicates, QString empty
 
 //*************************************************************************************************************
 
-bool KMeans::calculate( MatrixXd X, qint32 kClusters, VectorXi& idx, MatrixXd& C, VectorXd& sumD, MatrixXd& D)
+bool KMeans::calculate(const MatrixXd& p_X, qint32 kClusters, VectorXi& idx, MatrixXd& C, VectorXd& sumD, MatrixXd& D)
 {
     if (kClusters < 1)
         return false;
 
     //Init random generator
-    srand ( time(NULL) );
+    m_iRandState = m_bSeeded ? (quint64)m_iSeed : (quint64)time(NULL);
+    m_iRandState = m_iRandState * 0x9E3779B97F4A7C15ULL + 1; // state must not be zero
+
+    if (m_bAccelerated && (m_sStart.compare("sample") == 0 || m_sStart.compare("uniform") == 0))
+    {
+        if (m_sDistance.compare("sqeuclidean") == 0)
+            return calculateAccelerated<SqEuclideanDistance>(p_X, kClusters, idx, C, sumD, D);
+        else if (m_sDistance.compare("cityblock") == 0)
+            return calculateAccelerated<CityblockDistance>(p_X, kClusters, idx, C, sumD, D);
+    }
 
 // n points in p dimensional space
     k = kClusters;
-    n = X.rows();
-    p = X.cols();
+    n = p_X.rows();
+    p = p_X.cols();
 
+    MatrixXd Xcorr;
     if(m_sDistance.compare("cosine") == 0)
     {
 //        Xnorm = sqrt(sum(X.^2, 2));
@@ -115,15 +1007,17 @@ bool KMeans::calculate( MatrixXd X, qint32 kClusters, VectorXi& idx, MatrixXd& C
     }
     else if(m_sDistance.compare("correlation")==0)
     {
-        X.array() -= (X.rowwise().sum().array() / (double)p).replicate(1,p); //X - X.rowwise().sum();//.repmat(mean(X,2),1,p);
-        MatrixXd Xnorm = (X.array().pow(2).rowwise().sum()).sqrt();//sqrt(sum(X.^2, 2));
+        Xcorr = p_X;
+        Xcorr.array() -= (Xcorr.rowwise().sum().array() / (double)p).replicate(1,p); //X - X.rowwise().sum();//.repmat(mean(X,2),1,p);
+        MatrixXd Xnorm = (Xcorr.array().pow(2).rowwise().sum()).sqrt();//sqrt(sum(X.^2, 2));
 //        if any(min(Xnorm) <= eps(max(Xnorm)))
 //            error(['Some points have small relative standard deviations, making them ', ...
 //                   'effectively constant.\nEither remove those points, or choose a ', ...
 //                   'distance other than ''correlation''.']);
 //        end
-        X.array() /= Xnorm.replicate(1,p).array();
+        Xcorr.array() /= Xnorm.replicate(1,p).array();
     }
+    const MatrixXd& X = m_sDistance.compare("correlation") == 0 ? Xcorr : p_X;
 //    else if(m_sDistance.compare('hamming')==0)
 //    {
 //        if ~all(ismember(X(:),[0 1]))
@@ -181,7 +1075,7 @@ bool KMeans::calculate( MatrixXd X, qint32 kClusters, VectorXi& idx, MatrixXd& C
         {
             C = MatrixXd::Zero(k,p);
             for(qint32 i = 0; i < k; ++i)
-                C.block(i,0,1,p) = X.block(rand() % n, 0, 1, p);
+                C.block(i,0,1,p) = X.block(nextRandom() % n, 0, 1, p);
             // DEBUG
 //            C.block(0,0,1,p) = X.block(2, 0, 1, p);
 //            C.block(1,0,1,p) = X.block(7, 0, 1, p);
@@ -367,7 +1261,7 @@ bool KMeans::batchUpdate(const MatrixXd& X, MatrixXd& C, VectorXi& idx)
         // Deal with clusters that have just lost all their members
         VectorXi empties = VectorXi::Zero(changed.rows());
         for(qint32 i = 0; i < changed.rows(); ++i)
-            if(m(i) == 0)
+            if(m[changed[i]] == 0)
                 empties[i] = 1;
 
         if (empties.sum() > 0)
@@ -1008,6 +1902,121 @@ void KMeans::gcentroids(const MatrixXd& X, const VectorXi& index, const VectorXi
 }// function
 
 
+//*************************************************************************************************************
+
+template<typename Distance>
+bool KMeans::calculateAccelerated(const MatrixXd& X, qint32 kClusters, VectorXi& idx, MatrixXd& C, VectorXd& sumD, MatrixXd& D)
+{
+    k = kClusters;
+    n = X.rows();
+    p = X.cols();
+
+    // One point per column keeps the per point distances on contiguous memory
+    MatrixXd Xt = X.transpose();
+
+    RowVectorXd Xmins;
+    RowVectorXd Xmaxs;
+    if (m_sStart.compare("uniform") == 0)
+    {
+        Xmins = X.colwise().minCoeff();
+        Xmaxs = X.colwise().maxCoeff();
+    }
+
+    // Draw the start centroids of all replicates in the order of the serial engine
+    QList<KMeansReplicate> qListReplicates;
+    for(qint32 rep = 0; rep < m_iReps; ++rep)
+    {
+        KMeansReplicate t_rep;
+        t_rep.X = &X;
+        t_rep.Xt = &Xt;
+        t_rep.k = k;
+        t_rep.maxit = m_iMaxit;
+        t_rep.online = m_bOnline;
+        t_rep.emptyError = m_sEmptyact.compare("error") == 0;
+        t_rep.rep = rep;
+        t_rep.C0 = MatrixXd::Zero(k,p);
+        if (m_sStart.compare("uniform") == 0)
+        {
+            for(qint32 i = 0; i < k; ++i)
+                for(qint32 j = 0; j < p; ++j)
+                    t_rep.C0(i,j) = unifrnd(Xmins[j], Xmaxs[j]);
+        }
+        else
+        {
+            for(qint32 i = 0; i < k; ++i)
+                t_rep.C0.row(i) = X.row(nextRandom() % n);
+        }
+        qListReplicates.append(t_rep);
+    }
+
+    if (m_iReps > 1)
+        QtConcurrent::blockingMap(qListReplicates, runReplicate<Distance>);
+    else
+        runReplicate<Distance>(qListReplicates[0]);
+
+    // The serial engine hands the reassignment criterion on from one replicate to the next, which matters
+    // for clusters which are empty when the online phase starts. Replay those replicates in order.
+    if (m_bOnline)
+    {
+        qint32 lastInheriting = 0;
+        for(qint32 rep = 1; rep < m_iReps; ++rep)
+            if (qListReplicates[rep].inherits)
+                lastInheriting = rep;
+
+        MatrixXd Del;
+        for(qint32 rep = 1; rep <= lastInheriting; ++rep)
+        {
+            KMeansEngine<Distance>::finalCriterion(qListReplicates[rep-1], Del);
+            qListReplicates[rep].DelIn = Del;
+            if (qListReplicates[rep].inherits)
+                runReplicate<Distance>(qListReplicates[rep]);
+        }
+    }
+
+    // Return the best solution, the first one on ties. Like in the serial engine, where an empty cluster with
+    // emptyact "error" stops the batch phase instead of failing the replicate, every replicate is a candidate.
+    qint32 best = 0;
+    for(qint32 rep = 1; rep < m_iReps; ++rep)
+        if (qListReplicates[rep].totsumD < qListReplicates[best].totsumD)
+            best = rep;
+
+    idx = qListReplicates[best].idx;
+    C = qListReplicates[best].C;
+    sumD = qListReplicates[best].sumD;
+    D = qListReplicates[best].D;
+
+    return true;
+}
+
+
+//*************************************************************************************************************
+
+void KMeans::setAccelerated(bool p_bAccelerated)
+{
+    m_bAccelerated = p_bAccelerated;
+}
+
+
+//*************************************************************************************************************
+
+void KMeans::setSeed(quint32 p_iSeed)
+{
+    m_bSeeded = true;
+    m_iSeed = p_iSeed;
+}
+
+
+//*************************************************************************************************************
+
+quint32 KMeans::nextRandom()
+{
+    m_iRandState ^= m_iRandState >> 12;
+    m_iRandState ^= m_iRandState << 25;
+    m_iRandState ^= m_iRandState >> 27;
+    return (quint32)((m_iRandState * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+
 //*************************************************************************************************************
 
 double KMeans::unifrnd(double a, double b)
@@ -1020,7 +2029,7 @@ double KMeans::unifrnd(double a, double b)
     double mu = a2+b2;
     double sig = b2-a2;
 
-    double r = mu + sig * (2.0* (rand() % 1000)/1000 -1.0);
+    double r = mu + sig * (2.0* (nextRandom() % 1000)/1000 -1.0);
 
     return r;
 }
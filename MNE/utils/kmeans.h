@@ -117,7 +117,28 @@ public:
     * @param[out] sumD      Summation of the distances to the centroid within one cluster
     * @param[out] D         Cluster distances to the centroid
     */
-    bool calculate( MatrixXd X, qint32 kClusters, VectorXi& idx, MatrixXd& C, VectorXd& sumD, MatrixXd& D);
+    bool calculate(const MatrixXd& X, qint32 kClusters, VectorXi& idx, MatrixXd& C, VectorXd& sumD, MatrixXd& D);
+
+    //=========================================================================================================
+    /**
+    * Seeds the random generator used for the initial centroids. Seeded objects produce the same clustering
+    * for the same input in every calculate call and are independent of other KMeans objects, which makes
+    * them safe to be used concurrently. Unseeded objects are seeded with the current time in each calculate.
+    *
+    * @param[in] p_iSeed    The seed.
+    */
+    void setSeed(quint32 p_iSeed);
+
+    //=========================================================================================================
+    /**
+    * Enables the accelerated K-Means engine for the "sqeuclidean" and "cityblock" distances. It skips the
+    * distance computations of points which are bound to stay in their cluster (Hamerly bounds), works on
+    * preallocated buffers and runs the replicates in parallel. The initial centroids are drawn as before,
+    * hence the same seed leads to the same clustering. Other distances fall back to the default engine.
+    *
+    * @param[in] p_bAccelerated    Whether the accelerated engine should be used.
+    */
+    void setAccelerated(bool p_bAccelerated);
 
 
 private:
@@ -132,6 +153,20 @@ private:
     */
     MatrixXd distfun(const MatrixXd& X, MatrixXd& C);//, qint32 iter);
 
+    //=========================================================================================================
+    /**
+    * Clusters input data X with the accelerated engine, see setAccelerated.
+    *
+    * @param[in] X          Input data (rows = points; cols = p dimensional space)
+    * @param[in] kClusters  Number of k clusters
+    * @param[out] idx       The cluster indeces to which cluster the input points belong to
+    * @param[out] C         Cluster centroids k x p
+    * @param[out] sumD      Summation of the distances to the centroid within one cluster
+    * @param[out] D         Cluster distances to the centroid
+    */
+    template<typename Distance>
+    bool calculateAccelerated(const MatrixXd& X, qint32 kClusters, VectorXi& idx, MatrixXd& C, VectorXd& sumD, MatrixXd& D);
+
     //=========================================================================================================
     /**
     * Updates clusters when points moved
@@ -181,6 +216,14 @@ private:
     */
     double unifrnd(double a, double b);
 
+    //=========================================================================================================
+    /**
+    * Returns the next number of the object's random generator (xorshift64*).
+    *
+    * @return random number
+    */
+    quint32 nextRandom();
+
 
     QString m_sDistance;    /**< Distance measurement to use: "sqeuclidean" (default), "cityblock" , "cosine", "correlation", "hamming". */
     QString m_sStart;       /**< Initialization to use: "sample" (default), "uniform", "cluster". */
@@ -188,6 +231,7 @@ private:
     QString m_sEmptyact;    /**< What should be done if a cluster wents empty: "error" (default), "drop", "singleton" */
     qint32 m_iMaxit;        /**< Maximal number of iterations per replicate */
     bool m_bOnline;         /**< If online update should be performed */
+    bool m_bAccelerated;    /**< If the accelerated engine should be used, when available for the distance */
 
     qint32 emptyErrCnt;     /**< Counts the occurence of empty errors */
 
@@ -206,6 +250,10 @@ private:
 
     VectorXi previdx;       /**< Previous point cluster indeces */
 
+    bool m_bSeeded;         /**< Whether a seed was set with setSeed */
+    quint32 m_iSeed;        /**< The seed set with setSeed */
+    quint64 m_iRandState;   /**< State of the random generator */
+
 };
 
 } // NAMESPACE
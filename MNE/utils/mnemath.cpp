@@ -59,6 +59,7 @@
 // QT INCLUDES
 //=============================================================================================================
 
+#include <QAtomicInt>
 #include <QFile>
 #include <QDebug>
 
@@ -71,6 +72,14 @@
 using namespace UTILSLIB;
 
 
+//*************************************************************************************************************
+//=============================================================================================================
+// STATIC DEFINITIONS
+//=============================================================================================================
+
+static QAtomicInt s_svdBackend(MNEMath::GramEigenSvdBackend);   /**< MNEMath::SvdBackend used by MNEMath::svd; set once at startup. */
+
+
 //*************************************************************************************************************
 //=============================================================================================================
 // DEFINE MEMBER METHODS
@@ -124,6 +133,102 @@ double MNEMath::getConditionSlope(const MatrixXd& A, VectorXd &s)
 }
 
 
+//*************************************************************************************************************
+
+void MNEMath::svd(const MatrixXd &A, VectorXd &s, MatrixXd *U, MatrixXd *V)
+{
+    svd(A, svdBackend(), s, U, V);
+}
+
+
+//*************************************************************************************************************
+
+void MNEMath::svd(const MatrixXd &A, SvdBackend backend, VectorXd &s, MatrixXd *U, MatrixXd *V)
+{
+    if(backend == JacobiSvdBackend)
+    {
+        JacobiSVD<MatrixXd> t_svd(A, (U ? ComputeThinU : 0) | (V ? ComputeThinV : 0));
+        s = t_svd.singularValues();
+        if(U)
+            *U = t_svd.matrixU();
+        if(V)
+            *V = t_svd.matrixV();
+        return;
+    }
+
+    //
+    // Eigen-decomposition of the Gram matrix of the smaller side: A*A^T = U*S^2*U^T or A^T*A = V*S^2*V^T
+    //
+    bool bWide = A.rows() <= A.cols();
+    qint32 k = bWide ? A.rows() : A.cols();
+
+    MatrixXd t_matGram(k, k);
+    if(bWide)
+        t_matGram.noalias() = A * A.transpose();
+    else
+        t_matGram.noalias() = A.transpose() * A;
+
+    SelfAdjointEigenSolver<MatrixXd> t_eig(t_matGram, (U || V) ? ComputeEigenvectors : EigenvaluesOnly);
+
+    // eigenvalues are ascending and carry an absolute error of about eps times the largest one
+    s.resize(k);
+    for(qint32 i = 0; i < k; ++i)
+    {
+        double t_dEig = t_eig.eigenvalues()[k-1-i];
+        s[i] = t_dEig > 0 ? sqrt(t_dEig) : 0;
+    }
+    double t_dTol = k > 0 ? s[0] * sqrt(k * NumTraits<double>::epsilon()) : 0;
+    for(qint32 i = 0; i < k; ++i)
+        if(s[i] <= t_dTol)
+            s[i] = 0;
+
+    if(!U && !V)
+        return;
+
+    MatrixXd t_matVecs = t_eig.eigenvectors().rowwise().reverse();
+
+    //Singular vectors of the other side: A^T*U*S^-1 or A*V*S^-1
+    MatrixXd t_matOther(bWide ? A.cols() : A.rows(), k);
+    if(bWide)
+        t_matOther.noalias() = A.transpose() * t_matVecs;
+    else
+        t_matOther.noalias() = A * t_matVecs;
+    for(qint32 i = 0; i < k; ++i)
+        t_matOther.col(i) *= s[i] > 0 ? 1.0 / s[i] : 0.0;
+
+    if(bWide)
+    {
+        if(U)
+            *U = t_matVecs;
+        if(V)
+            *V = t_matOther;
+    }
+    else
+    {
+        if(U)
+            *U = t_matOther;
+        if(V)
+            *V = t_matVecs;
+    }
+}
+
+
+//*************************************************************************************************************
+
+void MNEMath::setSvdBackend(SvdBackend backend)
+{
+    s_svdBackend.store(backend);
+}
+
+
+//*************************************************************************************************************
+
+MNEMath::SvdBackend MNEMath::svdBackend()
+{
+    return (SvdBackend)s_svdBackend.load();
+}
+
+
 //*************************************************************************************************************
 
 void MNEMath::get_whitener(MatrixXd &A, bool pca, QString ch_type, VectorXd &eig, MatrixXd &eigvec)
@@ -135,7 +240,13 @@ void MNEMath::get_whitener(MatrixXd &A, bool pca, QString ch_type, VectorXd &eig
     eigvec = t_eigenSolver.eigenvectors().transpose();
 
     MNEMath::sort<double>(eig, eigvec, false);
-    qint32 rnk = MNEMath::rank(A);
+
+    // The singular values of a self-adjoint matrix are the magnitudes of its eigenvalues, so the rank
+    // (same relative tolerance as MNEMath::rank) follows without a further decomposition
+    double t_dTol = eig.size() > 0 ? eig.cwiseAbs().maxCoeff() * 1e-8 : 0;
+    qint32 rnk = 0;
+    for(qint32 i = 0; i < eig.size(); ++i)
+        rnk += fabs(eig[i]) > t_dTol ? 1 : 0;
 
     for(qint32 i = 0; i < eig.size()-rnk; ++i)
         eig(i) = 0;
@@ -103,6 +103,16 @@ class UTILSSHARED_EXPORT MNEMath
 public:
     typedef std::pair<int,int> IdxIntValue;         /**< Typedef of a pair of ints. */
 
+    //=========================================================================================================
+    /**
+    * Backends of the thin singular value decomposition (see svd).
+    */
+    enum SvdBackend
+    {
+        JacobiSvdBackend,       /**< Two-sided Jacobi SVD of the matrix itself. Accurate to machine precision, but O(mn^2) with a large constant. */
+        GramEigenSvdBackend     /**< Self-adjoint eigen-decomposition of the Gram matrix of the smaller side. Singular values up to sqrt(k*eps) relative to the largest one, k = min(m,n), are not resolved and are set to zero. */
+    };
+
     //=========================================================================================================
     /**
     * Destroys the MNEMath object
@@ -152,6 +162,51 @@ public:
     */
     static double getConditionSlope(const MatrixXd& A, VectorXd &s);
 
+    //=========================================================================================================
+    /**
+    * Thin singular value decomposition A = U*diag(s)*V^T with k = min(m,n) singular values sorted in
+    * descending order. U (m x k) and V (n x k) are only computed when requested. With the Gram backend the
+    * singular vectors of the Gram side (U for m <= n, V otherwise) are the eigenvectors of the Gram matrix, also
+    * for singular values which are set to zero. The singular vectors of the other side are computed as A^T*U*S^-1
+    * or A*V*S^-1 and are zero for singular values which are set to zero.
+    *
+    * @param[in] A          Matrix to decompose (m x n).
+    * @param[out] s         Singular values.
+    * @param[out] U         Left singular vectors (optional).
+    * @param[out] V         Right singular vectors (optional).
+    */
+    static void svd(const MatrixXd &A, VectorXd &s, MatrixXd *U = 0, MatrixXd *V = 0);
+
+    //=========================================================================================================
+    /**
+    * Thin singular value decomposition with an explicitly chosen backend, see svd.
+    *
+    * @param[in] A          Matrix to decompose (m x n).
+    * @param[in] backend    The backend to use.
+    * @param[out] s         Singular values.
+    * @param[out] U         Left singular vectors (optional).
+    * @param[out] V         Right singular vectors (optional).
+    */
+    static void svd(const MatrixXd &A, SvdBackend backend, VectorXd &s, MatrixXd *U = 0, MatrixXd *V = 0);
+
+    //=========================================================================================================
+    /**
+    * Sets the backend which is used by svd. Default is GramEigenSvdBackend. The setting is process wide and read
+    * atomically, but it is not meant to be toggled at runtime: set it once at startup, before svd is used
+    * concurrently, or pass the backend explicitly to svd instead.
+    *
+    * @param[in] backend    The backend to use.
+    */
+    static void setSvdBackend(SvdBackend backend);
+
+    //=========================================================================================================
+    /**
+    * Returns the backend which is used by svd.
+    *
+    * @return the current svd backend
+    */
+    static SvdBackend svdBackend();
+
     //=========================================================================================================
     /**
     * Returns the whitener of a given matrix.
@@ -400,7 +400,8 @@ void BabyMEG::run()
     {
         if(m_pRawMatrixBuffer)
         {
-            QSharedPointer<Eigen::MatrixXf> t_pRawBuffer(new Eigen::MatrixXf(m_pRawMatrixBuffer->pop()));
+            QSharedPointer<Eigen::MatrixXf> t_pRawBuffer(new Eigen::MatrixXf());
+            m_pRawMatrixBuffer->pop(*t_pRawBuffer);
 
 //            ++count;
 //            printf("%d raw buffer (%d x %d) generated\r\n", count, t_pRawBuffer->rows(), t_pRawBuffer->cols());
@@ -50,6 +50,14 @@
 #include <QDebug>
 
 
+//*************************************************************************************************************
+//=============================================================================================================
+// STL INCLUDES
+//=============================================================================================================
+
+#include <algorithm>
+
+
 //*************************************************************************************************************
 //=============================================================================================================
 // USED NAMESPACES
@@ -108,19 +116,15 @@ void FiffProducer::run()
     //
     fiff_int_t from = m_pFiffSimulator->m_RawInfo.first_samp;
     fiff_int_t to = m_pFiffSimulator->m_RawInfo.last_samp;
-//    float quantum_sec = (float)uiSamplePeriod/1000000.0f; //read and write in 10 sec junks
-    fiff_int_t quantum = m_pFiffSimulator->m_uiBufferSampleSize;//ceil(quantum_sec*m_pFiffSimulator->m_pRawInfo->info.sfreq);
+    fiff_int_t quantum = m_pFiffSimulator->m_uiBufferSampleSize;
 
-    qDebug() << "quantum " << quantum;
-
-    //
-    //   To read the whole file at once set
     //
-    //quantum     = to - from + 1;
-    //
-    //
-    //   Read and write all the data
+    //   The file is read in chunks of several buffers, which are sliced into the buffer of the simulator. The
+    //   simulator paces the buffers itself, so the loader only blocks while the buffer is full.
     //
+    fiff_int_t chunk = m_pFiffSimulator->chunkBuffers()*quantum;
+
+    qDebug() << "quantum " << quantum << "chunk " << chunk;
 
     fiff_int_t first, last;
     MatrixXd data;
@@ -130,71 +134,52 @@ void FiffProducer::run()
 
     qint32 nchan = m_pFiffSimulator->m_RawInfo.info.nchan;
 
-    MatrixXd cals(1,nchan);
-
-//    SparseMatrix<double> inv_calsMat(nchan, nchan);
-
-//    for(qint32 i = 0; i < nchan; ++i)
-//        inv_calsMat.insert(i, i) = 1.0f/m_pFiffSimulator->m_RawInfo.info.chs[i].cal;
-
-    //Not good cause production time is not accurate
-    //loading and thread sleep is longer than thread sleep time - better to have a extra loading thread
-    // ToDo restructure this producer as laoding buffer --> and thread sleep to simulator buffer
-    fiff_int_t t_iDiff;
-    bool t_bRestart = false;
+    MatrixXf t_matChunk;                    // Samples of the last read chunk
+    qint32 t_iChunkPos = 0;                 // First sample of t_matChunk not yet copied to a buffer
+    MatrixXf t_matBuffer(nchan, quantum);
+    qint32 t_iBufferPos = 0;                // Number of samples already in t_matBuffer
 
     while(m_bIsRunning)
     {
-        last = first+quantum-1;
-        if (last > to)
+        if(t_iChunkPos == t_matChunk.cols())
         {
-            t_iDiff = last - to;
-            t_bRestart = true;
+            last = first+chunk-1;
+            if (last > to)
+                last = to;
 
-            last = to;
-        }
-
-        if (!m_pFiffSimulator->m_RawInfo.read_raw_segment(data,times,first,last))
-        {
-            printf("error during read_raw_segment\n");
-        }
-
-        MatrixXf tmp = data.cast<float>();//(inv_calsMat*data).cast<float>();
-
-        if(t_bRestart)
-        {
-            //
-            // Case end of Simulation: restart file from the beginning and read remaining bytes
-            //
-            printf("### RESTART Simulation File ###\r\n");
-
-            first = from;
-            last = first+t_iDiff-1;
-
-            if (!m_pFiffSimulator->m_RawInfo.read_raw_segment(data,times,first,last))
+            if (!m_pFiffSimulator->m_RawInfo.read_raw_segment(data,times,first,last) || data.cols() == 0)
             {
                 printf("error during read_raw_segment\n");
+                break;
             }
 
-            MatrixXf tmp2 = data.cast<float>();//(inv_calsMat*data).cast<float>();
-
-            MatrixXf tmp3(tmp.rows(), tmp.cols()+tmp2.cols());
+            t_matChunk = data.cast<float>();
+            t_iChunkPos = 0;
 
-            tmp3.block(0,0,tmp.rows(),tmp.cols()) = tmp;
-            tmp3.block(0,tmp.cols(),tmp.rows(),tmp2.cols()) = tmp2;
+            if(last == to)
+            {
+                //
+                // Case end of Simulation: restart file from the beginning; the next buffer continues with it
+                //
+                printf("### RESTART Simulation File ###\r\n");
+                first = from;
+            }
+            else
+                first = last+1;
+        }
 
-            tmp = tmp3;
+        qint32 t_iCount = std::min(quantum - t_iBufferPos, (qint32)t_matChunk.cols() - t_iChunkPos);
+        t_matBuffer.block(0, t_iBufferPos, nchan, t_iCount) = t_matChunk.block(0, t_iChunkPos, nchan, t_iCount);
+        t_iBufferPos += t_iCount;
+        t_iChunkPos += t_iCount;
 
-            t_bRestart = false;
-            first += t_iDiff;
-        }
-        else
+        if(t_iBufferPos == quantum)
         {
-            first += quantum;
+            // waits while the buffer is full, but wakes up regularly to notice stop()
+            while(m_bIsRunning && !m_pFiffSimulator->m_pRawMatrixBuffer->push(&t_matBuffer, 100))
+                ;
+            t_iBufferPos = 0;
         }
-
-        // call blocks until there is free space in the buffer
-        m_pFiffSimulator->m_pRawMatrixBuffer->push(&tmp);
     }
 
     // close datastream in this thread
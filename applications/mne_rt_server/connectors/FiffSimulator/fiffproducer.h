@@ -82,7 +82,10 @@ class FiffSimulator;
 /**
 * DECLARE CLASS FiffProducer
 *
-* @brief The FiffProducer class provides a ECG data producer for a given sampling rate.
+* The FiffProducer reads the simulation file ahead of the simulator in chunks of several buffers and slices them
+* into the raw matrix buffer of the simulator, which does the pacing.
+*
+* @brief The FiffProducer class provides the loader thread of the FiffSimulator.
 */
 class FiffProducer : public QThread
 {
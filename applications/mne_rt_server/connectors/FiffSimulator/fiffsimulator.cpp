@@ -71,6 +71,7 @@
 #include <QFile>
 #include <QCoreApplication>
 #include <QDebug>
+#include <QElapsedTimer>
 
 
 //*************************************************************************************************************
@@ -92,6 +93,11 @@ const QString FiffSimulator::Commands::GETBUFSIZE   = "getbufsize";
 const QString FiffSimulator::Commands::ACCEL        = "accel";
 const QString FiffSimulator::Commands::GETACCEL     = "getaccel";
 const QString FiffSimulator::Commands::SIMFILE      = "simfile";
+const QString FiffSimulator::Commands::PACING       = "pacing";
+const QString FiffSimulator::Commands::GETPACING    = "getpacing";
+const QString FiffSimulator::Commands::STAMP        = "stamp";
+
+const float FiffSimulator::s_fChunkLength = 2.0f;
 
 
 //*************************************************************************************************************
@@ -110,6 +116,8 @@ FiffSimulator::FiffSimulator()
 , m_AccelerationFactor(1.0)
 , m_TrueSamplingRate(0.0)
 , m_pRawMatrixBuffer(NULL)
+, m_iAsFastAsPossible(0)
+, m_iStamp(0)
 , m_bIsRunning(false)
 {
     this->init();
@@ -282,6 +290,68 @@ void FiffSimulator::comSimfile(Command p_command)
 }
 
 
+//*************************************************************************************************************
+
+void FiffSimulator::comPacing(Command p_command)
+{
+    //ToDO JSON
+
+    QString t_sMode = p_command.pValues()[0].toString();
+
+    if(t_sMode == "realtime" || t_sMode == "fast")
+    {
+        // the pacing thread reads the mode once per buffer, no restart needed
+        m_iAsFastAsPossible.store(t_sMode == "fast" ? 1 : 0);
+
+        QString str = QString("\tSet %1 pacing to %2\r\n\n").arg(getName()).arg(t_sMode);
+
+        m_commandManager[Commands::PACING].reply(str);
+    }
+    else
+        m_commandManager[Commands::PACING].reply("Pacing not set, use realtime or fast\r\n");
+}
+
+
+//*************************************************************************************************************
+
+void FiffSimulator::comGetPacing(Command p_command)
+{
+    QString t_sMode = m_iAsFastAsPossible.load() ? "fast" : "realtime";
+
+    bool t_bCommandIsJson = p_command.isJson();
+    if(t_bCommandIsJson)
+    {
+        //
+        //create JSON help object
+        //
+        QJsonObject t_qJsonObjectRoot;
+        t_qJsonObjectRoot.insert(Commands::PACING, QJsonValue(t_sMode));
+        QJsonDocument p_qJsonDocument(t_qJsonObjectRoot);
+
+        m_commandManager[Commands::GETPACING].reply(p_qJsonDocument.toJson());
+    }
+    else
+    {
+        QString str = QString("\t%1\r\n\n").arg(t_sMode);
+        m_commandManager[Commands::GETPACING].reply(str);
+    }
+}
+
+
+//*************************************************************************************************************
+
+void FiffSimulator::comStamp(Command p_command)
+{
+    //ToDO JSON
+
+    m_iStamp.store(p_command.pValues()[0].toBool() ? 1 : 0);
+
+    QString str = QString("\tLatency stamps of %1 %2\r\n\n").arg(getName()).arg(m_iStamp.load() ? "enabled" : "disabled");
+
+    m_commandManager[Commands::STAMP].reply(str);
+}
+
+
 //*************************************************************************************************************
 
 void FiffSimulator::connectCommandManager()
@@ -292,6 +362,9 @@ void FiffSimulator::connectCommandManager()
     QObject::connect(&m_commandManager[Commands::ACCEL], &Command::executed, this, &FiffSimulator::comAccel);
     QObject::connect(&m_commandManager[Commands::GETACCEL], &Command::executed, this, &FiffSimulator::comGetAccel);
     QObject::connect(&m_commandManager[Commands::SIMFILE], &Command::executed, this, &FiffSimulator::comSimfile);
+    QObject::connect(&m_commandManager[Commands::PACING], &Command::executed, this, &FiffSimulator::comPacing);
+    QObject::connect(&m_commandManager[Commands::GETPACING], &Command::executed, this, &FiffSimulator::comGetPacing);
+    QObject::connect(&m_commandManager[Commands::STAMP], &Command::executed, this, &FiffSimulator::comStamp);
 }
 
 
@@ -319,8 +392,20 @@ void FiffSimulator::init()
         delete m_pRawMatrixBuffer;
     m_pRawMatrixBuffer = NULL;
 
+    //
+    // Room for two chunks: the loader reads the next chunk while the previous one is paced out
+    //
     if(!m_RawInfo.isEmpty())
-        m_pRawMatrixBuffer = new RawMatrixBuffer(RAW_BUFFFER_SIZE, m_RawInfo.info.nchan, this->m_uiBufferSampleSize);
+        m_pRawMatrixBuffer = new RawMatrixBuffer(qMax(RAW_BUFFFER_SIZE, 2*chunkBuffers()), m_RawInfo.info.nchan, this->m_uiBufferSampleSize);
+}
+
+
+//*************************************************************************************************************
+
+qint32 FiffSimulator::chunkBuffers() const
+{
+    qint32 t_iBuffers = (qint32)(s_fChunkLength*m_TrueSamplingRate/m_uiBufferSampleSize);
+    return t_iBuffers > 1 ? t_iBuffers : 1;
 }
 
 
@@ -328,6 +413,10 @@ void FiffSimulator::init()
 
 bool FiffSimulator::start()
 {
+    // every client's start command starts the active connector; don't pull the buffer from under running threads
+    if(this->isRunning())
+        return true;
+
     this->init();
 
     // Start threads
@@ -487,20 +576,47 @@ void FiffSimulator::run()
 {
     m_bIsRunning = true;
 
-    float t_fSamplingFrequency = m_RawInfo.info.sfreq;
-    float t_fBuffSampleSize = (float)m_uiBufferSampleSize;
+    //
+    // Buffer n is emitted at n times the buffer period after the first one. The deadlines are absolute on a
+    // monotonic clock, so time spent popping and emitting doesn't add up to a drift.
+    //
+    double t_dBufferPeriodNs = (double)m_uiBufferSampleSize/m_RawInfo.info.sfreq*1.0e9;
 
-    quint32 uiSamplePeriod = (unsigned int) ((t_fBuffSampleSize/t_fSamplingFrequency)*1000000.0f);
+    QElapsedTimer t_timer;
+    t_timer.start();
+    qint64 t_iBufferCount = 0;
 
-//    quint32 count = 0;
+    QSharedPointer<Eigen::MatrixXf> t_pRawBuffer;
 
     while(m_bIsRunning)
     {
-        QSharedPointer<Eigen::MatrixXf> t_pRawBuffer(new Eigen::MatrixXf(m_pRawMatrixBuffer->pop()));
-//        ++count;
-//        printf("%d raw buffer (%d x %d) generated\r\n", count, t_pRawBuffer->rows(), t_pRawBuffer->cols());
+        t_pRawBuffer = QSharedPointer<Eigen::MatrixXf>(new Eigen::MatrixXf());
+        // wakes up regularly to notice stop()
+        if(!m_pRawMatrixBuffer->pop(*t_pRawBuffer, 100))
+            continue;
+
+        if(!m_iAsFastAsPossible.load())
+        {
+            qint64 t_iDeadline = (qint64)(t_iBufferCount*t_dBufferPeriodNs);
+            qint64 t_iWait = t_iDeadline - t_timer.nsecsElapsed();
+
+            if(t_iWait > 0)
+                usleep((unsigned long)(t_iWait/1000));
+            else if(-t_iWait > 1000000000)
+            {
+                //
+                // More than a second behind, e.g. after a stalled loader or fast mode: start a new schedule instead
+                // of bursting to catch up
+                //
+                t_timer.restart();
+                t_iBufferCount = 0;
+            }
+        }
+
+        if(m_iStamp.load() && t_pRawBuffer->size() > 0)
+            (*t_pRawBuffer)(t_pRawBuffer->rows()-1, 0) = (float)(MonotonicClock::microseconds() & 0xFFFFFF);
 
         emit remitRawBuffer(t_pRawBuffer);
-        usleep(uiSamplePeriod);
+        ++t_iBufferCount;
     }
 }
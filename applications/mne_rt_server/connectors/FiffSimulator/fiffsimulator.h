@@ -52,6 +52,7 @@
 
 #include <fiff/fiff_raw_data.h>
 #include <generics/circularmatrixbuffer.h>
+#include <generics/monotonicclock.h>
 
 
 //*************************************************************************************************************
@@ -61,6 +62,7 @@
 
 #include <QString>
 #include <QMutex>
+#include <QAtomicInt>
 
 
 //*************************************************************************************************************
@@ -112,6 +114,9 @@ public:
         static const QString ACCEL;
         static const QString GETACCEL;
         static const QString SIMFILE;
+        static const QString PACING;
+        static const QString GETPACING;
+        static const QString STAMP;
     };
 
     //=========================================================================================================
@@ -184,6 +189,31 @@ private:
     */
     void comSimfile(Command p_command);
 
+    //=========================================================================================================
+    /**
+    * Sets the pacing mode: "realtime" emits the buffers at the (accelerated) sampling rate, "fast" as fast as
+    * they are loaded.
+    *
+    * @param[in] p_command  The pacing command.
+    */
+    void comPacing(Command p_command);
+
+    //=========================================================================================================
+    /**
+    * Returns the pacing mode
+    *
+    * @param[in] p_command  The pacing command.
+    */
+    void comGetPacing(Command p_command);
+
+    //=========================================================================================================
+    /**
+    * Enables or disables the latency stamps, see m_iStamp.
+    *
+    * @param[in] p_command  The stamp command.
+    */
+    void comStamp(Command p_command);
+
     //////////
 
     //=========================================================================================================
@@ -194,6 +224,14 @@ private:
 
     bool readRawInfo();
 
+    //=========================================================================================================
+    /**
+    * Returns the number of buffers the loader reads at once, about s_fChunkLength seconds of data.
+    *
+    * @return the number of buffers per chunk
+    */
+    qint32 chunkBuffers() const;
+
     QMutex mutex;
 
     FiffProducer*   m_pFiffProducer;        /**< Holds the DataProducer.*/
@@ -204,8 +242,12 @@ private:
     float           m_TrueSamplingRate;     /**< The true sampling rate of the fif file. */
 
     RawMatrixBuffer* m_pRawMatrixBuffer;    /**< The Circular Raw Matrix Buffer. */
+    QAtomicInt      m_iAsFastAsPossible;    /**< Whether buffers are emitted as fast as they are loaded, without pacing; set by comPacing, read by run(). */
+    QAtomicInt      m_iStamp;               /**< Whether the first sample of the last channel is replaced by the emit time, MonotonicClock microseconds modulo 2^24, to measure latencies; set by comStamp, read by run(). */
 
     bool            m_bIsRunning;
+
+    static const float s_fChunkLength;      /**< Length in seconds of the chunks read ahead by the loader. */
 };
 
 } // NAMESPACE
@@ -281,7 +281,8 @@ void Neuromag::run()
         if(m_pRawMatrixBuffer)
         {
             // Pop available Buffers
-            QSharedPointer<Eigen::MatrixXf> t_pRawBuffer(new Eigen::MatrixXf(m_pRawMatrixBuffer->pop()));
+            QSharedPointer<Eigen::MatrixXf> t_pRawBuffer(new Eigen::MatrixXf());
+            m_pRawMatrixBuffer->pop(*t_pRawBuffer);
 //            ++count;
 //            printf("%d raw buffer (%d x %d) generated\r\n", count, t_pRawBuffer->rows(), t_pRawBuffer->cols());
 
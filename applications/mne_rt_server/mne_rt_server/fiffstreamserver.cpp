@@ -44,6 +44,15 @@
 #include "mne_rt_server.h"
 
 
+//*************************************************************************************************************
+//=============================================================================================================
+// Fiff INCLUDES
+//=============================================================================================================
+
+#include <fiff/fiff_constants.h>
+#include <fiff/fiff_stream.h>
+
+
 //*************************************************************************************************************
 //=============================================================================================================
 // STL INCLUDES
@@ -52,6 +61,14 @@
 #include <stdlib.h>
 
 
+//*************************************************************************************************************
+//=============================================================================================================
+// QT INCLUDES
+//=============================================================================================================
+
+#include <QCoreApplication>
+
+
 //*************************************************************************************************************
 //=============================================================================================================
 // USED NAMESPACES
@@ -69,6 +86,10 @@ using namespace FIFFLIB;
 FiffStreamServer::FiffStreamServer(QObject *parent)
 : QTcpServer(parent)
 , m_iNextClientId(0)
+, m_iBackpressurePolicy(FiffStreamThread::DropOldest)
+, m_iMaxQueuedBytes(64*1048576)
+, m_iRingGeneration(0)
+, m_iEncodingFallbacks(0)
 {
 
 }
@@ -173,6 +194,35 @@ void FiffStreamServer::comStopAll(Command p_command)
 }
 
 
+//*************************************************************************************************************
+
+void FiffStreamServer::comBufPolicy(Command p_command)
+{
+    QString t_sOutput("");
+
+    bool t_bIsInt;
+    qint32 t_iLimit = p_command.pValues()[0].toString().toInt(&t_bIsInt);
+    QString t_sPolicy = p_command.pValues()[1].toString();
+
+    if(!t_bIsInt || t_iLimit <= 0)
+        t_sOutput.append(QString("\tinvalid limit '%1', expected a size in MB\r\n\n").arg(p_command.pValues()[0].toString()));
+    else if(t_sPolicy.compare("drop", Qt::CaseInsensitive) != 0 && t_sPolicy.compare("disconnect", Qt::CaseInsensitive) != 0)
+        t_sOutput.append(QString("\tinvalid policy '%1', expected drop or disconnect\r\n\n").arg(t_sPolicy));
+    else
+    {
+        m_iBackpressurePolicy = t_sPolicy.compare("drop", Qt::CaseInsensitive) == 0 ? FiffStreamThread::DropOldest : FiffStreamThread::Disconnect;
+        m_iMaxQueuedBytes = (qint64)t_iLimit*1048576;
+
+        QMap<qint32, FiffStreamThread*>::iterator i;
+        for (i = this->m_qClientList.begin(); i != this->m_qClientList.end(); ++i)
+            i.value()->setBackpressure((FiffStreamThread::BackpressurePolicy)m_iBackpressurePolicy, m_iMaxQueuedBytes);
+
+        t_sOutput.append(QString("\tFiffStreamClients queue up to %1 MB, then %2\r\n\n").arg(t_iLimit).arg(m_iBackpressurePolicy == FiffStreamThread::DropOldest ? "the oldest raw buffers are dropped" : "they are disconnected"));
+    }
+    qobject_cast<MNERTServer*>(this->parent())->getCommandManager()["bufpolicy"].reply(t_sOutput);
+}
+
+
 //*************************************************************************************************************
 
 void FiffStreamServer::connectCommands()
@@ -185,6 +235,7 @@ void FiffStreamServer::connectCommands()
     QObject::connect(&t_pMNERTServer->getCommandManager()["start"], &Command::executed, this, &FiffStreamServer::comStart);
     QObject::connect(&t_pMNERTServer->getCommandManager()["stop"], &Command::executed, this, &FiffStreamServer::comStop);
     QObject::connect(&t_pMNERTServer->getCommandManager()["stop-all"], &Command::executed, this, &FiffStreamServer::comStopAll);
+    QObject::connect(&t_pMNERTServer->getCommandManager()["bufpolicy"], &Command::executed, this, &FiffStreamServer::comBufPolicy);
 
 //    t_pMNERTServer->getCommandManager().connectSlot(QString("clist"), this, &FiffStreamServer::comClist);
 //    t_pMNERTServer->getCommandManager().connectSlot(QString("measinfo"), this, &FiffStreamServer::comMeasinfo);
@@ -368,6 +419,11 @@ QByteArray FiffStreamServer::parseToId(QString& p_sRawId, qint32& p_iParsedId)
 
 void FiffStreamServer::forwardMeasInfo(qint32 ID, FiffInfo p_fiffInfo)
 {
+    m_fiffInfo = p_fiffInfo;
+    m_rawBufferCodec.setInfo(p_fiffInfo);
+    m_qMapSelectionCodecs.clear();
+    m_iEncodingFallbacks = 0;
+
     emit remitMeasInfo(ID, p_fiffInfo);
 }
 
@@ -376,7 +432,148 @@ void FiffStreamServer::forwardMeasInfo(qint32 ID, FiffInfo p_fiffInfo)
 //ToDo increase preformance --> try inline
 void FiffStreamServer::forwardRawBuffer(QSharedPointer<Eigen::MatrixXf> m_pMatRawData)
 {
-    emit remitRawBuffer(m_pMatRawData);
+    //
+    // Build every distinct channel selection once, no matter how many clients share it
+    //
+    QMap<QByteArray, FiffStreamThread*> t_qMapSelections;
+    QMap<qint32, FiffStreamThread*>::iterator i;
+    for (i = this->m_qClientList.begin(); i != this->m_qClientList.end(); ++i)
+    {
+        QByteArray t_selectionKey = i.value()->getSelectionKey();
+        if(!t_qMapSelections.contains(t_selectionKey))
+            t_qMapSelections.insert(t_selectionKey, i.value());
+    }
+
+    MatrixXf t_matSelection;
+    QMap<QByteArray, FiffStreamThread*>::iterator s;
+    for (s = t_qMapSelections.begin(); s != t_qMapSelections.end(); ++s)
+    {
+        const RowVectorXi& t_vecSelection = s.value()->getSelection();
+        if(t_vecSelection.size() == 0)
+        {
+            forwardSelection(*m_pMatRawData, s.key(), t_vecSelection);
+            continue;
+        }
+
+        t_matSelection.resize(t_vecSelection.size(), m_pMatRawData->cols());
+        for(qint32 r = 0; r < t_vecSelection.size(); ++r)
+            t_matSelection.row(r) = m_pMatRawData->row(t_vecSelection[r]);
+
+        forwardSelection(t_matSelection, s.key(), t_vecSelection);
+    }
+}
+
+
+//*************************************************************************************************************
+
+void FiffStreamServer::forwardSelection(const MatrixXf& p_matRawBuffer, const QByteArray& p_selectionKey, const RowVectorXi& p_vecSelection)
+{
+    //
+    // Encode the buffer once per encoding in use; the clients share the implicitly shared blocks and never
+    // modify them. Buffers which can't be encoded losslessly go out as floats.
+    //
+    bool t_bEncodingUsed[FiffRawBufferCodec::NumEncodings] = { false };
+    bool t_bSharedMemoryUsed = false;
+    QMap<qint32, FiffStreamThread*>::iterator i;
+    for (i = this->m_qClientList.begin(); i != this->m_qClientList.end(); ++i)
+    {
+        if(i.value()->getSelectionKey() != p_selectionKey)
+            continue;
+
+        if(i.value()->isSharedMemory())
+            t_bSharedMemoryUsed = true;
+        else
+            t_bEncodingUsed[i.value()->getEncoding()] = true;
+    }
+
+    //
+    // The calibrations of a selection are those of its channels
+    //
+    const FiffRawBufferCodec* t_pCodec = &m_rawBufferCodec;
+    if(p_vecSelection.size() > 0)
+    {
+        if(!m_qMapSelectionCodecs.contains(p_selectionKey))
+            m_qMapSelectionCodecs.insert(p_selectionKey, FiffRawBufferCodec(m_fiffInfo.pick_info(p_vecSelection)));
+        t_pCodec = &m_qMapSelectionCodecs[p_selectionKey];
+    }
+
+    QByteArray t_blockFloat;
+    for(qint32 e = 0; e < FiffRawBufferCodec::NumEncodings; ++e)
+    {
+        if(!t_bEncodingUsed[e])
+            continue;
+
+        QByteArray t_blockRawBuffer;
+        if(e == FiffRawBufferCodec::Float || !t_pCodec->encode(p_matRawBuffer, (FiffRawBufferCodec::Encoding)e, t_blockRawBuffer))
+        {
+            if(e != FiffRawBufferCodec::Float && !(m_iEncodingFallbacks & (1 << e)))
+            {
+                m_iEncodingFallbacks |= 1 << e;
+                printf("Raw buffers don't reproduce their floats exactly in encoding %d, sending them as floats.\r\n\n", e);
+            }
+
+            if(t_blockFloat.isEmpty())
+                t_pCodec->encode(p_matRawBuffer, FiffRawBufferCodec::Float, t_blockFloat);
+            t_blockRawBuffer = t_blockFloat;
+        }
+
+        emit remitRawBuffer(t_blockRawBuffer, e, p_selectionKey);
+    }
+
+    //
+    // Same host clients only get the sequence number of the buffer in the shared memory ring; if the ring is not
+    // available they fall back to floats
+    //
+    if(t_bSharedMemoryUsed)
+    {
+        QByteArray t_blockAnnouncement;
+        if(!publishRawBuffer(p_matRawBuffer, t_blockAnnouncement))
+        {
+            if(t_blockFloat.isEmpty())
+                t_pCodec->encode(p_matRawBuffer, FiffRawBufferCodec::Float, t_blockFloat);
+            t_blockAnnouncement = t_blockFloat;
+        }
+
+        emit remitRawBuffer(t_blockAnnouncement, FiffStreamThread::SharedMemory, p_selectionKey);
+    }
+}
+
+
+//*************************************************************************************************************
+
+bool FiffStreamServer::publishRawBuffer(const Eigen::MatrixXf& p_matRawBuffer, QByteArray& p_blockAnnouncement)
+{
+    if(p_matRawBuffer.size() > m_rawBufferRing.capacity())
+    {
+        //
+        // Clients attached to the previous ring keep it alive until they move to the new key
+        //
+        QString t_sKey = QString("mne_rt_server_%1_%2").arg(QCoreApplication::applicationPid()).arg(m_iRingGeneration++);
+        if(!m_rawBufferRing.create(t_sKey, s_iRingSlots, (qint32)p_matRawBuffer.size()))
+            return false;
+        printf("FiffStreamServer: shared memory ring %s created (%d x %d elements).\r\n\n", t_sKey.toUtf8().constData(), s_iRingSlots, (qint32)p_matRawBuffer.size());
+    }
+
+    quint32 t_iSeq = m_rawBufferRing.publish(p_matRawBuffer);
+    if(t_iSeq == 0)
+        return false;
+
+    //
+    // Announcement: sequence number followed by the key of the ring
+    //
+    QByteArray t_sKey = m_rawBufferRing.key().toUtf8();
+
+    QByteArray t_block;
+    FiffStream t_FiffStreamOut(&t_block, QIODevice::WriteOnly);
+    t_FiffStreamOut << (qint32)FIFF_MNE_RT_SHMEM_BUFFER;
+    t_FiffStreamOut << (qint32)FIFFT_VOID;
+    t_FiffStreamOut << (qint32)(4 + t_sKey.size());
+    t_FiffStreamOut << (qint32)FIFFV_NEXT_SEQ;
+    t_FiffStreamOut << (qint32)t_iSeq;
+    t_FiffStreamOut.writeRawData(t_sKey.constData(), t_sKey.size());
+
+    p_blockAnnouncement = t_block;
+    return true;
 }
 
 
@@ -385,6 +582,7 @@ void FiffStreamServer::forwardRawBuffer(QSharedPointer<Eigen::MatrixXf> m_pMatRa
 void FiffStreamServer::incomingConnection(qintptr socketDescriptor)
 {
     FiffStreamThread* t_pStreamThread = new FiffStreamThread(m_iNextClientId, socketDescriptor, this);
+    t_pStreamThread->setBackpressure((FiffStreamThread::BackpressurePolicy)m_iBackpressurePolicy, m_iMaxQueuedBytes);
 
     m_qClientList.insert(m_iNextClientId, t_pStreamThread);
     ++m_iNextClientId;
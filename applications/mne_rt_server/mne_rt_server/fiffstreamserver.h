@@ -42,6 +42,8 @@
 //=============================================================================================================
 
 #include <fiff/fiff_info.h>
+#include <fiff/fiff_raw_buffer_codec.h>
+#include <generics/sharedmatrixring.h>
 #include <rtCommand/commandmanager.h>
 
 
@@ -50,6 +52,7 @@
 // QT INCLUDES
 //=============================================================================================================
 
+#include <QByteArray>
 #include <QStringList>
 #include <QTcpServer>
 
@@ -68,6 +71,7 @@ namespace RTSERVER
 //=============================================================================================================
 
 using namespace FIFFLIB;
+using namespace IOBuffer;
 using namespace RTCOMMANDLIB;
 
 
@@ -132,7 +136,7 @@ signals:
     void stopMeasFiffStreamClient(qint32 ID);
 
     void remitMeasInfo(qint32 ID, FIFFLIB::FiffInfo p_fiffInfo);
-    void remitRawBuffer(QSharedPointer<Eigen::MatrixXf>);
+    void remitRawBuffer(QByteArray p_blockRawBuffer, qint32 p_iEncoding, QByteArray p_selectionKey);
 
     void closeFiffStreamServer();
 
@@ -181,11 +185,52 @@ private:
     */
     void comStopAll(Command p_command);
 
+    //=========================================================================================================
+    /**
+    * Sets the backpressure policy of all current and future FiffStreamClients
+    *
+    * @param[in] p_command  The buffer policy command.
+    */
+    void comBufPolicy(Command p_command);
+
     QByteArray parseToId(QString& p_sRawId, qint32& p_iParsedId);
 
+    //=========================================================================================================
+    /**
+    * Publishes a raw buffer into the shared memory ring and encodes the tag which announces it to the clients.
+    * The ring is created under a new key when the buffer outgrows it.
+    *
+    * @param[in] p_matRawBuffer         The raw buffer.
+    * @param[out] p_blockAnnouncement   The FIFF_MNE_RT_SHMEM_BUFFER tag announcing the buffer.
+    *
+    * @return true if the buffer was published, false if the ring isn't available.
+    */
+    bool publishRawBuffer(const Eigen::MatrixXf& p_matRawBuffer, QByteArray& p_blockAnnouncement);
+
+    //=========================================================================================================
+    /**
+    * Encodes the raw buffer of one channel selection once per encoding in use by the clients of the selection.
+    *
+    * @param[in] p_matRawBuffer     The raw buffer, rows of the selected channels only.
+    * @param[in] p_selectionKey     The key of the channel selection, empty for all channels.
+    * @param[in] p_vecSelection     The selected channels, empty for all channels.
+    */
+    void forwardSelection(const Eigen::MatrixXf& p_matRawBuffer, const QByteArray& p_selectionKey, const RowVectorXi& p_vecSelection);
+
     QMap<qint32, FiffStreamThread*> m_qClientList;
     qint32                          m_iNextClientId;
 
+    qint32                          m_iBackpressurePolicy;  /**< FiffStreamThread::BackpressurePolicy of the clients */
+    qint64                          m_iMaxQueuedBytes;      /**< Maximal number of bytes queued per client */
+    FiffInfo                        m_fiffInfo;             /**< Last forwarded measurement info */
+    FiffRawBufferCodec              m_rawBufferCodec;       /**< Encodes the raw buffers, calibrations of the last forwarded measurement info */
+    QMap<QByteArray, FiffRawBufferCodec> m_qMapSelectionCodecs; /**< Codecs of the channel selections, by selection key */
+    SharedMatrixRing                m_rawBufferRing;        /**< Shared memory ring of the raw buffers for same host clients */
+    qint32                          m_iRingGeneration;      /**< Number of shared memory rings created so far, part of their keys */
+    qint32                          m_iEncodingFallbacks;   /**< Bit mask of the encodings which fell back to floats since the last measurement info */
+
+    static const qint32 s_iRingSlots = 32;                  /**< Number of raw buffers a shared memory client may lag behind */
+
 };
 
 
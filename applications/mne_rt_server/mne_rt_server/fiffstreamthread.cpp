@@ -72,6 +72,65 @@ using namespace RTSERVER;
 using namespace FIFFLIB;
 
 
+//*************************************************************************************************************
+//=============================================================================================================
+// STATIC DEFINITIONS
+//=============================================================================================================
+
+namespace
+{
+//=============================================================================================================
+/**
+* Whether an address is a loopback address, including IPv4 addresses mapped to IPv6 by a dual stack server.
+*/
+bool isLoopbackAddress(const QHostAddress& p_address)
+{
+    return p_address.isInSubnet(QHostAddress("127.0.0.0"), 8)
+            || p_address.isInSubnet(QHostAddress("::ffff:127.0.0.0"), 104)
+            || p_address == QHostAddress(QHostAddress::LocalHostIPv6);
+}
+
+//=============================================================================================================
+/**
+* Resolves a ':' separated channel selection of channel types (meg, grad, mag, eeg, stim) and channel names.
+* Returns an empty selection for all channels.
+*/
+RowVectorXi selectChannels(const FiffInfo& p_fiffInfo, const QString& p_sSelection)
+{
+    bool t_bGrad = false;
+    bool t_bMag = false;
+    bool t_bEeg = false;
+    bool t_bStim = false;
+    QStringList t_sListNames;
+
+    QStringList t_sListSelection = p_sSelection.split(":", QString::SkipEmptyParts);
+    if(t_sListSelection.isEmpty())
+        return RowVectorXi();
+
+    for(qint32 i = 0; i < t_sListSelection.size(); ++i)
+    {
+        QString t_sItem = t_sListSelection[i].trimmed();
+        if(t_sItem == "meg")
+            t_bGrad = t_bMag = true;
+        else if(t_sItem == "grad")
+            t_bGrad = true;
+        else if(t_sItem == "mag")
+            t_bMag = true;
+        else if(t_sItem == "eeg")
+            t_bEeg = true;
+        else if(t_sItem == "stim")
+            t_bStim = true;
+        else
+            t_sListNames << t_sItem;
+    }
+
+    QString t_sMeg = t_bGrad && t_bMag ? QString("all") : t_bGrad ? QString("grad") : t_bMag ? QString("mag") : QString("");
+
+    return p_fiffInfo.pick_types(t_sMeg, t_bEeg, t_bStim, t_sListNames);
+}
+}
+
+
 //*************************************************************************************************************
 //=============================================================================================================
 // DEFINE MEMBER METHODS
@@ -82,8 +141,15 @@ FiffStreamThread::FiffStreamThread(qint32 id, int socketDescriptor, QObject *par
 , m_iDataClientId(id)
 , m_sDataClientAlias(QString(""))
 , m_iSocketDescriptor(socketDescriptor)
+, m_iQueuedBytes(0)
+, m_iDroppedBuffers(0)
+, m_backpressurePolicy(DropOldest)
+, m_iMaxQueuedBytes(64*1048576)
+, m_iOverflow(0)
 , m_bIsSendingRawBuffer(false)
-, m_bIsRunning(false)
+, m_iEncoding(FiffRawBufferCodec::Float)
+, m_iSharedMemory(0)
+, m_bIsLocalClient(false)
 {
 }
 
@@ -97,7 +163,7 @@ FiffStreamThread::~FiffStreamThread()
     if(t_pFiffStreamServer)
         t_pFiffStreamServer->m_qClientList.remove(m_iDataClientId);
 
-    m_bIsRunning = false;
+    QThread::quit();
     QThread::wait();
 }
 
@@ -110,12 +176,13 @@ void FiffStreamThread::startMeas(qint32 ID)
     {
         qDebug() << "Activate raw buffer sending.";
 
-        m_qMutex.lock();
         // ToDo send start meas
-        FiffStream t_FiffStreamOut(&m_qSendBlock, QIODevice::WriteOnly);
+        QByteArray t_block;
+        FiffStream t_FiffStreamOut(&t_block, QIODevice::WriteOnly);
         t_FiffStreamOut.start_block(FIFFB_RAW_DATA);
+
+        enqueueBlock(t_block);
         m_bIsSendingRawBuffer = true;
-        m_qMutex.unlock();
     }
 }
 
@@ -129,11 +196,12 @@ void FiffStreamThread::stopMeas(qint32 ID)
     {
         qDebug() << "stop raw buffer sending.";
 
-        m_qMutex.lock();
-        FiffStream t_FiffStreamOut(&m_qSendBlock, QIODevice::WriteOnly);
+        QByteArray t_block;
+        FiffStream t_FiffStreamOut(&t_block, QIODevice::WriteOnly);
         t_FiffStreamOut.end_block(FIFFB_RAW_DATA);
+
         m_bIsSendingRawBuffer = false;
-        m_qMutex.unlock();
+        enqueueBlock(t_block);
     }
 }
 
@@ -164,6 +232,48 @@ void FiffStreamThread::parseCommand(FiffTag::SPtr p_pTag)
             printf("FiffStreamClient (ID %d): send client ID %d\r\n\n", m_iDataClientId, m_iDataClientId);
             writeClientId();
         }
+        else if(t_iCmd == MNE_RT_SET_BUFFER_ENCODING)
+        {
+            //
+            // Set Raw Buffer Encoding
+            //
+            bool t_bIsInt;
+            qint32 t_iEncoding = QString(p_pTag->mid(4, p_pTag->size()-4)).toInt(&t_bIsInt);
+            if(t_bIsInt && t_iEncoding >= 0 && t_iEncoding < FiffRawBufferCodec::NumEncodings)
+            {
+                m_iEncoding.store(t_iEncoding);
+                printf("FiffStreamClient (ID %d): new raw buffer encoding = %d\r\n\n", m_iDataClientId, t_iEncoding);
+                if(t_iEncoding != FiffRawBufferCodec::Float)
+                    printf("FiffStreamClient (ID %d): buffers which don't reproduce their floats exactly are sent as floats\r\n\n", m_iDataClientId);
+            }
+            else
+                printf("FiffStreamClient (ID %d): unknown raw buffer encoding\r\n\n", m_iDataClientId);
+        }
+        else if(t_iCmd == MNE_RT_SET_SHMEM_TRANSPORT)
+        {
+            //
+            // Set Shared Memory Transport; only clients on the same host can map the ring
+            //
+            bool t_bEnable = QString(p_pTag->mid(4, p_pTag->size()-4)).toInt() != 0;
+            if(t_bEnable && !m_bIsLocalClient)
+                printf("FiffStreamClient (ID %d): shared memory transport refused, client is not on this host\r\n\n", m_iDataClientId);
+            else
+            {
+                m_iSharedMemory.store(t_bEnable ? 1 : 0);
+                printf("FiffStreamClient (ID %d): shared memory transport %s\r\n\n", m_iDataClientId, t_bEnable ? "enabled" : "disabled");
+            }
+        }
+        else if(t_iCmd == MNE_RT_SET_CHANNEL_SELECTION)
+        {
+            //
+            // Set Channel Selection; resolved when the next measurement info is sent
+            //
+            QString t_sSelection = QString(p_pTag->mid(4, p_pTag->size()-4));
+            m_qMutex.lock();
+            m_sSelection = t_sSelection;
+            m_qMutex.unlock();
+            printf("FiffStreamClient (ID %d): new channel selection = '%s'\r\n\n", m_iDataClientId, t_sSelection.isEmpty() ? "all" : t_sSelection.toUtf8().constData());
+        }
         else
         {
             printf("FiffStreamClient (ID %d): unknown command\r\n\n", m_iDataClientId);
@@ -178,19 +288,17 @@ void FiffStreamThread::parseCommand(FiffTag::SPtr p_pTag)
 
 //*************************************************************************************************************
 
-void FiffStreamThread::sendRawBuffer(QSharedPointer<Eigen::MatrixXf> m_pMatRawData)
+void FiffStreamThread::sendRawBuffer(QByteArray p_blockRawBuffer, qint32 p_iEncoding, QByteArray p_selectionKey)
 {
-    if(m_bIsSendingRawBuffer)
+    qint32 t_iEncoding = isSharedMemory() ? SharedMemory : m_iEncoding.load();
+    if(m_bIsSendingRawBuffer && p_iEncoding == t_iEncoding && p_selectionKey == m_selectionKey)
     {
 //        qDebug() << "Send RawBuffer to client";
 
-        m_qMutex.lock();
-
-        FiffStream t_FiffStreamOut(&m_qSendBlock, QIODevice::WriteOnly);
-        t_FiffStreamOut.write_float(FIFF_DATA_BUFFER,m_pMatRawData->data(),m_pMatRawData->rows()*m_pMatRawData->cols());
-
-        m_qMutex.unlock();
-
+        //
+        // The buffer was encoded by the server, only a reference is queued
+        //
+        enqueueBlock(p_blockRawBuffer, true);
     }
 //    else
 //    {
@@ -225,9 +333,23 @@ void FiffStreamThread::sendMeasurementInfo(qint32 ID, FiffInfo p_fiffInfo)
 {
     if(ID == m_iDataClientId)
     {
+        //
+        // Resolve the channel selection; the client gets the info of the selected channels only
+        //
         m_qMutex.lock();
+        QString t_sSelection = m_sSelection;
+        m_qMutex.unlock();
+
+        m_vecSelection = selectChannels(p_fiffInfo, t_sSelection);
+        if(!t_sSelection.isEmpty() && m_vecSelection.size() == 0)
+            printf("FiffStreamClient (ID %d): channel selection '%s' matches no channel, send all channels\r\n\n", m_iDataClientId, t_sSelection.toUtf8().constData());
+        m_selectionKey = QByteArray((const char*)m_vecSelection.data(), m_vecSelection.size()*sizeof(int));
+
+        if(m_vecSelection.size() > 0)
+            p_fiffInfo = p_fiffInfo.pick_info(m_vecSelection);
 
-        FiffStream t_FiffStreamOut(&m_qSendBlock, QIODevice::WriteOnly);
+        QByteArray t_block;
+        FiffStream t_FiffStreamOut(&t_block, QIODevice::WriteOnly);
 
 //        qint32 init_info[2];
 //        init_info[0] = FIFF_MNE_RT_CLIENT_ID;
@@ -238,9 +360,9 @@ void FiffStreamThread::sendMeasurementInfo(qint32 ID, FiffInfo p_fiffInfo)
 //FiffStream::start_writing_raw
 
         p_fiffInfo.writeToStream(&t_FiffStreamOut);
-        m_qMutex.unlock();
+        enqueueBlock(t_block);
 
-//        qDebug() << "MeasInfo Blocksize: " << m_qSendBlock.size();
+//        qDebug() << "MeasInfo Blocksize: " << t_block.size();
     }
 }
 
@@ -249,9 +371,157 @@ void FiffStreamThread::sendMeasurementInfo(qint32 ID, FiffInfo p_fiffInfo)
 
 void FiffStreamThread::writeClientId()
 {
-    FiffStream t_FiffStreamOut(&m_qSendBlock, QIODevice::WriteOnly);
+    QByteArray t_block;
+    FiffStream t_FiffStreamOut(&t_block, QIODevice::WriteOnly);
 
     t_FiffStreamOut.write_int(FIFF_MNE_RT_CLIENT_ID, &m_iDataClientId);
+
+    enqueueBlock(t_block);
+}
+
+
+//*************************************************************************************************************
+
+void FiffStreamThread::enqueueBlock(const QByteArray& p_block, bool p_bDroppable)
+{
+    SendBlock t_sendBlock;
+    t_sendBlock.block = p_block;
+    t_sendBlock.droppable = p_bDroppable;
+
+    m_qMutex.lock();
+
+    //
+    // The client is about to be disconnected, don't let the queue grow any further
+    //
+    if(m_iOverflow.load())
+    {
+        m_qMutex.unlock();
+        return;
+    }
+
+    bool t_bWasEmpty = m_qListSendBlocks.isEmpty();
+    m_qListSendBlocks.append(t_sendBlock);
+    m_iQueuedBytes += p_block.size();
+
+    //
+    // Backpressure: the client doesn't keep up with the data
+    //
+    if(m_iQueuedBytes > m_iMaxQueuedBytes)
+    {
+        if(m_backpressurePolicy == DropOldest)
+        {
+            for(qint32 i = 0; i < m_qListSendBlocks.size() && m_iQueuedBytes > m_iMaxQueuedBytes; )
+            {
+                if(m_qListSendBlocks[i].droppable)
+                {
+                    m_iQueuedBytes -= m_qListSendBlocks[i].block.size();
+                    m_qListSendBlocks.removeAt(i);
+                    ++m_iDroppedBuffers;
+                }
+                else
+                    ++i;
+            }
+        }
+        else
+        {
+            // nothing is written anymore, the client is disconnected
+            m_iOverflow.store(1);
+            m_qListSendBlocks.clear();
+            m_iQueuedBytes = 0;
+        }
+    }
+    bool t_bOverflow = m_iOverflow.load() != 0;
+    m_qMutex.unlock();
+
+    if(t_bWasEmpty || t_bOverflow)
+        emit blockQueued();
+}
+
+
+//*************************************************************************************************************
+
+void FiffStreamThread::setBackpressure(BackpressurePolicy p_policy, qint64 p_iMaxQueuedBytes)
+{
+    m_qMutex.lock();
+    m_backpressurePolicy = p_policy;
+    m_iMaxQueuedBytes = p_iMaxQueuedBytes;
+    m_qMutex.unlock();
+}
+
+
+//*************************************************************************************************************
+
+void FiffStreamThread::readTags(QTcpSocket& p_qTcpSocket)
+{
+    FiffStream t_FiffStreamIn(&p_qTcpSocket);
+
+    while(true)
+    {
+        //
+        // Read the tag header as soon as it is complete
+        //
+        if(!m_pPendingTag)
+        {
+            if(p_qTcpSocket.bytesAvailable() < (int)sizeof(qint32)*4)
+                return;
+            FiffTag::read_tag_info(&t_FiffStreamIn, m_pPendingTag, false, &m_tagPool);
+        }
+
+        //
+        // Read the data when it is complete, otherwise wait for the next readyRead
+        //
+        if(p_qTcpSocket.bytesAvailable() < m_pPendingTag->size())
+            return;
+
+        FiffTag::SPtr t_pTag = m_pPendingTag;
+        m_pPendingTag.clear();
+        FiffTag::read_tag_data(&t_FiffStreamIn, t_pTag);
+
+        //
+        // Parse the tag
+        //
+        if(t_pTag->kind == FIFF_MNE_RT_COMMAND)
+        {
+            parseCommand(t_pTag);
+        }
+    }
+}
+
+
+//*************************************************************************************************************
+
+void FiffStreamThread::writeBlocks(QTcpSocket& p_qTcpSocket)
+{
+    if(m_iOverflow.load())
+    {
+        m_qMutex.lock();
+        qint64 t_iMaxQueuedBytes = m_iMaxQueuedBytes;
+        m_qMutex.unlock();
+
+        printf("FiffStreamClient (ID %d): more than %lld bytes queued - disconnect\r\n\n", m_iDataClientId, t_iMaxQueuedBytes);
+        p_qTcpSocket.abort();
+        return;
+    }
+
+    //
+    // Hand blocks to the socket while its buffer is small, the rest stays in the queue where backpressure applies
+    //
+    while(p_qTcpSocket.bytesToWrite() < s_iSocketWriteLimit)
+    {
+        SendBlock t_sendBlock;
+
+        m_qMutex.lock();
+        if(m_qListSendBlocks.isEmpty())
+        {
+            m_qMutex.unlock();
+            break;
+        }
+        t_sendBlock = m_qListSendBlocks.takeFirst();
+        m_iQueuedBytes -= t_sendBlock.block.size();
+        m_qMutex.unlock();
+
+        p_qTcpSocket.write(t_sendBlock.block);
+    }
 }
 
 
@@ -296,8 +566,6 @@ void FiffStreamThread::writeClientId()
 
 void FiffStreamThread::run()
 {
-    m_bIsRunning = true;
-
     FiffStreamServer* t_pParentServer = qobject_cast<FiffStreamServer*>(this->parent());
 
     connect(t_pParentServer, &FiffStreamServer::remitMeasInfo,
@@ -322,64 +590,33 @@ void FiffStreamThread::run()
                t_qTcpSocket.peerPort());
     }
 
-    FiffStream t_FiffStreamIn(&t_qTcpSocket);
+    m_bIsLocalClient = isLoopbackAddress(t_qTcpSocket.peerAddress());
 
-//    int i = 0;
-    while(t_qTcpSocket.state() != QAbstractSocket::UnconnectedState && m_bIsRunning)
-    {
-        //
-        // Write available data
-        //
-        m_qMutex.lock();
-        qint32 t_iBlockSize = m_qSendBlock.size();
-//        qDebug() << "data available" << t_iBlockSize;
-        if(t_iBlockSize > 0)
-        {
-            qint32 t_iBytesWritten = t_qTcpSocket.write(m_qSendBlock);
-//            qDebug() << ++i<< "[wrote bytes] " << t_iBytesWritten;
-            t_qTcpSocket.waitForBytesWritten();
-            if(t_iBytesWritten == t_iBlockSize)
-            {
-                m_qSendBlock.clear();
-            }
-            else
-            {
-                //we have to store bytes which were not written to the socket, due to writing limit
-                //m_qSendBlock = m_qSendBlock.mid(t_iBytesWritten, t_iBlockSize-t_iBytesWritten);
-                m_qSendBlock.remove(0,t_iBytesWritten); //higher performance then mid
-            }
-        }
-        m_qMutex.unlock();
+    //
+    // The socket lives in this thread; all handlers run in its event loop
+    //
+    connect(&t_qTcpSocket, &QTcpSocket::readyRead,
+            &t_qTcpSocket, [this, &t_qTcpSocket](){ readTags(t_qTcpSocket); });
+    connect(&t_qTcpSocket, &QTcpSocket::bytesWritten,
+            &t_qTcpSocket, [this, &t_qTcpSocket](){ writeBlocks(t_qTcpSocket); });
+    connect(this, &FiffStreamThread::blockQueued,
+            &t_qTcpSocket, [this, &t_qTcpSocket](){ writeBlocks(t_qTcpSocket); });
+    connect(&t_qTcpSocket, &QTcpSocket::disconnected,
+            &t_qTcpSocket, [this](){ quit(); });
 
-        //
-        // Read: Wait 10ms for incomming tag header, read and continue
-        //
-        t_qTcpSocket.waitForReadyRead(10);
+    // blocks queued before the event loop started
+    writeBlocks(t_qTcpSocket);
+    readTags(t_qTcpSocket);
 
-        if (t_qTcpSocket.bytesAvailable() >= (int)sizeof(qint32)*4)
-        {
-//            qDebug() << "goes to read bytes " ;
-            FiffTag::SPtr t_pTag;
-            FiffTag::read_tag_info(&t_FiffStreamIn, t_pTag, false);
+    if(t_qTcpSocket.state() != QAbstractSocket::UnconnectedState)
+        exec();
 
-            //
-            // wait until tag size data are available and read the data
-            //
-            while (t_qTcpSocket.bytesAvailable() < t_pTag->size())
-            {
-                t_qTcpSocket.waitForReadyRead(10);
-            }
-            FiffTag::read_tag_data(&t_FiffStreamIn, t_pTag);
+    m_qMutex.lock();
+    qint64 t_iDroppedBuffers = m_iDroppedBuffers;
+    m_qMutex.unlock();
 
-            //
-            // Parse the tag
-            //
-            if(t_pTag->kind == FIFF_MNE_RT_COMMAND)
-            {
-                parseCommand(t_pTag);
-            }
-        }
-    }
+    if(t_iDroppedBuffers > 0)
+        printf("FiffStreamClient (ID %d): %lld raw buffers dropped\r\n\n", m_iDataClientId, t_iDroppedBuffers);
 
     t_qTcpSocket.disconnectFromHost();
     if(t_qTcpSocket.state() != QAbstractSocket::UnconnectedState)
@@ -43,6 +43,8 @@
 
 #include <fiff/fiff_stream.h>
 #include <fiff/fiff_info.h>
+#include <fiff/fiff_tag_pool.h>
+#include <fiff/fiff_raw_buffer_codec.h>
 
 
 //*************************************************************************************************************
@@ -50,9 +52,12 @@
 // QT INCLUDES
 //=============================================================================================================
 
+#include <QByteArray>
+#include <QList>
 #include <QThread>
 #include <QTcpSocket>
 #include <QMutex>
+#include <QAtomicInt>
 #include <QSharedPointer>
 
 
@@ -81,16 +86,67 @@ class FiffStreamThread : public QThread
 {
     Q_OBJECT
 public:
+    //=========================================================================================================
+    /**
+    * What happens when more than the allowed amount of data is queued for a client which doesn't keep up.
+    */
+    enum BackpressurePolicy
+    {
+        DropOldest,     /**< Drop the oldest queued raw buffers. */
+        Disconnect      /**< Disconnect the client. */
+    };
+
+    static const qint32 SharedMemory = -1;  /**< Pseudo encoding of the raw buffers announced for the shared memory ring */
+
     FiffStreamThread(qint32 id, int socketDescriptor, QObject *parent);
 
     ~FiffStreamThread();
 
+    //=========================================================================================================
+    /**
+    * Runs the event loop of the client socket. Incoming commands are read when they arrive, queued blocks are
+    * written whenever the socket is able to take them.
+    */
     void run();
 
     inline qint32 getID();
 
     inline QString getAlias();
 
+    //=========================================================================================================
+    /**
+    * Returns the raw buffer encoding the client asked for with MNE_RT_SET_BUFFER_ENCODING.
+    *
+    * @return the FiffRawBufferCodec::Encoding of the client
+    */
+    inline FiffRawBufferCodec::Encoding getEncoding();
+
+    //=========================================================================================================
+    /**
+    * Returns whether the same host client asked with MNE_RT_SET_SHMEM_TRANSPORT to read the raw buffers from the
+    * shared memory ring of the server instead of the socket.
+    *
+    * @return true if the client uses the shared memory transport
+    */
+    inline bool isSharedMemory();
+
+    //=========================================================================================================
+    /**
+    * Returns the rows of the raw buffers the client receives, resolved from its MNE_RT_SET_CHANNEL_SELECTION
+    * against the last measurement info sent to it.
+    *
+    * @return the selected channels, empty if the client receives all channels
+    */
+    inline const RowVectorXi& getSelection();
+
+    //=========================================================================================================
+    /**
+    * Returns a key which is equal for all clients with the same channel selection.
+    *
+    * @return the selection key, empty if the client receives all channels
+    */
+    inline QByteArray getSelectionKey();
+
 //    void deactivateRawBufferSending();
 
 
@@ -98,29 +154,98 @@ public:
 
     void writeClientId();
 
+    //=========================================================================================================
+    /**
+    * Queues an encoded block for sending. Blocks are written to the socket in the order they were queued.
+    *
+    * @param[in] p_block        The encoded block, implicitly shared i.e. not copied
+    * @param[in] p_bDroppable   Whether the block may be dropped by the DropOldest policy (raw buffers only)
+    */
+    void enqueueBlock(const QByteArray& p_block, bool p_bDroppable = false);
+
+    //=========================================================================================================
+    /**
+    * Sets the backpressure policy which applies when more than p_iMaxQueuedBytes are waiting to be written.
+    *
+    * @param[in] p_policy           The backpressure policy
+    * @param[in] p_iMaxQueuedBytes  The maximal number of queued bytes
+    */
+    void setBackpressure(BackpressurePolicy p_policy, qint64 p_iMaxQueuedBytes);
+
 //    void sendData(QTcpSocket& p_qTcpSocket);
 
 signals:
     void error(QTcpSocket::SocketError socketError);
 
+    //=========================================================================================================
+    /**
+    * Emitted when a block is queued to an empty queue; wakes the writer in the event loop of the thread.
+    */
+    void blockQueued();
+
 private:
+    //=========================================================================================================
+    /**
+    * Reads all complete tags which are available at the socket, without blocking.
+    *
+    * @param[in] p_qTcpSocket   The client socket
+    */
+    void readTags(QTcpSocket& p_qTcpSocket);
+
+    //=========================================================================================================
+    /**
+    * Hands queued blocks to the socket as long as its write buffer is below s_iSocketWriteLimit, without blocking.
+    *
+    * @param[in] p_qTcpSocket   The client socket
+    */
+    void writeBlocks(QTcpSocket& p_qTcpSocket);
+
+    struct SendBlock
+    {
+        QByteArray  block;      /**< The encoded block */
+        bool        droppable;  /**< Whether the block is a raw buffer which may be dropped */
+    };
+
     qint32 m_iDataClientId;
     QString m_sDataClientAlias;
 
     int m_iSocketDescriptor;
 
     QMutex m_qMutex;
-    QByteArray m_qSendBlock;
+    QList<SendBlock> m_qListSendBlocks;     /**< Encoded blocks waiting to be written; raw buffers are shared with the other clients */
+    qint64 m_iQueuedBytes;                  /**< Number of bytes in m_qListSendBlocks */
+    qint64 m_iDroppedBuffers;               /**< Number of raw buffers dropped by the DropOldest policy */
+    BackpressurePolicy m_backpressurePolicy;/**< Policy applied when more than m_iMaxQueuedBytes are queued */
+    qint64 m_iMaxQueuedBytes;               /**< Maximal number of queued bytes */
+    QAtomicInt m_iOverflow;                 /**< Set under m_qMutex when the client has to be disconnected due to the Disconnect policy; no blocks are queued anymore */
 
     bool m_bIsSendingRawBuffer;
+    QAtomicInt m_iEncoding;                 /**< FiffRawBufferCodec::Encoding of the raw buffers; set by the client, read by the server */
+    QAtomicInt m_iSharedMemory;             /**< Whether raw buffers are announced for the shared memory ring; set by the client, read by the server */
+    bool m_bIsLocalClient;                  /**< Whether the client is connected through the loopback interface */
+    QString m_sSelection;                   /**< Channel selection requested by the client; set by the client, guarded by m_qMutex */
+    RowVectorXi m_vecSelection;             /**< Selected channels resolved against the measurement info; used by the server only */
+    QByteArray m_selectionKey;              /**< Raw bytes of m_vecSelection, compared by the server; empty for all channels */
+
+    FiffTagPool m_tagPool;
+    FiffTag::SPtr m_pPendingTag;            /**< Tag whose header was read while its data is still on the way */
 
-    bool m_bIsRunning;
+    static const qint64 s_iSocketWriteLimit = 1048576;  /**< Bytes handed to the socket before waiting for bytesWritten */
 
 //public slots: --> in Qt 5 not anymore declared as slot
     void startMeas(qint32 ID);
     void stopMeas(qint32 ID);
     void sendMeasurementInfo(qint32 ID, FiffInfo p_fiffInfo);
-    void sendRawBuffer(QSharedPointer<Eigen::MatrixXf> m_pMatRawData);
+    //=========================================================================================================
+    /**
+    * Queues a raw buffer if the client is measuring, p_iEncoding is its encoding, SharedMemory for clients of
+    * the shared memory transport, and p_selectionKey is the key of its channel selection.
+    *
+    * @param[in] p_blockRawBuffer   The encoded raw buffer, shared by all clients of the same encoding and selection
+    * @param[in] p_iEncoding        The FiffRawBufferCodec::Encoding the buffer was requested for, or SharedMemory
+    * @param[in] p_selectionKey     The key of the channel selection the buffer was built for
+    */
+    void sendRawBuffer(QByteArray p_blockRawBuffer, qint32 p_iEncoding, QByteArray p_selectionKey);
     //void readToBuffer1();
 //    void readProc(QTcpSocket& p_qTcpSocket);
 };
@@ -138,6 +263,38 @@ inline QString FiffStreamThread::getAlias()
 }
 
 
+//*************************************************************************************************************
+
+inline FiffRawBufferCodec::Encoding FiffStreamThread::getEncoding()
+{
+    return (FiffRawBufferCodec::Encoding)m_iEncoding.load();
+}
+
+
+//*************************************************************************************************************
+
+inline bool FiffStreamThread::isSharedMemory()
+{
+    return m_iSharedMemory.load() != 0;
+}
+
+
+//*************************************************************************************************************
+
+inline const RowVectorXi& FiffStreamThread::getSelection()
+{
+    return m_vecSelection;
+}
+
+
+//*************************************************************************************************************
+
+inline QByteArray FiffStreamThread::getSelectionKey()
+{
+    return m_selectionKey;
+}
+
+
 } // NAMESPACE
 
 #endif //FIFFSTREAMTHREAD_H
@@ -51,6 +51,9 @@ namespace RTSERVER
 
 #define MNE_RT_GET_CLIENT_ID        1       /**< Request client id at mne_rt_server */
 #define MNE_RT_SET_CLIENT_ALIAS     2       /**< Set client alias at mne_rt_server */
+#define MNE_RT_SET_BUFFER_ENCODING  3       /**< Set raw buffer encoding (FiffRawBufferCodec::Encoding) of the client at mne_rt_server */
+#define MNE_RT_SET_SHMEM_TRANSPORT  4       /**< Enable (1) or disable (0) the shared memory raw buffer transport of a same host client at mne_rt_server */
+#define MNE_RT_SET_CHANNEL_SELECTION 5      /**< Set the ':' separated channel types (meg, grad, mag, eeg, stim) and names the client receives from mne_rt_server; empty for all channels */
 
 } // NAMESPACE
 
@@ -316,6 +316,19 @@ void MNERTServer::init()
     QString t_sJsonCommand =
             "{"
             "   \"commands\": {"
+            "       \"bufpolicy\": {"
+            "           \"description\": \"Sets how much data is queued for a slow FiffStreamClient and what happens beyond (drop: drop the oldest raw buffers, disconnect: disconnect the client).\","
+            "           \"parameters\": {"
+            "               \"limit\": {"
+            "                   \"description\": \"Queue limit in MB\","
+            "                   \"type\": \"int\" "
+            "               },"
+            "               \"policy\": {"
+            "                   \"description\": \"drop/disconnect\","
+            "                   \"type\": \"QString\" "
+            "               }"
+            "           }"
+            "        },"
             "       \"clist\": {"
             "           \"description\": \"Prints and sends all available FiffStreamClients.\","
             "           \"parameters\": {}"
@@ -51,6 +51,7 @@
 #include <QtCore/QtPlugin>
 //#include <QtConcurrent>
 #include <QDebug>
+#include <QFileInfo>
 
 
 //*************************************************************************************************************
@@ -79,6 +80,8 @@ RapLab::RapLab()
 , m_bSingleTrial(false)
 , m_iStimChan(0)
 , m_iDownSample(4)
+, m_iNumDipolePairs(2)
+, m_iWindowSize(300)
 {
 
 }
@@ -115,8 +118,8 @@ void RapLab::init()
     m_pSurfaceSet = SurfaceSet::SPtr(new SurfaceSet(m_sSurfaceDir+"/lh.white", m_sSurfaceDir+"/rh.white"));
 
 
-    //ToDo accelerate this
-    m_pClusteredFwd = MNEForwardSolution::SPtr(new MNEForwardSolution(m_pFwd->cluster_forward_solution_ccr(*m_pAnnotationSet.data(), 40)));
+    // Clustering is cached next to the forward solution, only the first start computes it
+    m_pClusteredFwd = MNEForwardSolution::SPtr(new MNEForwardSolution(m_pFwd->cluster_forward_solution_cached(*m_pAnnotationSet.data(), 40, QFileInfo(m_qFileFwdSolution).absolutePath())));
 
     //Delete Buffer - will be initailzed with first incoming data
     if(!m_pRapLabBuffer.isNull())
@@ -196,16 +199,18 @@ bool RapLab::start()
 
 bool RapLab::stop()
 {
+    mutex.lock();
     m_bIsRunning = false;
+    m_qInputInitialized.wakeAll();
+    mutex.unlock();
 
-    // Stop threads
-    QThread::terminate();
+    // Stop threads - the worker blocks at most one pop timeout
     QThread::wait();
 
-    if(m_pRtCov->isRunning())
+    if(m_pRtCov && m_pRtCov->isRunning())
         m_pRtCov->stop();
 
-    if(m_pRtInvOp->isRunning())
+    if(m_pRtInvOp && m_pRtInvOp->isRunning())
         m_pRtInvOp->stop();
 
     if(m_pRapLabBuffer)
@@ -251,13 +256,19 @@ void RapLab::update(XMEASLIB::NewMeasurement::SPtr pMeasurement)
     //MEG
     if(pRTMSA && m_bReceiveData)
     {
-        //Check if buffer initialized
-        if(!m_pRapLabBuffer)
-            m_pRapLabBuffer = CircularMatrixBuffer<double>::SPtr(new CircularMatrixBuffer<double>(64, pRTMSA->getNumChannels(), pRTMSA->getMultiArraySize()));
+        //Check if buffer and fiff information are initialized
+        if(!m_pRapLabBuffer || !m_pFiffInfo)
+        {
+            mutex.lock();
+            if(!m_pRapLabBuffer)
+                m_pRapLabBuffer = CircularMatrixBuffer<double>::SPtr(new CircularMatrixBuffer<double>(64, pRTMSA->getNumChannels(), pRTMSA->getMultiArraySize()));
 
-        //Fiff information
-        if(!m_pFiffInfo)
-            m_pFiffInfo = pRTMSA->getFiffInfo();
+            if(!m_pFiffInfo)
+                m_pFiffInfo = pRTMSA->getFiffInfo();
+
+            m_qInputInitialized.wakeAll();
+            mutex.unlock();
+        }
 
         if(m_bProcessData)
         {
@@ -348,37 +359,64 @@ void RapLab::run()
     //
     // Read Fiff Info
     //
-    while(!m_pFiffInfo)
-        msleep(10);// Wait for fiff Info
+    mutex.lock();
+    while(m_bIsRunning && (!m_pFiffInfo || !m_pRapLabBuffer))
+        m_qInputInitialized.wait(&mutex);// Wait for fiff Info
+    mutex.unlock();
 
-    //
-    // Init Real-Time Covariance estimator
-    //
-    m_pRtCov = RtCov::SPtr(new RtCov(5000, m_pFiffInfo));
-    connect(m_pRtCov.data(), &RtCov::covCalculated, this, &RapLab::updateFiffCov);
+    if(!m_bIsRunning)
+        return;
 
-    //
-    // Init Real-Time inverse estimator
-    //
-    m_pRtInvOp = RtInvOp::SPtr(new RtInvOp(m_pFiffInfo, m_pClusteredFwd));
-    connect(m_pRtInvOp.data(), &RtInvOp::invOperatorCalculated, this, &RapLab::updateInvOp);
+    if(m_bSingleTrial)
+    {
+        //
+        // Init online RAP MUSIC - only the dipole scan runs per window, the signal subspace is tracked
+        //
+        MNEForwardSolution t_forwardMeg = m_pClusteredFwd->pick_types(true, false);
+
+        m_qListPicks.clear();
+        for(qint32 i = 0; i < t_forwardMeg.sol->row_names.size(); ++i)
+        {
+            qint32 t_iIdx = m_pFiffInfo->ch_names.indexOf(t_forwardMeg.sol->row_names[i]);
+            if(t_iIdx < 0)
+            {
+                qWarning() << "RapLab: Forward solution channel" << t_forwardMeg.sol->row_names[i] << "not found in the measurement.";
+                return;
+            }
+            m_qListPicks.append(t_iIdx);
+        }
 
-    if(!m_bSingleTrial)
+        m_pRapMusic = QSharedPointer<RapMusic>(new RapMusic(t_forwardMeg, false, m_iNumDipolePairs));
+        m_pRapMusic->setVerbose(false);    // scanned once per incoming buffer
+        m_pSubspaceTracker = SubspaceTracker::SPtr(new SubspaceTracker(m_qListPicks.size(), m_iWindowSize, m_iNumDipolePairs));
+    }
+    else
     {
+        //
+        // Init Real-Time Covariance estimator
+        //
+        m_pRtCov = RtCov::SPtr(new RtCov(5000, m_pFiffInfo));
+        connect(m_pRtCov.data(), &RtCov::covCalculated, this, &RapLab::updateFiffCov);
+
+        //
+        // Init Real-Time inverse estimator
+        //
+        m_pRtInvOp = RtInvOp::SPtr(new RtInvOp(m_pFiffInfo, m_pClusteredFwd));
+        connect(m_pRtInvOp.data(), &RtInvOp::invOperatorCalculated, this, &RapLab::updateInvOp);
+
         //
         // Init Real-Time average
         //
         m_pRtAve = RtAve::SPtr(new RtAve(m_iNumAverages, 750, 750, m_pFiffInfo));
         connect(m_pRtAve.data(), &RtAve::evokedStim, this, &RapLab::appendEvoked);
-    }
 
-    //
-    // Start the rt helpers
-    //
-    m_pRtCov->start();
-    m_pRtInvOp->start();
-    if(!m_bSingleTrial)
+        //
+        // Start the rt helpers
+        //
+        m_pRtCov->start();
+        m_pRtInvOp->start();
         m_pRtAve->start();
+    }
 
     //
     // start processing data
@@ -387,35 +425,50 @@ void RapLab::run()
 
     qint32 skip_count = 0;
 
+    MatrixXd t_mat;
+    MatrixXd t_matPicked(m_qListPicks.size(), m_pRapLabBuffer->cols());
+
     while(m_bIsRunning)
     {
-        qint32 nrows = m_pRapLabBuffer->rows();
-
-        if(nrows > 0) // check if init
+        /* Dispatch the inputs - timed, to notice stop() while no data arrives */
+        if(m_pRapLabBuffer->pop(t_mat, 100))
         {
-            /* Dispatch the inputs */
-            MatrixXd t_mat = m_pRapLabBuffer->pop();
-
-            //Add to covariance estimation
-            m_pRtCov->append(t_mat);
-
             if(m_bSingleTrial)
             {
                 //Continous Data
-                mutex.lock();
-                if(m_pMinimumNorm && t_mat.cols() > 0)
+                for(qint32 i = 0; i < m_qListPicks.size(); ++i)
+                    t_matPicked.row(i) = t_mat.row(m_qListPicks[i]);
+
+                m_pSubspaceTracker->append(t_matPicked);
+
+                if(m_pSubspaceTracker->isFull())
                 {
                     //
-                    // calculate the inverse
+                    // scan the tracked signal subspace
                     //
-                    MNESourceEstimate sourceEstimate = m_pMinimumNorm->calculateInverse(t_mat, 0, 1/m_pFiffInfo->sfreq);
-
-                    std::cout << "Source Estimated" << std::endl;
+                    QList< DipolePair<double> > t_RapDipoles;
+                    m_pRapMusic->scanSubspace(m_pSubspaceTracker->signalSubspace(), t_RapDipoles);
+
+                    VectorXd t_vecSource = VectorXd::Zero(m_pClusteredFwd->nsource);
+                    for(qint32 i = 0; i < t_RapDipoles.size(); ++i)
+                    {
+                        t_vecSource[t_RapDipoles[i].m_iIdx1] = sqrt( pow(t_RapDipoles[i].m_Dipole1.phi_x(),2) +
+                                                                     pow(t_RapDipoles[i].m_Dipole1.phi_y(),2) +
+                                                                     pow(t_RapDipoles[i].m_Dipole1.phi_z(),2) ) * t_RapDipoles[i].m_vCorrelation;
+
+                        t_vecSource[t_RapDipoles[i].m_iIdx2] = sqrt( pow(t_RapDipoles[i].m_Dipole2.phi_x(),2) +
+                                                                     pow(t_RapDipoles[i].m_Dipole2.phi_y(),2) +
+                                                                     pow(t_RapDipoles[i].m_Dipole2.phi_z(),2) ) * t_RapDipoles[i].m_vCorrelation;
+                    }
+
+                    m_pRTSEOutput->data()->setValue(t_vecSource);
                 }
-                mutex.unlock();
             }
             else
             {
+                //Add to covariance estimation
+                m_pRtCov->append(t_mat);
+
                 //Average Data
                 m_pRtAve->append(t_mat);
 
@@ -54,6 +54,8 @@
 #include <mne/mne_forwardsolution.h>
 #include <mne/mne_sourceestimate.h>
 #include <inverse/minimumNorm/minimumnorm.h>
+#include <inverse/rapMusic/rapmusic.h>
+#include <inverse/rapMusic/subspacetracker.h>
 #include <rtInv/rtcov.h>
 #include <rtInv/rtinvop.h>
 #include <rtInv/rtave.h>
@@ -69,6 +71,7 @@
 
 #include <QtWidgets>
 #include <QFile>
+#include <QWaitCondition>
 
 
 //*************************************************************************************************************
@@ -185,6 +188,7 @@ private:
 
 
     QMutex mutex;
+    QWaitCondition m_qInputInitialized;    /**< Signalled when the fiff info and the input buffer are available or the thread is stopped. */
 
     CircularMatrixBuffer<double>::SPtr m_pRapLabBuffer;   /**< Holds incoming rt server data.*/
 
@@ -218,6 +222,12 @@ private:
     qint32                      m_iStimChan;        /**< Stimulus Channel to use for source estimation */
 
     MinimumNorm::SPtr           m_pMinimumNorm;     /**< Minimum Norm Estimation. */
+
+    QSharedPointer<RapMusic>    m_pRapMusic;        /**< RAP MUSIC of the continuous data. */
+    SubspaceTracker::SPtr       m_pSubspaceTracker; /**< Online signal subspace of the sliding window. */
+    QList<qint32>               m_qListPicks;       /**< Data rows which correspond to the forward solution channels. */
+    qint32                      m_iNumDipolePairs;  /**< Number of dipole pairs to find, also the signal subspace rank. */
+    qint32                      m_iWindowSize;      /**< Samples of the sliding RAP MUSIC window. */
     qint32                      m_iDownSample;      /**< Sampling rate */
 
 //    RealTimeSourceEstimate::SPtr m_pRTSE_RapLab; /**< Source Estimate output channel. */
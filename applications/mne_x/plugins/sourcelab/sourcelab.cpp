@@ -51,6 +51,7 @@
 #include <QtCore/QtPlugin>
 //#include <QtConcurrent>
 #include <QDebug>
+#include <QFileInfo>
 
 
 //*************************************************************************************************************
@@ -115,8 +116,8 @@ void SourceLab::init()
     m_pSurfaceSet = SurfaceSet::SPtr(new SurfaceSet(m_sSurfaceDir+"/lh.white", m_sSurfaceDir+"/rh.white"));
 
 
-    //ToDo accelerate this
-    m_pClusteredFwd = MNEForwardSolution::SPtr(new MNEForwardSolution(m_pFwd->cluster_forward_solution_ccr(*m_pAnnotationSet.data(), 40)));
+    // Clustering is cached next to the forward solution, only the first start computes it
+    m_pClusteredFwd = MNEForwardSolution::SPtr(new MNEForwardSolution(m_pFwd->cluster_forward_solution_cached(*m_pAnnotationSet.data(), 40, QFileInfo(m_qFileFwdSolution).absolutePath())));
 
     //Delete Buffer - will be initailzed with first incoming data
     if(!m_pSourceLabBuffer.isNull())
@@ -196,16 +197,18 @@ bool SourceLab::start()
 
 bool SourceLab::stop()
 {
+    mutex.lock();
     m_bIsRunning = false;
+    m_qInputInitialized.wakeAll();
+    mutex.unlock();
 
-    // Stop threads
-    QThread::terminate();
+    // Stop threads - the worker blocks at most one pop timeout
     QThread::wait();
 
-    if(m_pRtCov->isRunning())
+    if(m_pRtCov && m_pRtCov->isRunning())
         m_pRtCov->stop();
 
-    if(m_pRtInvOp->isRunning())
+    if(m_pRtInvOp && m_pRtInvOp->isRunning())
         m_pRtInvOp->stop();
 
     if(m_pSourceLabBuffer)
@@ -251,13 +254,19 @@ void SourceLab::update(XMEASLIB::NewMeasurement::SPtr pMeasurement)
     //MEG
     if(pRTMSA && m_bReceiveData)
     {
-        //Check if buffer initialized
-        if(!m_pSourceLabBuffer)
-            m_pSourceLabBuffer = CircularMatrixBuffer<double>::SPtr(new CircularMatrixBuffer<double>(64, pRTMSA->getNumChannels(), pRTMSA->getMultiArraySize()));
+        //Check if buffer and fiff information are initialized
+        if(!m_pSourceLabBuffer || !m_pFiffInfo)
+        {
+            mutex.lock();
+            if(!m_pSourceLabBuffer)
+                m_pSourceLabBuffer = CircularMatrixBuffer<double>::SPtr(new CircularMatrixBuffer<double>(64, pRTMSA->getNumChannels(), pRTMSA->getMultiArraySize()));
 
-        //Fiff information
-        if(!m_pFiffInfo)
-            m_pFiffInfo = pRTMSA->getFiffInfo();
+            if(!m_pFiffInfo)
+                m_pFiffInfo = pRTMSA->getFiffInfo();
+
+            m_qInputInitialized.wakeAll();
+            mutex.unlock();
+        }
 
         if(m_bProcessData)
         {
@@ -348,8 +357,13 @@ void SourceLab::run()
     //
     // Read Fiff Info
     //
-    while(!m_pFiffInfo)
-        msleep(10);// Wait for fiff Info
+    mutex.lock();
+    while(m_bIsRunning && (!m_pFiffInfo || !m_pSourceLabBuffer))
+        m_qInputInitialized.wait(&mutex);// Wait for fiff Info
+    mutex.unlock();
+
+    if(!m_bIsRunning)
+        return;
 
     //
     // Init Real-Time Covariance estimator
@@ -387,14 +401,14 @@ void SourceLab::run()
 
     qint32 skip_count = 0;
 
+    MatrixXd t_mat;
+    MNESourceEstimate sourceEstimate;   // reused across buffers, only reallocated when the dimensions change
+
     while(m_bIsRunning)
     {
-        qint32 nrows = m_pSourceLabBuffer->rows();
-
-        if(nrows > 0) // check if init
+        /* Dispatch the inputs - timed, to notice stop() while no data arrives */
+        if(m_pSourceLabBuffer->pop(t_mat, 100))
         {
-            /* Dispatch the inputs */
-            MatrixXd t_mat = m_pSourceLabBuffer->pop();
 
             //Add to covariance estimation
             m_pRtCov->append(t_mat);
@@ -408,7 +422,7 @@ void SourceLab::run()
                     //
                     // calculate the inverse
                     //
-                    MNESourceEstimate sourceEstimate = m_pMinimumNorm->calculateInverse(t_mat, 0, 1/m_pFiffInfo->sfreq);
+                    m_pMinimumNorm->applyInverse(t_mat, 0, 1/m_pFiffInfo->sfreq, sourceEstimate);
 
                     std::cout << "Source Estimated" << std::endl;
                 }
@@ -429,7 +443,7 @@ void SourceLab::run()
                     float tmin = ((float)t_fiffEvoked.first) / t_fiffEvoked.info.sfreq;
                     float tstep = 1/t_fiffEvoked.info.sfreq;
 
-                    MNESourceEstimate sourceEstimate = m_pMinimumNorm->calculateInverse(t_fiffEvoked.data, tmin, tstep);
+                    m_pMinimumNorm->applyInverse(t_fiffEvoked.data, tmin, tstep, sourceEstimate);
 
                     std::cout << "SourceEstimated:\n" << std::endl;
     //                std::cout << "SourceEstimated:\n" << sourceEstimate.data.block(0,0,10,10) << std::endl;
@@ -69,6 +69,7 @@
 
 #include <QtWidgets>
 #include <QFile>
+#include <QWaitCondition>
 
 
 //*************************************************************************************************************
@@ -185,6 +186,7 @@ private:
 
 
     QMutex mutex;
+    QWaitCondition m_qInputInitialized;    /**< Signalled when the fiff info and the input buffer are available or the thread is stopped. */
 
     CircularMatrixBuffer<double>::SPtr m_pSourceLabBuffer;   /**< Holds incoming rt server data.*/
 
@@ -61,6 +61,7 @@
 
 #include <QGuiApplication>
 #include <QSet>
+#include <QFileInfo>
 
 
 //*************************************************************************************************************
@@ -170,7 +171,7 @@ int main(int argc, char *argv[])
     //
     // Cluster forward solution;
     //
-    MNEForwardSolution t_clusteredFwd = t_Fwd.cluster_forward_solution_ccr(t_annotationSet, 20);//40);
+    MNEForwardSolution t_clusteredFwd = t_Fwd.cluster_forward_solution_cached(t_annotationSet, 20, QFileInfo(t_fileFwd).absolutePath());//40);
 
 //    std::cout << "Size " << t_clusteredFwd.sol->data.rows() << " x " << t_clusteredFwd.sol->data.cols() << std::endl;
 //    std::cout << "Clustered Fwd:\n" << t_clusteredFwd.sol->data.row(0) << std::endl;
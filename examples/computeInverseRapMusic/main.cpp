@@ -62,6 +62,7 @@
 //=============================================================================================================
 
 #include <QGuiApplication>
+#include <QElapsedTimer>
 
 
 //*************************************************************************************************************
@@ -125,6 +126,8 @@ int main(int argc, char *argv[])
 
     bool doMovie = false;//true;
 
+    bool doBenchmark = false;
+
     // Parse command line parameters
     for(qint32 i = 0; i < argc; ++i)
     {
@@ -136,6 +139,9 @@ int main(int argc, char *argv[])
         {
             if(i + 1 < argc)
                 numDipolePairs = atof(argv[i+1]);
+        }else if(strcmp(argv[i], "-bench") == 0 || strcmp(argv[i], "--bench") == 0)
+        {
+            doBenchmark = true;
         }
     }
 
@@ -171,6 +177,33 @@ int main(int argc, char *argv[])
     if(doMovie)
         t_rapMusic.setStcAttr(200,0.5);
 
+    //
+    // Benchmark per pair SVD against batched subspace correlation
+    //
+    if(doBenchmark)
+    {
+        QList< DipolePair<double> > t_dipolesSvd;
+        QList< DipolePair<double> > t_dipolesBatched;
+        QElapsedTimer t_timer;
+
+        t_rapMusic.setBatchedSubcorr(false);
+        t_timer.start();
+        t_rapMusic.calculateInverse(pickedEvoked.data, t_dipolesSvd);
+        qint64 t_iTimeSvd = t_timer.elapsed();
+
+        t_rapMusic.setBatchedSubcorr(true);
+        t_timer.start();
+        t_rapMusic.calculateInverse(pickedEvoked.data, t_dipolesBatched);
+        qint64 t_iTimeBatched = t_timer.elapsed();
+
+        bool t_bSame = t_dipolesSvd.size() == t_dipolesBatched.size();
+        for(qint32 i = 0; t_bSame && i < t_dipolesSvd.size(); ++i)
+            t_bSame = t_dipolesSvd[i].m_iIdx1 == t_dipolesBatched[i].m_iIdx1 && t_dipolesSvd[i].m_iIdx2 == t_dipolesBatched[i].m_iIdx2;
+
+        std::cout << "Benchmark subcorr - per pair SVD: " << t_iTimeSvd << " ms; batched: " << t_iTimeBatched << " ms; speed-up: "
+                  << (t_iTimeBatched > 0 ? (double)t_iTimeSvd/(double)t_iTimeBatched : 0.0) << "; same dipole pairs: " << (t_bSame ? "yes" : "no") << std::endl;
+    }
+
 
     MNESourceEstimate sourceEstimate = t_rapMusic.calculateInverse(pickedEvoked);
     if(sourceEstimate.isEmpty())
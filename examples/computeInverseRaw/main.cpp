@@ -51,6 +51,8 @@
 
 #include <fiff/fiff_evoked_set.h>
 #include <mne/mne.h>
+#include <mne/mne_sourceestimate.h>
+#include <inverse/minimumNorm/minimumnorm.h>
 
 
 //*************************************************************************************************************
@@ -68,6 +70,7 @@
 
 using namespace FIFFLIB;
 using namespace MNELIB;
+using namespace INVERSELIB;
 
 
 //*************************************************************************************************************
@@ -115,6 +118,12 @@ int main(int argc, char *argv[])
     //
     MNEInverseOperator inv_raw(t_fileInv);
 
+    //
+    //   The minimum norm estimation applies the kernel either dense or in its factored form
+    //
+    MinimumNorm minimumNorm(inv_raw, lambda2, dSPM, sLORETA);
+    MNESourceEstimate sourceEstimate;
+
     //
     //   Iterate over found data sets
     //
@@ -127,88 +136,26 @@ int main(int argc, char *argv[])
         if (nave < 0)
             nave = evokedSet.evoked[setno].nave;
 
-        MNEInverseOperator inv = inv_raw.prepare_inverse_operator(nave,lambda2,dSPM,sLORETA);
+        minimumNorm.doInverseSetup(nave);
+
         //
         //   Pick the correct channels from the data
         //
-        FiffEvokedSet newEvokedSet = evokedSet.pick_channels(inv.noise_cov->names);
-
+        FiffEvokedSet newEvokedSet = evokedSet.pick_channels(inv_raw.noise_cov->names);
         evokedSet = newEvokedSet;
 
         printf("Picked %d channels from the data\n",evokedSet.info.nchan);
-        printf("Computing inverse...");
-        //
-        //   Simple matrix multiplication followed by combination of the
-        //   three current components
-        //
-        //   This does all the data transformations to compute the weights for the
-        //   eigenleads
-        //
-        SparseMatrix<double> reginv(inv.reginv.rows(),inv.reginv.rows());
-        // put this in the MNE algorithm class derived from inverse algorithm
-        //ToDo put this into a function of inv data
-        qint32 i;
-        for(i = 0; i < inv.reginv.rows(); ++i)
-            reginv.insert(i,i) = inv.reginv(i,0);
-
-        MatrixXd trans = reginv*inv.eigen_fields->data*inv.whitener*inv.proj*evokedSet.evoked[setno].data;
-        //
-        //   Transformation into current distributions by weighting the eigenleads
-        //   with the weights computed above
-        //
-        MatrixXd sol;
-        if (inv.eigen_leads_weighted)
-        {
-            //
-            //     R^0.5 has been already factored in
-            //
-            printf("(eigenleads already weighted)...");
-            sol = inv.eigen_leads->data*trans;
-        }
-        else
-        {
-            //
-            //     R^0.5 has to factored in
-            //
-           printf("(eigenleads need to be weighted)...");
-
-           SparseMatrix<double> sourceCov(inv.source_cov->data.rows(),inv.source_cov->data.rows());
-           for(i = 0; i < inv.source_cov->data.rows(); ++i)
-               sourceCov.insert(i,i) = sqrt(inv.source_cov->data(i,0));
-
-           sol   = sourceCov*inv.eigen_leads->data*trans;
-        }
-
-        if (inv.source_ori == FIFFV_MNE_FREE_ORI)
-        {
-            printf("combining the current components...");
-            MatrixXd sol1(sol.rows()/3,sol.cols());
-            for(i = 0; i < sol.cols(); ++i)
-            {
-                VectorXd* tmp = MNE::combine_xyz(sol.block(0,i,sol.rows(),1));
-                sol1.block(0,i,sol.rows()/3,1) = tmp->cwiseSqrt();
-                delete tmp;
-            }
-            sol.resize(sol1.rows(),sol1.cols());
-            sol = sol1;
-        }
-        if (dSPM)
-        {
-            printf("(dSPM)...");
-            sol = inv.noisenorm*sol;
-        }
-        else if (sLORETA)
-        {
-            printf("(sLORETA)...");
-            sol = inv.noisenorm*sol;
-        }
-        printf("[done]\n");
 
         //Results
         float tmin = ((float)evokedSet.evoked[setno].first) / evokedSet.info.sfreq;
         float tstep = 1/evokedSet.info.sfreq;
 
-        std::cout << "\npart ( block( 0, 0, 10, 10) ) of the inverse solution:\n" << sol.block(0,0,10,10) << std::endl;
+        const MatrixXd& data = evokedSet.evoked[setno].data;
+        printf("Applying the %s kernel...", minimumNorm.usesFactoredKernel(data.cols()) ? "factored" : "dense");
+        minimumNorm.applyInverse(data, tmin, tstep, sourceEstimate);
+        printf("[done]\n");
+
+        std::cout << "\npart ( block( 0, 0, 10, 10) ) of the inverse solution:\n" << sourceEstimate.data.block(0,0,10,10) << std::endl;
         printf("tmin = %f s\n", tmin);
         printf("tstep = %f s\n", tstep);
     }
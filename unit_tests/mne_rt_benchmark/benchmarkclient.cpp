@@ -0,0 +1,146 @@
+//=============================================================================================================
+/**
+* @file     benchmarkclient.cpp
+* @author   Christoph Dinh <chdinh@nmr.mgh.harvard.edu>;
+*           Matti Hamalainen <msh@nmr.mgh.harvard.edu>
+* @version  1.0
+* @date     March, 2014
+*
+* @section  LICENSE
+*
+* Copyright (C) 2014, Christoph Dinh and Matti Hamalainen. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+* the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+*       following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+*       the following disclaimer in the documentation and/or other materials provided with the distribution.
+*     * Neither the name of the Massachusetts General Hospital nor the names of its contributors may be used
+*       to endorse or promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MASSACHUSETTS GENERAL HOSPITAL BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*
+*
+* @brief    Implementation of the BenchmarkClient Class.
+*
+*/
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include "benchmarkclient.h"
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// MNE INCLUDES
+//=============================================================================================================
+
+#include <fiff/fiff_constants.h>
+#include <generics/monotonicclock.h>
+#include <rtClient/rtdataclient.h>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace FIFFLIB;
+using namespace IOBuffer;
+using namespace RTCLIENTLIB;
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE MEMBER METHODS
+//=============================================================================================================
+
+BenchmarkClient::BenchmarkClient(const QString& p_sHost, const QString& p_sAlias, bool p_bSharedMemory, QSemaphore* p_pSemReady)
+: m_sHost(p_sHost)
+, m_sAlias(p_sAlias)
+, m_bSharedMemory(p_bSharedMemory)
+, m_pSemReady(p_pSemReady)
+, m_iClientId(-1)
+, m_iChannels(0)
+, m_iInvalidBuffers(0)
+, m_iFirstArrival(0)
+, m_iLastArrival(0)
+{
+}
+
+
+//*************************************************************************************************************
+
+double BenchmarkClient::buffersPerSecond() const
+{
+    if(m_vecLatencies.size() < 2 || m_iLastArrival <= m_iFirstArrival)
+        return 0.0;
+
+    return (m_vecLatencies.size() - 1)*1.0e6/(m_iLastArrival - m_iFirstArrival);
+}
+
+
+//*************************************************************************************************************
+
+void BenchmarkClient::run()
+{
+    RtDataClient t_dataClient;
+    t_dataClient.setSharedMemoryTransport(m_bSharedMemory);
+    t_dataClient.connectToHost(m_sHost);
+    if(!t_dataClient.waitForConnected(5000))
+    {
+        printf("BenchmarkClient %s: could not connect to %s\n", m_sAlias.toUtf8().constData(), m_sHost.toUtf8().constData());
+        m_pSemReady->release();
+        return;
+    }
+
+    m_iClientId = t_dataClient.getClientId();
+    t_dataClient.setClientAlias(m_sAlias);
+    m_pSemReady->release();
+
+    FiffInfo::SPtr t_pFiffInfo = t_dataClient.readInfo();
+    m_iChannels = t_pFiffInfo->nchan;
+
+    //
+    // The stamp in the first sample of the last channel holds MonotonicClock microseconds modulo 2^24
+    //
+    fiff_int_t kind;
+    forever
+    {
+        Map<const MatrixXf> t_view = t_dataClient.readRawBufferView(m_iChannels, kind);
+
+        if(kind == FIFF_DATA_BUFFER && t_view.size() > 0)
+        {
+            qint64 t_iNow = MonotonicClock::microseconds();
+            qint64 t_iStamp = (qint64)t_view(t_view.rows()-1, 0);
+
+            if(!t_dataClient.isRawBufferViewValid())
+            {
+                ++m_iInvalidBuffers;
+                continue;
+            }
+
+            if(m_vecLatencies.isEmpty())
+                m_iFirstArrival = t_iNow;
+            m_iLastArrival = t_iNow;
+            m_vecLatencies.append((qint32)((t_iNow - t_iStamp) & 0xFFFFFF));
+        }
+        else if(kind == FIFF_BLOCK_END)
+            break;
+    }
+
+    t_dataClient.disconnectFromHost();
+    if(t_dataClient.state() != QAbstractSocket::UnconnectedState)
+        t_dataClient.waitForDisconnected(1000);
+}
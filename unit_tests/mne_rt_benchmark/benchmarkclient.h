@@ -0,0 +1,169 @@
+//=============================================================================================================
+/**
+* @file     benchmarkclient.h
+* @author   Christoph Dinh <chdinh@nmr.mgh.harvard.edu>;
+*           Matti Hamalainen <msh@nmr.mgh.harvard.edu>
+* @version  1.0
+* @date     March, 2014
+*
+* @section  LICENSE
+*
+* Copyright (C) 2014, Christoph Dinh and Matti Hamalainen. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+* the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+*       following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+*       the following disclaimer in the documentation and/or other materials provided with the distribution.
+*     * Neither the name of the Massachusetts General Hospital nor the names of its contributors may be used
+*       to endorse or promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MASSACHUSETTS GENERAL HOSPITAL BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*
+*
+* @brief    BenchmarkClient class declaration.
+*
+*/
+
+#ifndef BENCHMARKCLIENT_H
+#define BENCHMARKCLIENT_H
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// QT INCLUDES
+//=============================================================================================================
+
+#include <QSemaphore>
+#include <QString>
+#include <QThread>
+#include <QVector>
+
+
+//=============================================================================================================
+/**
+* Synthetic data client of the benchmark. It connects an RtDataClient to mne_rt_server and records the latency
+* of every raw buffer from the stamp the FiffSimulator wrote into it until the buffer is mapped by the client.
+* Reading stops at the end of the raw data block, i.e. when the client was stopped at the server.
+*
+* @brief Benchmark data client
+*/
+class BenchmarkClient : public QThread
+{
+public:
+    //=========================================================================================================
+    /**
+    * Constructs a BenchmarkClient.
+    *
+    * @param[in] p_sHost            Host of mne_rt_server
+    * @param[in] p_sAlias           Alias of the client at mne_rt_server
+    * @param[in] p_bSharedMemory    Whether the shared memory transport is used on same host connections
+    * @param[in] p_pSemReady        Released once the client is connected and knows its id
+    */
+    BenchmarkClient(const QString& p_sHost, const QString& p_sAlias, bool p_bSharedMemory, QSemaphore* p_pSemReady);
+
+    //=========================================================================================================
+    /**
+    * Returns the id of the client at mne_rt_server, valid once p_pSemReady was released.
+    *
+    * @return the client id, -1 if the client couldn't connect
+    */
+    inline qint32 clientId() const;
+
+    //=========================================================================================================
+    /**
+    * Returns the latencies of the received raw buffers, valid once the thread finished.
+    *
+    * @return latencies in microseconds
+    */
+    inline const QVector<qint32>& latencies() const;
+
+    //=========================================================================================================
+    /**
+    * Returns the number of received raw buffers per second, valid once the thread finished.
+    *
+    * @return the throughput of the client
+    */
+    double buffersPerSecond() const;
+
+    //=========================================================================================================
+    /**
+    * Returns the number of channels of the measurement, valid once the thread finished.
+    *
+    * @return the number of channels
+    */
+    inline qint32 channels() const;
+
+    //=========================================================================================================
+    /**
+    * Returns the number of raw buffers which were overwritten in the shared memory ring while they were read.
+    *
+    * @return the number of invalid buffers
+    */
+    inline qint32 invalidBuffers() const;
+
+protected:
+    //=========================================================================================================
+    /**
+    * Connects, reads the measurement info and records the raw buffers until the raw data block ends.
+    */
+    virtual void run();
+
+private:
+    QString         m_sHost;            /**< Host of mne_rt_server. */
+    QString         m_sAlias;           /**< Alias of the client. */
+    bool            m_bSharedMemory;    /**< Whether the shared memory transport is used. */
+    QSemaphore*     m_pSemReady;        /**< Released once the client id is known. */
+
+    qint32          m_iClientId;        /**< Id of the client at mne_rt_server. */
+    qint32          m_iChannels;        /**< Number of channels of the measurement. */
+    qint32          m_iInvalidBuffers;  /**< Buffers overwritten in the ring while they were read. */
+    QVector<qint32> m_vecLatencies;     /**< Latencies of the received buffers in microseconds. */
+    qint64          m_iFirstArrival;    /**< MonotonicClock time of the first buffer. */
+    qint64          m_iLastArrival;     /**< MonotonicClock time of the last buffer. */
+};
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INLINE DEFINITIONS
+//=============================================================================================================
+
+inline qint32 BenchmarkClient::clientId() const
+{
+    return m_iClientId;
+}
+
+
+//*************************************************************************************************************
+
+inline const QVector<qint32>& BenchmarkClient::latencies() const
+{
+    return m_vecLatencies;
+}
+
+
+//*************************************************************************************************************
+
+inline qint32 BenchmarkClient::channels() const
+{
+    return m_iChannels;
+}
+
+
+//*************************************************************************************************************
+
+inline qint32 BenchmarkClient::invalidBuffers() const
+{
+    return m_iInvalidBuffers;
+}
+
+#endif // BENCHMARKCLIENT_H
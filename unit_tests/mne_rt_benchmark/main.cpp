@@ -0,0 +1,320 @@
+//=============================================================================================================
+/**
+* @file     main.cpp
+* @author   Christoph Dinh <chdinh@nmr.mgh.harvard.edu>;
+*           Matti Hamalainen <msh@nmr.mgh.harvard.edu>
+* @version  1.0
+* @date     March, 2014
+*
+* @section  LICENSE
+*
+* Copyright (C) 2014, Christoph Dinh and Matti Hamalainen. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+* the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+*       following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+*       the following disclaimer in the documentation and/or other materials provided with the distribution.
+*     * Neither the name of the Massachusetts General Hospital nor the names of its contributors may be used
+*       to endorse or promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MASSACHUSETTS GENERAL HOSPITAL BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*
+*
+* @brief    Implements the main() application function.
+*
+*/
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include "benchmarkclient.h"
+
+#include <rtClient/rtcmdclient.h>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// STL INCLUDES
+//=============================================================================================================
+
+#include <stdio.h>
+#include <algorithm>
+
+#if defined(Q_OS_LINUX)
+#include <unistd.h>
+#endif
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// QT INCLUDES
+//=============================================================================================================
+
+#include <QtCore/QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QProcess>
+#include <QStringList>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace RTCLIENTLIB;
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Methods
+//=============================================================================================================
+
+//=============================================================================================================
+/**
+* Returns the CPU time a process spent so far, user and system.
+*
+* @param [in] pid   The process id.
+* @return the CPU time in seconds, negative if it is not available on this platform.
+*/
+double processCpuSeconds(qint64 pid)
+{
+#if defined(Q_OS_LINUX)
+    QFile t_file(QString("/proc/%1/stat").arg(pid));
+    if(!t_file.open(QIODevice::ReadOnly))
+        return -1.0;
+
+    // the fields after the command name, which is in parentheses: state is the first, utime the 12th, stime the 13th
+    QByteArray t_stat = t_file.readAll();
+    QList<QByteArray> t_fields = t_stat.mid(t_stat.lastIndexOf(')') + 2).split(' ');
+    if(t_fields.size() < 13)
+        return -1.0;
+
+    return (t_fields[11].toLongLong() + t_fields[12].toLongLong())/(double)sysconf(_SC_CLK_TCK);
+#else
+    Q_UNUSED(pid);
+    return -1.0;
+#endif
+}
+
+
+//*************************************************************************************************************
+
+//=============================================================================================================
+/**
+* Returns the value of a command line option, e.g. --clients 1,4.
+*
+* @param [in] p_sListArgs   The command line arguments.
+* @param [in] p_sOption     The option.
+* @param [in] p_sDefault    The value if the option is not given.
+* @return the value of the option.
+*/
+QString option(const QStringList& p_sListArgs, const QString& p_sOption, const QString& p_sDefault)
+{
+    qint32 i = p_sListArgs.indexOf(p_sOption);
+    return (i >= 0 && i + 1 < p_sListArgs.size()) ? p_sListArgs[i + 1] : p_sDefault;
+}
+
+
+//*************************************************************************************************************
+
+//=============================================================================================================
+/**
+* Returns the q quantile of sorted values.
+*/
+qint32 quantile(const QVector<qint32>& p_vecSorted, double q)
+{
+    if(p_vecSorted.isEmpty())
+        return 0;
+    qint32 i = (qint32)(q*p_vecSorted.size());
+    return p_vecSorted[std::min(i, p_vecSorted.size() - 1)];
+}
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// MAIN
+//=============================================================================================================
+
+//=============================================================================================================
+/**
+* The benchmark starts mne_rt_server with the FiffSimulator connector emitting as fast as possible and attaches
+* synthetic data clients. For every combination of simulation file (i.e. channel count), buffer size and client
+* count it reports the latency from connector to client (p50/p99/p99.9), the buffers per second and the CPU load
+* of the server.
+*
+* Options:
+*   --server <path>         mne_rt_server executable, default next to the benchmark; "none" uses a running server
+*   --host <host>           host of mne_rt_server, default 127.0.0.1
+*   --simfiles <f1,f2,...>  simulation files, default the file configured at the server
+*   --bufsizes <n1,n2,...>  buffer sizes in samples, default 100,1000
+*   --clients <n1,n2,...>   client counts, default 1,4,16
+*   --duration <s>          seconds per measurement, default 10
+*   --pacing <mode>         fast or realtime, default fast
+*   --transport <t>         shm or tcp for same host clients, default shm
+*
+* @param [in] argc (argument count) is an integer that indicates how many arguments were entered on the command line when the program was started.
+* @param [in] argv (argument vector) is an array of pointers to arrays of character objects. The array objects are null-terminated strings, representing the arguments that were entered on the command line when the program was started.
+* @return the value that was set to exit() (which is 0 if exit() is called via quit()).
+*/
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QStringList t_sListArgs = a.arguments();
+    QString t_sServer = option(t_sListArgs, "--server", QCoreApplication::applicationDirPath() + "/mne_rt_server");
+    QString t_sHost = option(t_sListArgs, "--host", "127.0.0.1");
+    QStringList t_sListSimFiles = option(t_sListArgs, "--simfiles", "").split(',', QString::SkipEmptyParts);
+    QStringList t_sListBufSizes = option(t_sListArgs, "--bufsizes", "100,1000").split(',', QString::SkipEmptyParts);
+    QStringList t_sListClients = option(t_sListArgs, "--clients", "1,4,16").split(',', QString::SkipEmptyParts);
+    qint32 t_iDuration = option(t_sListArgs, "--duration", "10").toInt();
+    QString t_sPacing = option(t_sListArgs, "--pacing", "fast");
+    bool t_bSharedMemory = option(t_sListArgs, "--transport", "shm") == "shm";
+
+    if(t_sListSimFiles.isEmpty())
+        t_sListSimFiles << QString();
+
+    //
+    // Start the server
+    //
+    QProcess t_serverProcess;
+    qint64 t_iServerPid = -1;
+    if(t_sServer != "none")
+    {
+        t_serverProcess.setProcessChannelMode(QProcess::ForwardedChannels);
+        t_serverProcess.start(t_sServer, QStringList());
+        if(!t_serverProcess.waitForStarted())
+        {
+            printf("Could not start %s\n", t_sServer.toUtf8().constData());
+            return 1;
+        }
+#if defined(Q_OS_LINUX)
+        t_iServerPid = t_serverProcess.pid();
+#endif
+    }
+
+    RtCmdClient t_cmdClient;
+    QElapsedTimer t_connectTimer;
+    t_connectTimer.start();
+    do
+    {
+        t_cmdClient.connectToHost(t_sHost);
+        t_cmdClient.waitForConnected(1000);
+        if(t_cmdClient.state() != QTcpSocket::ConnectedState)
+            QThread::msleep(100);
+    } while(t_cmdClient.state() != QTcpSocket::ConnectedState && t_connectTimer.elapsed() < 10000);
+
+    if(t_cmdClient.state() != QTcpSocket::ConnectedState)
+    {
+        printf("Could not connect to mne_rt_server at %s\n", t_sHost.toUtf8().constData());
+        return 1;
+    }
+
+    t_cmdClient.sendCLICommand("selcon 1");//FiffSimulator
+    t_cmdClient.sendCLICommand(QString("pacing %1").arg(t_sPacing));
+    t_cmdClient.sendCLICommand("stamp true");
+
+    printf("\n%8s %8s %8s %12s %12s %10s %10s %10s %8s %8s\n",
+           "channels", "bufsize", "clients", "buffers/s", "samples/s", "p50 [us]", "p99 [us]", "p999 [us]", "cpu [%]", "invalid");
+
+    for(qint32 f = 0; f < t_sListSimFiles.size(); ++f)
+    {
+        if(!t_sListSimFiles[f].isEmpty())
+            t_cmdClient.sendCLICommand(QString("simfile %1").arg(t_sListSimFiles[f]));
+
+        for(qint32 b = 0; b < t_sListBufSizes.size(); ++b)
+        {
+            qint32 t_iBufSize = t_sListBufSizes[b].toInt();
+            t_cmdClient.sendCLICommand(QString("bufsize %1").arg(t_iBufSize));
+
+            for(qint32 c = 0; c < t_sListClients.size(); ++c)
+            {
+                qint32 t_iClients = t_sListClients[c].toInt();
+
+                //
+                // Connect the clients and start the measurement of each
+                //
+                QSemaphore t_semReady;
+                QList<BenchmarkClient*> t_qListClients;
+                for(qint32 i = 0; i < t_iClients; ++i)
+                {
+                    t_qListClients.append(new BenchmarkClient(t_sHost, QString("bench%1").arg(i), t_bSharedMemory, &t_semReady));
+                    t_qListClients.last()->start();
+                }
+                t_semReady.acquire(t_iClients);
+
+                for(qint32 i = 0; i < t_iClients; ++i)
+                    if(t_qListClients[i]->clientId() >= 0)
+                        t_cmdClient.sendCLICommand(QString("measinfo %1").arg(t_qListClients[i]->clientId()));
+
+                double t_dCpuStart = processCpuSeconds(t_iServerPid);
+                QElapsedTimer t_timer;
+                t_timer.start();
+
+                for(qint32 i = 0; i < t_iClients; ++i)
+                    if(t_qListClients[i]->clientId() >= 0)
+                        t_cmdClient.sendCLICommand(QString("start %1").arg(t_qListClients[i]->clientId()));
+
+                QThread::sleep(t_iDuration);
+
+                double t_dCpu = processCpuSeconds(t_iServerPid) - t_dCpuStart;
+                double t_dWall = t_timer.nsecsElapsed()*1.0e-9;
+
+                //
+                // Stopping ends the raw data block of each client, which then disconnects
+                //
+                t_cmdClient.sendCLICommand("stop-all");
+
+                QVector<qint32> t_vecLatencies;
+                double t_dBuffersPerSecond = 0.0;
+                qint32 t_iChannels = 0;
+                qint32 t_iInvalid = 0;
+                for(qint32 i = 0; i < t_iClients; ++i)
+                {
+                    if(!t_qListClients[i]->wait(30000))
+                        printf("Client bench%d did not finish\n", i);
+                    else
+                    {
+                        t_vecLatencies += t_qListClients[i]->latencies();
+                        t_dBuffersPerSecond += t_qListClients[i]->buffersPerSecond();
+                        t_iChannels = t_qListClients[i]->channels();
+                        t_iInvalid += t_qListClients[i]->invalidBuffers();
+                        delete t_qListClients[i];
+                    }
+                }
+                std::sort(t_vecLatencies.begin(), t_vecLatencies.end());
+
+                printf("%8d %8d %8d %12.1f %12.0f %10d %10d %10d %8s %8d\n",
+                       t_iChannels, t_iBufSize, t_iClients, t_dBuffersPerSecond, t_dBuffersPerSecond*t_iBufSize,
+                       quantile(t_vecLatencies, 0.5), quantile(t_vecLatencies, 0.99), quantile(t_vecLatencies, 0.999),
+                       t_dCpuStart >= 0.0 ? QString::number(100.0*t_dCpu/t_dWall, 'f', 1).toUtf8().constData() : "n/a",
+                       t_iInvalid);
+                fflush(stdout);
+            }
+        }
+    }
+
+    t_cmdClient.sendCLICommand("stamp false");
+    t_cmdClient.disconnectFromHost();
+
+    if(t_serverProcess.state() != QProcess::NotRunning)
+    {
+        t_serverProcess.terminate();
+        if(!t_serverProcess.waitForFinished(5000))
+            t_serverProcess.kill();
+    }
+
+    return 0;
+}
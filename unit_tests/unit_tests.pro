@@ -40,6 +40,7 @@ TEMPLATE = subdirs
 SUBDIRS += \
     mne_lib_tests \
     mne_rt_tests \
+    mne_rt_benchmark \
     mne_x_plugin_com \
     mne_future_test
 